@@ -6,6 +6,8 @@
 // ---------------------------------------------------------------------------
 
 #include "colorist/colorist.h"
+#include "colorist/image.h"
+#include "colorist/transform.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -33,10 +35,143 @@ static void clContextSilentLogError(clContext * C, const char * format, va_list
     COLORIST_UNUSED(args);
 }
 
+// Measures clTransformRun() cost (including any threading overhead) across a few buffer sizes
+static int benchmarkTransform(int jobs, clBool fastCurves, int attempts)
+{
+    static const int pixelCounts[] = { 1, 1024, 6000 * 4000 };
+
+    clContextSystem silentSystem;
+    silentSystem.alloc = clContextDefaultAlloc;
+    silentSystem.free = clContextDefaultFree;
+    silentSystem.log = clContextSilentLog;
+    silentSystem.error = clContextSilentLogError;
+
+    clContext * C = clContextCreate(&silentSystem);
+    if (jobs > 0) {
+        C->jobs = jobs;
+    }
+    C->ccmmFastCurves = fastCurves;
+
+    clProfilePrimaries dstPrimaries;
+    clProfileCurve dstCurve;
+    clContextGetStockPrimaries(C, "bt2020", &dstPrimaries);
+    dstCurve.type = CL_PCT_PQ;
+    dstCurve.implicitScale = 1.0f;
+    dstCurve.gamma = 1.0f;
+
+    clProfile * srcProfile = clProfileCreateStock(C, CL_PS_SRGB);
+    clProfile * dstProfile = clProfileCreate(C, &dstPrimaries, &dstCurve, 10000, NULL);
+    clTransform * transform = clTransformCreate(C, srcProfile, CL_XF_RGBA, dstProfile, CL_XF_RGBA, CL_TONEMAP_OFF);
+
+    for (size_t sizeIndex = 0; sizeIndex < (sizeof(pixelCounts) / sizeof(pixelCounts[0])); ++sizeIndex) {
+        int pixelCount = pixelCounts[sizeIndex];
+        int calls = attempts * CL_CLAMP(pixelCount ? (24000000 / pixelCount) : 1, 1, 10000);
+
+        float * srcPixels = clAllocate(sizeof(float) * 4 * pixelCount);
+        float * dstPixels = clAllocate(sizeof(float) * 4 * pixelCount);
+        for (int i = 0; i < pixelCount * 4; ++i) {
+            srcPixels[i] = (float)(i % 251) / 250.0f;
+        }
+
+        // Warm up (prepares the transform and any lazily created state)
+        clTransformRun(C, transform, srcPixels, dstPixels, pixelCount);
+
+        Timer t;
+        timerStart(&t);
+        for (int call = 0; call < calls; ++call) {
+            clTransformRun(C, transform, srcPixels, dstPixels, pixelCount);
+        }
+        double elapsed = timerElapsedSeconds(&t);
+
+        printf("{ \"benchmark\": \"transform\", \"cmm\": \"%s\", \"curves\": \"%s\", \"pixels\": %d, \"jobs\": %d, \"calls\": %d, \"secondsPerCall\": %.9f, \"nanosecondsPerPixel\": %f }\n",
+               clTransformCMMName(C, transform),
+               C->ccmmFastCurves ? "fast" : "exact",
+               pixelCount,
+               C->jobs,
+               calls,
+               elapsed / (double)calls,
+               (elapsed * 1000000000.0) / ((double)calls * (double)pixelCount));
+
+        clFree(srcPixels);
+        clFree(dstPixels);
+    }
+
+    clTransformDestroy(C, transform);
+    clProfileDestroy(C, srcProfile);
+    clProfileDestroy(C, dstProfile);
+    clContextDestroy(C);
+    return 0;
+}
+
+// Measures clImagePrepareReadPixels() throughput for every pixel format conversion direction on a 4K image
+static int benchmarkPixelFormats(int jobs, int attempts)
+{
+    static const char * formatNames[CL_PIXELFORMAT_COUNT] = { "u8", "u16", "f32" };
+    static const int width = 3840;
+    static const int height = 2160;
+
+    clContextSystem silentSystem;
+    silentSystem.alloc = clContextDefaultAlloc;
+    silentSystem.free = clContextDefaultFree;
+    silentSystem.log = clContextSilentLog;
+    silentSystem.error = clContextSilentLogError;
+
+    clContext * C = clContextCreate(&silentSystem);
+    if (jobs > 0) {
+        C->jobs = jobs;
+    }
+
+    clImage * image = clImageCreate(C, width, height, 12, NULL);
+    int pixelCount = width * height;
+    for (int srcFormat = 0; srcFormat < CL_PIXELFORMAT_COUNT; ++srcFormat) {
+        for (int dstFormat = 0; dstFormat < CL_PIXELFORMAT_COUNT; ++dstFormat) {
+            if (srcFormat == dstFormat) {
+                continue;
+            }
+
+            // Start from a ramp in the source format only
+            clImagePrepareWritePixels(C, image, CL_PIXELFORMAT_F32);
+            for (int i = 0; i < pixelCount * CL_CHANNELS_PER_PIXEL; ++i) {
+                image->pixelsF32[i] = (float)(i % 4093) / 4092.0f;
+            }
+            clImagePrepareWritePixels(C, image, (clPixelFormat)srcFormat);
+
+            double elapsed = 0.0;
+            for (int attempt = 0; attempt < attempts; ++attempt) {
+                clImagePrepareWritePixels(C, image, (clPixelFormat)srcFormat); // Drops the previous dst pixels
+
+                Timer t;
+                timerStart(&t);
+                clImagePrepareReadPixels(C, image, (clPixelFormat)dstFormat);
+                elapsed += timerElapsedSeconds(&t);
+            }
+            elapsed /= (double)attempts;
+
+            double bytes = (double)pixelCount * (CL_BYTES_PER_PIXEL(srcFormat) + CL_BYTES_PER_PIXEL(dstFormat));
+            printf("{ \"benchmark\": \"pixelformat\", \"src\": \"%s\", \"dst\": \"%s\", \"pixels\": %d, \"jobs\": %d, \"attempts\": %d, \"secondsPerCall\": %.9f, \"gigabytesPerSecond\": %f }\n",
+                   formatNames[srcFormat],
+                   formatNames[dstFormat],
+                   pixelCount,
+                   C->jobs,
+                   attempts,
+                   elapsed,
+                   bytes / elapsed / 1000000000.0);
+        }
+    }
+
+    clImageDestroy(C, image);
+    clContextDestroy(C);
+    return 0;
+}
+
 int main(int argc, char * argv[])
 {
     const char * inputFilename = NULL;
     const char * readCodec = NULL;
+    clBool transformBenchmark = clFalse;
+    clBool pixelFormatBenchmark = clFalse;
+    clBool fastCurves = clFalse;
+    int jobs = 0;
     int attempts = 1;
     if (argc > 2) {
         attempts = atoi(argv[2]);
@@ -52,6 +187,16 @@ int main(int argc, char * argv[])
         if (!strcmp(arg, "-c") || !strcmp(arg, "--codec")) {
             NEXTARG();
             readCodec = arg;
+        } else if (!strcmp(arg, "-j") || !strcmp(arg, "--jobs")) {
+            NEXTARG();
+            jobs = atoi(arg);
+        } else if (!strcmp(arg, "--ccmm-accuracy")) {
+            NEXTARG();
+            fastCurves = !strcmp(arg, "fast") ? clTrue : clFalse;
+        } else if (!strcmp(arg, "-t") || !strcmp(arg, "--transform")) {
+            transformBenchmark = clTrue;
+        } else if (!strcmp(arg, "-p") || !strcmp(arg, "--pixelformats")) {
+            pixelFormatBenchmark = clTrue;
         } else {
             // Positional argument
             if (!inputFilename) {
@@ -64,10 +209,30 @@ int main(int argc, char * argv[])
         ++argIndex;
     }
 
+    if (transformBenchmark || pixelFormatBenchmark) {
+        if (inputFilename) {
+            // No image is read, so the only positional argument is the attempt count
+            attempts = atoi(inputFilename);
+            if (attempts < 1) {
+                attempts = 1;
+            }
+        }
+        if (pixelFormatBenchmark) {
+            return benchmarkPixelFormats(jobs, attempts);
+        }
+        return benchmarkTransform(jobs, fastCurves, attempts);
+    }
+
     if (!inputFilename) {
         printf("colorist-benchmark [options] [input image filename] [optional attempts]\n");
+        printf("colorist-benchmark -t [-j JOBS] [--ccmm-accuracy WHICH] [optional attempts]\n");
+        printf("colorist-benchmark -p [-j JOBS] [optional attempts]\n");
         printf("Options:\n");
         printf("    -c CODEC : pick which AV1 codec to use, if reading an AVIF\n");
+        printf("    -t       : benchmark clTransformRun() on 1, 1K and 24M pixel buffers instead of reading an image\n");
+        printf("    -p       : benchmark U8/U16/F32 pixel format conversions (GB/s read + written) instead of reading an image\n");
+        printf("    -j JOBS  : thread count for -t and -p (defaults to the number of CPUs)\n");
+        printf("    --ccmm-accuracy WHICH : exact (default) or fast transfer curves for -t\n");
         return 1;
     }
 
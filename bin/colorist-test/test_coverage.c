@@ -7,6 +7,10 @@
 
 #include "main.h"
 
+#include "colorist/transform.h"
+
+#include <math.h>
+
 // ------------------------------------------------------------------------------------------------
 // The tests in here are to attempt to hit 100% code coverage (when running scripts/coverage.sh).
 // colorist-test shouldn't have to run any other test suites but test_coverage() to achieve this.
@@ -319,6 +323,18 @@ static void test_clContextParseArgs(void)
         TEST_ASSERT_FALSE(clContextParseArgs(C, ARGS(argv)));
     }
 
+    {
+        // CCMM accuracy
+        const char * argv[] = { "colorist", "convert", "input.png", "output.png", "--ccmm-accuracy", "fast", "--ccmm-accuracy", "exact" };
+        TEST_ASSERT_TRUE(clContextParseArgs(C, ARGS(argv)));
+    }
+
+    {
+        // unknown CCMM accuracy
+        const char * argv[] = { "colorist", "convert", "input.png", "output.png", "--ccmm-accuracy", "derp" };
+        TEST_ASSERT_FALSE(clContextParseArgs(C, ARGS(argv)));
+    }
+
     {
         // unknown parameter
         const char * argv[] = { "colorist", "convert", "input.png", "output.png", "--derp" };
@@ -538,6 +554,1763 @@ static void test_clTask(void)
     clContextDestroy(C);
 }
 
+// The per-pixel gamma search clPixelMathColorGrade() used before it scored histograms
+static float referenceGradeGamma(const float * pixels, int pixelCount, float luminanceScale, float maxChannel)
+{
+    float bestGamma = 0.0f;
+    double bestErrorTerm = -1.0;
+    for (int gammaInt = 20; gammaInt <= 80; ++gammaInt) {
+        float gamma = (float)gammaInt / 20.0f;
+        double errorTerm = 0.0;
+        for (int i = 0; i < pixelCount * 4; ++i) {
+            if ((i % 4) == 3) {
+                continue;
+            }
+            float scaledChannel = CL_CLAMP(pixels[i] * luminanceScale, 0.0f, 1.0f);
+            float encoded = clPixelMathRoundf(powf(scaledChannel, 1.0f / gamma) * maxChannel) / maxChannel;
+            errorTerm += fabsf(scaledChannel - powf(encoded, gamma));
+        }
+        if ((bestErrorTerm < 0.0) || (bestErrorTerm > errorTerm)) {
+            bestErrorTerm = errorTerm;
+            bestGamma = gamma;
+        }
+    }
+    return bestGamma;
+}
+
+static void test_colorGradeGamma(void)
+{
+    clContext * C = clContextCreate(&silentSystem);
+    TEST_ASSERT_NOT_NULL(C);
+
+    // 8 bit source values (all but a few shadows), scattered over more pixels than one histogram part holds
+    clProfile * profile = clProfileCreateStock(C, CL_PS_SRGB);
+    int width = 512;
+    int height = 300;
+    int pixelCount = width * height;
+    float * pixels = clAllocate(sizeof(float) * 4 * pixelCount);
+    uint32_t seed = 12345;
+    for (int i = 0; i < pixelCount; ++i) {
+        for (int channel = 0; channel < 3; ++channel) {
+            seed = (seed * 1664525) + 1013904223;
+            pixels[(i * 4) + channel] = (float)(32 + ((seed >> 8) % 224)) / 255.0f;
+        }
+        pixels[(i * 4) + 3] = 1.0f;
+    }
+    pixels[0] = -0.25f; // clamps like 0
+    pixels[1] = 1.5f;   // clamps like 1
+
+    const int dstColorDepths[] = { 8, 10 };
+    for (int depthIndex = 0; depthIndex < 2; ++depthIndex) {
+        int dstColorDepth = dstColorDepths[depthIndex];
+        float maxChannel = (float)((1 << dstColorDepth) - 1);
+        float expectedGamma = referenceGradeGamma(pixels, pixelCount, 300.0f / 600.0f, maxChannel);
+
+        int luminance = 600;
+        float gamma = 0.0f;
+        clPixelMathColorGrade(C, profile, pixels, pixelCount, width, 300, dstColorDepth, &luminance, &gamma, clFalse);
+        TEST_ASSERT_EQUAL_INT(600, luminance);
+        TEST_ASSERT_EQUAL_FLOAT(expectedGamma, gamma);
+
+        // The histogram is built the same way by any number of threads
+        int jobs = C->jobs;
+        C->jobs = 1;
+        float serialGamma = 0.0f;
+        clPixelMathColorGrade(C, profile, pixels, pixelCount, width, 300, dstColorDepth, &luminance, &serialGamma, clFalse);
+        C->jobs = jobs;
+        TEST_ASSERT_EQUAL_FLOAT(gamma, serialGamma);
+    }
+
+    clFree(pixels);
+    clProfileDestroy(C, profile);
+    clContextDestroy(C);
+}
+
+static void test_ccmmBatch(void)
+{
+    clContext * C = clContextCreate(&silentSystem);
+    TEST_ASSERT_NOT_NULL(C);
+
+    clProfilePrimaries bt2020;
+    clContextGetStockPrimaries(C, "bt2020", &bt2020);
+    clProfileCurve curve;
+    curve.implicitScale = 1.0f;
+    curve.gamma = 1.0f;
+
+    clProfile * profiles[5];
+    profiles[0] = clProfileCreateStock(C, CL_PS_SRGB);
+    curve.type = CL_PCT_PQ;
+    profiles[1] = clProfileCreate(C, &bt2020, &curve, 10000, NULL);
+    curve.type = CL_PCT_HLG;
+    profiles[2] = clProfileCreate(C, &bt2020, &curve, 1000, NULL);
+    curve.type = CL_PCT_GAMMA;
+    curve.gamma = 2.2f;
+    profiles[3] = clProfileCreate(C, &bt2020, &curve, 300, NULL);
+    profiles[4] = NULL; // XYZ
+
+    // Enough pixels to span several batches with a ragged end, including out-of-range and black values
+    const int pixelCount = 1003;
+    float * srcPixels = clAllocate(sizeof(float) * 4 * pixelCount);
+    float * dstPixels = clAllocate(sizeof(float) * 4 * pixelCount);
+    for (int i = 0; i < pixelCount * 4; ++i) {
+        srcPixels[i] = ((float)((i * 37) % 101) / 90.0f) - 0.05f;
+    }
+    memset(srcPixels, 0, sizeof(float) * 4);
+
+    for (int srcIndex = 0; srcIndex < 4; ++srcIndex) {
+        for (int dstIndex = 0; dstIndex < 5; ++dstIndex) {
+            for (int tonemap = CL_TONEMAP_AUTO; tonemap <= CL_TONEMAP_OFF; ++tonemap) {
+                clTransformFormat dstFormat = profiles[dstIndex] ? CL_XF_RGB : CL_XF_XYZ;
+                clTransform * transform =
+                    clTransformCreate(C, profiles[srcIndex], CL_XF_RGBA, profiles[dstIndex], dstFormat, (clTonemap)tonemap);
+                if (!clTransformUsesCCMM(C, transform)) {
+                    clTransformDestroy(C, transform);
+                    continue;
+                }
+
+                // Converting everything at once (vector loops) must match converting one pixel at a time (scalar loops)
+                clTransformRun(C, transform, srcPixels, dstPixels, pixelCount);
+                for (int i = 0; i < pixelCount; ++i) {
+                    float expected[3];
+                    clTransformRun(C, transform, &srcPixels[i * 4], expected, 1);
+                    for (int c = 0; c < 3; ++c) {
+                        float tolerance = 0.00001f * CL_MAX(fabsf(expected[c]), 1.0f);
+                        TEST_ASSERT_FLOAT_WITHIN(tolerance, expected[c], dstPixels[(i * 3) + c]);
+                    }
+                }
+                clTransformDestroy(C, transform);
+            }
+        }
+    }
+
+    clFree(srcPixels);
+    clFree(dstPixels);
+    for (int i = 0; i < 4; ++i) {
+        clProfileDestroy(C, profiles[i]);
+    }
+    clContextDestroy(C);
+}
+
+static void test_lcmsBatch(void)
+{
+    clContext * C = clContextCreate(&silentSystem);
+    TEST_ASSERT_NOT_NULL(C);
+    C->ccmmAllowed = clFalse;
+
+    clProfilePrimaries bt2020;
+    clContextGetStockPrimaries(C, "bt2020", &bt2020);
+    clProfileCurve curve;
+    curve.implicitScale = 1.0f;
+    curve.gamma = 1.0f;
+
+    clProfile * profiles[4];
+    profiles[0] = clProfileCreateStock(C, CL_PS_SRGB);
+    curve.type = CL_PCT_PQ;
+    profiles[1] = clProfileCreate(C, &bt2020, &curve, 10000, NULL);
+    curve.type = CL_PCT_GAMMA;
+    curve.gamma = 2.2f;
+    profiles[2] = clProfileCreate(C, &bt2020, &curve, C->defaultLuminance, NULL); // no luminance scaling from sRGB
+    profiles[3] = NULL;                                                           // XYZ
+
+    const int pixelCount = 1003;
+    float * srcPixels = clAllocate(sizeof(float) * 4 * pixelCount);
+    float * dstPixels = clAllocate(sizeof(float) * 4 * pixelCount);
+    for (int i = 0; i < pixelCount * 4; ++i) {
+        srcPixels[i] = (float)((i * 37) % 101) / 100.0f;
+    }
+
+    for (int srcIndex = 0; srcIndex < 3; ++srcIndex) {
+        for (int dstIndex = 0; dstIndex < 4; ++dstIndex) {
+            clTransformFormat dstFormat = profiles[dstIndex] ? CL_XF_RGBA : CL_XF_XYZ;
+            int dstChannelCount = profiles[dstIndex] ? 4 : 3;
+            clTransform * transform =
+                clTransformCreate(C, profiles[srcIndex], CL_XF_RGBA, profiles[dstIndex], dstFormat, CL_TONEMAP_OFF);
+            TEST_ASSERT_FALSE(clTransformUsesCCMM(C, transform));
+
+            // Whole blocks through LittleCMS must match one pixel at a time, alpha included
+            clTransformRun(C, transform, srcPixels, dstPixels, pixelCount);
+            for (int i = 0; i < pixelCount; ++i) {
+                float expected[4];
+                clTransformRun(C, transform, &srcPixels[i * 4], expected, 1);
+                for (int c = 0; c < dstChannelCount; ++c) {
+                    TEST_ASSERT_EQUAL_FLOAT(expected[c], dstPixels[(i * dstChannelCount) + c]);
+                }
+                if (dstChannelCount == 4) {
+                    TEST_ASSERT_EQUAL_FLOAT(srcPixels[(i * 4) + 3], dstPixels[(i * 4) + 3]);
+                }
+            }
+            clTransformDestroy(C, transform);
+        }
+    }
+
+    // sRGB -> BT.2020 2.2 needs no luminance scaling, so it is done as a single LittleCMS transform; it must still agree
+    // with the built-in CMM
+    clTransform * fused = clTransformCreate(C, profiles[0], CL_XF_RGBA, profiles[2], CL_XF_RGBA, CL_TONEMAP_OFF);
+    clTransformPrepare(C, fused);
+    TEST_ASSERT_NOT_NULL(fused->lcmsCombined);
+    clTransformRun(C, fused, srcPixels, dstPixels, pixelCount);
+    clTransformDestroy(C, fused);
+    C->ccmmAllowed = clTrue;
+    float * ccmmPixels = clAllocate(sizeof(float) * 4 * pixelCount);
+    clTransform * ccmm = clTransformCreate(C, profiles[0], CL_XF_RGBA, profiles[2], CL_XF_RGBA, CL_TONEMAP_OFF);
+    TEST_ASSERT_TRUE(clTransformUsesCCMM(C, ccmm));
+    clTransformRun(C, ccmm, srcPixels, ccmmPixels, pixelCount);
+    clTransformDestroy(C, ccmm);
+    for (int i = 0; i < pixelCount * 4; ++i) {
+        TEST_ASSERT_FLOAT_WITHIN(0.002f, ccmmPixels[i], dstPixels[i]);
+    }
+
+    clFree(ccmmPixels);
+    clFree(srcPixels);
+    clFree(dstPixels);
+    for (int i = 0; i < 3; ++i) {
+        clProfileDestroy(C, profiles[i]);
+    }
+    clContextDestroy(C);
+}
+
+static void test_transformKernels(void)
+{
+    clContext * C = clContextCreate(&silentSystem);
+    TEST_ASSERT_NOT_NULL(C);
+
+    clProfilePrimaries bt709, bt2020;
+    clContextGetStockPrimaries(C, "bt709", &bt709);
+    clContextGetStockPrimaries(C, "bt2020", &bt2020);
+    clProfileCurve curve;
+    curve.type = CL_PCT_SRGB;
+    curve.implicitScale = 1.0f;
+    curve.gamma = 1.0f;
+
+    // A re-tagged sRGB (different description, so a different signature), plus one change at a time
+    clProfile * srgb = clProfileCreateStock(C, CL_PS_SRGB);
+    clProfile * retag = clProfileCreate(C, &bt709, &curve, 0, "Re-tagged sRGB");
+    clProfile * wide = clProfileCreate(C, &bt2020, &curve, 0, NULL);
+    curve.type = CL_PCT_GAMMA;
+    curve.gamma = 2.2f;
+    clProfile * gamma22 = clProfileCreate(C, &bt709, &curve, 0, NULL);
+    clProfile * bright = clProfileCreate(C, &bt709, &curve, 300, NULL);
+    TEST_ASSERT_FALSE(clProfileMatches(C, srgb, retag));
+
+    static const struct
+    {
+        int dstIndex;
+        clTransformKernel kernel;
+    } cases[] = { { 0, CL_XK_IDENTITY }, { 1, CL_XK_MATRIX }, { 2, CL_XK_CURVE }, { 3, CL_XK_FULL } };
+    clProfile * dstProfiles[4] = { retag, wide, gamma22, bright };
+
+    const int pixelCount = 257;
+    uint8_t srcPixels[257 * 4];
+    uint8_t dstPixels[257 * 4];
+    uint8_t lcmsPixels[257 * 4];
+    for (int i = 0; i < pixelCount * 4; ++i) {
+        srcPixels[i] = (uint8_t)((i * 37) % 256);
+    }
+
+    for (int caseIndex = 0; caseIndex < (int)(sizeof(cases) / sizeof(cases[0])); ++caseIndex) {
+        clProfile * dstProfile = dstProfiles[cases[caseIndex].dstIndex];
+        clTransform * transform = clTransformCreate(C, srgb, CL_XF_RGBA8, dstProfile, CL_XF_RGBA8, CL_TONEMAP_OFF);
+        clTransformPrepare(C, transform);
+        TEST_ASSERT_EQUAL_INT(cases[caseIndex].kernel, transform->ccmmKernel);
+        clTransformRun(C, transform, srcPixels, dstPixels, pixelCount);
+        clTransformDestroy(C, transform);
+
+        // Every shortcut must still land where the full pipeline (here, LittleCMS) does
+        C->ccmmAllowed = clFalse;
+        transform = clTransformCreate(C, srgb, CL_XF_RGBA8, dstProfile, CL_XF_RGBA8, CL_TONEMAP_OFF);
+        clTransformRun(C, transform, srcPixels, lcmsPixels, pixelCount);
+        clTransformDestroy(C, transform);
+        C->ccmmAllowed = clTrue;
+
+        for (int i = 0; i < pixelCount * 4; ++i) {
+            TEST_ASSERT_INT_WITHIN(1, lcmsPixels[i], dstPixels[i]);
+        }
+        if (cases[caseIndex].kernel == CL_XK_IDENTITY) {
+            TEST_ASSERT_EQUAL_MEMORY(srcPixels, dstPixels, sizeof(dstPixels));
+        }
+    }
+
+    clProfileDestroy(C, bright);
+    clProfileDestroy(C, gamma22);
+    clProfileDestroy(C, wide);
+    clProfileDestroy(C, retag);
+    clProfileDestroy(C, srgb);
+    clContextDestroy(C);
+}
+
+static void test_ditheredQuantize(void)
+{
+    clContext * C = clContextCreate(&silentSystem);
+    TEST_ASSERT_NOT_NULL(C);
+
+    clProfilePrimaries bt2020;
+    clContextGetStockPrimaries(C, "bt2020", &bt2020);
+    clProfileCurve curve;
+    curve.type = CL_PCT_SRGB;
+    curve.implicitScale = 1.0f;
+    curve.gamma = 1.0f;
+    clProfile * srgb = clProfileCreateStock(C, CL_PS_SRGB);
+    clProfile * wide = clProfileCreate(C, &bt2020, &curve, 0, NULL);
+
+    // A flat gray field that sits between two 8-bit codes, through both the repack path and the CCMM kernel
+    enum { W = 16, H = 16 };
+    static float srcPixels[W * H * 4];
+    static float floatPixels[W * H * 4];
+    static uint8_t roundedPixels[W * H * 4];
+    static uint8_t ditheredPixels[W * H * 4];
+    for (int i = 0; i < W * H; ++i) {
+        srcPixels[i * 4 + 0] = srcPixels[i * 4 + 1] = srcPixels[i * 4 + 2] = 0.301f;
+        srcPixels[i * 4 + 3] = 1.0f;
+    }
+
+    clProfile * dstProfiles[2] = { srgb, wide };
+    for (int profileIndex = 0; profileIndex < 2; ++profileIndex) {
+        clTransform * transform = clTransformCreate(C, srgb, CL_XF_RGBA, dstProfiles[profileIndex], CL_XF_RGBA, CL_TONEMAP_OFF);
+        clTransformRun(C, transform, srcPixels, floatPixels, W * H);
+        clTransformDestroy(C, transform);
+
+        transform = clTransformCreate(C, srgb, CL_XF_RGBA, dstProfiles[profileIndex], CL_XF_RGBA8, CL_TONEMAP_OFF);
+        clTransformRun(C, transform, srcPixels, roundedPixels, W * H);
+        clTransformRunDithered(C, transform, srcPixels, ditheredPixels, W, 3, H);
+        clTransformDestroy(C, transform);
+
+        int sum = 0;
+        int lowCount = 0;
+        for (int i = 0; i < W * H; ++i) {
+            TEST_ASSERT_EQUAL_UINT8(clPixelMathRoundUNorm(floatPixels[i * 4], 255), roundedPixels[i * 4]);
+            TEST_ASSERT_EQUAL_UINT8(255, ditheredPixels[i * 4 + 3]);
+            sum += ditheredPixels[i * 4];
+            if (ditheredPixels[i * 4] < roundedPixels[i * 4]) {
+                ++lowCount;
+            }
+        }
+        TEST_ASSERT_TRUE(lowCount > 0);
+        TEST_ASSERT_FLOAT_WITHIN(1.0f / 64.0f, floatPixels[0] * 255.0f, (float)sum / (W * H));
+    }
+
+    clProfileDestroy(C, wide);
+    clProfileDestroy(C, srgb);
+    clContextDestroy(C);
+}
+
+static void test_transformIntegerFormats(void)
+{
+    clContext * C = clContextCreate(&silentSystem);
+    TEST_ASSERT_NOT_NULL(C);
+
+    clProfilePrimaries bt2020;
+    clContextGetStockPrimaries(C, "bt2020", &bt2020);
+    clProfileCurve curve;
+    curve.type = CL_PCT_PQ;
+    curve.implicitScale = 1.0f;
+    curve.gamma = 1.0f;
+
+    clProfile * profiles[2];
+    profiles[0] = clProfileCreateStock(C, CL_PS_SRGB);
+    profiles[1] = clProfileCreate(C, &bt2020, &curve, 10000, NULL);
+
+    const int pixelCount = 1003;
+    const int depth = 10;
+    const uint32_t maxChannel = (1 << depth) - 1;
+    uint8_t * srcU8 = clAllocate(sizeof(uint8_t) * 4 * pixelCount);
+    uint16_t * srcU16 = clAllocate(sizeof(uint16_t) * 4 * pixelCount);
+    float * srcF32 = clAllocate(sizeof(float) * 4 * pixelCount);
+    float * expected = clAllocate(sizeof(float) * 4 * pixelCount);
+    uint8_t * dstU8 = clAllocate(sizeof(uint8_t) * 4 * pixelCount);
+    uint16_t * dstU16 = clAllocate(sizeof(uint16_t) * 4 * pixelCount);
+    for (int i = 0; i < pixelCount * 4; ++i) {
+        srcU8[i] = (uint8_t)((i * 37) % 256);
+        srcU16[i] = (uint16_t)((i * 37) % (maxChannel + 1));
+    }
+    srcU16[0] = 0xffff; // out of range for the depth, clamps
+
+    for (int cmm = 0; cmm < 2; ++cmm) {
+        C->ccmmAllowed = (cmm == 0) ? clTrue : clFalse;
+        for (int dstIndex = 0; dstIndex < 2; ++dstIndex) {
+            for (int srcFormat = CL_XF_RGBA8; srcFormat <= CL_XF_RGBA16; ++srcFormat) {
+                // Reading/writing integers directly must match converting through floats (like clImage's F32 pixels)
+                for (int i = 0; i < pixelCount * 4; ++i) {
+                    if (srcFormat == CL_XF_RGBA8) {
+                        srcF32[i] = srcU8[i] / 255.0f;
+                    } else {
+                        srcF32[i] = CL_MIN(srcU16[i], maxChannel) / (float)maxChannel;
+                    }
+                }
+                clTransform * floatTransform =
+                    clTransformCreate(C, profiles[0], CL_XF_RGBA, profiles[dstIndex], CL_XF_RGBA, CL_TONEMAP_OFF);
+                clTransformRun(C, floatTransform, srcF32, expected, pixelCount);
+                clTransformDestroy(C, floatTransform);
+
+                for (int dstFormat = CL_XF_RGBA8; dstFormat <= CL_XF_RGBA16; ++dstFormat) {
+                    clTransform * transform = clTransformCreate(C,
+                                                                profiles[0],
+                                                                (clTransformFormat)srcFormat,
+                                                                profiles[dstIndex],
+                                                                (clTransformFormat)dstFormat,
+                                                                CL_TONEMAP_OFF);
+                    transform->srcDepth = depth;
+                    transform->dstDepth = 12;
+                    void * srcPixels = (srcFormat == CL_XF_RGBA8) ? (void *)srcU8 : (void *)srcU16;
+                    void * dstPixels = (dstFormat == CL_XF_RGBA8) ? (void *)dstU8 : (void *)dstU16;
+                    clTransformRun(C, transform, srcPixels, dstPixels, pixelCount);
+                    for (int i = 0; i < pixelCount * 4; ++i) {
+                        if (dstFormat == CL_XF_RGBA8) {
+                            TEST_ASSERT_EQUAL_UINT(clPixelMathRoundUNorm(expected[i], 255), dstU8[i]);
+                        } else {
+                            TEST_ASSERT_EQUAL_UINT(clPixelMathRoundUNorm(expected[i], 4095), dstU16[i]);
+                        }
+                    }
+                    clTransformDestroy(C, transform);
+                }
+            }
+        }
+    }
+
+    clFree(srcU8);
+    clFree(srcU16);
+    clFree(srcF32);
+    clFree(expected);
+    clFree(dstU8);
+    clFree(dstU16);
+    clProfileDestroy(C, profiles[0]);
+    clProfileDestroy(C, profiles[1]);
+    clContextDestroy(C);
+}
+
+static void test_ccmmAccuracy(void)
+{
+    clContext * C = clContextCreate(&silentSystem);
+    TEST_ASSERT_NOT_NULL(C);
+
+    clProfilePrimaries bt2020;
+    clContextGetStockPrimaries(C, "bt2020", &bt2020);
+    clProfileCurve curve;
+    curve.implicitScale = 1.0f;
+    curve.gamma = 1.0f;
+
+    // Each curve is checked on its own by converting to/from a linear profile with the same primaries and
+    // luminance, so nothing else (matrices, tonemapping) touches the values
+    clProfile * curveProfiles[4];
+    curve.type = CL_PCT_SRGB;
+    curveProfiles[0] = clProfileCreate(C, &bt2020, &curve, 1000, NULL);
+    curve.type = CL_PCT_PQ;
+    curveProfiles[1] = clProfileCreate(C, &bt2020, &curve, 1000, NULL);
+    curve.type = CL_PCT_HLG;
+    curveProfiles[2] = clProfileCreate(C, &bt2020, &curve, 1000, NULL);
+    curve.type = CL_PCT_GAMMA;
+    curve.gamma = 2.2f;
+    curveProfiles[3] = clProfileCreate(C, &bt2020, &curve, 1000, NULL);
+    curve.gamma = 1.0f;
+    clProfile * linearProfile = clProfileCreate(C, &bt2020, &curve, 1000, NULL);
+
+    // Gray ramp, denser near black where the curves are steepest
+    const int pixelCount = 8192;
+    float * srcPixels = clAllocate(sizeof(float) * 3 * pixelCount);
+    float * exactPixels = clAllocate(sizeof(float) * 3 * pixelCount);
+    float * fastPixels = clAllocate(sizeof(float) * 3 * pixelCount);
+    for (int i = 0; i < pixelCount; ++i) {
+        float t = (float)i / (float)(pixelCount - 1);
+        srcPixels[(i * 3) + 0] = t * t * t;
+        srcPixels[(i * 3) + 1] = t * t;
+        srcPixels[(i * 3) + 2] = t;
+    }
+
+    // Relative to the exact result, with a floor so values near black are compared absolutely. Most curves
+    // land around 1e-5; the exact PQ EOTF's own float rounding near peak white is already ~1e-4.
+    const float maxRelativeError = 0.0002f;
+    for (int curveIndex = 0; curveIndex < 4; ++curveIndex) {
+        for (int direction = 0; direction < 2; ++direction) {
+            clProfile * srcProfile = direction ? linearProfile : curveProfiles[curveIndex]; // 0: EOTF, 1: OETF
+            clProfile * dstProfile = direction ? curveProfiles[curveIndex] : linearProfile;
+
+            C->ccmmFastCurves = clFalse;
+            clTransform * exact = clTransformCreate(C, srcProfile, CL_XF_RGB, dstProfile, CL_XF_RGB, CL_TONEMAP_OFF);
+            clTransformRun(C, exact, srcPixels, exactPixels, pixelCount);
+            C->ccmmFastCurves = clTrue;
+            clTransform * fast = clTransformCreate(C, srcProfile, CL_XF_RGB, dstProfile, CL_XF_RGB, CL_TONEMAP_OFF);
+            clTransformRun(C, fast, srcPixels, fastPixels, pixelCount);
+            TEST_ASSERT_NOT_NULL(direction ? fast->ccmmDstOETFTable : fast->ccmmSrcEOTFTable);
+
+            for (int i = 0; i < pixelCount * 3; ++i) {
+                float tolerance = maxRelativeError * CL_MAX(fabsf(exactPixels[i]), 0.01f);
+                TEST_ASSERT_FLOAT_WITHIN(tolerance, exactPixels[i], fastPixels[i]);
+            }
+
+            clTransformDestroy(C, exact);
+            clTransformDestroy(C, fast);
+        }
+    }
+
+    clFree(srcPixels);
+    clFree(exactPixels);
+    clFree(fastPixels);
+    for (int i = 0; i < 4; ++i) {
+        clProfileDestroy(C, curveProfiles[i]);
+    }
+    clProfileDestroy(C, linearProfile);
+    clContextDestroy(C);
+}
+
+typedef struct parallelForTestInfo
+{
+    clContext * C;
+    int * visits;
+    clBool nested;
+} parallelForTestInfo;
+
+static void parallelForTestFunc(parallelForTestInfo * info, int firstItem, int itemCount)
+{
+    if (info->nested) {
+        // Nested calls run inline on whichever thread is already running this range
+        parallelForTestInfo nestedInfo = *info;
+        nestedInfo.visits = &info->visits[firstItem];
+        nestedInfo.nested = clFalse;
+        clTaskParallelFor(info->C, itemCount, 1, (clTaskRangeFunc)parallelForTestFunc, &nestedInfo);
+        return;
+    }
+    for (int i = firstItem; i < firstItem + itemCount; ++i) {
+        ++info->visits[i];
+    }
+}
+
+static void test_clTaskParallelFor(void)
+{
+    clContext * C = clContextCreate(&silentSystem);
+    TEST_ASSERT_NOT_NULL(C);
+
+    int itemCounts[] = { 0, 1, 7, 1000, 1001 };
+    int jobCounts[] = { 1, 4, 4, 3 };
+    int visits[1001];
+
+    parallelForTestInfo info;
+    info.C = C;
+    info.visits = visits;
+
+    for (int j = 0; j < (int)(sizeof(jobCounts) / sizeof(jobCounts[0])); ++j) {
+        C->jobs = jobCounts[j];
+        for (int n = 0; n < (int)(sizeof(itemCounts) / sizeof(itemCounts[0])); ++n) {
+            for (int nested = 0; nested < 2; ++nested) {
+                memset(visits, 0, sizeof(visits));
+                info.nested = nested ? clTrue : clFalse;
+                clTaskParallelFor(C, itemCounts[n], 10, (clTaskRangeFunc)parallelForTestFunc, &info);
+                for (int i = 0; i < itemCounts[n]; ++i) {
+                    TEST_ASSERT_EQUAL_INT(1, visits[i]);
+                }
+                for (int i = itemCounts[n]; i < 1001; ++i) {
+                    TEST_ASSERT_EQUAL_INT(0, visits[i]);
+                }
+            }
+        }
+    }
+
+    // Single-item blocks, so there is plenty to steal
+    C->jobs = 4;
+    memset(visits, 0, sizeof(visits));
+    info.nested = clFalse;
+    clTaskParallelFor(C, 1001, 1, (clTaskRangeFunc)parallelForTestFunc, &info);
+    for (int i = 0; i < 1001; ++i) {
+        TEST_ASSERT_EQUAL_INT(1, visits[i]);
+    }
+    clTaskLogBusyTime(C);
+
+    clContextDestroy(C);
+}
+
+static void test_stripIO(void)
+{
+    clContext * C = clContextCreate(&silentSystem);
+    TEST_ASSERT_NOT_NULL(C);
+
+    static const struct
+    {
+        const char * formatName;
+        int depth;
+    } cases[] = { { "png", 8 }, { "png", 16 }, { "jpg", 8 }, { "tiff", 8 }, { "tiff", 16 }, { "tiff", 32 } };
+    const int width = 37;
+    const int height = 23;
+    const int stripRows = 5;
+
+    clWriteParams writeParams;
+    clWriteParamsSetDefaults(C, &writeParams);
+
+    for (int caseIndex = 0; caseIndex < (int)(sizeof(cases) / sizeof(cases[0])); ++caseIndex) {
+        const char * formatName = cases[caseIndex].formatName;
+        const int depth = cases[caseIndex].depth;
+        clPixelFormat pixelFormat = (depth == 8) ? CL_PIXELFORMAT_U8 : ((depth == 16) ? CL_PIXELFORMAT_U16 : CL_PIXELFORMAT_F32);
+        const int rowBytes = width * CL_BYTES_PER_PIXEL(pixelFormat);
+        clFormat * format = clContextFindFormat(C, formatName);
+        TEST_ASSERT_NOT_NULL(format);
+
+        clImage * image = clImageCreate(C, width, height, depth, NULL);
+        clImagePrepareWritePixels(C, image, CL_PIXELFORMAT_F32);
+        for (int i = 0; i < width * height * CL_CHANNELS_PER_PIXEL; ++i) {
+            image->pixelsF32[i] = (float)((i * 7919) % 1000) / 999.0f;
+        }
+
+        // Encoding a strip at a time must produce exactly what the whole-image writer does. Stream first, as libtiff
+        // byteswaps the rows it is handed in-place (the strip writer only ever hands it copies).
+        clRaw whole = CL_RAW_EMPTY;
+        clRaw streamed = CL_RAW_EMPTY;
+        clFormatStripWriter * writer = clContextWriteStrips(C, image, formatName, &streamed, &writeParams);
+        TEST_ASSERT_NOT_NULL(writer);
+        clImage * strip = clImageCreate(C, width, stripRows, depth, NULL);
+        clImagePrepareReadPixels(C, image, pixelFormat);
+        const uint8_t * imagePixels = (pixelFormat == CL_PIXELFORMAT_U8) ? image->pixelsU8
+                                      : (pixelFormat == CL_PIXELFORMAT_U16) ? (const uint8_t *)image->pixelsU16
+                                                                            : (const uint8_t *)image->pixelsF32;
+        for (int y = 0; y < height; y += stripRows) {
+            int rowCount = CL_MIN(stripRows, height - y);
+            clImagePrepareWritePixels(C, strip, pixelFormat);
+            uint8_t * stripPixels = (pixelFormat == CL_PIXELFORMAT_U8) ? strip->pixelsU8
+                                    : (pixelFormat == CL_PIXELFORMAT_U16) ? (uint8_t *)strip->pixelsU16
+                                                                          : (uint8_t *)strip->pixelsF32;
+            memcpy(stripPixels, &imagePixels[y * rowBytes], rowCount * rowBytes);
+            TEST_ASSERT_TRUE(writer->writeRows(C, writer, strip, rowCount));
+        }
+        TEST_ASSERT_TRUE(writer->finish(C, writer));
+        writer->destroy(C, writer);
+        TEST_ASSERT_TRUE(format->writeFunc(C, image, formatName, &whole, &writeParams));
+        TEST_ASSERT_EQUAL_UINT(whole.size, streamed.size);
+        TEST_ASSERT_EQUAL_MEMORY(whole.ptr, streamed.ptr, whole.size);
+
+        // Decoding a strip at a time must produce the whole-image reader's pixels
+        clImage * decoded = format->readFunc(C, formatName, NULL, &whole);
+        TEST_ASSERT_NOT_NULL(decoded);
+        clFormatStripReader * reader = clContextReadStrips(C, formatName, NULL, &whole);
+        TEST_ASSERT_NOT_NULL(reader);
+        TEST_ASSERT_EQUAL_INT(decoded->width, reader->image->width);
+        TEST_ASSERT_EQUAL_INT(decoded->height, reader->image->height);
+        TEST_ASSERT_EQUAL_INT(decoded->depth, reader->image->depth);
+        TEST_ASSERT_TRUE(clProfileMatches(C, decoded->profile, reader->image->profile));
+        clImagePrepareReadPixels(C, decoded, pixelFormat);
+        const uint8_t * decodedPixels = (pixelFormat == CL_PIXELFORMAT_U8) ? decoded->pixelsU8
+                                        : (pixelFormat == CL_PIXELFORMAT_U16) ? (const uint8_t *)decoded->pixelsU16
+                                                                              : (const uint8_t *)decoded->pixelsF32;
+        for (int y = 0; y < height; y += stripRows) {
+            int rowCount = CL_MIN(stripRows, height - y);
+            TEST_ASSERT_TRUE(reader->readRows(C, reader, strip, rowCount));
+            const uint8_t * stripPixels = (pixelFormat == CL_PIXELFORMAT_U8) ? strip->pixelsU8
+                                          : (pixelFormat == CL_PIXELFORMAT_U16) ? (const uint8_t *)strip->pixelsU16
+                                                                                : (const uint8_t *)strip->pixelsF32;
+            TEST_ASSERT_NOT_NULL(stripPixels);
+            TEST_ASSERT_EQUAL_MEMORY(&decodedPixels[y * rowBytes], stripPixels, rowCount * rowBytes);
+        }
+        reader->destroy(C, reader);
+
+        clImageDestroy(C, decoded);
+        clImageDestroy(C, strip);
+        clImageDestroy(C, image);
+        clRawFree(C, &streamed);
+        clRawFree(C, &whole);
+    }
+
+    clContextDestroy(C);
+}
+
+static void test_wrappedImage(void)
+{
+    clContext * C = clContextCreate(&silentSystem);
+    TEST_ASSERT_NOT_NULL(C);
+
+    // A caller's 16-bit buffer with padding at the end of every row, and a packed copy of the same pixels
+    enum { W = 37, H = 23, ROW_BYTES = (W * 8) + 24 };
+    static uint8_t buffer[ROW_BYTES * H];
+    static uint8_t original[ROW_BYTES * H];
+    for (int i = 0; i < (int)sizeof(buffer); ++i) {
+        buffer[i] = (uint8_t)((i * 7919) % 251);
+    }
+    memcpy(original, buffer, sizeof(buffer));
+
+    TEST_ASSERT_NULL(clImageCreateWrapped(C, W, H, 16, NULL, CL_PIXELFORMAT_U16, buffer, (W * 8) - 1));
+    clImage * wrapped = clImageCreateWrapped(C, W, H, 16, NULL, CL_PIXELFORMAT_U16, buffer, ROW_BYTES);
+    TEST_ASSERT_NOT_NULL(wrapped);
+    TEST_ASSERT_FALSE(clImageIsPacked(C, wrapped, CL_PIXELFORMAT_U16));
+    clImage * packed = clImageCreate(C, W, H, 16, NULL);
+    clImagePrepareWritePixels(C, packed, CL_PIXELFORMAT_U16);
+    for (int y = 0; y < H; ++y) {
+        memcpy(clImagePixelRow(C, packed, CL_PIXELFORMAT_U16, y), &buffer[y * ROW_BYTES], W * 8);
+    }
+
+    // Encoders read the rows in place
+    clWriteParams writeParams;
+    clWriteParamsSetDefaults(C, &writeParams);
+    static const char * formatNames[] = { "png", "tiff" };
+    for (int formatIndex = 0; formatIndex < 2; ++formatIndex) {
+        clFormat * format = clContextFindFormat(C, formatNames[formatIndex]);
+        clRaw fromWrapped = CL_RAW_EMPTY;
+        clRaw fromPacked = CL_RAW_EMPTY;
+        TEST_ASSERT_TRUE(format->writeFunc(C, wrapped, formatNames[formatIndex], &fromWrapped, &writeParams));
+        TEST_ASSERT_TRUE(format->writeFunc(C, packed, formatNames[formatIndex], &fromPacked, &writeParams));
+        TEST_ASSERT_EQUAL_UINT(fromPacked.size, fromWrapped.size);
+        TEST_ASSERT_EQUAL_MEMORY(fromPacked.ptr, fromWrapped.ptr, fromPacked.size);
+        clRawFree(C, &fromWrapped);
+        clRawFree(C, &fromPacked);
+    }
+    TEST_ASSERT_TRUE(wrapped->borrowed[CL_PIXELFORMAT_U16]);
+
+    // Crops, conversions and format changes see the same pixels
+    clImage * wrappedCrop = clImageCrop(C, wrapped, 3, 2, 20, 17, clTrue);
+    clImage * packedCrop = clImageCrop(C, packed, 3, 2, 20, 17, clTrue);
+    clImagePrepareReadPixels(C, wrappedCrop, CL_PIXELFORMAT_U16);
+    clImagePrepareReadPixels(C, packedCrop, CL_PIXELFORMAT_U16);
+    TEST_ASSERT_EQUAL_MEMORY(packedCrop->pixelsU16, wrappedCrop->pixelsU16, 20 * 17 * 8);
+    clImage * wrappedConverted = clImageConvert(C, wrapped, 8, wrapped->profile, CL_TONEMAP_OFF, NULL, clFalse);
+    clImage * packedConverted = clImageConvert(C, packed, 8, packed->profile, CL_TONEMAP_OFF, NULL, clFalse);
+    TEST_ASSERT_EQUAL_MEMORY(packedConverted->pixelsU8, wrappedConverted->pixelsU8, W * H * 4);
+    clImagePrepareReadPixels(C, wrapped, CL_PIXELFORMAT_F32);
+    clImagePrepareReadPixels(C, packed, CL_PIXELFORMAT_F32);
+    TEST_ASSERT_EQUAL_MEMORY(packed->pixelsF32, wrapped->pixelsF32, W * H * 16);
+
+    // Packed access to the plane swaps in a copy, leaving the caller's buffer alone
+    clImagePrepareReadPixels(C, wrapped, CL_PIXELFORMAT_U16);
+    TEST_ASSERT_TRUE(clImageIsPacked(C, wrapped, CL_PIXELFORMAT_U16));
+    TEST_ASSERT_FALSE(wrapped->borrowed[CL_PIXELFORMAT_U16]);
+    TEST_ASSERT_EQUAL_MEMORY(packed->pixelsU16, wrapped->pixelsU16, W * H * 8);
+    TEST_ASSERT_EQUAL_MEMORY(original, buffer, sizeof(buffer));
+
+    clImageDestroy(C, wrappedConverted);
+    clImageDestroy(C, packedConverted);
+    clImageDestroy(C, wrappedCrop);
+    clImageDestroy(C, packedCrop);
+    clImageDestroy(C, wrapped);
+    clImageDestroy(C, packed);
+    clContextDestroy(C);
+}
+
+static void test_cropView(void)
+{
+    clContext * C = clContextCreate(&silentSystem);
+    TEST_ASSERT_NOT_NULL(C);
+
+    enum { W = 29, H = 19, X = 5, Y = 3, CW = 17, CH = 11 };
+    clImage * image = clImageCreate(C, W, H, 8, NULL);
+    clImagePrepareWritePixels(C, image, CL_PIXELFORMAT_U8);
+    for (int i = 0; i < (W * H * CL_CHANNELS_PER_PIXEL); ++i) {
+        image->pixelsU8[i] = (uint8_t)((i * 31) % 253);
+    }
+    static uint8_t original[W * H * CL_CHANNELS_PER_PIXEL];
+    memcpy(original, image->pixelsU8, sizeof(original));
+
+    // The view points into the source's rows instead of copying them
+    clImage * view = clImageCrop(C, image, X, Y, CW, CH, clTrue);
+    TEST_ASSERT_NOT_NULL(view);
+    TEST_ASSERT_TRUE(view->borrowed[CL_PIXELFORMAT_U8]);
+    TEST_ASSERT_FALSE(clImageIsPacked(C, view, CL_PIXELFORMAT_U8));
+    uint8_t * srcRow = clImagePixelRow(C, image, CL_PIXELFORMAT_U8, Y + 1);
+    TEST_ASSERT_EQUAL_PTR(srcRow + (X * 4), clImagePixelRow(C, view, CL_PIXELFORMAT_U8, 1));
+    TEST_ASSERT_NULL(clImagePixelRow(C, view, CL_PIXELFORMAT_U16, 0));
+
+    // Full-width crops are packed views
+    clImage * band = clImageCrop(C, image, 0, Y, W, CH, clTrue);
+    TEST_ASSERT_TRUE(clImageIsPacked(C, band, CL_PIXELFORMAT_U8));
+    TEST_ASSERT_EQUAL_PTR(&image->pixelsU8[Y * W * 4], band->pixelsU8);
+    clImageDestroy(C, band);
+
+    // Writing to a view copies it first, leaving the source alone
+    clImage * written = clImageCrop(C, image, X, Y, CW, CH, clTrue);
+    float black[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    clImageClear(C, written, black);
+    TEST_ASSERT_FALSE(written->borrowed[CL_PIXELFORMAT_U8]);
+    TEST_ASSERT_EQUAL_MEMORY(original, image->pixelsU8, sizeof(original));
+    clImageDestroy(C, written);
+
+    // Packed reads see the cropped pixels
+    clImagePrepareReadPixels(C, view, CL_PIXELFORMAT_U8);
+    TEST_ASSERT_FALSE(view->borrowed[CL_PIXELFORMAT_U8]);
+    for (int j = 0; j < CH; ++j) {
+        TEST_ASSERT_EQUAL_MEMORY(&original[(((j + Y) * W) + X) * 4], &view->pixelsU8[j * CW * 4], CW * 4);
+    }
+    clImageDestroy(C, view);
+
+    // A view that took over its source keeps it alive only while it still borrows from it
+    view = clImageCrop(C, image, X, Y, CW, CH, clFalse);
+    TEST_ASSERT_EQUAL_PTR(image, view->viewParent);
+    clImage * converted = clImageConvert(C, view, 16, view->profile, CL_TONEMAP_OFF, NULL, clFalse);
+    TEST_ASSERT_NOT_NULL(converted);
+    TEST_ASSERT_EQUAL_UINT8(original[((Y * W) + X) * 4], converted->pixelsU16[0] >> 8);
+    clImagePrepareReadPixels(C, view, CL_PIXELFORMAT_U8);
+    TEST_ASSERT_NULL(view->viewParent);
+    clImageDestroy(C, converted);
+    clImageDestroy(C, view);
+
+    clContextDestroy(C);
+}
+
+static void test_orientation(void)
+{
+    clContext * C = clContextCreate(&silentSystem);
+    TEST_ASSERT_NOT_NULL(C);
+
+    // Sizes that leave partial tiles on both axes, an odd height for the in-place middle row, and padded src rows (a crop)
+    enum { W = 71, H = 45 };
+    clImage * parent = clImageCreate(C, W + 6, H + 4, 16, NULL);
+    clImagePrepareWritePixels(C, parent, CL_PIXELFORMAT_U16);
+    for (int i = 0; i < ((W + 6) * (H + 4) * CL_CHANNELS_PER_PIXEL); ++i) {
+        parent->pixelsU16[i] = (uint16_t)((i * 40503) & 0xffff);
+    }
+    clImage * image = clImageCrop(C, parent, 3, 2, W, H, clTrue);
+    clImagePrepareReadRows(C, image, CL_PIXELFORMAT_F32);
+
+    for (int op = 0; op < 6; ++op) {
+        // Rotations by 0-3 turns, then horizontal and vertical mirrors
+        clImage * oriented = (op < 4) ? clImageRotate(C, image, op) : clImageMirror(C, image, op == 4);
+        TEST_ASSERT_NOT_NULL(oriented);
+        TEST_ASSERT_EQUAL_INT((op & 1) && (op < 4) ? H : W, oriented->width);
+        for (int y = 0; y < oriented->height; ++y) {
+            for (int x = 0; x < oriented->width; ++x) {
+                int sx = x, sy = y;
+                switch (op) {
+                    case 1: sx = y; sy = H - 1 - x; break;
+                    case 2: sx = W - 1 - x; sy = H - 1 - y; break;
+                    case 3: sx = W - 1 - y; sy = x; break;
+                    case 4: sx = W - 1 - x; break;
+                    case 5: sy = H - 1 - y; break;
+                }
+                for (clPixelFormat pixelFormat = CL_PIXELFORMAT_U16; pixelFormat <= CL_PIXELFORMAT_F32; ++pixelFormat) {
+                    int pixelBytes = CL_BYTES_PER_PIXEL(pixelFormat);
+                    TEST_ASSERT_EQUAL_MEMORY(clImagePixelRow(C, image, pixelFormat, sy) + (sx * pixelBytes),
+                                             clImagePixelRow(C, oriented, pixelFormat, y) + (x * pixelBytes),
+                                             pixelBytes);
+                }
+            }
+        }
+
+        // Orientations that keep the dimensions also work in place, without touching the crop's source
+        if ((op == 0) || (op == 2) || (op >= 4)) {
+            clImage * flipped = clImageCrop(C, parent, 3, 2, W, H, clTrue);
+            clImagePrepareReadRows(C, flipped, CL_PIXELFORMAT_F32);
+            if (op < 4) {
+                TEST_ASSERT_TRUE(clImageRotateInPlace(C, flipped, op));
+            } else {
+                clImageMirrorInPlace(C, flipped, op == 4);
+            }
+            for (clPixelFormat pixelFormat = CL_PIXELFORMAT_U16; pixelFormat <= CL_PIXELFORMAT_F32; ++pixelFormat) {
+                clImagePrepareReadPixels(C, flipped, pixelFormat);
+                clImagePrepareReadPixels(C, oriented, pixelFormat);
+                TEST_ASSERT_EQUAL_MEMORY(clImagePixelRow(C, oriented, pixelFormat, 0),
+                                         clImagePixelRow(C, flipped, pixelFormat, 0),
+                                         W * H * CL_BYTES_PER_PIXEL(pixelFormat));
+            }
+            clImageDestroy(C, flipped);
+        } else {
+            TEST_ASSERT_FALSE(clImageRotateInPlace(C, image, op));
+        }
+        clImageDestroy(C, oriented);
+    }
+    for (int i = 0; i < ((W + 6) * (H + 4) * CL_CHANNELS_PER_PIXEL); ++i) {
+        TEST_ASSERT_EQUAL_UINT16((uint16_t)((i * 40503) & 0xffff), parent->pixelsU16[i]);
+    }
+
+    clImageDestroy(C, image);
+    clImageDestroy(C, parent);
+    clContextDestroy(C);
+}
+
+static void test_renditions(void)
+{
+    clContext * C = clContextCreate(&silentSystem);
+    TEST_ASSERT_NOT_NULL(C);
+
+    {
+        // rendition ladder
+        const char * argv[] = { "colorist",    "convert",          "input.png",   "output.png",
+                                "--rendition", "640,0,medium.jpg", "--rendition", "0,90,a,b.png" };
+        TEST_ASSERT_TRUE(clContextParseArgs(C, ARGS(argv)));
+        TEST_ASSERT_EQUAL_INT(2, C->params.renditionCount);
+        TEST_ASSERT_EQUAL_INT(90, C->params.renditions[1].height);
+        TEST_ASSERT_EQUAL_STRING("a,b.png", C->params.renditions[1].filename);
+    }
+
+    {
+        // rendition: missing filename, no dimensions, unknown format
+        const char * badRenditions[] = { "640,0", "0,0,small.png", "640,480,small.derp" };
+        for (int i = 0; i < 3; ++i) {
+            const char * argv[] = { "colorist", "convert", "input.png", "output.png", "--rendition", badRenditions[i] };
+            TEST_ASSERT_FALSE(clContextParseArgs(C, ARGS(argv)));
+        }
+    }
+
+    // One decode, a main output and a ladder; every rendition is filtered straight from the source
+    clImage * image = clImageParseString(C, "256x192,#ff0000..#0000ff", 8, NULL);
+    TEST_ASSERT_NOT_NULL(image);
+    TEST_ASSERT_TRUE(clContextWrite(C, image, "rendition_src.png", NULL, &C->params.writeParams));
+    clImageDestroy(C, image);
+    {
+        const char * argv[] = { "colorist",    "convert",             "rendition_src.png", "rendition_main.png",
+                                "--rendition", "32,0,rendition_c.png", "--rendition",      "128,96,rendition_a.png",
+                                "--rendition", "0,48,rendition_b.bmp" };
+        TEST_ASSERT_TRUE(clContextParseArgs(C, ARGS(argv)));
+        TEST_ASSERT_EQUAL_INT(0, clContextConvert(C));
+    }
+
+    static const char * filenames[] = { "rendition_main.png", "rendition_a.png", "rendition_b.bmp", "rendition_c.png" };
+    static const int expectedSizes[][2] = { { 256, 192 }, { 128, 96 }, { 64, 48 }, { 32, 24 } };
+    for (int i = 0; i < 4; ++i) {
+        clImage * rendition = clContextRead(C, filenames[i], NULL, NULL);
+        TEST_ASSERT_NOT_NULL(rendition);
+        TEST_ASSERT_EQUAL_INT(expectedSizes[i][0], rendition->width);
+        TEST_ASSERT_EQUAL_INT(expectedSizes[i][1], rendition->height);
+        if (i > 0) {
+            char size[32];
+            sprintf(size, "%d,%d", expectedSizes[i][0], expectedSizes[i][1]);
+            const char * argv[] = { "colorist", "convert", "rendition_src.png", "rendition_direct.png", "--resize", size };
+            TEST_ASSERT_TRUE(clContextParseArgs(C, ARGS(argv)));
+            TEST_ASSERT_EQUAL_INT(0, clContextConvert(C));
+
+            clImage * direct = clContextRead(C, "rendition_direct.png", NULL, NULL);
+            TEST_ASSERT_NOT_NULL(direct);
+            clImagePrepareReadPixels(C, rendition, CL_PIXELFORMAT_U8);
+            clImagePrepareReadPixels(C, direct, CL_PIXELFORMAT_U8);
+            TEST_ASSERT_EQUAL_MEMORY(direct->pixelsU8, rendition->pixelsU8, expectedSizes[i][0] * expectedSizes[i][1] * 4);
+            clImageDestroy(C, direct);
+        }
+        clImageDestroy(C, rendition);
+    }
+
+    clContextDestroy(C);
+}
+
+static void test_resizeKernels(void)
+{
+    clContext * C = clContextCreate(&silentSystem);
+    TEST_ASSERT_NOT_NULL(C);
+
+    // Left half opaque red, right half transparent green, on both sides of a hard edge
+    enum { W = 64, H = 48 };
+    clImage * image = clImageCreate(C, W, H, 16, NULL);
+    clImagePrepareWritePixels(C, image, CL_PIXELFORMAT_F32);
+    for (int j = 0; j < H; ++j) {
+        for (int i = 0; i < W; ++i) {
+            float * pixel = &image->pixelsF32[(i + (j * W)) * CL_CHANNELS_PER_PIXEL];
+            pixel[0] = (i < (W / 2)) ? 1.0f : 0.0f;
+            pixel[1] = (i < (W / 2)) ? 0.0f : 1.0f;
+            pixel[2] = 0.0f;
+            pixel[3] = (i < (W / 2)) ? 1.0f : 0.0f;
+        }
+    }
+
+    static const int sizes[][2] = { { 17, 13 }, { 64, 48 }, { 150, 101 }, { 1, 1 } };
+    for (int filter = CL_FILTER_AUTO; filter <= CL_FILTER_NEAREST; ++filter) {
+        for (size_t sizeIndex = 0; sizeIndex < (sizeof(sizes) / sizeof(sizes[0])); ++sizeIndex) {
+            int dstW = sizes[sizeIndex][0];
+            int dstH = sizes[sizeIndex][1];
+            clImage * resized = clImageResize(C, image, dstW, dstH, (clFilter)filter);
+            TEST_ASSERT_NOT_NULL(resized);
+            for (int i = 0; i < (dstW * dstH); ++i) {
+                const float * pixel = &resized->pixelsF32[i * CL_CHANNELS_PER_PIXEL];
+
+                // Alpha-weighted filtering never lets transparent green into visible pixels, and ringing is clamped
+                TEST_ASSERT_TRUE(pixel[3] >= 0.0f);
+                TEST_ASSERT_TRUE((pixel[1] == 0.0f) || (pixel[3] == 0.0f));
+                TEST_ASSERT_TRUE((pixel[3] == 0.0f) || (fabsf(pixel[0] - 1.0f) < 0.0001f));
+            }
+
+            // Same-size resizes with an interpolating filter leave the image alone (transparent color aside)
+            clBool interpolating =
+                (filter == CL_FILTER_TRIANGLE) || (filter == CL_FILTER_CATMULLROM) || (filter == CL_FILTER_NEAREST);
+            if ((dstW == W) && interpolating) {
+                for (int i = 0; i < (W * H * CL_CHANNELS_PER_PIXEL); ++i) {
+                    if (image->pixelsF32[(i & ~3) + 3] > 0.0f) {
+                        TEST_ASSERT_FLOAT_WITHIN(0.0001f, image->pixelsF32[i], resized->pixelsF32[i]);
+                    }
+                }
+            }
+            clImageDestroy(C, resized);
+        }
+    }
+
+    // Doubling with a triangle filter is bilinear interpolation between source pixel centers
+    clImage * ramp = clImageCreate(C, 8, 2, 16, NULL);
+    clImagePrepareWritePixels(C, ramp, CL_PIXELFORMAT_F32);
+    for (int i = 0; i < 16; ++i) {
+        float * pixel = &ramp->pixelsF32[i * CL_CHANNELS_PER_PIXEL];
+        pixel[0] = pixel[1] = pixel[2] = (float)(i % 8) / 7.0f;
+        pixel[3] = 1.0f;
+    }
+    clImage * doubled = clImageResize(C, ramp, 16, 4, CL_FILTER_TRIANGLE);
+    for (int i = 1; i < 15; ++i) {
+        float srcX = (((float)i + 0.5f) / 2.0f) - 0.5f;
+        TEST_ASSERT_FLOAT_WITHIN(0.0001f, srcX / 7.0f, doubled->pixelsF32[(16 + i) * CL_CHANNELS_PER_PIXEL]);
+    }
+    clImageDestroy(C, doubled);
+    clImageDestroy(C, ramp);
+
+    clImageDestroy(C, image);
+    clContextDestroy(C);
+}
+
+static void test_haldLUT(void)
+{
+    clContext * C = clContextCreate(&silentSystem);
+    TEST_ASSERT_NOT_NULL(C);
+
+    static const float colors[][4] = { { 0.0f, 0.0f, 0.0f, 1.0f }, { 1.0f, 1.0f, 1.0f, 0.5f }, { 0.3f, 0.6f, 0.9f, 0.25f },
+                                       { 0.9f, 0.1f, 0.5f, 0.0f }, { 0.5f, 0.5f, 0.5f, 1.0f }, { -0.5f, 1.5f, 0.7f, 1.0f } };
+    const int colorCount = (int)(sizeof(colors) / sizeof(colors[0]));
+    float looked[sizeof(colors) / sizeof(colors[0])][4];
+
+    // An identity Hald reproduces every (clamped) color with either interpolation, and alpha passes through
+    clImage * identity = clImageParseString(C, "hald(16)", 32, NULL);
+    TEST_ASSERT_NOT_NULL(identity);
+    clImagePrepareReadPixels(C, identity, CL_PIXELFORMAT_F32);
+    for (int interpolation = CL_HALD_TETRAHEDRAL; interpolation <= CL_HALD_TRILINEAR; ++interpolation) {
+        clHaldLUT * lut = clHaldLUTCreate(C, identity->pixelsF32, 16, (clHaldInterpolation)interpolation);
+        TEST_ASSERT_NOT_NULL(lut);
+        clPixelMathHaldLUTApply(C, lut, &colors[0][0], &looked[0][0], colorCount);
+        for (int i = 0; i < colorCount; ++i) {
+            for (int c = 0; c < 3; ++c) {
+                TEST_ASSERT_FLOAT_WITHIN(0.00001f, CL_CLAMP(colors[i][c], 0.0f, 1.0f), looked[i][c]);
+            }
+            TEST_ASSERT_EQUAL_FLOAT(colors[i][3], looked[i][3]);
+        }
+        clHaldLUTDestroy(C, lut);
+    }
+    clImageDestroy(C, identity);
+    TEST_ASSERT_NULL(clHaldLUTCreate(C, colors[0], 1, CL_HALD_TETRAHEDRAL));
+
+    // R = r * g is exact under trilinear interpolation, but tetrahedral only reads the gray axis for grays
+    enum { DIMS = 4 };
+    float cube[DIMS * DIMS * DIMS * 4];
+    for (int i = 0; i < (DIMS * DIMS * DIMS); ++i) {
+        float r = (float)(i % DIMS) / (DIMS - 1);
+        float g = (float)((i / DIMS) % DIMS) / (DIMS - 1);
+        cube[(i * 4) + 0] = r * g;
+        cube[(i * 4) + 1] = cube[(i * 4) + 2] = cube[(i * 4) + 3] = 0.0f;
+    }
+    const float gray[4] = { 0.5f, 0.5f, 0.5f, 1.0f };
+    float result[4];
+    clHaldLUT * trilinear = clHaldLUTCreate(C, cube, DIMS, CL_HALD_TRILINEAR);
+    clHaldLUT * tetrahedral = clHaldLUTCreate(C, cube, DIMS, CL_HALD_TETRAHEDRAL);
+    clPixelMathHaldLUTApply(C, trilinear, gray, result, 1);
+    TEST_ASSERT_FLOAT_WITHIN(0.00001f, 0.25f, result[0]);
+    clPixelMathHaldLUTApply(C, trilinear, colors[2], result, 1);
+    TEST_ASSERT_FLOAT_WITHIN(0.00001f, 0.3f * 0.6f, result[0]);
+    clPixelMathHaldLUTApply(C, tetrahedral, gray, result, 1);
+    TEST_ASSERT_FLOAT_WITHIN(0.00001f, ((1.0f / 9.0f) + (4.0f / 9.0f)) / 2.0f, result[0]);
+    clHaldLUTDestroy(C, trilinear);
+    clHaldLUTDestroy(C, tetrahedral);
+
+    // Grading integer images in place: an inverting Hald maps every channel v to max - v, with alpha untouched
+    const float invert[2 * 2 * 2 * 4] = { 1, 1, 1, 0, 0, 1, 1, 0, 1, 0, 1, 0, 0, 0, 1, 0,
+                                          1, 1, 0, 0, 0, 1, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0 };
+    clHaldLUT * inverter = clHaldLUTCreate(C, invert, 2, CL_HALD_TETRAHEDRAL);
+    static const int depths[] = { 8, 10, 32 };
+    for (size_t depthIndex = 0; depthIndex < (sizeof(depths) / sizeof(depths[0])); ++depthIndex) {
+        int depth = depths[depthIndex];
+        clImage * image = clImageParseString(C, "37x29,#000000..#ff8040", depth, NULL);
+        TEST_ASSERT_NOT_NULL(image);
+        clImage * original = clImageRotate(C, image, 0);
+        clImageApplyHaldLUT(C, image, image, inverter);
+
+        clImagePrepareReadPixels(C, image, CL_PIXELFORMAT_U16);
+        clImagePrepareReadPixels(C, original, CL_PIXELFORMAT_U16);
+        int maxChannel = (1 << ((depth == 32) ? 16 : depth)) - 1;
+        for (int i = 0; i < (image->width * image->height * CL_CHANNELS_PER_PIXEL); ++i) {
+            int expected = ((i % 4) == 3) ? original->pixelsU16[i] : (maxChannel - original->pixelsU16[i]);
+            TEST_ASSERT_INT_WITHIN((depth == 32) ? 1 : 0, expected, image->pixelsU16[i]);
+        }
+        clImageDestroy(C, original);
+        clImageDestroy(C, image);
+    }
+    clHaldLUTDestroy(C, inverter);
+
+    clContextDestroy(C);
+}
+
+static void test_bakedLUT(void)
+{
+    clContext * C = clContextCreate(&silentSystem);
+    TEST_ASSERT_NOT_NULL(C);
+
+    // The baked lattice reproduces the exact conversion at its own points, and the error report covers everything between
+    clProfilePrimaries p3;
+    TEST_ASSERT_TRUE(clContextGetStockPrimaries(C, "p3", &p3));
+    clProfileCurve curve;
+    curve.type = CL_PCT_GAMMA;
+    curve.implicitScale = 1.0f;
+    curve.gamma = 2.2f;
+    clProfile * srgb = clProfileCreateStock(C, CL_PS_SRGB);
+    clProfile * displayP3 = clProfileCreate(C, &p3, &curve, 300, NULL);
+    clTransform * transform = clTransformAcquire(C, srgb, CL_XF_RGBA, displayP3, CL_XF_RGBA, CL_TONEMAP_OFF, NULL, 0, 0);
+    clHaldLUT * lut = clTransformBakeLUT(C, transform, NULL, 9, NULL);
+    TEST_ASSERT_NOT_NULL(lut);
+    float lattice[9 * 4];
+    float exact[9 * 4];
+    float looked[9 * 4];
+    for (int i = 0; i < 9; ++i) {
+        lattice[(i * 4) + 0] = (float)i / 8.0f;
+        lattice[(i * 4) + 1] = (float)(8 - i) / 8.0f;
+        lattice[(i * 4) + 2] = (float)((i * 3) % 9) / 8.0f;
+        lattice[(i * 4) + 3] = 1.0f;
+    }
+    clTransformRun(C, transform, lattice, exact, 9);
+    clPixelMathHaldLUTApply(C, lut, lattice, looked, 9);
+    for (int i = 0; i < (9 * 4); ++i) {
+        TEST_ASSERT_FLOAT_WITHIN(0.00001f, exact[i], looked[i]);
+    }
+    float maxError, meanError;
+    clTransformMeasureBakedLUT(C, transform, NULL, lut, &maxError, &meanError);
+    TEST_ASSERT_TRUE(maxError > 0.0f);
+    TEST_ASSERT_TRUE(maxError < 0.1f);
+    TEST_ASSERT_TRUE(meanError <= maxError);
+    clHaldLUTDestroy(C, lut);
+
+    // The same hald with each interpolation bakes (and caches) separately. r*g*b is exact under trilinear only.
+    float haldPixels[3 * 3 * 3 * 4];
+    for (int i = 0; i < (3 * 3 * 3); ++i) {
+        float product = ((float)(i % 3) / 2.0f) * ((float)((i / 3) % 3) / 2.0f) * ((float)(i / 9) / 2.0f);
+        haldPixels[(i * 4) + 0] = product;
+        haldPixels[(i * 4) + 1] = product;
+        haldPixels[(i * 4) + 2] = product;
+        haldPixels[(i * 4) + 3] = 1.0f;
+    }
+    clHaldLUT * trilinearHald = clHaldLUTCreate(C, haldPixels, 3, CL_HALD_TRILINEAR);
+    clHaldLUT * tetrahedralHald = clHaldLUTCreate(C, haldPixels, 3, CL_HALD_TETRAHEDRAL);
+    clHaldLUT * trilinearBake = clTransformBakeLUT(C, transform, trilinearHald, 9, ".");
+    clHaldLUT * tetrahedralBake = clTransformBakeLUT(C, transform, tetrahedralHald, 9, ".");
+    clHaldLUT * tetrahedralFresh = clTransformBakeLUT(C, transform, tetrahedralHald, 9, NULL);
+    TEST_ASSERT_NOT_NULL(trilinearBake);
+    TEST_ASSERT_NOT_NULL(tetrahedralBake);
+    TEST_ASSERT_NOT_NULL(tetrahedralFresh);
+    TEST_ASSERT_TRUE(memcmp(trilinearBake->cube, tetrahedralBake->cube, sizeof(float) * 4 * 9 * 9 * 9) != 0);
+    TEST_ASSERT_EQUAL_MEMORY(tetrahedralFresh->cube, tetrahedralBake->cube, sizeof(float) * 4 * 9 * 9 * 9);
+    clHaldLUTDestroy(C, tetrahedralFresh);
+    clHaldLUTDestroy(C, tetrahedralBake);
+    clHaldLUTDestroy(C, trilinearBake);
+    clHaldLUTDestroy(C, tetrahedralHald);
+    clHaldLUTDestroy(C, trilinearHald);
+    clTransformRelease(C, transform);
+    clProfileDestroy(C, displayP3);
+    clProfileDestroy(C, srgb);
+
+    // End to end: within a few codes of the exact conversion, and a second run loads the cached bake
+    clImage * image = clImageParseString(C, "256x64,#ff0000..#0000ff", 8, NULL);
+    TEST_ASSERT_NOT_NULL(image);
+    TEST_ASSERT_TRUE(clContextWrite(C, image, "lut_src.png", NULL, &C->params.writeParams));
+    clImageDestroy(C, image);
+    static const char * outputs[] = { "lut_exact.bmp", "lut_baked.bmp", "lut_cached.bmp" };
+    for (int i = 0; i < 3; ++i) {
+        const char * argv[] = { "colorist", "convert", "lut_src.png", outputs[i],    "-p",          "p3",
+                                "-g",       "2.2",     "--lut-bake",  "33",          "--lut-cache", "." };
+        TEST_ASSERT_TRUE(clContextParseArgs(C, (i == 0) ? 8 : 12, argv));
+        TEST_ASSERT_EQUAL_INT(0, clContextConvert(C));
+    }
+    clImage * converted[3];
+    for (int i = 0; i < 3; ++i) {
+        converted[i] = clContextRead(C, outputs[i], NULL, NULL);
+        TEST_ASSERT_NOT_NULL(converted[i]);
+        clImagePrepareReadPixels(C, converted[i], CL_PIXELFORMAT_U8);
+    }
+    for (int i = 0; i < (256 * 64 * CL_CHANNELS_PER_PIXEL); ++i) {
+        TEST_ASSERT_INT_WITHIN(4, converted[0]->pixelsU8[i], converted[1]->pixelsU8[i]);
+    }
+    TEST_ASSERT_EQUAL_MEMORY(converted[1]->pixelsU8, converted[2]->pixelsU8, 256 * 64 * CL_CHANNELS_PER_PIXEL);
+    for (int i = 0; i < 3; ++i) {
+        clImageDestroy(C, converted[i]);
+    }
+
+    {
+        const char * argv[] = { "colorist", "convert", "lut_src.png", "lut_bad.png", "--lut-bake", "1" };
+        TEST_ASSERT_FALSE(clContextParseArgs(C, ARGS(argv)));
+    }
+
+    clContextDestroy(C);
+}
+
+static void test_blend(void)
+{
+    clContext * C = clContextCreate(&silentSystem);
+    TEST_ASSERT_NOT_NULL(C);
+
+    // Every mode's kernel against the reference math on premultiplied colors, with both alpha modes
+    static const float cmp[][4] = { { 1.0f, 0.0f, 0.0f, 0.5f }, { 0.2f, 0.4f, 0.6f, 1.0f }, { 0.9f, 0.8f, 0.7f, 0.0f },
+                                    { 0.3f, 0.3f, 0.3f, 0.25f }, { 0.5f, 1.0f, 0.0f, 0.75f } };
+    static const float dst[][4] = { { 0.0f, 0.0f, 1.0f, 1.0f }, { 1.0f, 1.0f, 1.0f, 0.5f }, { 0.1f, 0.2f, 0.3f, 0.4f },
+                                    { 0.6f, 0.0f, 0.9f, 0.0f }, { 0.25f, 0.5f, 0.75f, 1.0f } };
+    const int pixelCount = (int)(sizeof(cmp) / sizeof(cmp[0]));
+    for (int mode = CL_BLEND_SOURCEOVER; mode <= CL_BLEND_MASK; ++mode) {
+        TEST_ASSERT_EQUAL_INT(mode, clBlendModeFromString(C, clBlendModeToString(C, (clBlendMode)mode)));
+        for (int premultiplied = 0; premultiplied < 2; ++premultiplied) {
+            float blended[sizeof(dst) / sizeof(dst[0])][4];
+            memcpy(blended, dst, sizeof(blended));
+            clPixelMathBlend(C, (clBlendMode)mode, &cmp[0][0], &blended[0][0], pixelCount, premultiplied ? clTrue : clFalse);
+            for (int i = 0; i < pixelCount; ++i) {
+                float sa = cmp[i][3];
+                float da = dst[i][3];
+                for (int c = 0; c < 4; ++c) {
+                    float s = ((c == 3) || premultiplied) ? cmp[i][c] : (cmp[i][c] * sa);
+                    float d = ((c == 3) || premultiplied) ? dst[i][c] : (dst[i][c] * da);
+                    float expected = 0.0f;
+                    switch ((clBlendMode)mode) {
+                        case CL_BLEND_SOURCEOVER:
+                            expected = s + (d * (1.0f - sa));
+                            break;
+                        case CL_BLEND_MULTIPLY:
+                            expected = (s * d) + (s * (1.0f - da)) + (d * (1.0f - sa));
+                            break;
+                        case CL_BLEND_SCREEN:
+                            expected = s + d - (s * d);
+                            break;
+                        case CL_BLEND_ADD:
+                            expected = (c == 3) ? CL_MIN(s + d, 1.0f) : (s + d);
+                            break;
+                        case CL_BLEND_MASK:
+                            expected = d * sa;
+                            break;
+                        case CL_BLEND_INVALID:
+                            break;
+                    }
+                    TEST_ASSERT_FLOAT_WITHIN(0.00001f, expected, blended[i][c]);
+                }
+            }
+        }
+    }
+    TEST_ASSERT_EQUAL_INT(CL_BLEND_INVALID, clBlendModeFromString(C, "overlay"));
+
+    // --composite-* options before the first --composite apply to it, then each later layer starts from the previous one
+    {
+        const char * argv[] = { "colorist",        "convert",      "input.png",   "output.png", "--composite-mode", "screen",
+                                "--composite",     "a.png",        "--composite", "b.png",      "--composite-offset", "3,4",
+                                "--composite-gamma", "1.8" };
+        TEST_ASSERT_TRUE(clContextParseArgs(C, ARGS(argv)));
+        TEST_ASSERT_EQUAL_INT(2, C->params.compositeCount);
+        TEST_ASSERT_EQUAL_STRING("b.png", C->params.composites[1].filename);
+        TEST_ASSERT_EQUAL_INT(CL_BLEND_SCREEN, C->params.composites[0].params.mode);
+        TEST_ASSERT_EQUAL_INT(CL_BLEND_SCREEN, C->params.composites[1].params.mode);
+        TEST_ASSERT_EQUAL_INT(0, C->params.composites[0].params.offsetX);
+        TEST_ASSERT_EQUAL_INT(3, C->params.composites[1].params.offsetX);
+        TEST_ASSERT_EQUAL_FLOAT(1.8f, C->params.composites[0].params.gamma);
+    }
+    {
+        const char * argv[] = { "colorist", "convert", "input.png", "output.png", "--composite-mode", "overlay" };
+        TEST_ASSERT_FALSE(clContextParseArgs(C, ARGS(argv)));
+    }
+
+    // Blending in place only touches the overlap (here clipped on the left and bottom), and matches clImageBlend()
+    static const int depths[] = { 8, 16, 32 };
+    for (size_t depthIndex = 0; depthIndex < (sizeof(depths) / sizeof(depths[0])); ++depthIndex) {
+        int depth = depths[depthIndex];
+        clImage * image = clImageParseString(C, "48x40,#102030..#f0e0d0", depth, NULL);
+        clImage * compositeImage = clImageParseString(C, "16x12,#ff000080..#00ff00ff", 8, NULL);
+        TEST_ASSERT_NOT_NULL(image);
+        TEST_ASSERT_NOT_NULL(compositeImage);
+        clImage * original = clImageRotate(C, image, 0);
+
+        clBlendParams blendParams;
+        clBlendParamsSetDefaults(C, &blendParams);
+        blendParams.offsetX = -5;
+        blendParams.offsetY = 33;
+        clImage * blendedImage = clImageBlend(C, image, compositeImage, &blendParams);
+        TEST_ASSERT_NOT_NULL(blendedImage);
+        TEST_ASSERT_TRUE(clImageBlendInPlace(C, image, compositeImage, &blendParams));
+
+        clImagePrepareReadPixels(C, image, CL_PIXELFORMAT_U16);
+        clImagePrepareReadPixels(C, blendedImage, CL_PIXELFORMAT_U16);
+        clImagePrepareReadPixels(C, original, CL_PIXELFORMAT_U16);
+        int changedCount = 0;
+        for (int y = 0; y < image->height; ++y) {
+            for (int x = 0; x < image->width; ++x) {
+                const uint16_t * pixel = &image->pixelsU16[CL_CHANNELS_PER_PIXEL * (x + (y * image->width))];
+                const uint16_t * originalPixel = &original->pixelsU16[CL_CHANNELS_PER_PIXEL * (x + (y * image->width))];
+                const uint16_t * blendedPixel = &blendedImage->pixelsU16[CL_CHANNELS_PER_PIXEL * (x + (y * image->width))];
+                TEST_ASSERT_EQUAL_MEMORY(blendedPixel, pixel, CL_BYTES_PER_PIXEL(CL_PIXELFORMAT_U16));
+                if ((x >= 11) || (y < 33)) {
+                    TEST_ASSERT_EQUAL_MEMORY(originalPixel, pixel, CL_BYTES_PER_PIXEL(CL_PIXELFORMAT_U16));
+                } else if (memcmp(originalPixel, pixel, CL_BYTES_PER_PIXEL(CL_PIXELFORMAT_U16))) {
+                    ++changedCount;
+                }
+            }
+        }
+        TEST_ASSERT_EQUAL_INT(11 * 7, changedCount);
+
+        // Nothing to do off the edge
+        blendParams.offsetX = image->width;
+        TEST_ASSERT_TRUE(clImageBlendInPlace(C, image, compositeImage, &blendParams));
+
+        // A batch of layers (overlapping, separate, and off the edge) matches blending them one at a time. Pixels
+        // only go through blend space once instead of per layer, so integer images can differ by a rounding.
+        clImage * layers[4] = { compositeImage, compositeImage, compositeImage, compositeImage };
+        clBlendParams layerParams[4];
+        static const int layerOffsets[4][2] = { { 2, 3 }, { 10, 8 }, { 30, 20 }, { -20, 0 } };
+        for (int i = 0; i < 4; ++i) {
+            clBlendParamsSetDefaults(C, &layerParams[i]);
+            layerParams[i].mode = (clBlendMode)(i + 1);
+            layerParams[i].offsetX = layerOffsets[i][0];
+            layerParams[i].offsetY = layerOffsets[i][1];
+        }
+        clImage * sequential = clImageRotate(C, image, 0);
+        for (int i = 0; i < 4; ++i) {
+            TEST_ASSERT_TRUE(clImageBlendInPlace(C, sequential, layers[i], &layerParams[i]));
+        }
+        TEST_ASSERT_TRUE(clImageBlendLayersInPlace(C, image, 4, layers, layerParams));
+        clImagePrepareReadPixels(C, image, CL_PIXELFORMAT_U16);
+        clImagePrepareReadPixels(C, sequential, CL_PIXELFORMAT_U16);
+        for (int i = 0; i < (image->width * image->height * CL_CHANNELS_PER_PIXEL); ++i) {
+            TEST_ASSERT_INT_WITHIN((depth == 8) ? 257 : 2, sequential->pixelsU16[i], image->pixelsU16[i]);
+        }
+        clImageDestroy(C, sequential);
+
+        clImageDestroy(C, original);
+        clImageDestroy(C, blendedImage);
+        clImageDestroy(C, compositeImage);
+        clImageDestroy(C, image);
+    }
+
+    clContextDestroy(C);
+}
+
+static int compareTestFloats(const void * p, const void * q)
+{
+    const float x = *(const float *)p;
+    const float y = *(const float *)q;
+    return (x < y) ? -1 : ((x > y) ? 1 : 0);
+}
+
+static clProfile * createTestPQProfile(clContext * C)
+{
+    clProfilePrimaries bt2020;
+    clContextGetStockPrimaries(C, "bt2020", &bt2020);
+    clProfileCurve curve;
+    curve.type = CL_PCT_PQ;
+    curve.implicitScale = 1.0f;
+    curve.gamma = 1.0f;
+    return clProfileCreate(C, &bt2020, &curve, 10000, NULL);
+}
+
+// Sweeps red across x and green down y, so there are pixels in and out of gamut, both dim and overbright
+static clImage * createTestHDRImage(clContext * C, clProfile * pq)
+{
+    clImage * image = clImageCreate(C, 97, 61, 16, pq);
+    int pixelCount = image->width * image->height;
+    clImagePrepareWritePixels(C, image, CL_PIXELFORMAT_F32);
+    for (int i = 0; i < pixelCount; ++i) {
+        float * pixel = &image->pixelsF32[i * CL_CHANNELS_PER_PIXEL];
+        pixel[0] = (float)(i % image->width) / (float)(image->width - 1);
+        pixel[1] = 0.5f * (float)(i / image->width) / (float)(image->height - 1);
+        pixel[2] = 0.75f * (1.0f - pixel[0]);
+        pixel[3] = 1.0f;
+    }
+    return image;
+}
+
+static void test_measureHDR(void)
+{
+    clContext * C = clContextCreate(&silentSystem);
+    TEST_ASSERT_NOT_NULL(C);
+
+    // Max Y is white's 1 at the white point, and a primary's share of white at that primary
+    clProfilePrimaries srgb = { { 0.64f, 0.33f }, { 0.30f, 0.60f }, { 0.15f, 0.06f }, { 0.3127f, 0.3290f } };
+    gbMat3 fromXYZ;
+    clTransformDeriveFromXYZMatrix(C, &srgb, &fromXYZ);
+    TEST_ASSERT_FLOAT_WITHIN(0.0001f, 1.0f, clTransformCalcMaxY(C, &fromXYZ, srgb.white[0], srgb.white[1]));
+    TEST_ASSERT_FLOAT_WITHIN(0.001f, 0.2126f, clTransformCalcMaxY(C, &fromXYZ, srgb.red[0], srgb.red[1]));
+    TEST_ASSERT_FLOAT_WITHIN(0.001f, 0.0722f, clTransformCalcMaxY(C, &fromXYZ, srgb.blue[0], srgb.blue[1]));
+
+    clProfile * pq = createTestPQProfile(C);
+    clImage * image = createTestHDRImage(C, pq);
+    int pixelCount = image->width * image->height;
+
+    clImageHDRStats stats;
+    clImageHDRQuantization * quantization = clAllocateStruct(clImageHDRQuantization);
+    clImageHDRPixelInfo * pixelInfo = clImageHDRPixelInfoCreate(C, pixelCount);
+    clImage * highlight = NULL;
+    clImageMeasureHDR(C, image, 100, 0.0f, &highlight, &stats, pixelInfo, quantization);
+    TEST_ASSERT_NOT_NULL(highlight);
+    TEST_ASSERT_EQUAL_INT64(pixelCount, stats.pixelCount);
+    TEST_ASSERT_EQUAL_INT64(stats.overbrightPixelCount + stats.outOfGamutPixelCount + stats.bothPixelCount, stats.hdrPixelCount);
+    TEST_ASSERT_TRUE(stats.overbrightPixelCount > 0);
+    TEST_ASSERT_TRUE(stats.outOfGamutPixelCount > 0);
+    TEST_ASSERT_TRUE(stats.bothPixelCount > 0);
+
+    // Histogram percentiles land within a bucket of the sorted ones (in PQ for nits), and the extremes are exact
+    float * sortedNits = clAllocate(sizeof(float) * pixelCount);
+    float * sortedSaturation = clAllocate(sizeof(float) * pixelCount);
+    int64_t countedPQ = 0;
+    for (int i = 0; i < pixelCount; ++i) {
+        sortedNits[i] = pixelInfo->pixels[i].nits;
+        sortedSaturation[i] = pixelInfo->pixels[i].saturation;
+    }
+    for (int i = 0; i < CL_QUANTIZATION_BUCKET_COUNT; ++i) {
+        countedPQ += quantization->pixelCountsNitsPQ[i];
+    }
+    TEST_ASSERT_EQUAL_INT64(pixelCount, countedPQ);
+    qsort(sortedNits, pixelCount, sizeof(float), compareTestFloats);
+    qsort(sortedSaturation, pixelCount, sizeof(float), compareTestFloats);
+    TEST_ASSERT_EQUAL_FLOAT(sortedNits[pixelCount - 1], stats.brightestPixelNits);
+    for (int i = 0; i <= 100; ++i) {
+        int index = (i == 100) ? (pixelCount - 1) : (int)((float)i * (float)pixelCount / 100.0f);
+        float expectedPQ = clTransformOETF_PQ(CL_CLAMP(sortedNits[index], 0.0f, 10000.0f) / 10000.0f);
+        float actualPQ = clTransformOETF_PQ(CL_CLAMP(quantization->percentiles[i].nits, 0.0f, 10000.0f) / 10000.0f);
+        TEST_ASSERT_FLOAT_WITHIN(1.0f / 16384.0f, expectedPQ, actualPQ);
+        TEST_ASSERT_FLOAT_WITHIN(2.0f / 16384.0f, sortedSaturation[index], quantization->percentiles[i].saturation);
+    }
+    TEST_ASSERT_EQUAL_FLOAT(sortedNits[0], quantization->percentiles[0].nits);
+    TEST_ASSERT_EQUAL_FLOAT(sortedNits[pixelCount - 1], quantization->percentiles[100].nits);
+
+    // Splitting the work across threads doesn't change any result
+    clImageHDRStats serialStats;
+    clImageHDRQuantization * serialQuantization = clAllocateStruct(clImageHDRQuantization);
+    int jobs = C->jobs;
+    C->jobs = 1;
+    clImageMeasureHDR(C, image, 100, 0.0f, NULL, &serialStats, NULL, serialQuantization);
+    C->jobs = jobs;
+    TEST_ASSERT_EQUAL_MEMORY(&stats, &serialStats, sizeof(clImageHDRStats));
+    TEST_ASSERT_EQUAL_MEMORY(quantization, serialQuantization, sizeof(clImageHDRQuantization));
+
+    clFree(serialQuantization);
+    clFree(sortedSaturation);
+    clFree(sortedNits);
+    clImageHDRPixelInfoDestroy(C, pixelInfo);
+    clFree(quantization);
+    clImageDestroy(C, highlight);
+    clImageDestroy(C, image);
+    clProfileDestroy(C, pq);
+    clContextDestroy(C);
+}
+
+static void fillTestGray(clContext * C, clImage * image, float nits)
+{
+    int pixelCount = image->width * image->height;
+    float pq = clTransformOETF_PQ(nits / 10000.0f);
+    clImagePrepareWritePixels(C, image, CL_PIXELFORMAT_F32);
+    for (int i = 0; i < pixelCount; ++i) {
+        float * pixel = &image->pixelsF32[i * CL_CHANNELS_PER_PIXEL];
+        pixel[0] = pq;
+        pixel[1] = pq;
+        pixel[2] = pq;
+        pixel[3] = 1.0f;
+    }
+}
+
+static void test_hdrAccumulator(void)
+{
+    clContext * C = clContextCreate(&silentSystem);
+    TEST_ASSERT_NOT_NULL(C);
+
+    clProfile * pq = createTestPQProfile(C);
+    clImage * image = createTestHDRImage(C, pq);
+    int pixelCount = image->width * image->height;
+
+    clImageHDRStats stats;
+    clImageHDRQuantization * quantization = clAllocateStruct(clImageHDRQuantization);
+    clImageMeasureHDR(C, image, 100, 0.0f, NULL, &stats, NULL, quantization);
+    TEST_ASSERT_EQUAL_INT(1, stats.frameCount);
+    TEST_ASSERT_TRUE(stats.maxCLL > 0.0f);
+    TEST_ASSERT_TRUE(stats.maxFALL > 0.0f);
+    TEST_ASSERT_TRUE(stats.maxFALL < stats.maxCLL);
+
+    // Adding a whole image matches clImageMeasureHDR() exactly
+    clImageHDRStats accumulatedStats;
+    clImageHDRQuantization * accumulatedQuantization = clAllocateStruct(clImageHDRQuantization);
+    struct clImageHDRAccumulator * accumulator = clImageHDRAccumulatorCreate(C, 100, 0.0f);
+    clImageHDRAccumulatorAddImage(C, accumulator, image);
+    clImageHDRAccumulatorFinish(C, accumulator, &accumulatedStats, accumulatedQuantization);
+    clImageHDRAccumulatorDestroy(C, accumulator);
+    TEST_ASSERT_EQUAL_MEMORY(&stats, &accumulatedStats, sizeof(clImageHDRStats));
+    TEST_ASSERT_EQUAL_MEMORY(quantization, accumulatedQuantization, sizeof(clImageHDRQuantization));
+
+    // So does adding it in uneven strips of rows (only maxFALL's summation order differs)
+    accumulator = clImageHDRAccumulatorCreate(C, 100, 0.0f);
+    for (int y = 0; y < image->height; y += 7) {
+        clImageHDRAccumulatorAddRows(C, accumulator, image, y, CL_MIN(7, image->height - y));
+    }
+    clImageHDRAccumulatorEndFrame(C, accumulator);
+    clImageHDRAccumulatorFinish(C, accumulator, &accumulatedStats, accumulatedQuantization);
+    clImageHDRAccumulatorDestroy(C, accumulator);
+    TEST_ASSERT_EQUAL_INT(1, accumulatedStats.frameCount);
+    TEST_ASSERT_EQUAL_INT64(stats.pixelCount, accumulatedStats.pixelCount);
+    TEST_ASSERT_EQUAL_INT64(stats.overbrightPixelCount, accumulatedStats.overbrightPixelCount);
+    TEST_ASSERT_EQUAL_INT64(stats.outOfGamutPixelCount, accumulatedStats.outOfGamutPixelCount);
+    TEST_ASSERT_EQUAL_INT64(stats.bothPixelCount, accumulatedStats.bothPixelCount);
+    TEST_ASSERT_EQUAL_FLOAT(stats.brightestPixelNits, accumulatedStats.brightestPixelNits);
+    TEST_ASSERT_EQUAL_INT(stats.brightestPixelX, accumulatedStats.brightestPixelX);
+    TEST_ASSERT_EQUAL_INT(stats.brightestPixelY, accumulatedStats.brightestPixelY);
+    TEST_ASSERT_EQUAL_FLOAT(stats.maxCLL, accumulatedStats.maxCLL);
+    TEST_ASSERT_FLOAT_WITHIN(stats.maxFALL * 0.0001f, stats.maxFALL, accumulatedStats.maxFALL);
+    TEST_ASSERT_EQUAL_MEMORY(quantization, accumulatedQuantization, sizeof(clImageHDRQuantization));
+
+    // Uniform frames: MaxCLL is the brightest frame's level, MaxFALL the brightest frame average, and ties keep the first frame
+    clImage * gray = clImageCreate(C, 16, 8, 16, pq);
+    accumulator = clImageHDRAccumulatorCreate(C, 100, 0.0f);
+    fillTestGray(C, gray, 100.0f);
+    clImageHDRAccumulatorAddImage(C, accumulator, gray);
+    fillTestGray(C, gray, 400.0f);
+    clImageHDRAccumulatorAddImage(C, accumulator, gray);
+    clImageHDRAccumulatorAddImage(C, accumulator, gray);
+    fillTestGray(C, gray, 200.0f);
+    clImageHDRAccumulatorAddImage(C, accumulator, gray);
+    clImageHDRAccumulatorAddImage(C, accumulator, image);
+    clImageHDRAccumulatorFinish(C, accumulator, &accumulatedStats, NULL);
+    clImageHDRAccumulatorDestroy(C, accumulator);
+    TEST_ASSERT_EQUAL_INT(5, accumulatedStats.frameCount);
+    TEST_ASSERT_EQUAL_INT64(4 * 16 * 8 + pixelCount, accumulatedStats.pixelCount);
+    TEST_ASSERT_FLOAT_WITHIN(0.5f, CL_MAX(400.0f, stats.maxCLL), accumulatedStats.maxCLL);
+    TEST_ASSERT_FLOAT_WITHIN(0.5f, CL_MAX(400.0f, stats.maxFALL), accumulatedStats.maxFALL);
+    int brightestFrame = (stats.brightestPixelNits > accumulatedStats.brightestPixelNits - 0.5f) ? 4 : 1;
+    TEST_ASSERT_EQUAL_INT(brightestFrame, accumulatedStats.brightestPixelFrame);
+    TEST_ASSERT_EQUAL_INT64(stats.overbrightPixelCount + 3 * 16 * 8, accumulatedStats.overbrightPixelCount);
+
+    // Directories list their regular files, sorted; files aren't directories
+    clFileList * fileList = clFileListCreate(C, "../test");
+    if (fileList) {
+        TEST_ASSERT_TRUE(fileList->count > 0);
+        for (int i = 1; i < fileList->count; ++i) {
+            TEST_ASSERT_TRUE(strcmp(fileList->filenames[i - 1], fileList->filenames[i]) < 0);
+        }
+        TEST_ASSERT_NULL(clFileListCreate(C, fileList->filenames[0]));
+        clFileListDestroy(C, fileList);
+    }
+
+    clImageDestroy(C, gray);
+    clFree(accumulatedQuantization);
+    clFree(quantization);
+    clImageDestroy(C, image);
+    clProfileDestroy(C, pq);
+    clContextDestroy(C);
+}
+
+static void test_imageReduce(void)
+{
+    clContext * C = clContextCreate(&silentSystem);
+    TEST_ASSERT_NOT_NULL(C);
+
+    // Padded rows (a wrapped F32 buffer), enough of them for several parallel parts
+    const int width = 301;
+    const int height = 177;
+    const int rowFloats = (width + 3) * CL_CHANNELS_PER_PIXEL;
+    float * buffer = clAllocate(sizeof(float) * rowFloats * height);
+    double expectedSum[3] = { 0.0, 0.0, 0.0 };
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width + 3; ++x) {
+            float * pixel = &buffer[(y * rowFloats) + (x * CL_CHANNELS_PER_PIXEL)];
+            pixel[0] = (x < width) ? (float)((x * 7 + y * 3) % 101) / 100.0f : 99.0f; // padding is never reduced
+            pixel[1] = (x < width) ? 0.25f - (float)(y % 13) / 10.0f : 99.0f;
+            pixel[2] = (x < width) ? 0.5f : 99.0f;
+            pixel[3] = 99.0f; // neither is alpha
+        }
+    }
+    buffer[(45 * rowFloats) + (123 * CL_CHANNELS_PER_PIXEL) + 1] = 3.0f;
+    buffer[(160 * rowFloats) + (7 * CL_CHANNELS_PER_PIXEL) + 2] = 3.0f; // ties go to the first pixel in row order
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            for (int c = 0; c < 3; ++c) {
+                expectedSum[c] += buffer[(y * rowFloats) + (x * CL_CHANNELS_PER_PIXEL) + c];
+            }
+        }
+    }
+
+    clProfile * profile = clProfileCreateStock(C, CL_PS_SRGB);
+    clImage * image = clImageCreateWrapped(C, width, height, 32, profile, CL_PIXELFORMAT_F32, buffer, rowFloats * sizeof(float));
+    const clPixelReduction * reduction = clImageReduce(C, image);
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, reduction->channelMin[0]);
+    TEST_ASSERT_EQUAL_FLOAT(1.0f, reduction->channelMax[0]);
+    TEST_ASSERT_EQUAL_FLOAT(0.25f - 1.2f, reduction->channelMin[1]);
+    TEST_ASSERT_EQUAL_FLOAT(3.0f, reduction->channelMax[1]);
+    TEST_ASSERT_EQUAL_FLOAT(0.5f, reduction->channelMin[2]);
+    TEST_ASSERT_EQUAL_FLOAT(3.0f, reduction->maxChannel);
+    TEST_ASSERT_EQUAL_INT(123, reduction->maxChannelX);
+    TEST_ASSERT_EQUAL_INT(45, reduction->maxChannelY);
+    for (int c = 0; c < 3; ++c) {
+        TEST_ASSERT_FLOAT_WITHIN(fabs(expectedSum[c]) * 0.00001, expectedSum[c], reduction->channelSum[c]);
+    }
+    double expectedLuma = (0.2126 * expectedSum[0]) + (0.7152 * expectedSum[1]) + (0.0722 * expectedSum[2]);
+    TEST_ASSERT_FLOAT_WITHIN(fabs(expectedLuma) * 0.001, expectedLuma, reduction->lumaSum);
+    TEST_ASSERT_EQUAL_FLOAT(3.0f, clImageLargestChannel(C, image));
+
+    // Borrowed pixels are reduced again every time; the same split on one thread finds the same extremes
+    buffer[(45 * rowFloats) + (123 * CL_CHANNELS_PER_PIXEL) + 1] = 0.0f;
+    int jobs = C->jobs;
+    C->jobs = 1;
+    reduction = clImageReduce(C, image);
+    C->jobs = jobs;
+    TEST_ASSERT_EQUAL_FLOAT(3.0f, reduction->maxChannel);
+    TEST_ASSERT_EQUAL_INT(7, reduction->maxChannelX);
+    TEST_ASSERT_EQUAL_INT(160, reduction->maxChannelY);
+
+    // NaNs are skipped by the min and max, but not the sum
+    buffer[(2 * rowFloats) + (9 * CL_CHANNELS_PER_PIXEL) + 0] = NAN;
+    reduction = clImageReduce(C, image);
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, reduction->channelMin[0]);
+    TEST_ASSERT_EQUAL_FLOAT(1.0f, reduction->channelMax[0]);
+    TEST_ASSERT_TRUE(isnan(reduction->channelSum[0]));
+    clImageDestroy(C, image);
+
+    // Integer pixels are normalized; colorist's own pixels are cached until they're next prepared for writing
+    image = clImageCreate(C, 64, 64, 10, profile);
+    clImagePrepareWritePixels(C, image, CL_PIXELFORMAT_U16);
+    for (int i = 0; i < 64 * 64 * CL_CHANNELS_PER_PIXEL; ++i) {
+        image->pixelsU16[i] = ((i % CL_CHANNELS_PER_PIXEL) == 0) ? 1023 : 0; // pure red
+    }
+    reduction = clImageReduce(C, image);
+    TEST_ASSERT_EQUAL_FLOAT(1.0f, reduction->maxChannel);
+    TEST_ASSERT_EQUAL_INT(0, reduction->maxChannelX);
+    TEST_ASSERT_EQUAL_INT(0, reduction->maxChannelY);
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, reduction->channelMax[1]);
+    TEST_ASSERT_FLOAT_WITHIN(0.001f, 0.2126f, (float)(reduction->lumaSum / (64.0 * 64.0)));
+    TEST_ASSERT_TRUE(reduction == clImageReduce(C, image));
+    clImagePrepareReadPixels(C, image, CL_PIXELFORMAT_F32);
+    TEST_ASSERT_TRUE(image->reduction != NULL);
+    clImagePrepareWritePixels(C, image, CL_PIXELFORMAT_F32);
+    TEST_ASSERT_NULL(image->reduction);
+    image->pixelsF32[(10 * 64 + 20) * CL_CHANNELS_PER_PIXEL + 2] = 1.5f;
+    reduction = clImageReduce(C, image);
+    TEST_ASSERT_EQUAL_FLOAT(1.5f, reduction->maxChannel);
+    TEST_ASSERT_EQUAL_INT(20, reduction->maxChannelX);
+    TEST_ASSERT_EQUAL_INT(10, reduction->maxChannelY);
+    TEST_ASSERT_EQUAL_FLOAT(1.5f, clImageLargestChannel(C, image));
+
+    // Flipping in place moves the largest channel, so it drops the cache too
+    clImageMirrorInPlace(C, image, 1);
+    reduction = clImageReduce(C, image);
+    TEST_ASSERT_EQUAL_INT(63 - 20, reduction->maxChannelX);
+    TEST_ASSERT_EQUAL_INT(10, reduction->maxChannelY);
+    clImageMirrorInPlace(C, image, 0);
+    reduction = clImageReduce(C, image);
+    TEST_ASSERT_EQUAL_INT(63 - 20, reduction->maxChannelX);
+    TEST_ASSERT_EQUAL_INT(63 - 10, reduction->maxChannelY);
+    TEST_ASSERT_TRUE(clImageRotateInPlace(C, image, 2));
+    reduction = clImageReduce(C, image);
+    TEST_ASSERT_EQUAL_INT(20, reduction->maxChannelX);
+    TEST_ASSERT_EQUAL_INT(10, reduction->maxChannelY);
+
+    clImageDestroy(C, image);
+    clProfileDestroy(C, profile);
+    clFree(buffer);
+    clContextDestroy(C);
+}
+
+static void test_pixelFormatConversion(void)
+{
+    clContext * C = clContextCreate(&silentSystem);
+    TEST_ASSERT_NOT_NULL(C);
+
+    // Enough pixels for several parallel ranges, and a channel count that leaves a scalar tail
+    const int width = 257;
+    const int height = 131;
+    const int channelCount = width * height * CL_CHANNELS_PER_PIXEL;
+    const float maxChannel[CL_PIXELFORMAT_COUNT] = { 255.0f, 1023.0f, 1.0f };
+    clImage * image = clImageCreate(C, width, height, 10, NULL);
+    float * reference = clAllocate(sizeof(float) * channelCount);
+
+    for (int srcFormat = 0; srcFormat < CL_PIXELFORMAT_COUNT; ++srcFormat) {
+        // Overranged, negative and exactly-halfway values included
+        clImagePrepareWritePixels(C, image, CL_PIXELFORMAT_F32);
+        for (int i = 0; i < channelCount; ++i) {
+            image->pixelsF32[i] = ((float)(i % 3001) / 2000.0f) - 0.25f;
+        }
+        if (srcFormat != CL_PIXELFORMAT_F32) {
+            clImagePrepareWritePixels(C, image, (clPixelFormat)srcFormat);
+        }
+        for (int i = 0; i < channelCount; ++i) {
+            if (srcFormat == CL_PIXELFORMAT_U8) {
+                reference[i] = image->pixelsU8[i] / maxChannel[srcFormat];
+            } else if (srcFormat == CL_PIXELFORMAT_U16) {
+                reference[i] = image->pixelsU16[i] / maxChannel[srcFormat];
+            } else {
+                reference[i] = image->pixelsF32[i];
+            }
+        }
+
+        for (int dstFormat = 0; dstFormat < CL_PIXELFORMAT_COUNT; ++dstFormat) {
+            if (dstFormat == srcFormat) {
+                continue;
+            }
+            clImagePrepareWritePixels(C, image, (clPixelFormat)srcFormat);
+            clImagePrepareReadPixels(C, image, (clPixelFormat)dstFormat);
+            for (int i = 0; i < channelCount; ++i) {
+                if (dstFormat == CL_PIXELFORMAT_U8) {
+                    TEST_ASSERT_EQUAL_UINT8(clPixelMathRoundUNorm(reference[i], 255), image->pixelsU8[i]);
+                } else if (dstFormat == CL_PIXELFORMAT_U16) {
+                    TEST_ASSERT_EQUAL_UINT16(clPixelMathRoundUNorm(reference[i], 1023), image->pixelsU16[i]);
+                } else {
+                    TEST_ASSERT_EQUAL_FLOAT(reference[i], image->pixelsF32[i]);
+                }
+            }
+        }
+    }
+
+    clFree(reference);
+    clImageDestroy(C, image);
+    clContextDestroy(C);
+}
+
+static void test_transformCache(void)
+{
+    clContext * C = clContextCreate(&silentSystem);
+    TEST_ASSERT_NOT_NULL(C);
+
+    clProfilePrimaries bt2020;
+    clContextGetStockPrimaries(C, "bt2020", &bt2020);
+    clProfileCurve curve;
+    curve.type = CL_PCT_PQ;
+    curve.implicitScale = 1.0f;
+    curve.gamma = 1.0f;
+
+    // Two separately built (but identical) profiles must share a transform
+    clProfile * srgb = clProfileCreateStock(C, CL_PS_SRGB);
+    clProfile * pq1 = clProfileCreate(C, &bt2020, &curve, 10000, NULL);
+    clProfile * pq2 = clProfileCreate(C, &bt2020, &curve, 10000, NULL);
+
+    clTransform * a = clTransformAcquire(C, srgb, CL_XF_RGBA, pq1, CL_XF_RGBA, CL_TONEMAP_OFF, NULL, 0, 0);
+    clTransform * b = clTransformAcquire(C, srgb, CL_XF_RGBA, pq2, CL_XF_RGBA, CL_TONEMAP_OFF, NULL, 0, 0);
+    TEST_ASSERT_EQUAL_PTR(a, b);
+    TEST_ASSERT_EQUAL_INT(1, C->transformCacheHits);
+    TEST_ASSERT_EQUAL_INT(1, C->transformCacheMisses);
+
+    // Anything that changes the prepared transform is part of the key
+    clTransform * c = clTransformAcquire(C, srgb, CL_XF_RGBA, pq1, CL_XF_RGBA16, CL_TONEMAP_OFF, NULL, 0, 10);
+    TEST_ASSERT_TRUE(c != a);
+    TEST_ASSERT_EQUAL_INT(10, c->dstDepth);
+    clTonemapParams tonemapParams;
+    clTonemapParamsSetDefaults(C, &tonemapParams);
+    tonemapParams.contrast = 2.0f;
+    clTransform * d = clTransformAcquire(C, pq1, CL_XF_RGBA, srgb, CL_XF_RGBA, CL_TONEMAP_ON, &tonemapParams, 0, 0);
+    TEST_ASSERT_EQUAL_FLOAT(2.0f, d->tonemapParams.contrast);
+    TEST_ASSERT_EQUAL_INT(3, C->transformCacheMisses);
+
+    // Cached transforms outlive the profiles they were acquired with
+    clTransformRelease(C, a);
+    clTransformRelease(C, b);
+    clTransformRelease(C, c);
+    clTransformRelease(C, d);
+    clProfileDestroy(C, pq2);
+    float src[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+    float dst[4];
+    a = clTransformAcquire(C, srgb, CL_XF_RGBA, pq1, CL_XF_RGBA, CL_TONEMAP_OFF, NULL, 0, 0);
+    TEST_ASSERT_EQUAL_INT(2, C->transformCacheHits);
+    clTransformRun(C, a, src, dst, 1);
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 0.486f, dst[0]); // sRGB white (80 nits) on a 10000 nit PQ curve
+    clTransformRelease(C, a);
+
+    // Filling the cache with other tonemap settings evicts the least recently used entries, never one in use
+    clTransform * held = clTransformAcquire(C, srgb, CL_XF_RGBA, pq1, CL_XF_RGBA, CL_TONEMAP_OFF, NULL, 0, 0);
+    for (int i = 0; i < CL_TRANSFORM_CACHE_CAPACITY; ++i) {
+        tonemapParams.contrast = 1.0f + (float)i;
+        clTransform * t = clTransformAcquire(C, pq1, CL_XF_RGBA, srgb, CL_XF_RGBA, CL_TONEMAP_ON, &tonemapParams, 0, 0);
+        clTransformRelease(C, t);
+    }
+    TEST_ASSERT_TRUE(C->transformCacheEvictions > 0);
+    int hits = C->transformCacheHits;
+    clTransform * again = clTransformAcquire(C, srgb, CL_XF_RGBA, pq1, CL_XF_RGBA, CL_TONEMAP_OFF, NULL, 0, 0);
+    TEST_ASSERT_EQUAL_PTR(held, again);
+    TEST_ASSERT_EQUAL_INT(hits + 1, C->transformCacheHits);
+    clTransformRelease(C, again);
+    clTransformRelease(C, held);
+
+    // Transforms prepared with and without the CCMM aren't interchangeable
+    a = clTransformAcquire(C, srgb, CL_XF_RGBA, pq1, CL_XF_RGBA, CL_TONEMAP_OFF, NULL, 0, 0);
+    C->ccmmAllowed = clFalse;
+    b = clTransformAcquire(C, srgb, CL_XF_RGBA, pq1, CL_XF_RGBA, CL_TONEMAP_OFF, NULL, 0, 0);
+    TEST_ASSERT_TRUE(b != a);
+    clTransformRelease(C, b);
+    clTransformRelease(C, a);
+    C->ccmmAllowed = clTrue;
+
+    clProfileDestroy(C, pq1);
+    clProfileDestroy(C, srgb);
+    clContextDestroy(C);
+}
+
 static void test_types(void)
 {
     clContext * C = clContextCreate(&silentSystem);
@@ -614,6 +2387,28 @@ int test_coverage(void)
     RUN_TEST(test_debugDump);
     RUN_TEST(test_resize);
     RUN_TEST(test_clTask);
+    RUN_TEST(test_colorGradeGamma);
+    RUN_TEST(test_clTaskParallelFor);
+    RUN_TEST(test_ccmmBatch);
+    RUN_TEST(test_lcmsBatch);
+    RUN_TEST(test_transformKernels);
+    RUN_TEST(test_ditheredQuantize);
+    RUN_TEST(test_transformIntegerFormats);
+    RUN_TEST(test_ccmmAccuracy);
+    RUN_TEST(test_stripIO);
+    RUN_TEST(test_pixelFormatConversion);
+    RUN_TEST(test_imageReduce);
+    RUN_TEST(test_wrappedImage);
+    RUN_TEST(test_cropView);
+    RUN_TEST(test_orientation);
+    RUN_TEST(test_resizeKernels);
+    RUN_TEST(test_haldLUT);
+    RUN_TEST(test_bakedLUT);
+    RUN_TEST(test_blend);
+    RUN_TEST(test_renditions);
+    RUN_TEST(test_transformCache);
+    RUN_TEST(test_measureHDR);
+    RUN_TEST(test_hdrAccumulator);
     RUN_TEST(test_types);
     RUN_TEST(test_floorRound);
     RUN_TEST(test_raw);
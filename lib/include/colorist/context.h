@@ -21,6 +21,7 @@ struct clImage;
 struct clProfile;
 struct clProfilePrimaries;
 struct clRaw;
+struct clTaskPool;
 struct cJSON;
 
 #define CL_DIAGNOSTIC_ERROR_SIZE 256
@@ -54,6 +55,37 @@ typedef clBool (*clFormatWriteFunc)(struct clContext * C,
                                     struct clRaw * output,
                                     struct clWriteParams * writeParams);
 
+// Strip I/O (optional per format) lets clContextConvert() stream an image a few rows at a time instead of holding
+// whole decoded images in memory. A strip reader's image only describes the file (width, height, depth, profile; no
+// pixels); readRows() fills the first rowCount rows of a strip (an image of the same width) with the file's next rows,
+// in the pixel format matching the depth: U8 for 8 bits or less, U16 for 9-16, F32 for 32. A strip writer encodes the
+// first rowCount rows of each strip it is given (in any pixel format it likes), and finish() completes the output.
+// Callers may take ownership of a reader's image (NULLing the pointer); readRows() doesn't depend on it.
+typedef struct clFormatStripReader
+{
+    struct clImage * image;
+    clBool (*readRows)(struct clContext * C, struct clFormatStripReader * reader, struct clImage * strip, int rowCount);
+    void (*destroy)(struct clContext * C, struct clFormatStripReader * reader);
+} clFormatStripReader;
+
+typedef struct clFormatStripWriter
+{
+    clBool (*writeRows)(struct clContext * C, struct clFormatStripWriter * writer, struct clImage * strip, int rowCount);
+    clBool (*finish)(struct clContext * C, struct clFormatStripWriter * writer);
+    void (*destroy)(struct clContext * C, struct clFormatStripWriter * writer);
+} clFormatStripWriter;
+
+// Both return NULL if this particular image can't be streamed (the caller falls back to readFunc/writeFunc)
+typedef clFormatStripReader * (*clFormatReadStripsFunc)(struct clContext * C,
+                                                        const char * formatName,
+                                                        struct clProfile * overrideProfile,
+                                                        struct clRaw * input);
+typedef clFormatStripWriter * (*clFormatWriteStripsFunc)(struct clContext * C,
+                                                         struct clImage * image, // dimensions, depth and profile only
+                                                         const char * formatName,
+                                                         struct clRaw * output,
+                                                         struct clWriteParams * writeParams);
+
 typedef enum clFormatDepth
 {
     CL_FORMAT_DEPTH_8 = 0,
@@ -81,6 +113,8 @@ typedef struct clFormat
     clFormatDetectFunc detectFunc;
     clFormatReadFunc readFunc;
     clFormatWriteFunc writeFunc;
+    clFormatReadStripsFunc readStripsFunc;   // optional
+    clFormatWriteStripsFunc writeStripsFunc; // optional
 } clFormat;
 
 clBool clFormatExists(struct clContext * C, const char * formatName);
@@ -123,7 +157,7 @@ typedef enum clFilter
     CL_FILTER_CUBICBSPLINE = 3, // The cubic b-spline (aka Mitchell-Netrevalli with B=1,C=0), gaussian-esque
     CL_FILTER_CATMULLROM = 4,   // An interpolating cubic spline
     CL_FILTER_MITCHELL = 5,     // Mitchell-Netrevalli filter with B=1/3, C=1/3
-    CL_FILTER_NEAREST = 6,      // Doesn't use stb_image_resize, just does an obvious nearest neighbor
+    CL_FILTER_NEAREST = 6,      // Just does an obvious nearest neighbor
 
     CL_FILTER_INVALID = -1
 } clFilter;
@@ -131,6 +165,13 @@ typedef enum clFilter
 clFilter clFilterFromString(struct clContext * C, const char * str);
 const char * clFilterToString(struct clContext * C, clFilter filter);
 
+// How a Hald CLUT is sampled between its lattice points (--hald-interp)
+typedef enum clHaldInterpolation
+{
+    CL_HALD_TETRAHEDRAL = 0, // Blends the 4 corners of the cell's tetrahedron holding the color; keeps neutrals neutral
+    CL_HALD_TRILINEAR        // Blends all 8 corners of the cell
+} clHaldInterpolation;
+
 typedef enum clPixelFormat
 {
     CL_PIXELFORMAT_FIRST = 0,
@@ -191,8 +232,24 @@ typedef struct clContextSystem
     clContextLogErrorFunc error;
 } clContextSystem;
 
+// How a composite's pixels combine with the pixels beneath them (--composite-mode), on premultiplied colors
+typedef enum clBlendMode
+{
+    CL_BLEND_SOURCEOVER = 0, // Porter/Duff SourceOver
+    CL_BLEND_MULTIPLY,       // Darkens: the product of both colors where they overlap
+    CL_BLEND_SCREEN,         // Lightens: the inverse of the product of both inverted colors
+    CL_BLEND_ADD,            // Porter/Duff Plus: the sum of both (alpha clamped to 1)
+    CL_BLEND_MASK,           // Porter/Duff DestinationIn: keeps what's beneath, scaled by the composite's alpha
+
+    CL_BLEND_INVALID = -1
+} clBlendMode;
+
+clBlendMode clBlendModeFromString(struct clContext * C, const char * str);
+const char * clBlendModeToString(struct clContext * C, clBlendMode mode);
+
 typedef struct clBlendParams
 {
+    clBlendMode mode;
     float gamma;               // gamma curve used when blending (instead of blending with a potentially-bad dst curve)
     clTonemap srcTonemap;      // hint to conversion pipeline when converting image to dst profile
     clTonemapParams srcParams; // tonemap params
@@ -223,23 +280,46 @@ typedef struct clReadExtraInfo
     double decodeFillSeconds;     // Time spent filling final clImage RGBA16 buffers
 } clReadExtraInfo;
 
+// An extra, resized output written from the same decode and color conversion (--rendition)
+#define CL_MAX_RENDITIONS 16
+typedef struct clRendition
+{
+    int width;  // 0 to derive it from height and the source's aspect ratio
+    int height; // 0 to derive it from width and the source's aspect ratio
+    const char * filename;
+} clRendition;
+
+// A layer blended on top of the converted image (--composite)
+#define CL_MAX_COMPOSITES 16
+typedef struct clComposite
+{
+    const char * filename;
+    clBlendParams params;
+} clComposite;
+
 typedef struct clConversionParams
 {
     clBool autoGrade;               // -a
     int bpc;                        // -b
     const char * copyright;         // -c
     const char * description;       // -d
+    clBool dither;                  // --dither
     const char * formatName;        // -f
     uint32_t curveType;             // -g
     uint32_t frameIndex;            // --frameindex
     float gamma;                    // -g
     const char * hald;              // --hald
+    clHaldInterpolation haldInterpolation; // --hald-interp
     int luminance;                  // -l
+    int lutBakeSize;                // --lut-bake, 0 to convert exactly
+    const char * lutCacheDir;       // --lut-cache
     const char * iccOverrideOut;    // -o
     float primaries[8];             // -p
-    int resizeW;                    // --resize
-    int resizeH;                    // --resize
-    clFilter resizeFilter;          // --resize
+    clRendition renditions[CL_MAX_RENDITIONS]; // --rendition
+    int renditionCount;                        // --rendition
+    int resizeW;                               // --resize
+    int resizeH;                               // --resize
+    clFilter resizeFilter;                     // --resize, --rendition
     int rotate;                     // --rotate
     const char * stripTags;         // -s
     clBool stats;                   // --stats
@@ -248,8 +328,8 @@ typedef struct clConversionParams
     clWriteParams writeParams;      // -n, -q, -r, --yuv
     const char * readCodec;         // AVIF only. Specify a codec to read with (NULL == auto)
     int rect[4];                    // -z
-    const char * compositeFilename; // --composite
-    clBlendParams compositeParams;  // --composite-gamma, --composite-premultiplied
+    clComposite composites[CL_MAX_COMPOSITES]; // --composite, --composite-*
+    int compositeCount;                        // --composite
 } clConversionParams;
 void clConversionParamsSetDefaults(struct clContext * C, clConversionParams * params);
 
@@ -278,9 +358,16 @@ typedef struct clContext
     int jobs;                      // -j
     clBool verbose;                // -v
     clBool ccmmAllowed;            // --ccmm
+    clBool ccmmFastCurves;         // --ccmm-accuracy
     const char * inputFilename;    // index 0
     const char * outputFilename;   // index 1
     int defaultLuminance;
+
+    struct clTaskPool * taskPool; // Lazily created by clTaskParallelFor(), destroyed with the context
+    struct clTransformCache * transformCache; // Lazily created by clTransformAcquire(), destroyed with the context
+    int transformCacheHits;
+    int transformCacheMisses;
+    int transformCacheEvictions;
 } clContext;
 
 struct clImage;
@@ -306,6 +393,17 @@ clBool clContextParseArgs(clContext * C, int argc, const char * argv[]);
 struct clImage * clContextRead(clContext * C, const char * filename, const char * iccOverride, const char ** outFormatName);
 clBool clContextWrite(clContext * C, struct clImage * image, const char * filename, const char * formatName, clWriteParams * writeParams);
 char * clContextWriteURI(struct clContext * C, struct clImage * image, const char * formatName, clWriteParams * writeParams);
+
+// Strip I/O (see clFormatStripReader); input/output must outlive the returned reader/writer. NULL if unsupported.
+struct clFormatStripReader * clContextReadStrips(clContext * C,
+                                                 const char * formatName,
+                                                 const char * iccOverride,
+                                                 struct clRaw * input);
+struct clFormatStripWriter * clContextWriteStrips(clContext * C,
+                                                  struct clImage * image,
+                                                  const char * formatName,
+                                                  struct clRaw * output,
+                                                  clWriteParams * writeParams);
 void clContextLogWrite(clContext * C, const char * filename, const char * formatName, clWriteParams * writeParams);
 
 clBool clContextGetStockPrimaries(struct clContext * C, const char * name, struct clProfilePrimaries * outPrimaries);
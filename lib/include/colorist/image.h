@@ -17,8 +17,15 @@ static const uint32_t CL_BYTES_PER_CHANNEL[CL_PIXELFORMAT_COUNT] = { (uint32_t)s
                                                                      (uint32_t)sizeof(float) };
 #define CL_BYTES_PER_PIXEL(PIXELFORMAT) (CL_CHANNELS_PER_PIXEL * CL_BYTES_PER_CHANNEL[PIXELFORMAT])
 
+// Smallest block of pixels worth handing to clTaskParallelFor() from a per-pixel image loop
+#define CL_IMAGE_MIN_PIXELS_PER_TASK 256
+
+struct clHaldLUT;
+struct clImageHDRAccumulator;
+struct clPixelReduction;
 struct clProfile;
 struct clRaw;
+struct clTransform;
 struct cJSON;
 
 typedef struct clImage
@@ -34,6 +41,18 @@ typedef struct clImage
     uint8_t * pixelsU8;
     uint16_t * pixelsU16;
     float * pixelsF32;
+
+    // Per plane (indexed by clPixelFormat): the distance in bytes from the start of one row to the next, and
+    // whether the plane is a caller's buffer (see clImageCreateWrapped()) that must never be freed. Planes that
+    // colorist allocates itself are always tightly packed (width * CL_BYTES_PER_PIXEL()).
+    int rowBytes[CL_PIXELFORMAT_COUNT];
+    clBool borrowed[CL_PIXELFORMAT_COUNT];
+
+    // The source of a crop view that took ownership of it (see clImageCrop()); destroyed once nothing borrows from it
+    struct clImage * viewParent;
+
+    // Cached by clImageReduce() until the pixels next change (are prepared for writing, or flipped in place)
+    struct clPixelReduction * reduction;
 } clImage;
 
 typedef struct clImageSignals
@@ -104,14 +123,18 @@ void clImageHDRPixelInfoDestroy(struct clContext * C, clImageHDRPixelInfo * pixe
 
 typedef struct clImageHDRStats
 {
-    int overbrightPixelCount;
-    int outOfGamutPixelCount;
-    int bothPixelCount; // overbright + out-of-gamut
-    int hdrPixelCount;  // the sum of the above values
-    int pixelCount;
+    int64_t overbrightPixelCount;
+    int64_t outOfGamutPixelCount;
+    int64_t bothPixelCount; // overbright + out-of-gamut
+    int64_t hdrPixelCount;  // the sum of the above values
+    int64_t pixelCount;
+    int frameCount;
+    int brightestPixelFrame;
     int brightestPixelX;
     int brightestPixelY;
     float brightestPixelNits;
+    float maxCLL;  // nits, the brightest linear R, G, or B of any pixel (CTA-861.3 MaxCLL)
+    float maxFALL; // nits, the brightest frame's average of that per pixel (CTA-861.3 MaxFALL)
 } clImageHDRStats;
 
 typedef struct clImageHDRPercentile
@@ -124,22 +147,60 @@ typedef struct clImageHDRPercentile
 typedef struct clImageHDRQuantization
 {
     clImageHDRPercentile percentiles[101];
-    int pixelCountsNitsPQ[CL_QUANTIZATION_BUCKET_COUNT];     // pixels counts quantized into nits values on the PQ curve
-    int pixelCountsSaturation[CL_QUANTIZATION_BUCKET_COUNT]; // pixel counts quantized from (0-1 / 1023), see saturation comment above
+    int64_t pixelCountsNitsPQ[CL_QUANTIZATION_BUCKET_COUNT];     // pixels counts quantized into nits values on the PQ curve
+    int64_t pixelCountsSaturation[CL_QUANTIZATION_BUCKET_COUNT]; // pixel counts quantized from (0-1 / 1023), see saturation comment above
 } clImageHDRQuantization;
 
 clImage * clImageCreate(struct clContext * C, int width, int height, int depth, struct clProfile * profile);
+// Wraps a caller's buffer as the image's pixelFormat plane without copying it (rowBytes of 0 means tightly packed).
+// The buffer is never freed by colorist and must outlive the image.
+clImage * clImageCreateWrapped(struct clContext * C,
+                               int width,
+                               int height,
+                               int depth,
+                               struct clProfile * profile,
+                               clPixelFormat pixelFormat,
+                               void * pixels,
+                               int rowBytes);
 clImage * clImageRotate(struct clContext * C, clImage * image, int cwTurns);
 clImage * clImageMirror(struct clContext * C, clImage * image, int horizontal); // if horizontal is false, mirror vertically
+// In-place versions of the above for orientations that keep the image's dimensions. clImageRotateInPlace() returns
+// clFalse (leaving the image alone) for 1 or 3 turns. Borrowed planes are copied first.
+clBool clImageRotateInPlace(struct clContext * C, clImage * image, int cwTurns);
+void clImageMirrorInPlace(struct clContext * C, clImage * image, int horizontal);
 clImage * clImageConvert(struct clContext * C,
                          clImage * srcImage,
                          int depth,
                          struct clProfile * dstProfile,
                          clTonemap tonemap,
-                         clTonemapParams * tonemapParams);
+                         clTonemapParams * tonemapParams,
+                         clBool dither); // if true, integer dst pixels are ordered dithered instead of rounded
+// The (prepared, logged) transform clImageConvert() runs between images' pixels; tonemap must already be resolved.
+// Hand it back with clTransformRelease().
+struct clTransform * clImageConvertTransformAcquire(struct clContext * C,
+                                                    clImage * srcImage,
+                                                    clPixelFormat srcPixelFormat,
+                                                    clImage * dstImage,
+                                                    clPixelFormat dstPixelFormat,
+                                                    clTonemap tonemap,
+                                                    clTonemapParams * tonemapParams);
+// Returns a view borrowing srcImage's planes in place; pixels are only copied once something needs them packed. If
+// keepSrc is true, srcImage must outlive the view (and not drop the planes it borrows), otherwise the view owns it.
 clImage * clImageCrop(struct clContext * C, clImage * srcImage, int x, int y, int w, int h, clBool keepSrc);
-clImage * clImageApplyHALD(struct clContext * C, clImage * image, clImage * hald, int haldDims);
+// Fills dstImage (same dimensions, may be srcImage) with srcImage's pixels looked up in lut, at the pixel formats both
+// already hold (integer pixels are rounded as a F32 round-trip would). Applies a Hald, or a --lut-bake conversion.
+void clImageApplyHaldLUT(struct clContext * C, clImage * srcImage, clImage * dstImage, const struct clHaldLUT * lut);
 clImage * clImageResize(struct clContext * C, clImage * image, int width, int height, clFilter resizeFilter);
+// Blends compositeImage (with blendParams' mode, at its offset, which may be negative) onto image in place. Only the
+// rectangle they share is converted into blend space and back; the rest of image is left untouched.
+clBool clImageBlendInPlace(struct clContext * C, clImage * image, clImage * compositeImage, clBlendParams * blendParams);
+// Same as blending each of compositeImages onto image in order, each with its own blendParams, but in a single pass:
+// every pixel they cover goes into blend space (blendParams[0]'s gamma and srcTonemap) and back only once.
+clBool clImageBlendLayersInPlace(struct clContext * C,
+                                 clImage * image,
+                                 int layerCount,
+                                 clImage ** compositeImages,
+                                 clBlendParams * blendParams);
 clImage * clImageBlend(struct clContext * C, clImage * image, clImage * compositeImage, clBlendParams * blendParams);
 void clImageMeasureHDR(clContext * C,
                        clImage * srcImage,
@@ -149,8 +210,34 @@ void clImageMeasureHDR(clContext * C,
                        clImageHDRStats * outStats,
                        clImageHDRPixelInfo * outPixelInfo,
                        clImageHDRQuantization * outQuantization);
+// Accumulates clImageMeasureHDR()'s stats and quantization over any number of frames (each added whole, or a strip of
+// rows at a time followed by clImageHDRAccumulatorEndFrame()) in memory that doesn't grow with image size or frame count.
+// Frames may have different sizes and profiles.
+struct clImageHDRAccumulator * clImageHDRAccumulatorCreate(struct clContext * C, int srgbLuminance, float satLuminance);
+void clImageHDRAccumulatorAddRows(struct clContext * C,
+                                  struct clImageHDRAccumulator * accumulator,
+                                  clImage * image,
+                                  int firstRow,
+                                  int rowCount);
+void clImageHDRAccumulatorEndFrame(struct clContext * C, struct clImageHDRAccumulator * accumulator);
+void clImageHDRAccumulatorAddImage(struct clContext * C, struct clImageHDRAccumulator * accumulator, clImage * image);
+// Totals everything added so far (a frame still open counts towards all but MaxFALL); either output may be NULL
+void clImageHDRAccumulatorFinish(struct clContext * C,
+                                 struct clImageHDRAccumulator * accumulator,
+                                 clImageHDRStats * outStats,
+                                 clImageHDRQuantization * outQuantization);
+void clImageHDRAccumulatorDestroy(struct clContext * C, struct clImageHDRAccumulator * accumulator);
+// These guarantee a tightly packed plane, so a borrowed plane with padded rows is first copied into one of colorist's own.
+// clImagePrepareWritePixels() also copies borrowed planes that are already packed, so writes never reach a caller's
+// buffer or a crop view's source.
 void clImagePrepareReadPixels(struct clContext * C, clImage * image, clPixelFormat pixelFormat);
 void clImagePrepareWritePixels(struct clContext * C, clImage * image, clPixelFormat pixelFormat);
+// Same as above, but borrowed planes are used in place (writes land in the caller's buffer); rows must be addressed
+// with clImagePixelRow()
+void clImagePrepareReadRows(struct clContext * C, clImage * image, clPixelFormat pixelFormat);
+void clImagePrepareWriteRows(struct clContext * C, clImage * image, clPixelFormat pixelFormat);
+uint8_t * clImagePixelRow(struct clContext * C, clImage * image, clPixelFormat pixelFormat, int y);
+clBool clImageIsPacked(struct clContext * C, clImage * image, clPixelFormat pixelFormat);
 clBool clImageAdjustRect(struct clContext * C, clImage * image, int * x, int * y, int * w, int * h);
 void clImageColorGrade(struct clContext * C, clImage * image, int dstColorDepth, int * outLuminance, float * outGamma, clBool verbose);
 void clImageDebugDump(struct clContext * C, clImage * image, int x, int y, int w, int h, int extraIndent);
@@ -160,8 +247,19 @@ void clImageDestroy(struct clContext * C, clImage * image);
 void clImageLogCreate(struct clContext * C, int width, int height, int depth, struct clProfile * profile);
 clImage * clImageParseString(struct clContext * C, const char * str, int depth, struct clProfile * profile);
 clBool clImageCalcSignals(struct clContext * C, clImage * srcImage, clImage * dstImage, clImageSignals * signals);
+// Min/max/sum of the image's most precise RGB channels (luma weighted by its profile's primaries), computed in parallel
+// once and then cached until the pixels next change. Borrowed pixels (see clImageCreateWrapped()) are
+// never cached, as their owner can change them at any time. The result is valid until the next call or pixel write.
+const struct clPixelReduction * clImageReduce(struct clContext * C, clImage * image);
 float clImageLargestChannel(struct clContext * C, clImage * image);
 float clImagePeakLuminance(struct clContext * C, clImage * image); // Doesn't return maxCLL, but the lum of (largestChannel, largestChannel, largestChannel)
+float clImageChannelLuminance(struct clContext * C, struct clProfile * profile, float channelValue); // lum of (v, v, v)
+// Resolves CL_TONEMAP_AUTO for a conversion to dstDepth/dstProfile of an image measured with clImagePeakLuminance()
+clTonemap clImageAutoTonemap(struct clContext * C,
+                             float srcPeakLuminance,
+                             int dstDepth,
+                             struct clProfile * dstProfile,
+                             clBool verbose);
 void clImageClear(struct clContext * C, clImage * image, float color[4]);
 void clImageDrawCIE(struct clContext * C, clImage * image, float borderColor[4], int borderThickness);
 void clImageDrawGamut(struct clContext * C,
@@ -16,9 +16,34 @@ struct clProfile;
 
 float clPixelMathRoundf(float val);
 uint32_t clPixelMathRoundUNorm(float val, uint32_t maxValue);
+uint32_t clPixelMathDitherUNorm(float val, uint32_t maxValue, float threshold); // threshold in [0,1); 0.5 rounds
 float clPixelMathFloorf(float val);
 clBool clPixelMathEqualsf(float a, float b);
 float clPixelMathRoundNormalized(float normalizedValue, float factor); // Clamps normalizedValue int [0,1], then scales by factor, then rounds. Used in unorm conversion
+
+// Whole-plane reductions over RGB (alpha is ignored), with integer channels normalized by their max value
+typedef struct clPixelReduction
+{
+    float channelMin[3];
+    float channelMax[3];
+    double channelSum[3];
+    double lumaSum;   // channelSum weighted by the lumaWeights given to clPixelMathReduce()
+    float maxChannel; // the largest channel of any pixel, but never below 0
+    int maxChannelX;  // the first pixel (in row order) with maxChannel, or 0,0 if maxChannel is 0
+    int maxChannelY;
+} clPixelReduction;
+
+// Reduces width x height pixels (rows rowBytes apart, integer channels scaled by maxValue) in parallel
+void clPixelMathReduce(struct clContext * C,
+                       clPixelFormat pixelFormat,
+                       const uint8_t * pixels,
+                       int rowBytes,
+                       int width,
+                       int height,
+                       uint32_t maxValue,
+                       const float lumaWeights[3],
+                       clPixelReduction * outReduction);
+
 void clPixelMathColorGrade(struct clContext * C,
                            struct clProfile * pixelProfile,
                            float * pixels,
@@ -29,7 +54,46 @@ void clPixelMathColorGrade(struct clContext * C,
                            int * outLuminance,
                            float * outGamma,
                            clBool verbose);
+// As clPixelMathColorGrade(), with a precomputed reduction of the (tightly packed) pixels for the max luminance search
+void clPixelMathColorGradeWithReduction(struct clContext * C,
+                                        struct clProfile * pixelProfile,
+                                        float * pixels,
+                                        int pixelCount,
+                                        int imageWidth,
+                                        const clPixelReduction * reduction,
+                                        int srcLuminance,
+                                        int dstColorDepth,
+                                        int * outLuminance,
+                                        float * outGamma,
+                                        clBool verbose);
+// Resizes RGBA float pixels (alpha-weighted, edges clamped) in parallel; negative results are clamped to 0
 void clPixelMathResize(struct clContext * C, int srcW, int srcH, float * srcPixels, int dstW, int dstH, float * dstPixels, clFilter filter);
-void clPixelMathHaldCLUTLookup(struct clContext * C, float * haldData, int haldDims, const float src[4], float dst[4]);
+
+// A Hald CLUT repacked once into a haldDims^3 cube of lattice points (4 floats each: RGB and padding), red varying fastest
+typedef struct clHaldLUT
+{
+    int dims;
+    clHaldInterpolation interpolation;
+    float * cube;
+} clHaldLUT;
+
+// haldPixels are the Hald image's tightly packed F32 pixels; returns NULL if haldDims is too small to interpolate
+clHaldLUT * clHaldLUTCreate(struct clContext * C, const float * haldPixels, int haldDims, clHaldInterpolation interpolation);
+void clHaldLUTDestroy(struct clContext * C, clHaldLUT * lut);
+// Looks up the RGB of pixelCount RGBA float pixels (clamped to [0,1] first) and copies alpha; srcPixels may be dstPixels
+void clPixelMathHaldLUTApply(struct clContext * C,
+                             const clHaldLUT * lut,
+                             const float * srcPixels,
+                             float * dstPixels,
+                             int pixelCount);
+
+// dstPixels = cmpPixels blended onto dstPixels with mode, on pixelCount RGBA float pixels. If premultiplied is false,
+// both sides' colors are multiplied by their own alpha during the blend (and the result is left premultiplied).
+void clPixelMathBlend(struct clContext * C,
+                      clBlendMode mode,
+                      const float * cmpPixels,
+                      float * dstPixels,
+                      int pixelCount,
+                      clBool premultiplied);
 
 #endif
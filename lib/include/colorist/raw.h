@@ -33,4 +33,15 @@ clBool clRawReadFile(struct clContext * C, clRaw * raw, const char * filename);
 clBool clRawReadFileHeader(struct clContext * C, clRaw * raw, const char * filename, size_t bytes);
 clBool clRawWriteFile(struct clContext * C, clRaw * raw, const char * filename);
 
+// The regular files in a directory, sorted by name, each joined onto the directory's path
+typedef struct clFileList
+{
+    int count;
+    char ** filenames;
+} clFileList;
+
+// NULL if dirName isn't a directory that can be listed
+clFileList * clFileListCreate(struct clContext * C, const char * dirName);
+void clFileListDestroy(struct clContext * C, clFileList * fileList);
+
 #endif
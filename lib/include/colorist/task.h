@@ -11,9 +11,13 @@
 #include "colorist/types.h"
 
 struct clContext;
+struct clTaskPool;
 
 typedef void (*clTaskFunc)(void * userData);
 
+// Invoked once per contiguous range of items by clTaskParallelFor(), [firstItem, firstItem + itemCount)
+typedef void (*clTaskRangeFunc)(void * userData, int firstItem, int itemCount);
+
 typedef struct clTask
 {
     clTaskFunc func;
@@ -27,4 +31,15 @@ void clTaskJoin(struct clContext * C, clTask * task);
 void clTaskDestroy(struct clContext * C, clTask * task);
 int clTaskLimit(void);
 
+// Splits [0, itemCount) into blocks of at least minItemsPerRange items each, and runs func on every
+// block using the context's persistent worker pool (the calling thread works too). Each thread starts
+// on its own contiguous run of blocks and steals from the others once it runs dry, so uneven per-item
+// cost still balances. The pool is created lazily on first use and is owned/destroyed by the clContext.
+// Calls made from inside a running func (nested parallel-for) simply run inline on the calling thread.
+void clTaskParallelFor(struct clContext * C, int itemCount, int minItemsPerRange, clTaskRangeFunc func, void * userData);
+void clTaskPoolDestroy(struct clContext * C, struct clTaskPool * pool);
+
+// Logs (and resets) how long each pool thread has spent inside parallel-for funcs, calling thread first
+void clTaskLogBusyTime(struct clContext * C);
+
 #endif // ifndef COLORIST_TASK_H
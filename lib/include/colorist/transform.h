@@ -18,16 +18,20 @@
 #include "lcms2.h"
 
 struct clContext;
+struct clHaldLUT;
 struct clProfile;
 struct clProfilePrimaries;
+struct clTransformCache;
 
 // Why the X's in these enums? Transform, XForm, get it? (I needed to disambiguate)
 
 typedef enum clTransformFormat
 {
     CL_XF_XYZ = 0, // 3 component, 32bit float
-    CL_XF_RGB,     // 3 component, 32bit == float, 8bit == uint8_t, 9-16bit == uint16_t
-    CL_XF_RGBA     // 4 component, 32bit == float, 8bit == uint8_t, 9-16bit == uint16_t
+    CL_XF_RGB,     // 3 component, 32bit float
+    CL_XF_RGBA,    // 4 component, 32bit float
+    CL_XF_RGBA8,   // 4 component, uint8_t
+    CL_XF_RGBA16   // 4 component, uint16_t holding srcDepth/dstDepth bits per channel
 } clTransformFormat;
 
 typedef enum clTransformTransferFunction
@@ -39,6 +43,15 @@ typedef enum clTransformTransferFunction
     CL_XTF_PQ
 } clTransformTransferFunction;
 
+// How much of the CCMM pipeline a prepared transform actually needs
+typedef enum clTransformKernel
+{
+    CL_XK_FULL = 0, // EOTF, to XYZ, luminance scale/tonemap, from XYZ, OETF
+    CL_XK_MATRIX,   // EOTF, one combined 3x3, OETF (no luminance scaling between the two profiles)
+    CL_XK_CURVE,    // EOTF, OETF (same primaries too)
+    CL_XK_IDENTITY  // Same primaries and curves; pixels are only repacked
+} clTransformKernel;
+
 // clTransform does not own either clProfile and it is expected that both will outlive the clTransform that uses them
 typedef struct clTransform
 {
@@ -46,6 +59,8 @@ typedef struct clTransform
     struct clProfile * dstProfile; // If NULL, is XYZ profile
     clTransformFormat srcFormat;
     clTransformFormat dstFormat;
+    int srcDepth; // Bits per channel (9-16) of a CL_XF_RGBA16 src, must be set prior to clTransformPrepare()
+    int dstDepth; // Bits per channel (9-16) of a CL_XF_RGBA16 dst
     float whitePointX;
     float whitePointY;
     float srcCurveScale;
@@ -58,6 +73,7 @@ typedef struct clTransform
     clBool luminanceScaleEnabled; // optimization; if false, avoid all luminance scaling math
 
     // Cache for CCMM objects
+    clTransformKernel ccmmKernel;
     clTransformTransferFunction ccmmSrcEOTF;
     clTransformTransferFunction ccmmDstOETF;
     float ccmmSrcGamma;
@@ -66,6 +82,10 @@ typedef struct clTransform
     gbMat3 ccmmXYZToDst;
     gbMat3 ccmmCombined;
     float ccmmHLGLuminance;
+    float ccmmHLGExponent;    // HLG OOTF exponent derived from ccmmHLGLuminance
+    float * ccmmSrcEOTFTable; // Curve lookup tables, only built with --ccmm-accuracy fast (C->ccmmFastCurves)
+    float * ccmmDstOETFTable;
+    float * ccmmSrcIntegerTable; // EOTF(i / maxChannel) for every value of an integer src format
     clBool ccmmReady;
 
     // Cache for LittleCMS objects
@@ -87,7 +107,55 @@ void clTransformPrepare(struct clContext * C, struct clTransform * transform);
 clBool clTransformUsesCCMM(struct clContext * C, clTransform * transform);
 const char * clTransformCMMName(struct clContext * C, clTransform * transform);    // Convenience function
 float clTransformGetLuminanceScale(struct clContext * C, clTransform * transform); // Convenience function
-void clTransformRun(struct clContext * C, clTransform * transform, float * srcPixels, float * dstPixels, int pixelCount);
+void clTransformRun(struct clContext * C, clTransform * transform, void * srcPixels, void * dstPixels, int pixelCount);
+// Same as clTransformRun() on rowCount full rows starting at firstRow of a width-wide image, but integer dst formats are
+// quantized with an 8x8 ordered (Bayer) dither keyed on each pixel's image position instead of being rounded
+void clTransformRunDithered(struct clContext * C,
+                            clTransform * transform,
+                            void * srcPixels,
+                            void * dstPixels,
+                            int width,
+                            int firstRow,
+                            int rowCount);
+
+// Shared, already prepared transforms from a small per-context LRU cache, keyed on both profiles' signatures, the formats,
+// integer depths (0 for the default of 16) and tonemap settings (NULL params for the defaults). Callers must not modify
+// an acquired transform, and must hand it back with clTransformRelease() instead of clTransformDestroy(). The cache isn't
+// locked: acquire and release only on the thread that owns C, never from inside a clTask or clTaskParallelFor() callback.
+#define CL_TRANSFORM_CACHE_CAPACITY 16
+clTransform * clTransformAcquire(struct clContext * C,
+                                 struct clProfile * srcProfile,
+                                 clTransformFormat srcFormat,
+                                 struct clProfile * dstProfile,
+                                 clTransformFormat dstFormat,
+                                 clTonemap tonemap,
+                                 const clTonemapParams * tonemapParams,
+                                 int srcDepth,
+                                 int dstDepth);
+void clTransformRelease(struct clContext * C, clTransform * transform);
+void clTransformCacheDestroy(struct clContext * C, struct clTransformCache * cache);
+// MD5 of a profile's ICC payload, ignoring its creation date and profile ID (what the transform caches are keyed on)
+void clTransformProfileSignature(struct clProfile * profile, uint8_t signature[16]);
+// Whether transforms involving profile can be cached: it has a signature, or is NULL (XYZ)
+clBool clTransformProfileIsIdentifiable(struct clProfile * profile);
+
+// Baked conversions (--lut-bake): a CL_XF_RGBA -> CL_XF_RGBA transform (followed by hald, if any) sampled on a dims^3
+// lattice of [0,1] inputs. If cacheDir is set, an identical earlier bake saved there is loaded instead (and new bakes
+// are saved there), keyed on the profiles' signatures, tonemap settings, CMM choices, dims and the hald's contents and
+// interpolation.
+struct clHaldLUT * clTransformBakeLUT(struct clContext * C,
+                                      clTransform * transform,
+                                      const struct clHaldLUT * hald,
+                                      int dims,
+                                      const char * cacheDir);
+// Largest and mean per-channel difference (output clamped to [0,1]) between lut and the exact pipeline, at the center of
+// every lattice cell (where interpolation is furthest from the baked samples)
+void clTransformMeasureBakedLUT(struct clContext * C,
+                                clTransform * transform,
+                                const struct clHaldLUT * hald,
+                                const struct clHaldLUT * lut,
+                                float * outMaxError,
+                                float * outMeanError);
 
 // if X+Y+Z is 0, clTransformXYZToXYY() returns (whitePointX, whitePointY, 0)
 void clTransformXYZToXYY(struct clContext * C, float * dstXYY, const float * srcXYZ, float whitePointX, float whitePointY);
@@ -95,8 +163,12 @@ void clTransformXYYToXYZ(struct clContext * C, float * dstXYZ, const float * src
 
 int clTransformCalcHLGLuminance(int diffuseWhite);
 int clTransformCalcDefaultLuminanceFromHLG(int hlgLuminance);
-float clTransformCalcMaxY(clContext * C, clTransform * linearFromXYZ, clTransform * linearToXYZ, float x, float y);
+// The largest Y (relative to white's 1) a color with chromaticity x,y can have in the gamut fromXYZ converts to, in closed
+// form: the Y at which its largest linear RGB channel reaches 1
+float clTransformCalcMaxY(clContext * C, const gbMat3 * fromXYZ, float x, float y);
 void clTransformDeriveXYZMatrix(struct clContext * C, struct clProfilePrimaries * primaries, gbMat3 * toXYZ);
+// The inverse of clTransformDeriveXYZMatrix()'s, laid out for gb_mat3_mul_vec3() (as the CCMM applies it)
+void clTransformDeriveFromXYZMatrix(struct clContext * C, struct clProfilePrimaries * primaries, gbMat3 * fromXYZ);
 
 float clTransformEOTF_PQ(float N);
 float clTransformOETF_PQ(float L);
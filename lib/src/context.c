@@ -350,6 +350,45 @@ const char * clFilterToString(struct clContext * C, clFilter filter)
     return "invalid";
 }
 
+clBlendMode clBlendModeFromString(struct clContext * C, const char * str)
+{
+    COLORIST_UNUSED(C);
+
+    if (!strcmp(str, "sourceover"))
+        return CL_BLEND_SOURCEOVER;
+    if (!strcmp(str, "multiply"))
+        return CL_BLEND_MULTIPLY;
+    if (!strcmp(str, "screen"))
+        return CL_BLEND_SCREEN;
+    if (!strcmp(str, "add"))
+        return CL_BLEND_ADD;
+    if (!strcmp(str, "mask"))
+        return CL_BLEND_MASK;
+    return CL_BLEND_INVALID;
+}
+
+const char * clBlendModeToString(struct clContext * C, clBlendMode mode)
+{
+    COLORIST_UNUSED(C);
+
+    switch (mode) {
+        case CL_BLEND_SOURCEOVER:
+            return "sourceover";
+        case CL_BLEND_MULTIPLY:
+            return "multiply";
+        case CL_BLEND_SCREEN:
+            return "screen";
+        case CL_BLEND_ADD:
+            return "add";
+        case CL_BLEND_MASK:
+            return "mask";
+        case CL_BLEND_INVALID:
+        default:
+            break;
+    }
+    return "invalid";
+}
+
 // ------------------------------------------------------------------------------------------------
 // clYUVFormat
 
@@ -409,13 +448,18 @@ void clConversionParamsSetDefaults(clContext * C, clConversionParams * params)
 {
     clConversionParamsSetOutputProfileDefaults(C, params);
     params->bpc = 0;
+    params->dither = clFalse;
     params->formatName = NULL;
     params->hald = NULL;
+    params->haldInterpolation = CL_HALD_TETRAHEDRAL;
     params->iccOverrideOut = NULL;
+    params->lutBakeSize = 0;
+    params->lutCacheDir = NULL;
     params->rect[0] = 0;
     params->rect[1] = 0;
     params->rect[2] = -1;
     params->rect[3] = -1;
+    params->renditionCount = 0;
     params->resizeW = 0;
     params->resizeH = 0;
     params->resizeFilter = CL_FILTER_AUTO;
@@ -425,9 +469,9 @@ void clConversionParamsSetDefaults(clContext * C, clConversionParams * params)
     params->tonemap = CL_TONEMAP_AUTO;
     params->readCodec = NULL;
     clTonemapParamsSetDefaults(C, &params->tonemapParams);
-    params->compositeFilename = NULL;
+    params->compositeCount = 0;
     clWriteParamsSetDefaults(C, &params->writeParams);
-    clBlendParamsSetDefaults(C, &params->compositeParams);
+    clBlendParamsSetDefaults(C, &params->composites[0].params);
 }
 
 void clWriteParamsSetDefaults(struct clContext * C, clWriteParams * writeParams)
@@ -458,6 +502,7 @@ static void clContextSetDefaultArgs(clContext * C)
     C->jobs = clTaskLimit();
     C->verbose = clFalse;
     C->ccmmAllowed = clTrue;
+    C->ccmmFastCurves = clFalse;
     C->inputFilename = NULL;
     C->outputFilename = NULL;
     C->defaultLuminance = COLORIST_DEFAULT_LUMINANCE;
@@ -487,6 +532,11 @@ clContext * clContextCreate(clContextSystem * system)
 
     // TODO: hook up memory management plugin to route through C->system.alloc
     C->lcms = cmsCreateContext(NULL, NULL);
+    C->taskPool = NULL;
+    C->transformCache = NULL;
+    C->transformCacheHits = 0;
+    C->transformCacheMisses = 0;
+    C->transformCacheEvictions = 0;
 
     // Clue in LittleCMS that we intend to do absolute colorimetric conversions
     // on profiles that use white points other than D50 (profiles containing a
@@ -508,6 +558,10 @@ void clContextDestroy(clContext * C)
         clFree(freeme);
     }
     C->formats = NULL;
+    clTaskPoolDestroy(C, C->taskPool);
+    C->taskPool = NULL;
+    clTransformCacheDestroy(C, C->transformCache);
+    C->transformCache = NULL;
     cmsDeleteContext(C->lcms);
     clFree(C);
 }
@@ -737,6 +791,61 @@ static clBool parseResize(clContext * C, clConversionParams * params, const char
     return clTrue;
 }
 
+// The layer --composite-* options apply to: the latest --composite, or the first one if none has been named yet
+static clBlendParams * currentCompositeParams(clConversionParams * params)
+{
+    return &params->composites[(params->compositeCount > 0) ? (params->compositeCount - 1) : 0].params;
+}
+
+static clBool parseComposite(clContext * C, clConversionParams * params, const char * arg)
+{
+    if (params->compositeCount >= CL_MAX_COMPOSITES) {
+        clContextLogError(C, "Too many --composite layers (max %d)", CL_MAX_COMPOSITES);
+        return clFalse;
+    }
+
+    // Each layer starts with the previous layer's settings (or whatever was set before the first --composite)
+    clComposite * composite = &params->composites[params->compositeCount];
+    if (params->compositeCount > 0) {
+        memcpy(&composite->params, &params->composites[params->compositeCount - 1].params, sizeof(clBlendParams));
+    }
+    composite->filename = arg;
+    ++params->compositeCount;
+    return clTrue;
+}
+
+// w,h,filename (filename is everything after the second comma)
+static clBool parseRendition(clContext * C, clConversionParams * params, const char * arg)
+{
+    if (params->renditionCount >= CL_MAX_RENDITIONS) {
+        clContextLogError(C, "Too many --rendition outputs (max %d)", CL_MAX_RENDITIONS);
+        return clFalse;
+    }
+
+    const char * heightStart = strchr(arg, ',');
+    const char * filename = heightStart ? strchr(heightStart + 1, ',') : NULL;
+    if (!filename || !isdigit(arg[0]) || !isdigit(heightStart[1]) || (filename[1] == 0)) {
+        clContextLogError(C, "--rendition expects w,h,filename: %s", arg);
+        return clFalse;
+    }
+    ++filename;
+
+    clRendition * rendition = &params->renditions[params->renditionCount];
+    rendition->width = atoi(arg);
+    rendition->height = atoi(heightStart + 1);
+    rendition->filename = filename;
+    if ((rendition->width == 0) && (rendition->height == 0)) {
+        clContextLogError(C, "--rendition missing at least one non-zero dimension");
+        return clFalse;
+    }
+    if (!clFormatDetect(C, filename)) {
+        clContextLogError(C, "Unknown --rendition output format: %s", filename);
+        return clFalse;
+    }
+    ++params->renditionCount;
+    return clTrue;
+}
+
 #define NEXTARG()                                                     \
     if (((argIndex + 1) == argc) || (argv[argIndex + 1][0] == '-')) { \
         clContextLogError(C, "%s requires an argument.", arg);        \
@@ -772,6 +881,8 @@ clBool clContextParseArgs(clContext * C, int argc, const char * argv[])
             } else if (!strcmp(arg, "-d") || !strcmp(arg, "--description")) {
                 NEXTARG();
                 C->params.description = arg;
+            } else if (!strcmp(arg, "--dither")) {
+                C->params.dither = clTrue;
             } else if (!strcmp(arg, "-f") || !strcmp(arg, "--format")) {
                 NEXTARG();
                 C->params.formatName = arg;
@@ -802,6 +913,26 @@ clBool clContextParseArgs(clContext * C, int argc, const char * argv[])
             } else if (!strcmp(arg, "--hald")) {
                 NEXTARG();
                 C->params.hald = arg;
+            } else if (!strcmp(arg, "--hald-interp")) {
+                NEXTARG();
+                if (!strcmp(arg, "tetrahedral")) {
+                    C->params.haldInterpolation = CL_HALD_TETRAHEDRAL;
+                } else if (!strcmp(arg, "trilinear")) {
+                    C->params.haldInterpolation = CL_HALD_TRILINEAR;
+                } else {
+                    clContextLogError(C, "Unknown Hald interpolation: %s", arg);
+                    return clFalse;
+                }
+            } else if (!strcmp(arg, "--lut-bake")) {
+                NEXTARG();
+                C->params.lutBakeSize = atoi(arg);
+                if ((C->params.lutBakeSize < 2) || (C->params.lutBakeSize > 129)) {
+                    clContextLogError(C, "Invalid --lut-bake size (2-129): %s", arg);
+                    return clFalse;
+                }
+            } else if (!strcmp(arg, "--lut-cache")) {
+                NEXTARG();
+                C->params.lutCacheDir = arg;
             } else if (!strcmp(arg, "-i") || !strcmp(arg, "--iccin")) {
                 NEXTARG();
                 C->iccOverrideIn = arg;
@@ -833,6 +964,10 @@ clBool clContextParseArgs(clContext * C, int argc, const char * argv[])
             } else if (!strcmp(arg, "-q") || !strcmp(arg, "--quality")) {
                 NEXTARG();
                 C->params.writeParams.quality = atoi(arg);
+            } else if (!strcmp(arg, "--rendition")) {
+                NEXTARG();
+                if (!parseRendition(C, &C->params, arg))
+                    return clFalse;
             } else if (!strcmp(arg, "--resize")) {
                 NEXTARG();
                 if (!parseResize(C, &C->params, arg))
@@ -849,17 +984,31 @@ clBool clContextParseArgs(clContext * C, int argc, const char * argv[])
                 }
             } else if (!strcmp(arg, "--composite")) {
                 NEXTARG();
-                C->params.compositeFilename = arg;
+                if (!parseComposite(C, &C->params, arg))
+                    return clFalse;
             } else if (!strcmp(arg, "--composite-gamma")) {
                 NEXTARG();
-                C->params.compositeParams.gamma = (float)atof(arg);
-                if (C->params.compositeParams.gamma <= 0.0f) {
+                float gamma = (float)atof(arg);
+                if (gamma <= 0.0f) {
                     clContextLogError(C, "Invalid composite gamma: %s", arg);
                     return clFalse;
                 }
+                // Every layer is blended in the same space
+                for (int i = 0; i < CL_MAX_COMPOSITES; ++i) {
+                    C->params.composites[i].params.gamma = gamma;
+                }
+            } else if (!strcmp(arg, "--composite-mode")) {
+                NEXTARG();
+                clBlendMode mode = clBlendModeFromString(C, arg);
+                if (mode == CL_BLEND_INVALID) {
+                    clContextLogError(C, "Unknown composite mode: %s", arg);
+                    return clFalse;
+                }
+                currentCompositeParams(&C->params)->mode = mode;
             } else if (!strcmp(arg, "--composite-tonemap")) {
                 NEXTARG();
-                if (!clTonemapFromString(C, arg, &C->params.compositeParams.cmpTonemap, &C->params.compositeParams.cmpParams)) {
+                clBlendParams * compositeParams = currentCompositeParams(&C->params);
+                if (!clTonemapFromString(C, arg, &compositeParams->cmpTonemap, &compositeParams->cmpParams)) {
                     return clFalse;
                 }
             } else if (!strcmp(arg, "--composite-offset")) {
@@ -871,13 +1020,13 @@ clBool clContextParseArgs(clContext * C, int argc, const char * argv[])
                 if (comma) {
                     *comma = 0;
                     ++comma;
-                    C->params.compositeParams.offsetX = atoi(tmpBuffer);
-                    C->params.compositeParams.offsetY = atoi(comma);
+                    currentCompositeParams(&C->params)->offsetX = atoi(tmpBuffer);
+                    currentCompositeParams(&C->params)->offsetY = atoi(comma);
                 } else {
                     return clFalse;
                 }
             } else if (!strcmp(arg, "--composite-premultiplied")) {
-                C->params.compositeParams.premultiplied = clTrue;
+                currentCompositeParams(&C->params)->premultiplied = clTrue;
             } else if (!strcmp(arg, "-v") || !strcmp(arg, "--verbose")) {
                 C->verbose = clTrue;
             } else if (!strcmp(arg, "--yuv")) {
@@ -897,6 +1046,16 @@ clBool clContextParseArgs(clContext * C, int argc, const char * argv[])
                     clContextLogError(C, "Unknown CMM: %s", arg);
                     return clFalse;
                 }
+            } else if (!strcmp(arg, "--ccmm-accuracy")) {
+                NEXTARG();
+                if (!strcmp(arg, "exact")) {
+                    C->ccmmFastCurves = clFalse;
+                } else if (!strcmp(arg, "fast")) {
+                    C->ccmmFastCurves = clTrue;
+                } else {
+                    clContextLogError(C, "Unknown CCMM accuracy: %s", arg);
+                    return clFalse;
+                }
             } else if (!strcmp(arg, "--deflum")) {
                 NEXTARG();
                 C->defaultLuminance = atoi(arg);
@@ -1135,6 +1294,7 @@ void clContextPrintSyntax(clContext * C)
     clContextLog(C, NULL, 0, "    -j,--jobs JOBS           : Number of jobs to use when working. 0 for as many as possible (default)");
     clContextLog(C, NULL, 0, "    -v,--verbose             : Verbose mode.");
     clContextLog(C, NULL, 0, "    --cmm WHICH,--cms WHICH  : Choose Color Management Module/System: auto (default), lcms, colorist (built-in, uses when possible)");
+    clContextLog(C, NULL, 0, "    --ccmm-accuracy WHICH    : Built-in CMM transfer curves: exact (default), fast (interpolated lookup tables)");
     clContextLog(C,
                  NULL,
                  0,
@@ -1159,6 +1319,7 @@ void clContextPrintSyntax(clContext * C)
     clContextLog(C, NULL, 0, "");
     clContextLog(C, NULL, 0, "Output Format Options:");
     clContextLog(C, NULL, 0, "    -b,--bpc BPC             : Output bits-per-channel. 8 - 16, or 0 for auto (default)");
+    clContextLog(C, NULL, 0, "    --dither                 : Ordered dither when quantizing to 8-16 bpc output instead of rounding");
     clContextLog(C, NULL, 0, formatLine);
     clContextLog(C, NULL, 0, "    -q,--quality QUALITY     : Output quality for supported output formats. (default: 90)");
     clContextLog(C, NULL, 0, "    -r,--rate RATE           : Output rate for for supported output formats. If 0, codec uses -q value above instead. (default: 0)");
@@ -1172,20 +1333,29 @@ void clContextPrintSyntax(clContext * C)
     clContextLog(C, NULL, 0, "");
     clContextLog(C, NULL, 0, "Convert Options:");
     clContextLog(C, NULL, 0, "    --resize w,h,filter      : Resize dst image to WxH. Use optional filter (auto (default), box, triangle, cubic, catmullrom, mitchell, nearest)");
+    clContextLog(C, NULL, 0, "    --rendition w,h,FILENAME : Also write a WxH copy to FILENAME (repeatable, format from extension). Uses the --resize filter");
     clContextLog(C, NULL, 0, "    --rotate cwTurns         : Rotate image cwTurns clockwise");
     clContextLog(C, NULL, 0, "    -z,--rect,--crop x,y,w,h : Crop source image to rect (before conversion). x,y,w,h");
-    clContextLog(C, NULL, 0, "    --composite FILENAME     : Composite FILENAME on top of input. Must be identical dimensions to input.");
-    clContextLog(C, NULL, 0, "    --composite-gamma GAMMA  : When compositing, perform sourceover blend using this gamma (default: 2.2)");
+    clContextLog(C, NULL, 0, "    --composite FILENAME     : Composite FILENAME on top of input (repeatable, in order; --composite-* options apply to the latest)");
+    clContextLog(C, NULL, 0, "    --composite-gamma GAMMA  : When compositing, blend every layer using this gamma (default: 2.2)");
+    clContextLog(C, NULL, 0, "    --composite-mode MODE    : When compositing, blend mode: sourceover (default), multiply, screen, add, mask");
     clContextLog(C, NULL, 0, "    --composite-premultiplied: When compositing, assume composite image's alpha is premultiplied (default: false)");
     clContextLog(C, NULL, 0, "    --composite-tonemap TM   : When compositing, determines if composite image is tonemapped before blend. auto (default), on, or off");
     clContextLog(C, NULL, 0, "    --composite-offset x,y   : When compositing, offsets source image onto destination image");
     clContextLog(C, NULL, 0, "    --hald FILENAME          : Image containing valid Hald CLUT to be used after color conversion");
+    clContextLog(C, NULL, 0, "    --hald-interp WHICH      : Hald CLUT interpolation: tetrahedral (default), trilinear");
+    clContextLog(C, NULL, 0, "    --lut-bake SIZE          : Convert through the whole conversion (and Hald) baked into a SIZE^3 LUT (33 or 65 are typical)");
+    clContextLog(C, NULL, 0, "    --lut-cache DIR          : Save --lut-bake LUTs in DIR and reuse them for identical conversions");
     clContextLog(C, NULL, 0, "    --stats                  : Enable post-conversion stats (MSE, PSNR, etc)");
     clContextLog(C, NULL, 0, "");
     clContextLog(C, NULL, 0, "Identify / Calc Options:");
     clContextLog(C, NULL, 0, "    -z,--rect x,y,w,h        : Pixels to dump. x,y,w,h");
     clContextLog(C, NULL, 0, "    --json                   : Output valid JSON description instead of standard log output");
     clContextLog(C, NULL, 0, "");
+    clContextLog(C, NULL, 0, "Highlight Sequences:");
+    clContextLog(C, NULL, 0, "    When [input] is a directory, every frame is measured and [output] is a JSON report");
+    clContextLog(C, NULL, 0, "    of their combined stats (MaxCLL, MaxFALL, brightest pixel, nits/saturation percentiles)");
+    clContextLog(C, NULL, 0, "");
     clContextLog(C, NULL, 0, "Modify Options:");
     clContextLog(C, NULL, 0, "    -s,--striptags TAG,...   : Strips ICC tags from profile");
     clContextLog(C, NULL, 0, "");
@@ -10,7 +10,9 @@
 #include "colorist/image.h"
 #include "colorist/pixelmath.h"
 #include "colorist/profile.h"
+#include "colorist/raw.h"
 #include "colorist/task.h"
+#include "colorist/transform.h"
 
 #include <string.h>
 
@@ -31,6 +33,385 @@ struct ImageInfo
     int luminance;
 };
 
+// Roughly how many pixels each strip of a streamed conversion holds (a few MB per strip buffer)
+#define CL_CONVERT_STRIP_PIXELS (256 * 1024)
+
+// Strip readers fill (and the streamed conversion writes) the pixel format matching an image's depth
+static clPixelFormat stripPixelFormat(int depth)
+{
+    if (depth <= 8) {
+        return CL_PIXELFORMAT_U8;
+    }
+    if (depth <= 16) {
+        return CL_PIXELFORMAT_U16;
+    }
+    return CL_PIXELFORMAT_F32;
+}
+
+static uint8_t * stripPixels(clImage * strip, clPixelFormat pixelFormat)
+{
+    switch (pixelFormat) {
+        case CL_PIXELFORMAT_U8:
+            return strip->pixelsU8;
+        case CL_PIXELFORMAT_U16:
+            return (uint8_t *)strip->pixelsU16;
+        case CL_PIXELFORMAT_F32:
+        case CL_PIXELFORMAT_COUNT:
+            break;
+    }
+    return (uint8_t *)strip->pixelsF32;
+}
+
+// A conversion can be streamed when both formats support strip I/O and every requested step works on rows
+// independently (cropping, resizing, grading, compositing, rotating and stats all need the whole image).
+static clBool clContextConvertCanStream(clContext * C, clConversionParams * params, const char * srcFormatName)
+{
+    if (!srcFormatName || !strcmp(srcFormatName, "icc") || !strcmp(params->formatName, "icc")) {
+        return clFalse;
+    }
+    clFormat * srcFormat = clContextFindFormat(C, srcFormatName);
+    clFormat * dstFormat = clContextFindFormat(C, params->formatName);
+    if (!srcFormat || !srcFormat->readStripsFunc || !dstFormat || !dstFormat->writeStripsFunc) {
+        return clFalse;
+    }
+    if ((params->rect[0] >= 0) && (params->rect[1] >= 0) && (params->rect[2] > 0) && (params->rect[3] > 0)) {
+        return clFalse;
+    }
+    if ((params->resizeW > 0) || (params->resizeH > 0) || (params->renditionCount > 0) || params->autoGrade ||
+        (params->compositeCount > 0) || (params->rotate != 0) || params->stats) {
+        return clFalse;
+    }
+    return clTrue;
+}
+
+// Resolves --resize/--rendition dimensions, where a missing (0) dimension follows the source's aspect ratio
+static void clContextResolveResize(int srcW, int srcH, int reqW, int reqH, int * outW, int * outH)
+{
+    if (reqW <= 0) {
+        *outW = (int)(((float)srcW / (float)srcH) * reqH);
+        *outH = reqH;
+    } else if (reqH <= 0) {
+        *outW = reqW;
+        *outH = (int)(((float)srcH / (float)srcW) * reqW);
+    } else {
+        *outW = reqW;
+        *outH = reqH;
+    }
+    if (*outW <= 0)
+        *outW = 1;
+    if (*outH <= 0)
+        *outH = 1;
+}
+
+// Resizes srcImage (still in its own color space) to every --rendition size. Each rendition is filtered straight from
+// the shared, read-only source, so every size matches a separate --resize run regardless of the ladder's order.
+static clBool clContextBuildRenditions(clContext * C, clImage * srcImage, clConversionParams * params, clImage ** renditionImages)
+{
+    for (int i = 0; i < params->renditionCount; ++i) {
+        clRendition * rendition = &params->renditions[i];
+        int width, height;
+        clContextResolveResize(srcImage->width, srcImage->height, rendition->width, rendition->height, &width, &height);
+
+        Timer t;
+        timerStart(&t);
+        clContextLog(C,
+                     "rendition",
+                     0,
+                     "Resizing %dx%d -> [filter:%s] -> %dx%d (%s)",
+                     srcImage->width,
+                     srcImage->height,
+                     clFilterToString(C, params->resizeFilter),
+                     width,
+                     height,
+                     rendition->filename);
+        if ((srcImage->width == width) && (srcImage->height == height)) {
+            renditionImages[i] = clImageRotate(C, srcImage, 0); // Same size, just copy it
+        } else {
+            renditionImages[i] = clImageResize(C, srcImage, width, height, params->resizeFilter);
+        }
+        if (!renditionImages[i]) {
+            clContextLogError(C, "Failed to resize rendition: %s", rendition->filename);
+            return clFalse;
+        }
+        clContextLog(C, "timing", -1, TIMING_FORMAT, timerElapsedSeconds(&t));
+    }
+    return clTrue;
+}
+
+// --lut-bake: bakes the conversion from srcImage's profile (followed by haldLUT, if any) into one 3D LUT and reports how
+// far it strays from the exact conversion. Returns NULL (converting exactly instead) when the LUT can't stand in for it.
+static clHaldLUT * clContextBakeConversion(clContext * C,
+                                           clImage * srcImage,
+                                           int dstDepth,
+                                           clProfile * dstProfile,
+                                           clTonemap tonemap,
+                                           clHaldLUT * haldLUT,
+                                           clConversionParams * params)
+{
+    if (params->dither) {
+        clContextLog(C, "lut", 0, "Not baking a LUT: --dither quantizes inside the exact conversion");
+        return NULL;
+    }
+    if (srcImage->depth > 16) {
+        clContextLog(C, "lut", 0, "Not baking a LUT: float source pixels can exceed its [0,1] input range");
+        return NULL;
+    }
+
+    Timer t;
+    timerStart(&t);
+    clTransform * transform =
+        clTransformAcquire(C, srcImage->profile, CL_XF_RGBA, dstProfile, CL_XF_RGBA, tonemap, &params->tonemapParams, 0, 0);
+    clHaldLUT * lut = clTransformBakeLUT(C, transform, haldLUT, params->lutBakeSize, params->lutCacheDir);
+    if (lut) {
+        float maxError, meanError;
+        clTransformMeasureBakedLUT(C, transform, haldLUT, lut, &maxError, &meanError);
+        float maxChannel = (dstDepth == 32) ? 1.0f : (float)((1 << dstDepth) - 1);
+        clContextLog(C,
+                     "lut",
+                     1,
+                     "Error vs exact conversion: max %.3f, mean %.4f (%d-bit codes)",
+                     maxError * maxChannel,
+                     meanError * maxChannel,
+                     dstDepth);
+    }
+    clTransformRelease(C, transform);
+    clContextLog(C, "timing", -1, TIMING_FORMAT, timerElapsedSeconds(&t));
+    return lut;
+}
+
+// Converts a resized rendition exactly like the main output (sharing its cached transform or baked LUT) and writes it
+static clBool clContextWriteRendition(clContext * C,
+                                      clImage * renditionImage,
+                                      clRendition * rendition,
+                                      int dstDepth,
+                                      clProfile * dstProfile,
+                                      clHaldLUT * conversionLUT,
+                                      clHaldLUT * haldLUT,
+                                      clConversionParams * params)
+{
+    Timer t;
+    timerStart(&t);
+
+    const char * formatName = clFormatDetect(C, rendition->filename);
+    if (!formatName) {
+        clContextLogError(C, "Unknown rendition output format: %s", rendition->filename);
+        return clFalse;
+    }
+    int depth = clFormatBestDepth(C, formatName, dstDepth);
+    clContextLog(C,
+                 "rendition",
+                 0,
+                 "Converting %dx%d rendition (%d-bit): %s",
+                 renditionImage->width,
+                 renditionImage->height,
+                 depth,
+                 rendition->filename);
+
+    clImage * dstImage;
+    if (conversionLUT) {
+        dstImage = clImageCreate(C, renditionImage->width, renditionImage->height, depth, dstProfile);
+        clImageApplyHaldLUT(C, renditionImage, dstImage, conversionLUT);
+    } else {
+        dstImage = clImageConvert(C,
+                                  renditionImage,
+                                  depth,
+                                  dstProfile,
+                                  params->autoGrade ? CL_TONEMAP_OFF : params->tonemap,
+                                  &params->tonemapParams,
+                                  params->dither);
+    }
+    if (!dstImage) {
+        return clFalse;
+    }
+    if (haldLUT) {
+        clImageApplyHaldLUT(C, dstImage, dstImage, haldLUT);
+    }
+    if ((params->rotate != 0) && !clImageRotateInPlace(C, dstImage, params->rotate)) {
+        clImage * rotatedImage = clImageRotate(C, dstImage, params->rotate);
+        if (rotatedImage) {
+            clImageDestroy(C, dstImage);
+            dstImage = rotatedImage;
+        }
+    }
+
+    clContextLogWrite(C, rendition->filename, formatName, &params->writeParams);
+    clBool result = clContextWrite(C, dstImage, rendition->filename, formatName, &params->writeParams);
+    clImageDestroy(C, dstImage);
+    if (result) {
+        clContextLog(C, "encode", 1, "Wrote %d bytes.", clFileSize(rendition->filename));
+    }
+    clContextLog(C, "timing", -1, TIMING_FORMAT, timerElapsedSeconds(&t));
+    return result;
+}
+
+// Measures the largest channel of a streamed image with a second pass over its rows
+static clBool clContextMeasureLargestChannelStrips(clContext * C,
+                                                   const char * srcFormatName,
+                                                   clRaw * srcRaw,
+                                                   int stripRows,
+                                                   float * outLargestChannel)
+{
+    clFormatStripReader * reader = clContextReadStrips(C, srcFormatName, C->iccOverrideIn, srcRaw);
+    if (!reader) {
+        return clFalse;
+    }
+
+    clBool result = clTrue;
+    clImage * image = reader->image;
+    clImage * strip = clImageCreate(C, image->width, stripRows, image->depth, image->profile);
+    *outLargestChannel = 0.0f;
+    for (int y = 0; y < image->height; y += stripRows) {
+        // Rows past the end of a final partial strip still hold earlier (real) pixels, so they can't raise the max
+        if (!reader->readRows(C, reader, strip, CL_MIN(stripRows, image->height - y))) {
+            result = clFalse;
+            break;
+        }
+        float largestChannel = clImageLargestChannel(C, strip);
+        *outLargestChannel = CL_MAX(*outLargestChannel, largestChannel);
+    }
+    clImageDestroy(C, strip);
+    reader->destroy(C, reader);
+    return result;
+}
+
+// Converts, Hald-processes and writes an image a strip of rows at a time, so the decoded image is never whole in memory.
+// srcImage is the reader's header-only image and srcRaw the encoded input (reread if auto-tonemapping needs a pre-pass).
+static clBool clContextConvertStrips(clContext * C,
+                                     clFormatStripReader * reader,
+                                     clImage * srcImage,
+                                     const char * srcFormatName,
+                                     clRaw * srcRaw,
+                                     int dstDepth,
+                                     clProfile * dstProfile,
+                                     clHaldLUT * haldLUT,
+                                     clConversionParams * params)
+{
+    Timer t;
+    clBool result = clFalse;
+    const int width = srcImage->width;
+    const int height = srcImage->height;
+    const int stripRows = CL_CLAMP(CL_CONVERT_STRIP_PIXELS / width, 1, height);
+
+    clImage * dstImage = clImageCreate(C, width, height, dstDepth, dstProfile); // header only, never holds pixels
+    clImage * srcStrip = clImageCreate(C, width, stripRows, srcImage->depth, srcImage->profile);
+    clImage * dstStrip = clImageCreate(C, width, stripRows, dstDepth, dstProfile);
+    clPixelFormat srcPixelFormat = stripPixelFormat(srcImage->depth);
+    clPixelFormat dstPixelFormat = stripPixelFormat(dstDepth);
+    clTransform * transform = NULL;
+    clHaldLUT * conversionLUT = NULL;
+    clFormatStripWriter * writer = NULL;
+    clRaw dstRaw = CL_RAW_EMPTY;
+
+    clContextLog(C, "details", 0, "Source:");
+    clImageDebugDump(C, srcImage, 0, 0, 0, 0, 1);
+    clContextLog(C, "details", 0, "Destination:");
+    clImageDebugDump(C, dstImage, 0, 0, 0, 0, 1);
+
+    clTonemap tonemap = params->tonemap;
+    if (tonemap == CL_TONEMAP_AUTO) {
+        float srcPeakLuminance = 0.0f;
+        if (dstDepth != 32) {
+            // Integer pixels can't exceed 1.0, so full white bounds the peak; only measure if that bound would tonemap
+            srcPeakLuminance = clImageChannelLuminance(C, srcImage->profile, 1.0f);
+            if ((srcPixelFormat == CL_PIXELFORMAT_F32) ||
+                (clImageAutoTonemap(C, srcPeakLuminance, dstDepth, dstProfile, clFalse) == CL_TONEMAP_ON)) {
+                float largestChannel;
+                if (!clContextMeasureLargestChannelStrips(C, srcFormatName, srcRaw, stripRows, &largestChannel)) {
+                    clContextLogError(C, "Failed to measure source peak luminance");
+                    goto convertStripsCleanup;
+                }
+                srcPeakLuminance = clImageChannelLuminance(C, srcImage->profile, largestChannel);
+            }
+        }
+        tonemap = clImageAutoTonemap(C, srcPeakLuminance, dstDepth, dstProfile, clTrue);
+    }
+
+    if (params->lutBakeSize > 0) {
+        conversionLUT = clContextBakeConversion(C, srcImage, dstDepth, dstProfile, tonemap, haldLUT, params);
+    }
+    if (conversionLUT) {
+        clContextLog(C, "convert", 0, "Converting through the baked LUT...");
+    } else {
+        transform = clImageConvertTransformAcquire(C,
+                                                   srcImage,
+                                                   srcPixelFormat,
+                                                   dstStrip,
+                                                   dstPixelFormat,
+                                                   tonemap,
+                                                   &params->tonemapParams);
+        if (haldLUT) {
+            clContextLog(C, "hald", 0, "Performing Hald CLUT postprocessing...");
+        }
+    }
+    clContextLogWrite(C, C->outputFilename, params->formatName, &params->writeParams);
+    clContextLog(C, "convert", 1, "Streaming %d-row strips (%dx%d)", stripRows, width, stripRows);
+
+    writer = clContextWriteStrips(C, dstImage, params->formatName, &dstRaw, &params->writeParams);
+    if (!writer) {
+        clContextLogError(C, "Failed to start writing %s", C->outputFilename);
+        goto convertStripsCleanup;
+    }
+
+    timerStart(&t);
+    for (int y = 0; y < height; y += stripRows) {
+        int rowCount = CL_MIN(stripRows, height - y);
+        if (!reader->readRows(C, reader, srcStrip, rowCount)) {
+            clContextLogError(C, "Failed to read rows %d-%d: %s", y, y + rowCount - 1, C->inputFilename);
+            goto convertStripsCleanup;
+        }
+
+        clImagePrepareWritePixels(C, dstStrip, dstPixelFormat);
+        if (conversionLUT) {
+            // The Hald (if any) is baked in
+            clImageApplyHaldLUT(C, srcStrip, dstStrip, conversionLUT);
+        } else if (params->dither) {
+            clTransformRunDithered(C,
+                                   transform,
+                                   stripPixels(srcStrip, srcPixelFormat),
+                                   stripPixels(dstStrip, dstPixelFormat),
+                                   width,
+                                   y,
+                                   rowCount);
+        } else {
+            clTransformRun(C,
+                           transform,
+                           stripPixels(srcStrip, srcPixelFormat),
+                           stripPixels(dstStrip, dstPixelFormat),
+                           width * rowCount);
+        }
+        if (haldLUT && !conversionLUT) {
+            // Graded in place while the strip is still in cache, right after its transform
+            clImageApplyHaldLUT(C, dstStrip, dstStrip, haldLUT);
+        }
+        if (!writer->writeRows(C, writer, dstStrip, rowCount)) {
+            clContextLogError(C, "Failed to write rows %d-%d: %s", y, y + rowCount - 1, C->outputFilename);
+            goto convertStripsCleanup;
+        }
+    }
+    if (!writer->finish(C, writer) || !clRawWriteFile(C, &dstRaw, C->outputFilename)) {
+        goto convertStripsCleanup;
+    }
+    clContextLog(C, "encode", 1, "Wrote %d bytes.", clFileSize(C->outputFilename));
+    clContextLog(C, "timing", -1, TIMING_FORMAT, timerElapsedSeconds(&t));
+    result = clTrue;
+
+convertStripsCleanup:
+    if (writer) {
+        writer->destroy(C, writer);
+    }
+    if (transform) {
+        clTransformRelease(C, transform);
+    }
+    if (conversionLUT) {
+        clHaldLUTDestroy(C, conversionLUT);
+    }
+    clRawFree(C, &dstRaw);
+    clImageDestroy(C, dstStrip);
+    clImageDestroy(C, srcStrip);
+    clImageDestroy(C, dstImage);
+    return result;
+}
+
 int clContextConvert(clContext * C)
 {
     Timer overall, t;
@@ -46,8 +427,20 @@ int clContextConvert(clContext * C)
     struct ImageInfo dstInfo;
 
     // Hald CLUT
-    clImage * haldImage = NULL;
-    int haldDims = 0;
+    clHaldLUT * haldLUT = NULL;
+
+    // --lut-bake, and whether haldLUT is baked into it
+    clHaldLUT * conversionLUT = NULL;
+    clBool haldBaked = clFalse;
+
+    // Resized (but not yet converted) copies for every --rendition
+    clImage * renditionImages[CL_MAX_RENDITIONS];
+    memset(renditionImages, 0, sizeof(renditionImages));
+
+    // Strip streaming, when the whole conversion can be done a few rows at a time
+    const char * srcFormatName = clFormatDetect(C, C->inputFilename);
+    clFormatStripReader * reader = NULL;
+    clRaw srcRaw = CL_RAW_EMPTY;
 
     clConversionParams params;
     memcpy(&params, &C->params, sizeof(params));
@@ -64,7 +457,19 @@ int clContextConvert(clContext * C)
 
     clContextLog(C, "decode", 0, "Reading: %s (%d bytes)", C->inputFilename, clFileSize(C->inputFilename));
     timerStart(&t);
-    srcImage = clContextRead(C, C->inputFilename, C->iccOverrideIn, NULL);
+    if (clContextConvertCanStream(C, &params, srcFormatName) && clRawReadFile(C, &srcRaw, C->inputFilename)) {
+        reader = clContextReadStrips(C, srcFormatName, C->iccOverrideIn, &srcRaw);
+        if (reader) {
+            // Only the header is decoded here; clContextConvertStrips() reads the rows
+            srcImage = reader->image;
+            reader->image = NULL;
+        } else {
+            clRawFree(C, &srcRaw);
+        }
+    }
+    if (srcImage == NULL) {
+        srcImage = clContextRead(C, C->inputFilename, C->iccOverrideIn, NULL);
+    }
     if (srcImage == NULL) {
         return 1;
     }
@@ -84,20 +489,22 @@ int clContextConvert(clContext * C)
 
     // Load HALD, if any
     if (params.hald) {
-        haldImage = clContextRead(C, params.hald, NULL, NULL);
+        clImage * haldImage = clContextRead(C, params.hald, NULL, NULL);
         if (!haldImage) {
             clContextLogError(C, "Can't read Hald CLUT: %s", params.hald);
             FAIL();
         }
         if (haldImage->width != haldImage->height) {
             clContextLogError(C, "Hald CLUT isn't square [%dx%d]: %s", haldImage->width, haldImage->height, params.hald);
+            clImageDestroy(C, haldImage);
             FAIL();
         }
 
-        // Calc haldDims
+        // Calc haldDims, then repack the Hald into a lookup cube (the image itself isn't needed after that)
         {
+            int haldDims = 0;
             int i;
-            for (i = 0; i < 32; ++i) {
+            for (i = 2; i < 32; ++i) {
                 if ((i * i * i) == haldImage->width) {
                     haldDims = i * i;
                     break;
@@ -106,10 +513,17 @@ int clContextConvert(clContext * C)
 
             if (haldDims == 0) {
                 clContextLogError(C, "Hald CLUT dimensions aren't cubic [%dx%d]: %s", haldImage->width, haldImage->height, params.hald);
+                clImageDestroy(C, haldImage);
                 FAIL();
             }
 
             clContextLog(C, "hald", 0, "Loaded %dx%dx%d Hald CLUT: %s", haldDims, haldDims, haldDims, params.hald);
+            clImagePrepareReadPixels(C, haldImage, CL_PIXELFORMAT_F32);
+            haldLUT = clHaldLUTCreate(C, haldImage->pixelsF32, haldDims, params.haldInterpolation);
+            clImageDestroy(C, haldImage);
+            if (!haldLUT) {
+                FAIL();
+            }
         }
     }
 
@@ -201,20 +615,7 @@ int clContextConvert(clContext * C)
 
     // Override width and height
     if ((params.resizeW > 0) || (params.resizeH > 0)) {
-        if (params.resizeW <= 0) {
-            dstInfo.width = (int)(((float)srcInfo.width / (float)srcInfo.height) * params.resizeH);
-            dstInfo.height = params.resizeH;
-        } else if (params.resizeH <= 0) {
-            dstInfo.width = params.resizeW;
-            dstInfo.height = (int)(((float)srcInfo.height / (float)srcInfo.width) * params.resizeW);
-        } else {
-            dstInfo.width = params.resizeW;
-            dstInfo.height = params.resizeH;
-        }
-        if (dstInfo.width <= 0)
-            dstInfo.width = 1;
-        if (dstInfo.height <= 0)
-            dstInfo.height = 1;
+        clContextResolveResize(srcInfo.width, srcInfo.height, params.resizeW, params.resizeH, &dstInfo.width, &dstInfo.height);
     }
 
     // Override depth
@@ -230,6 +631,19 @@ int clContextConvert(clContext * C)
         }
     }
 
+    // -----------------------------------------------------------------------
+    // Renditions, resized from the full (cropped) source before the main output's resize replaces it
+
+    if (params.renditionCount > 0) {
+        if (params.compositeCount > 0) {
+            clContextLogError(C, "--rendition can't be combined with --composite");
+            FAIL();
+        }
+        if (!clContextBuildRenditions(C, srcImage, &params, renditionImages)) {
+            FAIL();
+        }
+    }
+
     // -----------------------------------------------------------------------
     // Resize, if necessary
 
@@ -331,61 +745,100 @@ int clContextConvert(clContext * C)
         }
     }
 
-    dstImage = clImageConvert(C, srcImage, dstInfo.depth, dstProfile, params.autoGrade ? CL_TONEMAP_OFF : params.tonemap, &params.tonemapParams);
+    if (reader) {
+        clBool converted =
+            clContextConvertStrips(C, reader, srcImage, srcFormatName, &srcRaw, dstInfo.depth, dstProfile, haldLUT, &params);
+        if (!converted) {
+            FAIL();
+        }
+        goto convertCleanup;
+    }
+
+    clTonemap tonemap = params.autoGrade ? CL_TONEMAP_OFF : params.tonemap;
+    if (params.lutBakeSize > 0) {
+        if (tonemap == CL_TONEMAP_AUTO) {
+            float srcPeakLuminance = (dstInfo.depth == 32) ? 0.0f : clImagePeakLuminance(C, srcImage);
+            tonemap = clImageAutoTonemap(C, srcPeakLuminance, dstInfo.depth, dstProfile, clTrue);
+        }
+
+        // A composite is blended between the conversion and the Hald, so the Hald can only be baked in without one
+        clHaldLUT * bakedHald = (params.compositeCount > 0) ? NULL : haldLUT;
+        conversionLUT = clContextBakeConversion(C, srcImage, dstInfo.depth, dstProfile, tonemap, bakedHald, &params);
+        haldBaked = (conversionLUT && bakedHald) ? clTrue : clFalse;
+    }
+
+    if (conversionLUT) {
+        clContextLog(C, "convert", 0, "Converting through the baked LUT...");
+        timerStart(&t);
+        dstImage = clImageCreate(C, srcImage->width, srcImage->height, dstInfo.depth, dstProfile);
+        clImageApplyHaldLUT(C, srcImage, dstImage, conversionLUT);
+        clContextLog(C, "timing", -1, TIMING_FORMAT, timerElapsedSeconds(&t));
+    } else {
+        dstImage = clImageConvert(C, srcImage, dstInfo.depth, dstProfile, tonemap, &params.tonemapParams, params.dither);
+    }
     if (!dstImage) {
         FAIL();
     }
 
-    if (C->params.compositeFilename) {
-        clContextLog(C,
-                     "composite",
-                     0,
-                     "Composition enabled. Reading: %s (%d bytes)",
-                     C->params.compositeFilename,
-                     clFileSize(C->params.compositeFilename));
-        timerStart(&t);
-        clImage * compositeImage = clContextRead(C, params.compositeFilename, NULL, NULL);
-        if (compositeImage == NULL) {
-            clContextLogError(C, "Can't load composite image, bailing out");
-            FAIL();
+    if (params.compositeCount > 0) {
+        clImage * compositeImages[CL_MAX_COMPOSITES];
+        clBlendParams compositeParams[CL_MAX_COMPOSITES];
+        int compositeCount = 0;
+        for (; compositeCount < params.compositeCount; ++compositeCount) {
+            const clComposite * composite = &params.composites[compositeCount];
+            clContextLog(C,
+                         "composite",
+                         0,
+                         "Composition enabled. Reading: %s (%d bytes)",
+                         composite->filename,
+                         clFileSize(composite->filename));
+            timerStart(&t);
+            compositeImages[compositeCount] = clContextRead(C, composite->filename, NULL, NULL);
+            if (compositeImages[compositeCount] == NULL) {
+                break;
+            }
+            clContextLog(C, "timing", -1, TIMING_FORMAT, timerElapsedSeconds(&t));
+
+            memcpy(&compositeParams[compositeCount], &composite->params, sizeof(clBlendParams));
+            compositeParams[compositeCount].srcTonemap = params.tonemap;
+            memcpy(&compositeParams[compositeCount].srcParams, &params.tonemapParams, sizeof(clTonemapParams));
         }
-        clContextLog(C, "timing", -1, TIMING_FORMAT, timerElapsedSeconds(&t));
 
-        clContextLog(C,
-                     "composite",
-                     0,
-                     "Blending composite on top (%.2g gamma, %s, offset %d,%d)...",
-                     params.compositeParams.gamma,
-                     params.compositeParams.premultiplied ? "premultiplied" : "not premultiplied",
-                     params.compositeParams.offsetX,
-                     params.compositeParams.offsetY);
-        timerStart(&t);
-        params.compositeParams.srcTonemap = params.tonemap;
-        memcpy(&params.compositeParams.srcParams, &params.tonemapParams, sizeof(clTonemapParams));
-        clImage * blendedImage = clImageBlend(C, dstImage, compositeImage, &params.compositeParams);
-        if (!blendedImage) {
-            clContextLogError(C, "Image blend failed, bailing out");
-            clImageDestroy(C, blendedImage);
+        clBool blended = clFalse;
+        if (compositeCount < params.compositeCount) {
+            clContextLogError(C, "Can't load composite image, bailing out");
+        } else {
+            for (int i = 0; i < compositeCount; ++i) {
+                clContextLog(C,
+                             "composite",
+                             0,
+                             "Blending composite on top (%s, %.2g gamma, %s, offset %d,%d)...",
+                             clBlendModeToString(C, compositeParams[i].mode),
+                             compositeParams[i].gamma,
+                             compositeParams[i].premultiplied ? "premultiplied" : "not premultiplied",
+                             compositeParams[i].offsetX,
+                             compositeParams[i].offsetY);
+            }
+            timerStart(&t);
+            blended = clImageBlendLayersInPlace(C, dstImage, compositeCount, compositeImages, compositeParams);
+            if (!blended) {
+                clContextLogError(C, "Image blend failed, bailing out");
+            }
+            clContextLog(C, "timing", -1, TIMING_FORMAT, timerElapsedSeconds(&t));
+        }
+        for (int i = 0; i < compositeCount; ++i) {
+            clImageDestroy(C, compositeImages[i]);
+        }
+        if (!blended) {
             FAIL();
         }
-        clContextLog(C, "timing", -1, TIMING_FORMAT, timerElapsedSeconds(&t));
-
-        clImageDestroy(C, dstImage);
-        dstImage = blendedImage;
     }
 
-    if (haldImage) {
+    if (haldLUT && !haldBaked) {
         clContextLog(C, "hald", 0, "Performing Hald CLUT postprocessing...");
         timerStart(&t);
 
-        clImage * appliedImage = clImageApplyHALD(C, dstImage, haldImage, haldDims);
-        if (!appliedImage) {
-            clContextLogError(C, "Failed to apply HALD");
-            FAIL();
-        }
-
-        clImageDestroy(C, dstImage);
-        dstImage = appliedImage;
+        clImageApplyHaldLUT(C, dstImage, dstImage, haldLUT);
 
         clContextLog(C, "timing", -1, TIMING_FORMAT, timerElapsedSeconds(&t));
     }
@@ -394,10 +847,12 @@ int clContextConvert(clContext * C)
         clContextLog(C, "rotate", 0, "Rotating image clockwise %dx...", params.rotate);
         timerStart(&t);
 
-        clImage * rotatedImage = clImageRotate(C, dstImage, params.rotate);
-        if (rotatedImage) {
-            clImageDestroy(C, dstImage);
-            dstImage = rotatedImage;
+        if (!clImageRotateInPlace(C, dstImage, params.rotate)) {
+            clImage * rotatedImage = clImageRotate(C, dstImage, params.rotate);
+            if (rotatedImage) {
+                clImageDestroy(C, dstImage);
+                dstImage = rotatedImage;
+            }
         }
 
         clContextLog(C, "timing", -1, TIMING_FORMAT, timerElapsedSeconds(&t));
@@ -411,6 +866,20 @@ int clContextConvert(clContext * C)
     clContextLog(C, "encode", 1, "Wrote %d bytes.", clFileSize(C->outputFilename));
     clContextLog(C, "timing", -1, TIMING_FORMAT, timerElapsedSeconds(&t));
 
+    for (int i = 0; i < params.renditionCount; ++i) {
+        clRendition * rendition = &params.renditions[i];
+        if (!clContextWriteRendition(C,
+                                     renditionImages[i],
+                                     rendition,
+                                     dstInfo.depth,
+                                     dstProfile,
+                                     conversionLUT,
+                                     haldBaked ? NULL : haldLUT,
+                                     &params)) {
+            FAIL();
+        }
+    }
+
     if (params.stats) {
         clContextLog(C, "stats", 0, "Calculating conversion stats...");
         timerStart(&t);
@@ -439,9 +908,28 @@ convertCleanup:
         clImageDestroy(C, srcImage);
     if (dstImage)
         clImageDestroy(C, dstImage);
-    if (haldImage)
-        clImageDestroy(C, haldImage);
+    if (haldLUT)
+        clHaldLUTDestroy(C, haldLUT);
+    if (conversionLUT)
+        clHaldLUTDestroy(C, conversionLUT);
+    for (int i = 0; i < CL_MAX_RENDITIONS; ++i) {
+        if (renditionImages[i])
+            clImageDestroy(C, renditionImages[i]);
+    }
+    if (reader)
+        reader->destroy(C, reader);
+    clRawFree(C, &srcRaw);
 
+    if (C->verbose) {
+        clContextLog(C,
+                     "xfcache",
+                     0,
+                     "Transform cache: %d hits, %d misses, %d evictions",
+                     C->transformCacheHits,
+                     C->transformCacheMisses,
+                     C->transformCacheEvictions);
+        clTaskLogBusyTime(C);
+    }
     if (returnCode == 0) {
         clContextLog(C, "action", 0, "Conversion complete.");
         clContextLog(C, "timing", -1, OVERALL_TIMING_FORMAT, timerElapsedSeconds(&overall));
@@ -24,6 +24,15 @@ clBool clFormatWriteBMP(struct clContext * C, struct clImage * image, const char
 
 struct clImage * clFormatReadJPG(struct clContext * C, const char * formatName, struct clProfile * overrideProfile, struct clRaw * input);
 clBool clFormatWriteJPG(struct clContext * C, struct clImage * image, const char * formatName, struct clRaw * output, struct clWriteParams * writeParams);
+struct clFormatStripReader * clFormatReadStripsJPG(struct clContext * C,
+                                                  const char * formatName,
+                                                  struct clProfile * overrideProfile,
+                                                  struct clRaw * input);
+struct clFormatStripWriter * clFormatWriteStripsJPG(struct clContext * C,
+                                                   struct clImage * image,
+                                                   const char * formatName,
+                                                   struct clRaw * output,
+                                                   struct clWriteParams * writeParams);
 
 struct clImage * clFormatReadJP2(struct clContext * C, const char * formatName, struct clProfile * overrideProfile, struct clRaw * input);
 clBool clFormatWriteJP2(struct clContext * C, struct clImage * image, const char * formatName, struct clRaw * output, struct clWriteParams * writeParams);
@@ -33,6 +42,15 @@ clBool clFormatWriteJXR(struct clContext * C, struct clImage * image, const char
 
 struct clImage * clFormatReadPNG(struct clContext * C, const char * formatName, struct clProfile * overrideProfile, struct clRaw * input);
 clBool clFormatWritePNG(struct clContext * C, struct clImage * image, const char * formatName, struct clRaw * output, struct clWriteParams * writeParams);
+struct clFormatStripReader * clFormatReadStripsPNG(struct clContext * C,
+                                                  const char * formatName,
+                                                  struct clProfile * overrideProfile,
+                                                  struct clRaw * input);
+struct clFormatStripWriter * clFormatWriteStripsPNG(struct clContext * C,
+                                                   struct clImage * image,
+                                                   const char * formatName,
+                                                   struct clRaw * output,
+                                                   struct clWriteParams * writeParams);
 
 struct clImage * clFormatReadTIFF(struct clContext * C, const char * formatName, struct clProfile * overrideProfile, struct clRaw * input);
 clBool clFormatWriteTIFF(struct clContext * C,
@@ -40,6 +58,15 @@ clBool clFormatWriteTIFF(struct clContext * C,
                          const char * formatName,
                          struct clRaw * output,
                          struct clWriteParams * writeParams);
+struct clFormatStripReader * clFormatReadStripsTIFF(struct clContext * C,
+                                                    const char * formatName,
+                                                    struct clProfile * overrideProfile,
+                                                    struct clRaw * input);
+struct clFormatStripWriter * clFormatWriteStripsTIFF(struct clContext * C,
+                                                     struct clImage * image,
+                                                     const char * formatName,
+                                                     struct clRaw * output,
+                                                     struct clWriteParams * writeParams);
 
 struct clImage * clFormatReadWebP(struct clContext * C, const char * formatName, struct clProfile * overrideProfile, struct clRaw * input);
 clBool clFormatWriteWebP(struct clContext * C,
@@ -132,6 +159,8 @@ void clContextRegisterBuiltinFormats(struct clContext * C)
         format.detectFunc = detectFormatSignature;
         format.readFunc = clFormatReadJPG;
         format.writeFunc = clFormatWriteJPG;
+        format.readStripsFunc = clFormatReadStripsJPG;
+        format.writeStripsFunc = clFormatWriteStripsJPG;
         clContextRegisterFormat(C, &format);
     }
 
@@ -220,6 +249,8 @@ void clContextRegisterBuiltinFormats(struct clContext * C)
         format.detectFunc = detectFormatSignature;
         format.readFunc = clFormatReadPNG;
         format.writeFunc = clFormatWritePNG;
+        format.readStripsFunc = clFormatReadStripsPNG;
+        format.writeStripsFunc = clFormatWriteStripsPNG;
         clContextRegisterFormat(C, &format);
     }
 
@@ -246,6 +277,8 @@ void clContextRegisterBuiltinFormats(struct clContext * C)
         format.detectFunc = detectFormatSignature;
         format.readFunc = clFormatReadTIFF;
         format.writeFunc = clFormatWriteTIFF;
+        format.readStripsFunc = clFormatReadStripsTIFF;
+        format.writeStripsFunc = clFormatWriteStripsTIFF;
         clContextRegisterFormat(C, &format);
     }
 
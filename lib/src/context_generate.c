@@ -131,10 +131,12 @@ int clContextGenerate(clContext * C, struct cJSON * output)
             Timer t;
             timerStart(&t);
 
-            clImage * rotatedImage = clImageRotate(C, image, C->params.rotate);
-            if (rotatedImage) {
-                clImageDestroy(C, image);
-                image = rotatedImage;
+            if (!clImageRotateInPlace(C, image, C->params.rotate)) {
+                clImage * rotatedImage = clImageRotate(C, image, C->params.rotate);
+                if (rotatedImage) {
+                    clImageDestroy(C, image);
+                    image = rotatedImage;
+                }
             }
 
             clContextLog(C, "timing", -1, TIMING_FORMAT, timerElapsedSeconds(&t));
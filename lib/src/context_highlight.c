@@ -9,15 +9,179 @@
 
 #include "colorist/image.h"
 #include "colorist/profile.h"
+#include "colorist/raw.h"
 
 #include "cJSON.h"
 
+#include <inttypes.h>
+#include <stdlib.h>
 #include <string.h>
 
+// Largest strip of rows measured at once when a sequence's frames can be streamed
+#define CL_HIGHLIGHT_STRIP_PIXELS (256 * 1024)
+
+static void logHDRStats(clContext * C, const clImageHDRStats * stats)
+{
+    float pixelCount = (float)stats->pixelCount;
+    clContextLog(C, "highlight", 2, "Total Pixels          : %" PRId64, stats->pixelCount);
+    clContextLog(C,
+                 "highlight",
+                 2,
+                 "Overbright (%4d nits): %" PRId64 " (%2.2f%%)",
+                 C->defaultLuminance,
+                 stats->overbrightPixelCount,
+                 100.0f * (float)stats->overbrightPixelCount / pixelCount);
+    clContextLog(C,
+                 "highlight",
+                 2,
+                 "Out of Gamut (BT709)  : %" PRId64 " (%2.2f%%)",
+                 stats->outOfGamutPixelCount,
+                 100.0f * (float)stats->outOfGamutPixelCount / pixelCount);
+    clContextLog(C,
+                 "highlight",
+                 2,
+                 "Both                  : %" PRId64 " (%2.2f%%)",
+                 stats->hdrPixelCount,
+                 100.0f * (float)stats->hdrPixelCount / pixelCount);
+    if (stats->frameCount > 1) {
+        clContextLog(C,
+                     "highlight",
+                     2,
+                     "Brightest Pixel       : %2.2f nits @ [%d, %d] in frame %d",
+                     stats->brightestPixelNits,
+                     stats->brightestPixelX,
+                     stats->brightestPixelY,
+                     stats->brightestPixelFrame);
+    } else {
+        clContextLog(C,
+                     "highlight",
+                     2,
+                     "Brightest Pixel       : %2.2f nits @ [%d, %d]",
+                     stats->brightestPixelNits,
+                     stats->brightestPixelX,
+                     stats->brightestPixelY);
+    }
+    clContextLog(C, "highlight", 2, "MaxCLL                : %2.2f nits", stats->maxCLL);
+    clContextLog(C, "highlight", 2, "MaxFALL               : %2.2f nits", stats->maxFALL);
+}
+
+// Adds one file's frame to accumulator: a strip of rows at a time if its format can stream, otherwise whole
+static clBool accumulateFrame(clContext * C, struct clImageHDRAccumulator * accumulator, const char * filename)
+{
+    const char * formatName = clFormatDetect(C, filename);
+    if (!formatName || !strcmp(formatName, "icc")) {
+        clContextLog(C, "highlight", 1, "Skipping: %s", filename);
+        return clTrue;
+    }
+
+    // Only formats that can stream are read raw here; the rest go straight to clContextRead() so nothing is read twice
+    clRaw raw = CL_RAW_EMPTY;
+    clFormatStripReader * stripReader = NULL;
+    clFormat * format = clContextFindFormat(C, formatName);
+    if (format && format->readStripsFunc && clRawReadFile(C, &raw, filename)) {
+        stripReader = clContextReadStrips(C, formatName, C->iccOverrideIn, &raw);
+    }
+    clBool result = clTrue;
+    if (stripReader) {
+        clImage * image = stripReader->image;
+        int stripRows = CL_CLAMP(CL_HIGHLIGHT_STRIP_PIXELS / image->width, 1, image->height);
+        clImage * strip = clImageCreate(C, image->width, stripRows, image->depth, image->profile);
+        for (int y = 0; y < image->height; y += stripRows) {
+            int rowCount = CL_MIN(stripRows, image->height - y);
+            if (!stripReader->readRows(C, stripReader, strip, rowCount)) {
+                clContextLogError(C, "Failed to read rows from: %s", filename);
+                result = clFalse;
+                break;
+            }
+            clImageHDRAccumulatorAddRows(C, accumulator, strip, 0, rowCount);
+        }
+        clImageHDRAccumulatorEndFrame(C, accumulator);
+        clImageDestroy(C, strip);
+        stripReader->destroy(C, stripReader);
+    } else {
+        clImage * image = clContextRead(C, filename, C->iccOverrideIn, NULL);
+        if (image) {
+            clImageHDRAccumulatorAddImage(C, accumulator, image);
+            clImageDestroy(C, image);
+        } else {
+            result = clFalse;
+        }
+    }
+    clRawFree(C, &raw);
+    return result;
+}
+
+// Measures every frame of a directory of images with a single accumulator, so memory stays bounded however long the
+// sequence is, and writes the combined stats (HDR10's MaxCLL and MaxFALL included) as JSON
+static int highlightSequence(clContext * C, clFileList * fileList)
+{
+    struct clImageHDRAccumulator * accumulator = clImageHDRAccumulatorCreate(C, C->defaultLuminance, 0.0f);
+    clBool result = clTrue;
+    for (int i = 0; (i < fileList->count) && result; ++i) {
+        clContextLog(C, "decode", 1, "Reading: %s (%d bytes)", fileList->filenames[i], clFileSize(fileList->filenames[i]));
+        result = accumulateFrame(C, accumulator, fileList->filenames[i]);
+    }
+
+    clImageHDRStats stats;
+    clImageHDRQuantization * quantization = clAllocateStruct(clImageHDRQuantization);
+    clImageHDRAccumulatorFinish(C, accumulator, &stats, quantization);
+    clImageHDRAccumulatorDestroy(C, accumulator);
+
+    int ret = 1;
+    if (result && (stats.frameCount > 0)) {
+        clContextLog(C, "highlight", 1, "Measured %d frames", stats.frameCount);
+        logHDRStats(C, &stats);
+
+        cJSON * jsonOutput = cJSON_CreateObject();
+        cJSON_AddNumberToObject(jsonOutput, "frames", stats.frameCount);
+        cJSON_AddNumberToObject(jsonOutput, "pixels", (double)stats.pixelCount);
+        cJSON_AddNumberToObject(jsonOutput, "maxCLL", stats.maxCLL);
+        cJSON_AddNumberToObject(jsonOutput, "maxFALL", stats.maxFALL);
+        cJSON_AddNumberToObject(jsonOutput, "overbrightPixels", (double)stats.overbrightPixelCount);
+        cJSON_AddNumberToObject(jsonOutput, "outOfGamutPixels", (double)stats.outOfGamutPixelCount);
+        cJSON_AddNumberToObject(jsonOutput, "bothPixels", (double)stats.bothPixelCount);
+        cJSON_AddNumberToObject(jsonOutput, "hdrPixels", (double)stats.hdrPixelCount);
+        cJSON * jsonBrightest = cJSON_AddObjectToObject(jsonOutput, "brightestPixel");
+        cJSON_AddNumberToObject(jsonBrightest, "nits", stats.brightestPixelNits);
+        cJSON_AddNumberToObject(jsonBrightest, "frame", stats.brightestPixelFrame);
+        cJSON_AddNumberToObject(jsonBrightest, "x", stats.brightestPixelX);
+        cJSON_AddNumberToObject(jsonBrightest, "y", stats.brightestPixelY);
+        cJSON * jsonNits = cJSON_AddArrayToObject(jsonOutput, "nitsPercentiles");
+        cJSON * jsonSaturation = cJSON_AddArrayToObject(jsonOutput, "saturationPercentiles");
+        for (int i = 0; i <= 100; ++i) {
+            cJSON_AddItemToArray(jsonNits, cJSON_CreateNumber(quantization->percentiles[i].nits));
+            cJSON_AddItemToArray(jsonSaturation, cJSON_CreateNumber(quantization->percentiles[i].saturation));
+        }
+
+        char * textOutput = cJSON_Print(jsonOutput);
+        clRaw output = CL_RAW_EMPTY;
+        clRawSet(C, &output, (const uint8_t *)textOutput, strlen(textOutput));
+        if (clRawWriteFile(C, &output, C->outputFilename)) {
+            ret = 0;
+            clContextLog(C, "encode", 1, "Wrote %d bytes.", clFileSize(C->outputFilename));
+        }
+        clRawFree(C, &output);
+        free(textOutput);
+        cJSON_Delete(jsonOutput);
+    } else if (result) {
+        clContextLogError(C, "No frames found in: %s", C->inputFilename);
+    }
+    clFree(quantization);
+    return ret;
+}
+
 int clContextHighlight(clContext * C)
 {
     COLORIST_UNUSED(C);
 
+    clFileList * fileList = clFileListCreate(C, C->inputFilename);
+    if (fileList) {
+        clContextLog(C, "action", 0, "Highlight: %s (%d files)", C->inputFilename, fileList->count);
+        int ret = highlightSequence(C, fileList);
+        clFileListDestroy(C, fileList);
+        return ret;
+    }
+
     const char * formatName = C->params.formatName;
     if (!formatName)
         formatName = clFormatDetect(C, C->inputFilename);
@@ -32,6 +196,7 @@ int clContextHighlight(clContext * C)
 
     clContextLog(C, "action", 0, "Highlight: %s", C->inputFilename);
     clContextLog(C, "decode", 0, "Reading: %s (%d bytes)", C->inputFilename, clFileSize(C->inputFilename));
+
     clImage * image = clContextRead(C, C->inputFilename, C->iccOverrideIn, &formatName);
     int ret = 1;
     if (image) {
@@ -41,33 +206,7 @@ int clContextHighlight(clContext * C)
         clImageHDRStats stats;
         clImageMeasureHDR(C, image, C->defaultLuminance, 0.0f, &highlight, &stats, NULL, NULL);
         if (highlight) {
-            clContextLog(C, "highlight", 2, "Total Pixels          : %d", stats.pixelCount);
-            clContextLog(C,
-                         "highlight",
-                         2,
-                         "Overbright (%4d nits): %d (%2.2f%%)",
-                         C->defaultLuminance,
-                         stats.overbrightPixelCount,
-                         100.0f * (float)stats.overbrightPixelCount / stats.pixelCount);
-            clContextLog(C,
-                         "highlight",
-                         2,
-                         "Out of Gamut (BT709)  : %d (%2.2f%%)",
-                         stats.outOfGamutPixelCount,
-                         100.0f * (float)stats.outOfGamutPixelCount / stats.pixelCount);
-            clContextLog(C,
-                         "highlight",
-                         2,
-                         "Both                  : %d (%2.2f%%)",
-                         stats.hdrPixelCount,
-                         100.0f * (float)stats.hdrPixelCount / stats.pixelCount);
-            clContextLog(C,
-                         "highlight",
-                         2,
-                         "Brightest Pixel       : %2.2f nits @ [%d, %d]",
-                         stats.brightestPixelNits,
-                         stats.brightestPixelX,
-                         stats.brightestPixelY);
+            logHDRStats(C, &stats);
 
             clConversionParams params;
             memcpy(&params, &C->params, sizeof(params));
@@ -107,6 +107,56 @@ clBool clContextWrite(clContext * C, struct clImage * image, const char * filena
     return result;
 }
 
+struct clFormatStripReader * clContextReadStrips(clContext * C,
+                                                 const char * formatName,
+                                                 const char * iccOverride,
+                                                 struct clRaw * input)
+{
+    clFormat * format = clContextFindFormat(C, formatName);
+    if (!format || !format->readStripsFunc) {
+        return NULL;
+    }
+
+    clProfile * overrideProfile = NULL;
+    if (iccOverride) {
+        overrideProfile = clProfileRead(C, iccOverride);
+        if (overrideProfile) {
+            clContextLog(C, "profile", 1, "Overriding src profile with file: %s", iccOverride);
+        } else {
+            clContextLogError(C, "Bad ICC override file [-i]: %s", iccOverride);
+            return NULL;
+        }
+    }
+
+    memset(&C->readExtraInfo, 0, sizeof(C->readExtraInfo));
+    clFormatStripReader * reader = format->readStripsFunc(C, formatName, overrideProfile, input);
+
+    if (overrideProfile) {
+        if (reader && !clProfileMatches(C, reader->image->profile, overrideProfile)) {
+            clProfileDestroy(C, reader->image->profile);
+            reader->image->profile = overrideProfile; // take ownership
+            overrideProfile = NULL;
+        }
+        if (overrideProfile) {
+            clProfileDestroy(C, overrideProfile);
+        }
+    }
+    return reader;
+}
+
+struct clFormatStripWriter * clContextWriteStrips(clContext * C,
+                                                  struct clImage * image,
+                                                  const char * formatName,
+                                                  struct clRaw * output,
+                                                  clWriteParams * writeParams)
+{
+    clFormat * format = clContextFindFormat(C, formatName);
+    if (!format || !format->writeStripsFunc) {
+        return NULL;
+    }
+    return format->writeStripsFunc(C, image, formatName, output, writeParams);
+}
+
 char * clContextWriteURI(struct clContext * C, clImage * image, const char * formatName, clWriteParams * writeParams)
 {
     char * output = NULL;
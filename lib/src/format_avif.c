@@ -259,16 +259,16 @@ clBool clFormatWriteAVIF(struct clContext * C, struct clImage * image, const cha
     avifRGBImage rgb;
     avifRGBImageSetDefaults(&rgb, avif);
     if (avifImageUsesU16(avif)) {
-        clImagePrepareReadPixels(C, image, CL_PIXELFORMAT_U16);
+        clImagePrepareReadRows(C, image, CL_PIXELFORMAT_U16);
 
         rgb.pixels = (uint8_t *)image->pixelsU16;
-        rgb.rowBytes = image->width * sizeof(uint16_t) * CL_CHANNELS_PER_PIXEL;
+        rgb.rowBytes = image->rowBytes[CL_PIXELFORMAT_U16];
         avifImageRGBToYUV(avif, &rgb);
     } else {
-        clImagePrepareReadPixels(C, image, CL_PIXELFORMAT_U8);
+        clImagePrepareReadRows(C, image, CL_PIXELFORMAT_U8);
 
         rgb.pixels = image->pixelsU8;
-        rgb.rowBytes = image->width * sizeof(uint8_t) * CL_CHANNELS_PER_PIXEL;
+        rgb.rowBytes = image->rowBytes[CL_PIXELFORMAT_U8];
         avifImageRGBToYUV(avif, &rgb);
     }
 
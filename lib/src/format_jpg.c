@@ -38,37 +38,84 @@ static void write_icc_profile(j_compress_ptr cinfo, const JOCTET * icc_data_ptr,
 
 struct clImage * clFormatReadJPG(struct clContext * C, const char * formatName, struct clProfile * overrideProfile, struct clRaw * input);
 clBool clFormatWriteJPG(struct clContext * C, struct clImage * image, const char * formatName, struct clRaw * output, struct clWriteParams * writeParams);
-
-struct clImage * clFormatReadJPG(struct clContext * C, const char * formatName, struct clProfile * overrideProfile, struct clRaw * input)
+clFormatStripReader * clFormatReadStripsJPG(struct clContext * C,
+                                            const char * formatName,
+                                            struct clProfile * overrideProfile,
+                                            struct clRaw * input);
+clFormatStripWriter * clFormatWriteStripsJPG(struct clContext * C,
+                                             struct clImage * image,
+                                             const char * formatName,
+                                             struct clRaw * output,
+                                             struct clWriteParams * writeParams);
+
+typedef struct jpgStripReader
 {
-    COLORIST_UNUSED(formatName);
-
-    clImage * image = NULL;
-
+    clFormatStripReader base;
     struct my_error_mgr jerr;
     struct jpeg_decompress_struct cinfo;
-    cinfo.err = jpeg_std_error(&jerr.pub);
-    jerr.pub.error_exit = my_error_exit;
-    if (setjmp(jerr.setjmp_buffer)) {
-        if (image) {
-            clImageDestroy(C, image);
+    JSAMPARRAY buffer;
+} jpgStripReader;
+
+static clBool stripReaderReadRows(struct clContext * C, clFormatStripReader * base, clImage * strip, int rowCount)
+{
+    jpgStripReader * reader = (jpgStripReader *)base;
+    if (setjmp(reader->jerr.setjmp_buffer)) {
+        return clFalse;
+    }
+
+    clImagePrepareWritePixels(C, strip, CL_PIXELFORMAT_U8);
+    for (int row = 0; row < rowCount; ++row) {
+        jpeg_read_scanlines(&reader->cinfo, reader->buffer, 1);
+        uint8_t * pixelRow = &strip->pixelsU8[row * strip->width * CL_CHANNELS_PER_PIXEL];
+        for (unsigned int i = 0; i < reader->cinfo.output_width; ++i) {
+            uint8_t * dst = &pixelRow[i * CL_CHANNELS_PER_PIXEL];
+            uint8_t * src = &reader->buffer[0][i * 3];
+            dst[0] = src[0];
+            dst[1] = src[1];
+            dst[2] = src[2];
+            dst[3] = 255;
         }
-        jpeg_destroy_decompress(&cinfo);
-        return 0;
     }
+    return clTrue;
+}
 
-    Timer t;
-    timerStart(&t);
+static void stripReaderDestroy(struct clContext * C, clFormatStripReader * base)
+{
+    jpgStripReader * reader = (jpgStripReader *)base;
+    jpeg_destroy_decompress(&reader->cinfo);
+    if (base->image) {
+        clImageDestroy(C, base->image);
+    }
+    clFree(reader);
+}
 
-    jpeg_create_decompress(&cinfo);
-    setup_read_icc_profile(&cinfo);
-    jpeg_mem_src(&cinfo, input->ptr, (unsigned long)input->size);
-    jpeg_read_header(&cinfo, TRUE);
-    cinfo.out_color_space = JCS_RGB;
-    jpeg_start_decompress(&cinfo);
+clFormatStripReader * clFormatReadStripsJPG(struct clContext * C,
+                                            const char * formatName,
+                                            struct clProfile * overrideProfile,
+                                            struct clRaw * input)
+{
+    COLORIST_UNUSED(formatName);
 
-    int row_stride = cinfo.output_width * cinfo.output_components;
-    JSAMPARRAY buffer = (*cinfo.mem->alloc_sarray)((j_common_ptr)&cinfo, JPOOL_IMAGE, row_stride, 1);
+    jpgStripReader * reader = clAllocateStruct(jpgStripReader);
+    reader->base.image = NULL;
+    reader->base.readRows = stripReaderReadRows;
+    reader->base.destroy = stripReaderDestroy;
+    reader->cinfo.err = jpeg_std_error(&reader->jerr.pub);
+    reader->jerr.pub.error_exit = my_error_exit;
+    if (setjmp(reader->jerr.setjmp_buffer)) {
+        stripReaderDestroy(C, &reader->base);
+        return NULL;
+    }
+
+    jpeg_create_decompress(&reader->cinfo);
+    setup_read_icc_profile(&reader->cinfo);
+    jpeg_mem_src(&reader->cinfo, input->ptr, (unsigned long)input->size);
+    jpeg_read_header(&reader->cinfo, TRUE);
+    reader->cinfo.out_color_space = JCS_RGB;
+    jpeg_start_decompress(&reader->cinfo);
+
+    int row_stride = reader->cinfo.output_width * reader->cinfo.output_components;
+    reader->buffer = (*reader->cinfo.mem->alloc_sarray)((j_common_ptr)&reader->cinfo, JPOOL_IMAGE, row_stride, 1);
 
     clProfile * profile = NULL;
     if (overrideProfile) {
@@ -76,112 +123,154 @@ struct clImage * clFormatReadJPG(struct clContext * C, const char * formatName,
     } else {
         uint8_t * iccData = NULL;
         unsigned int iccDataLen;
-        if (read_icc_profile(C, &cinfo, &iccData, &iccDataLen)) {
+        if (read_icc_profile(C, &reader->cinfo, &iccData, &iccDataLen)) {
             profile = clProfileParse(C, iccData, iccDataLen, NULL);
+            clFree(iccData);
             if (!profile) {
                 clContextLogError(C, "ERROR: can't parse JPEG embedded ICC profile");
-                jpeg_destroy_decompress(&cinfo);
+                stripReaderDestroy(C, &reader->base);
                 return NULL;
             }
-            clFree(iccData);
         }
     }
 
-    clImageLogCreate(C, cinfo.output_width, cinfo.output_height, 8, profile);
-    image = clImageCreate(C, cinfo.output_width, cinfo.output_height, 8, profile);
-    clImagePrepareWritePixels(C, image, CL_PIXELFORMAT_U8);
-
+    clImageLogCreate(C, reader->cinfo.output_width, reader->cinfo.output_height, 8, profile);
+    reader->base.image = clImageCreate(C, reader->cinfo.output_width, reader->cinfo.output_height, 8, profile);
     if (profile) {
         clProfileDestroy(C, profile);
     }
+    return &reader->base;
+}
 
-    int row = 0;
-    while (cinfo.output_scanline < cinfo.output_height) {
-        jpeg_read_scanlines(&cinfo, buffer, 1);
-        uint8_t * pixelRow = &image->pixelsU8[row * image->width * CL_CHANNELS_PER_PIXEL];
-        for (unsigned int i = 0; i < cinfo.output_width; ++i) {
-            uint8_t * dst = &pixelRow[i * CL_CHANNELS_PER_PIXEL];
-            uint8_t * src = &buffer[0][i * 3];
-            dst[0] = src[0];
-            dst[1] = src[1];
-            dst[2] = src[2];
-            dst[3] = 255;
+typedef struct jpgStripWriter
+{
+    clFormatStripWriter base;
+    struct jpeg_compress_struct cinfo;
+    struct jpeg_error_mgr jerr;
+    unsigned char * outbuffer;
+    unsigned long outsize;
+    uint8_t * rowPixels; // one row of RGB
+    clRaw * output;
+} jpgStripWriter;
+
+static clBool stripWriterWriteRows(struct clContext * C, clFormatStripWriter * base, clImage * strip, int rowCount)
+{
+    jpgStripWriter * writer = (jpgStripWriter *)base;
+
+    clImagePrepareReadPixels(C, strip, CL_PIXELFORMAT_U8);
+    for (int row = 0; row < rowCount; ++row) {
+        uint8_t * pixelRow = &strip->pixelsU8[row * strip->width * CL_CHANNELS_PER_PIXEL];
+        for (int i = 0; i < strip->width; ++i) {
+            uint8_t * imagePixel = &pixelRow[i * CL_CHANNELS_PER_PIXEL];
+            uint8_t * jpegPixel = &writer->rowPixels[i * 3];
+            jpegPixel[0] = imagePixel[0];
+            jpegPixel[1] = imagePixel[1];
+            jpegPixel[2] = imagePixel[2];
         }
-        ++row;
+        JSAMPROW row_pointer[1];
+        row_pointer[0] = writer->rowPixels;
+        (void)jpeg_write_scanlines(&writer->cinfo, row_pointer, 1);
     }
+    return clTrue;
+}
 
-    jpeg_finish_decompress(&cinfo);
-    jpeg_destroy_decompress(&cinfo);
+static clBool stripWriterFinish(struct clContext * C, clFormatStripWriter * base)
+{
+    jpgStripWriter * writer = (jpgStripWriter *)base;
 
-    C->readExtraInfo.decodeCodecSeconds = timerElapsedSeconds(&t);
-    return image;
+    jpeg_finish_compress(&writer->cinfo);
+    if (writer->outbuffer && writer->outsize) {
+        clRawSet(C, writer->output, writer->outbuffer, writer->outsize);
+    } else {
+        clContextLogError(C, "ERROR: JPG compression failed");
+        clRawFree(C, writer->output);
+    }
+    return (writer->output->size > 0) ? clTrue : clFalse;
 }
 
-clBool clFormatWriteJPG(struct clContext * C, struct clImage * image, const char * formatName, struct clRaw * output, struct clWriteParams * writeParams)
+static void stripWriterDestroy(struct clContext * C, clFormatStripWriter * base)
 {
-    COLORIST_UNUSED(formatName);
-
-    struct jpeg_compress_struct cinfo;
-    struct jpeg_error_mgr jerr;
+    jpgStripWriter * writer = (jpgStripWriter *)base;
+    jpeg_destroy_compress(&writer->cinfo);
+    free(writer->outbuffer);
+    clFree(writer->rowPixels);
+    clFree(writer);
+}
 
-    JSAMPROW row_pointer[1];
-    int row_stride;
-    unsigned char * outbuffer = NULL;
-    unsigned long outsize = 0;
+clFormatStripWriter * clFormatWriteStripsJPG(struct clContext * C,
+                                             struct clImage * image,
+                                             const char * formatName,
+                                             struct clRaw * output,
+                                             struct clWriteParams * writeParams)
+{
+    COLORIST_UNUSED(formatName);
 
     clRaw rawProfile = CL_RAW_EMPTY;
     if (!clProfilePack(C, image->profile, &rawProfile)) {
-        return clFalse;
+        return NULL;
     }
 
-    cinfo.err = jpeg_std_error(&jerr);
-    jpeg_create_compress(&cinfo);
-    jpeg_mem_dest(&cinfo, &outbuffer, &outsize);
+    jpgStripWriter * writer = clAllocateStruct(jpgStripWriter);
+    writer->base.writeRows = stripWriterWriteRows;
+    writer->base.finish = stripWriterFinish;
+    writer->base.destroy = stripWriterDestroy;
+    writer->outbuffer = NULL;
+    writer->outsize = 0;
+    writer->rowPixels = clAllocate(3 * image->width);
+    writer->output = output;
+
+    writer->cinfo.err = jpeg_std_error(&writer->jerr);
+    jpeg_create_compress(&writer->cinfo);
+    jpeg_mem_dest(&writer->cinfo, &writer->outbuffer, &writer->outsize);
+
+    writer->cinfo.image_width = image->width;
+    writer->cinfo.image_height = image->height;
+    writer->cinfo.input_components = 3;
+    writer->cinfo.in_color_space = JCS_RGB;
+    jpeg_set_defaults(&writer->cinfo);
+    jpeg_set_quality(&writer->cinfo, writeParams->quality, TRUE);
+    jpeg_start_compress(&writer->cinfo, TRUE);
 
-    clImagePrepareReadPixels(C, image, CL_PIXELFORMAT_U8);
-
-    int pixelCount = image->width * image->height;
-    uint8_t * jpegPixels = clAllocate(3 * pixelCount);
-    for (int i = 0; i < pixelCount; ++i) {
-        uint8_t * imagePixel = &image->pixelsU8[i * CL_CHANNELS_PER_PIXEL];
-        uint8_t * jpegPixel = &jpegPixels[i * 3];
-        jpegPixel[0] = imagePixel[0];
-        jpegPixel[1] = imagePixel[1];
-        jpegPixel[2] = imagePixel[2];
+    if (writeParams->writeProfile) {
+        write_icc_profile(&writer->cinfo, rawProfile.ptr, (unsigned int)rawProfile.size);
     }
+    clRawFree(C, &rawProfile);
+    return &writer->base;
+}
 
-    cinfo.image_width = image->width;
-    cinfo.image_height = image->height;
-    cinfo.input_components = 3;
-    cinfo.in_color_space = JCS_RGB;
-    jpeg_set_defaults(&cinfo);
-    jpeg_set_quality(&cinfo, writeParams->quality, TRUE);
-    jpeg_start_compress(&cinfo, TRUE);
+struct clImage * clFormatReadJPG(struct clContext * C, const char * formatName, struct clProfile * overrideProfile, struct clRaw * input)
+{
+    Timer t;
+    timerStart(&t);
 
-    if (writeParams->writeProfile) {
-        write_icc_profile(&cinfo, rawProfile.ptr, (unsigned int)rawProfile.size);
+    clFormatStripReader * reader = clFormatReadStripsJPG(C, formatName, overrideProfile, input);
+    if (!reader) {
+        return NULL;
     }
 
-    row_stride = image->width * 3;
-    while (cinfo.next_scanline < cinfo.image_height) {
-        row_pointer[0] = &jpegPixels[cinfo.next_scanline * row_stride];
-        (void)jpeg_write_scanlines(&cinfo, row_pointer, 1);
+    // Take ownership of the reader's image, and decode all of it
+    clImage * image = reader->image;
+    reader->image = NULL;
+    if (!reader->readRows(C, reader, image, image->height)) {
+        clImageDestroy(C, image);
+        image = NULL;
     }
+    reader->destroy(C, reader);
 
-    jpeg_finish_compress(&cinfo);
+    C->readExtraInfo.decodeCodecSeconds = timerElapsedSeconds(&t);
+    return image;
+}
 
-    if (outbuffer && outsize) {
-        clRawSet(C, output, outbuffer, outsize);
-    } else {
-        clContextLogError(C, "ERROR: JPG compression failed");
-        clRawFree(C, output);
+clBool clFormatWriteJPG(struct clContext * C, struct clImage * image, const char * formatName, struct clRaw * output, struct clWriteParams * writeParams)
+{
+    clFormatStripWriter * writer = clFormatWriteStripsJPG(C, image, formatName, output, writeParams);
+    if (!writer) {
+        return clFalse;
     }
-    free(outbuffer);
 
-    jpeg_destroy_compress(&cinfo);
-    clFree(jpegPixels);
-    clRawFree(C, &rawProfile);
-    return (output->size > 0) ? clTrue : clFalse;
+    clBool result = writer->writeRows(C, writer, image, image->height) && writer->finish(C, writer);
+    writer->destroy(C, writer);
+    return result;
 }
 
 // ----------------------------------------------------------------------------
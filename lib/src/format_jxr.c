@@ -352,11 +352,11 @@ clBool clFormatWriteJXR(struct clContext * C, struct clImage * image, const char
     }
 
     if (image->depth > 8) {
-        clImagePrepareReadPixels(C, image, CL_PIXELFORMAT_U16);
-        pEncoder->WritePixels(pEncoder, image->height, (U8 *)image->pixelsU16, image->width * 4 * sizeof(uint16_t));
+        clImagePrepareReadRows(C, image, CL_PIXELFORMAT_U16);
+        pEncoder->WritePixels(pEncoder, image->height, (U8 *)image->pixelsU16, image->rowBytes[CL_PIXELFORMAT_U16]);
     } else {
-        clImagePrepareReadPixels(C, image, CL_PIXELFORMAT_U8);
-        pEncoder->WritePixels(pEncoder, image->height, image->pixelsU8, image->width * 4 * sizeof(uint8_t));
+        clImagePrepareReadRows(C, image, CL_PIXELFORMAT_U8);
+        pEncoder->WritePixels(pEncoder, image->height, image->pixelsU8, image->rowBytes[CL_PIXELFORMAT_U8]);
     }
     output->size = pEncodeStream->state.buf.cbLast;
 
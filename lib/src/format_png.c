@@ -16,6 +16,15 @@
 
 struct clImage * clFormatReadPNG(struct clContext * C, const char * formatName, struct clProfile * overrideProfile, struct clRaw * input);
 clBool clFormatWritePNG(struct clContext * C, struct clImage * image, const char * formatName, struct clRaw * output, struct clWriteParams * writeParams);
+clFormatStripReader * clFormatReadStripsPNG(struct clContext * C,
+                                            const char * formatName,
+                                            struct clProfile * overrideProfile,
+                                            struct clRaw * input);
+clFormatStripWriter * clFormatWriteStripsPNG(struct clContext * C,
+                                             struct clImage * image,
+                                             const char * formatName,
+                                             struct clRaw * output,
+                                             struct clWriteParams * writeParams);
 
 struct readInfo
 {
@@ -33,42 +42,10 @@ static void readCallback(png_structp png, png_bytep data, png_size_t length)
     ri->offset += length;
 }
 
-struct clImage * clFormatReadPNG(struct clContext * C, const char * formatName, struct clProfile * overrideProfile, struct clRaw * input)
+// Reads the header and sets libpng up to produce RGBA rows, returning an image without any pixels. Must be called
+// under the caller's setjmp().
+static clImage * readHeader(struct clContext * C, png_structp png, png_infop info, struct clProfile * overrideProfile)
 {
-    COLORIST_UNUSED(formatName);
-
-    clImage * image = NULL;
-    png_bytep * rowPointers = NULL;
-
-    if (png_sig_cmp(input->ptr, 0, 8)) {
-        clContextLogError(C, "not a PNG");
-        return NULL;
-    }
-
-    Timer t;
-    timerStart(&t);
-
-    png_structp png = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
-    png_infop info = png_create_info_struct(png);
-    COLORIST_ASSERT(png && info);
-
-    if (setjmp(png_jmpbuf(png))) {
-        if (rowPointers) {
-            clFree(rowPointers);
-        }
-        if (image) {
-            clImageDestroy(C, image);
-        }
-        png_destroy_read_struct(&png, &info, NULL);
-        return NULL;
-    }
-
-    struct readInfo ri;
-    ri.C = C;
-    ri.src = input;
-    ri.offset = 0;
-
-    png_set_read_fn(png, &ri, readCallback);
     png_read_info(png, info);
 
     clProfile * profile = NULL;
@@ -110,30 +87,69 @@ struct clImage * clFormatReadPNG(struct clContext * C, const char * formatName,
     }
 
     int imgBitDepth = 8;
-    int imgBytesPerChannel = 1;
     if (rawBitDepth == 16) {
         png_set_swap(png);
         imgBitDepth = 16;
-        imgBytesPerChannel = 2;
     }
 
     png_read_update_info(png, info);
 
     clImageLogCreate(C, rawWidth, rawHeight, imgBitDepth, profile);
-    image = clImageCreate(C, rawWidth, rawHeight, imgBitDepth, profile);
+    clImage * image = clImageCreate(C, rawWidth, rawHeight, imgBitDepth, profile);
     if (profile) {
         clProfileDestroy(C, profile);
     }
-    rowPointers = (png_bytep *)clAllocate(sizeof(png_bytep) * rawHeight);
-    if (imgBytesPerChannel == 1) {
+    return image;
+}
+
+struct clImage * clFormatReadPNG(struct clContext * C, const char * formatName, struct clProfile * overrideProfile, struct clRaw * input)
+{
+    COLORIST_UNUSED(formatName);
+
+    clImage * image = NULL;
+    png_bytep * rowPointers = NULL;
+
+    if (png_sig_cmp(input->ptr, 0, 8)) {
+        clContextLogError(C, "not a PNG");
+        return NULL;
+    }
+
+    Timer t;
+    timerStart(&t);
+
+    png_structp png = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    png_infop info = png_create_info_struct(png);
+    COLORIST_ASSERT(png && info);
+
+    if (setjmp(png_jmpbuf(png))) {
+        if (rowPointers) {
+            clFree(rowPointers);
+        }
+        if (image) {
+            clImageDestroy(C, image);
+        }
+        png_destroy_read_struct(&png, &info, NULL);
+        return NULL;
+    }
+
+    struct readInfo ri;
+    ri.C = C;
+    ri.src = input;
+    ri.offset = 0;
+
+    png_set_read_fn(png, &ri, readCallback);
+    image = readHeader(C, png, info, overrideProfile);
+
+    rowPointers = (png_bytep *)clAllocate(sizeof(png_bytep) * image->height);
+    if (image->depth == 8) {
         clImagePrepareWritePixels(C, image, CL_PIXELFORMAT_U8);
-        for (int y = 0; y < rawHeight; ++y) {
-            rowPointers[y] = &image->pixelsU8[CL_CHANNELS_PER_PIXEL * y * rawWidth];
+        for (int y = 0; y < image->height; ++y) {
+            rowPointers[y] = &image->pixelsU8[CL_CHANNELS_PER_PIXEL * y * image->width];
         }
     } else {
         clImagePrepareWritePixels(C, image, CL_PIXELFORMAT_U16);
-        for (int y = 0; y < rawHeight; ++y) {
-            rowPointers[y] = (png_byte *)&image->pixelsU16[CL_CHANNELS_PER_PIXEL * y * rawWidth];
+        for (int y = 0; y < image->height; ++y) {
+            rowPointers[y] = (png_byte *)&image->pixelsU16[CL_CHANNELS_PER_PIXEL * y * image->width];
         }
     }
     png_read_image(png, rowPointers);
@@ -144,6 +160,85 @@ struct clImage * clFormatReadPNG(struct clContext * C, const char * formatName,
     return image;
 }
 
+typedef struct pngStripReader
+{
+    clFormatStripReader base;
+    png_structp png;
+    png_infop info;
+    struct readInfo ri;
+    int depth;
+} pngStripReader;
+
+static clBool stripReaderReadRows(struct clContext * C, clFormatStripReader * base, clImage * strip, int rowCount)
+{
+    pngStripReader * reader = (pngStripReader *)base;
+    if (setjmp(png_jmpbuf(reader->png))) {
+        return clFalse;
+    }
+
+    clPixelFormat pixelFormat = (reader->depth == 8) ? CL_PIXELFORMAT_U8 : CL_PIXELFORMAT_U16;
+    clImagePrepareWritePixels(C, strip, pixelFormat);
+    for (int y = 0; y < rowCount; ++y) {
+        png_bytep row;
+        if (pixelFormat == CL_PIXELFORMAT_U8) {
+            row = &strip->pixelsU8[CL_CHANNELS_PER_PIXEL * y * strip->width];
+        } else {
+            row = (png_bytep)&strip->pixelsU16[CL_CHANNELS_PER_PIXEL * y * strip->width];
+        }
+        png_read_row(reader->png, row, NULL);
+    }
+    return clTrue;
+}
+
+static void stripReaderDestroy(struct clContext * C, clFormatStripReader * base)
+{
+    pngStripReader * reader = (pngStripReader *)base;
+    png_destroy_read_struct(&reader->png, &reader->info, NULL);
+    if (base->image) {
+        clImageDestroy(C, base->image);
+    }
+    clFree(reader);
+}
+
+clFormatStripReader * clFormatReadStripsPNG(struct clContext * C,
+                                            const char * formatName,
+                                            struct clProfile * overrideProfile,
+                                            struct clRaw * input)
+{
+    COLORIST_UNUSED(formatName);
+
+    if (png_sig_cmp(input->ptr, 0, 8)) {
+        clContextLogError(C, "not a PNG");
+        return NULL;
+    }
+
+    pngStripReader * reader = clAllocateStruct(pngStripReader);
+    reader->base.image = NULL;
+    reader->base.readRows = stripReaderReadRows;
+    reader->base.destroy = stripReaderDestroy;
+    reader->png = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    reader->info = png_create_info_struct(reader->png);
+    COLORIST_ASSERT(reader->png && reader->info);
+    reader->ri.C = C;
+    reader->ri.src = input;
+    reader->ri.offset = 0;
+
+    if (setjmp(png_jmpbuf(reader->png))) {
+        stripReaderDestroy(C, &reader->base);
+        return NULL;
+    }
+
+    png_set_read_fn(reader->png, &reader->ri, readCallback);
+    reader->base.image = readHeader(C, reader->png, reader->info, overrideProfile);
+    if (!reader->base.image || (png_get_interlace_type(reader->png, reader->info) != PNG_INTERLACE_NONE)) {
+        // Interlaced rows aren't final until the last pass
+        stripReaderDestroy(C, &reader->base);
+        return NULL;
+    }
+    reader->depth = reader->base.image->depth;
+    return &reader->base;
+}
+
 struct writeInfo
 {
     struct clContext * C;
@@ -167,10 +262,29 @@ static void writeCallback(png_structp png, png_bytep data, png_size_t length)
     wi->offset += length;
 }
 
+// Must be called under the caller's setjmp()
+static void writeHeader(struct clContext * C,
+                        png_structp png,
+                        png_infop info,
+                        struct clImage * image,
+                        clRaw * rawProfile,
+                        struct clWriteParams * writeParams)
+{
+    COLORIST_UNUSED(C);
+
+    png_set_IHDR(png, info, image->width, image->height, image->depth, PNG_COLOR_TYPE_RGBA, PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+    if (writeParams->writeProfile) {
+        png_set_iCCP(png, info, image->profile->description, 0, rawProfile->ptr, (png_uint_32)rawProfile->size);
+    }
+    png_write_info(png, info);
+    if (image->depth != 8) {
+        png_set_swap(png);
+    }
+}
+
 clBool clFormatWritePNG(struct clContext * C, struct clImage * image, const char * formatName, struct clRaw * output, struct clWriteParams * writeParams)
 {
     COLORIST_UNUSED(formatName);
-    COLORIST_UNUSED(writeParams);
 
     png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
     png_infop info = png_create_info_struct(png);
@@ -197,26 +311,14 @@ clBool clFormatWritePNG(struct clContext * C, struct clImage * image, const char
     wi.offset = 0;
     wi.dst = output;
     png_set_write_fn(png, &wi, writeCallback, NULL);
-
-    png_set_IHDR(png, info, image->width, image->height, image->depth, PNG_COLOR_TYPE_RGBA, PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
-    if (writeParams->writeProfile) {
-        png_set_iCCP(png, info, image->profile->description, 0, rawProfile.ptr, (png_uint_32)rawProfile.size);
-    }
-    png_write_info(png, info);
+    writeHeader(C, png, info, image, &rawProfile, writeParams);
 
     rowPointers = (png_bytep *)clAllocate(sizeof(png_bytep) * image->height);
     int imgBytesPerChannel = (image->depth == 16) ? 2 : 1;
-    if (imgBytesPerChannel == 1) {
-        clImagePrepareReadPixels(C, image, CL_PIXELFORMAT_U8);
-        for (int y = 0; y < image->height; ++y) {
-            rowPointers[y] = &image->pixelsU8[CL_CHANNELS_PER_PIXEL * y * image->width];
-        }
-    } else {
-        clImagePrepareReadPixels(C, image, CL_PIXELFORMAT_U16);
-        for (int y = 0; y < image->height; ++y) {
-            rowPointers[y] = (png_byte *)&image->pixelsU16[CL_CHANNELS_PER_PIXEL * y * image->width];
-        }
-        png_set_swap(png);
+    clPixelFormat pixelFormat = (imgBytesPerChannel == 1) ? CL_PIXELFORMAT_U8 : CL_PIXELFORMAT_U16;
+    clImagePrepareReadRows(C, image, pixelFormat);
+    for (int y = 0; y < image->height; ++y) {
+        rowPointers[y] = clImagePixelRow(C, image, pixelFormat, y);
     }
 
     png_write_image(png, rowPointers);
@@ -228,3 +330,89 @@ clBool clFormatWritePNG(struct clContext * C, struct clImage * image, const char
     output->size = wi.offset;
     return clTrue;
 }
+
+typedef struct pngStripWriter
+{
+    clFormatStripWriter base;
+    png_structp png;
+    png_infop info;
+    struct writeInfo wi;
+    int depth;
+} pngStripWriter;
+
+static clBool stripWriterWriteRows(struct clContext * C, clFormatStripWriter * base, clImage * strip, int rowCount)
+{
+    pngStripWriter * writer = (pngStripWriter *)base;
+    if (setjmp(png_jmpbuf(writer->png))) {
+        return clFalse;
+    }
+
+    clPixelFormat pixelFormat = (writer->depth == 16) ? CL_PIXELFORMAT_U16 : CL_PIXELFORMAT_U8;
+    clImagePrepareReadPixels(C, strip, pixelFormat);
+    for (int y = 0; y < rowCount; ++y) {
+        if (pixelFormat == CL_PIXELFORMAT_U8) {
+            png_write_row(writer->png, &strip->pixelsU8[CL_CHANNELS_PER_PIXEL * y * strip->width]);
+        } else {
+            png_write_row(writer->png, (png_bytep)&strip->pixelsU16[CL_CHANNELS_PER_PIXEL * y * strip->width]);
+        }
+    }
+    return clTrue;
+}
+
+static clBool stripWriterFinish(struct clContext * C, clFormatStripWriter * base)
+{
+    COLORIST_UNUSED(C);
+
+    pngStripWriter * writer = (pngStripWriter *)base;
+    if (setjmp(png_jmpbuf(writer->png))) {
+        return clFalse;
+    }
+
+    png_write_end(writer->png, NULL);
+    writer->wi.dst->size = writer->wi.offset;
+    return clTrue;
+}
+
+static void stripWriterDestroy(struct clContext * C, clFormatStripWriter * base)
+{
+    pngStripWriter * writer = (pngStripWriter *)base;
+    png_destroy_write_struct(&writer->png, &writer->info);
+    clFree(writer);
+}
+
+clFormatStripWriter * clFormatWriteStripsPNG(struct clContext * C,
+                                             struct clImage * image,
+                                             const char * formatName,
+                                             struct clRaw * output,
+                                             struct clWriteParams * writeParams)
+{
+    COLORIST_UNUSED(formatName);
+
+    clRaw rawProfile = CL_RAW_EMPTY;
+    if (!clProfilePack(C, image->profile, &rawProfile)) {
+        return NULL;
+    }
+
+    pngStripWriter * writer = clAllocateStruct(pngStripWriter);
+    writer->base.writeRows = stripWriterWriteRows;
+    writer->base.finish = stripWriterFinish;
+    writer->base.destroy = stripWriterDestroy;
+    writer->png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    writer->info = png_create_info_struct(writer->png);
+    COLORIST_ASSERT(writer->png && writer->info);
+    writer->wi.C = C;
+    writer->wi.offset = 0;
+    writer->wi.dst = output;
+    writer->depth = image->depth;
+
+    if (setjmp(png_jmpbuf(writer->png))) {
+        clRawFree(C, &rawProfile);
+        stripWriterDestroy(C, &writer->base);
+        return NULL;
+    }
+
+    png_set_write_fn(writer->png, &writer->wi, writeCallback, NULL);
+    writeHeader(C, writer->png, writer->info, image, &rawProfile, writeParams);
+    clRawFree(C, &rawProfile);
+    return &writer->base;
+}
@@ -20,6 +20,15 @@ clBool clFormatWriteTIFF(struct clContext * C,
                          const char * formatName,
                          struct clRaw * output,
                          struct clWriteParams * writeParams);
+clFormatStripReader * clFormatReadStripsTIFF(struct clContext * C,
+                                             const char * formatName,
+                                             struct clProfile * overrideProfile,
+                                             struct clRaw * input);
+clFormatStripWriter * clFormatWriteStripsTIFF(struct clContext * C,
+                                              struct clImage * image,
+                                              const char * formatName,
+                                              struct clRaw * output,
+                                              struct clWriteParams * writeParams);
 
 typedef struct tiffCallbackInfo
 {
@@ -127,42 +136,16 @@ static void warningHandler(thandle_t handle, const char * module, const char * f
     clContextLogError(ci->C, "TIFF Warning: %s", tmp);
 }
 
-struct clImage * clFormatReadTIFF(struct clContext * C, const char * formatName, struct clProfile * overrideProfile, struct clRaw * input)
+static TIFF * openTIFF(tiffCallbackInfo * ci, const char * mode)
 {
-    COLORIST_UNUSED(formatName);
-
-    clProfile * profile = NULL;
-    clImage * image = NULL;
-    TIFF * tiff;
-    int width = 0;
-    int height = 0;
-    int depth = 0;
-    int iccLen = 0;
-    int channelCount = 0;
-    uint16_t planarConfig = PLANARCONFIG_CONTIG;
-    int orientation = ORIENTATION_TOPLEFT;
-    int sampleFormat = SAMPLEFORMAT_UINT;
-    uint8_t * iccBuf = NULL;
-    int rowIndex, rowBytes;
-    tiffCallbackInfo ci;
-    uint8_t * pixels = NULL;
-    clBool fp32 = clFalse;
-
-    ci.C = C;
-    ci.raw = input;
-    ci.offset = 0;
-
-    Timer t;
-    timerStart(&t);
-
     TIFFSetErrorHandler(NULL);
     TIFFSetErrorHandlerExt(errorHandler);
     TIFFSetWarningHandler(NULL);
     TIFFSetWarningHandlerExt(warningHandler);
 
-    tiff = TIFFClientOpen("tiff",
-                          "rb",
-                          (thandle_t)&ci,
+    return TIFFClientOpen("tiff",
+                          mode,
+                          (thandle_t)ci,
                           (TIFFReadWriteProc)readCallback,
                           (TIFFReadWriteProc)writeCallback,
                           (TIFFSeekProc)seekCallback,
@@ -170,28 +153,54 @@ struct clImage * clFormatReadTIFF(struct clContext * C, const char * formatName,
                           (TIFFSizeProc)sizeCallback,
                           (TIFFMapFileProc)mapCallback,
                           (TIFFUnmapFileProc)unmapCallback);
-    if (!tiff) {
-        clContextLogError(C, "cannot open TIFF for read");
-        goto readCleanup;
-    }
+}
+
+typedef struct tiffHeader
+{
+    int width;
+    int height;
+    int depth;
+    int channelCount;
+    uint16_t planarConfig;
+    int orientation;
+    clBool fp32;
+    uint8_t monochrome[2];
+    clProfile * profile; // owned by the header's reader
+} tiffHeader;
+
+// Everything but the pixels; returns clFalse (having logged why) if the TIFF is unsupported
+static clBool readHeader(struct clContext * C, TIFF * tiff, struct clProfile * overrideProfile, tiffHeader * header)
+{
+    int width = 0;
+    int height = 0;
+    int depth = 0;
+    int iccLen = 0;
+    int channelCount = 0;
+    uint16_t planarConfig = PLANARCONFIG_CONTIG;
+    int orientation = ORIENTATION_TOPLEFT;
+    int sampleFormat = SAMPLEFORMAT_UINT;
+    uint8_t * iccBuf = NULL;
+    clBool fp32 = clFalse;
+
+    header->profile = NULL;
 
     TIFFGetField(tiff, TIFFTAG_IMAGEWIDTH, &width);
     TIFFGetField(tiff, TIFFTAG_IMAGELENGTH, &height);
     if ((width <= 0) || (height <= 0)) {
         clContextLogError(C, "cannot read width and height from TIFF");
-        goto readCleanup;
+        return clFalse;
     }
 
     TIFFGetField(tiff, TIFFTAG_SAMPLESPERPIXEL, &channelCount);
     if ((channelCount != 1) && (channelCount != 3) && (channelCount != 4)) {
         clContextLogError(C, "unsupported channelCount(%d) from TIFF", channelCount);
-        goto readCleanup;
+        return clFalse;
     }
 
     TIFFGetField(tiff, TIFFTAG_PLANARCONFIG, &planarConfig);
     if ((planarConfig != PLANARCONFIG_CONTIG) && (planarConfig != PLANARCONFIG_SEPARATE)) {
         clContextLogError(C, "unsupported planarConfig(%u) from TIFF", planarConfig);
-        goto readCleanup;
+        return clFalse;
     }
 
     TIFFGetField(tiff, TIFFTAG_SAMPLEFORMAT, &sampleFormat);
@@ -202,28 +211,18 @@ struct clImage * clFormatReadTIFF(struct clContext * C, const char * formatName,
     if (depth <= 0) {
         // TODO: convert to 16bit
         clContextLogError(C, "cannot read depth from TIFF: '%s'");
-        goto readCleanup;
+        return clFalse;
     }
     if ((sampleFormat == SAMPLEFORMAT_IEEEFP) && (depth == 32)) {
         fp32 = clTrue;
     } else {
         if (sampleFormat != SAMPLEFORMAT_UINT) {
             clContextLogError(C, "unsupported sample format (%d) with depth(%d) from TIFF", sampleFormat, depth);
-            goto readCleanup;
+            return clFalse;
         }
         if ((depth != 1) && (depth != 8) && (depth != 16)) {
             clContextLogError(C, "unsupported uint depth(%d) from TIFF", depth);
-            goto readCleanup;
-        }
-    }
-
-    if (overrideProfile) {
-        profile = clProfileClone(C, overrideProfile);
-    } else if (TIFFGetField(tiff, TIFFTAG_ICCPROFILE, &iccLen, &iccBuf)) {
-        profile = clProfileParse(C, iccBuf, iccLen, NULL);
-        if (!profile) {
-            clContextLogError(C, "cannot parse ICC profile from TIFF");
-            goto readCleanup;
+            return clFalse;
         }
     }
 
@@ -231,41 +230,198 @@ struct clImage * clFormatReadTIFF(struct clContext * C, const char * formatName,
         if ((orientation != ORIENTATION_TOPLEFT) && (orientation != ORIENTATION_BOTLEFT)) {
             // TODO: Support other orientations
             clContextLogError(C, "Unsupported orientation (%d)", orientation);
-            goto readCleanup;
+            return clFalse;
         }
     } else {
         // ?
         orientation = ORIENTATION_TOPLEFT;
     }
 
-    uint8_t monochrome[2] = { 255, 0 };
+    header->monochrome[0] = 255;
+    header->monochrome[1] = 0;
     if (depth == 1) {
         uint16_t photometric = PHOTOMETRIC_MINISWHITE;
         TIFFGetField(tiff, TIFFTAG_PHOTOMETRIC, &photometric);
         if (photometric == PHOTOMETRIC_MINISBLACK) {
-            monochrome[0] = 0;
-            monochrome[1] = 255;
+            header->monochrome[0] = 0;
+            header->monochrome[1] = 255;
         }
     }
 
-    clImageLogCreate(C, width, height, depth, profile);
-    image = clImageCreate(C, width, height, depth, profile);
+    if (overrideProfile) {
+        header->profile = clProfileClone(C, overrideProfile);
+    } else if (TIFFGetField(tiff, TIFFTAG_ICCPROFILE, &iccLen, &iccBuf)) {
+        header->profile = clProfileParse(C, iccBuf, iccLen, NULL);
+        if (!header->profile) {
+            clContextLogError(C, "cannot parse ICC profile from TIFF");
+            return clFalse;
+        }
+    }
 
-    if (fp32) {
-        clImagePrepareWritePixels(C, image, CL_PIXELFORMAT_F32);
-        pixels = (uint8_t *)image->pixelsF32;
-        rowBytes = image->width * CL_BYTES_PER_PIXEL(CL_PIXELFORMAT_F32);
-    } else if ((depth == 1) || (depth == 8)) {
-        clImagePrepareWritePixels(C, image, CL_PIXELFORMAT_U8);
-        pixels = image->pixelsU8;
-        rowBytes = image->width * CL_BYTES_PER_PIXEL(CL_PIXELFORMAT_U8);
-    } else {
-        clImagePrepareWritePixels(C, image, CL_PIXELFORMAT_U16);
-        pixels = (uint8_t *)image->pixelsU16;
-        rowBytes = image->width * CL_BYTES_PER_PIXEL(CL_PIXELFORMAT_U16);
+    header->width = width;
+    header->height = height;
+    header->depth = depth;
+    header->channelCount = channelCount;
+    header->planarConfig = planarConfig;
+    header->orientation = orientation;
+    header->fp32 = fp32;
+    return clTrue;
+}
+
+// Expands a contiguous scanline (read into the start of an RGBA row) in-place into RGBA, then fills A
+static void expandRow(tiffHeader * header, uint8_t * pixelRow)
+{
+    const int width = header->width;
+    const int depth = header->depth;
+    const clBool fp32 = header->fp32;
+    const uint8_t * monochrome = header->monochrome;
+
+    if (header->channelCount == 1) {
+        // Expand grey in-place into RGBA, then fill A
+        if (fp32) {
+            for (int x = width - 1; x >= 0; --x) {
+                float * srcPixel = (float *)&pixelRow[x * sizeof(float)];
+                float * dstPixel = (float *)&pixelRow[x * 4 * sizeof(float)];
+                dstPixel[3] = 1.0f;
+                dstPixel[2] = srcPixel[0];
+                dstPixel[1] = srcPixel[0];
+                dstPixel[0] = srcPixel[0];
+            }
+        } else if (depth == 1) {
+            int shift = 7 - (width % 8);
+            for (int x = width - 1; x >= 0; --x) {
+                uint8_t mask = (uint8_t)(1 << (7 - shift));
+                uint8_t * srcPixel = &pixelRow[(x / 8) * sizeof(uint8_t)];
+                uint8_t * dstPixel = &pixelRow[x * 4 * sizeof(uint8_t)];
+                dstPixel[3] = 255;
+                dstPixel[2] = (srcPixel[0] & mask) ? monochrome[1] : monochrome[0];
+                dstPixel[1] = (srcPixel[0] & mask) ? monochrome[1] : monochrome[0];
+                dstPixel[0] = (srcPixel[0] & mask) ? monochrome[1] : monochrome[0];
+                --shift;
+                if (shift < 0) {
+                    shift = 7;
+                }
+            }
+        } else if (depth == 8) {
+            for (int x = width - 1; x >= 0; --x) {
+                uint8_t * srcPixel = &pixelRow[x * sizeof(uint8_t)];
+                uint8_t * dstPixel = &pixelRow[x * 4 * sizeof(uint8_t)];
+                dstPixel[3] = 255;
+                dstPixel[2] = srcPixel[0];
+                dstPixel[1] = srcPixel[0];
+                dstPixel[0] = srcPixel[0];
+            }
+        } else {
+            for (int x = width - 1; x >= 0; --x) {
+                uint16_t * srcPixel = (uint16_t *)&pixelRow[x * sizeof(uint16_t)];
+                uint16_t * dstPixel = (uint16_t *)&pixelRow[x * 4 * sizeof(uint16_t)];
+                dstPixel[3] = 65535;
+                dstPixel[2] = srcPixel[0];
+                dstPixel[1] = srcPixel[0];
+                dstPixel[0] = srcPixel[0];
+            }
+        }
+    } else if (header->channelCount == 3) {
+        // Expand RGB in-place into RGBA, then fill A
+        if (fp32) {
+            for (int x = width - 1; x >= 0; --x) {
+                float * srcPixel = (float *)&pixelRow[x * 3 * sizeof(float)];
+                float * dstPixel = (float *)&pixelRow[x * 4 * sizeof(float)];
+                dstPixel[3] = 1.0f;
+                dstPixel[2] = srcPixel[2];
+                dstPixel[1] = srcPixel[1];
+                dstPixel[0] = srcPixel[0];
+            }
+        } else if (depth == 1) {
+            int shift = 7 - (width % 8);
+            for (int x = width - 1; x >= 0; --x) {
+                uint8_t mask = (uint8_t)(1 << (7 - shift));
+                uint8_t * srcPixel = &pixelRow[((x * 3) / 8) * sizeof(uint8_t)];
+                uint8_t * dstPixel = &pixelRow[x * 4 * sizeof(uint8_t)];
+                dstPixel[3] = 255;
+                dstPixel[2] = (srcPixel[2] & mask) ? monochrome[1] : monochrome[0];
+                dstPixel[1] = (srcPixel[1] & mask) ? monochrome[1] : monochrome[0];
+                dstPixel[0] = (srcPixel[0] & mask) ? monochrome[1] : monochrome[0];
+                --shift;
+                if (shift < 0) {
+                    shift = 7;
+                }
+            }
+        } else if (depth == 8) {
+            for (int x = width - 1; x >= 0; --x) {
+                uint8_t * srcPixel = &pixelRow[x * 3 * sizeof(uint8_t)];
+                uint8_t * dstPixel = &pixelRow[x * 4 * sizeof(uint8_t)];
+                dstPixel[3] = 255;
+                dstPixel[2] = srcPixel[2];
+                dstPixel[1] = srcPixel[1];
+                dstPixel[0] = srcPixel[0];
+            }
+        } else {
+            for (int x = width - 1; x >= 0; --x) {
+                uint16_t * srcPixel = (uint16_t *)&pixelRow[x * 3 * sizeof(uint16_t)];
+                uint16_t * dstPixel = (uint16_t *)&pixelRow[x * 4 * sizeof(uint16_t)];
+                dstPixel[3] = 65535;
+                dstPixel[2] = srcPixel[2];
+                dstPixel[1] = srcPixel[1];
+                dstPixel[0] = srcPixel[0];
+            }
+        }
+    }
+}
+
+static clPixelFormat headerPixelFormat(tiffHeader * header)
+{
+    if (header->fp32) {
+        return CL_PIXELFORMAT_F32;
+    }
+    if ((header->depth == 1) || (header->depth == 8)) {
+        return CL_PIXELFORMAT_U8;
     }
+    return CL_PIXELFORMAT_U16;
+}
+
+struct clImage * clFormatReadTIFF(struct clContext * C, const char * formatName, struct clProfile * overrideProfile, struct clRaw * input)
+{
+    COLORIST_UNUSED(formatName);
 
-    if (planarConfig == PLANARCONFIG_CONTIG) {
+    clImage * image = NULL;
+    TIFF * tiff;
+    tiffHeader header;
+    int rowIndex, rowBytes;
+    tiffCallbackInfo ci;
+    uint8_t * pixels = NULL;
+
+    ci.C = C;
+    ci.raw = input;
+    ci.offset = 0;
+    header.profile = NULL;
+
+    Timer t;
+    timerStart(&t);
+
+    tiff = openTIFF(&ci, "rb");
+    if (!tiff) {
+        clContextLogError(C, "cannot open TIFF for read");
+        goto readCleanup;
+    }
+    if (!readHeader(C, tiff, overrideProfile, &header)) {
+        goto readCleanup;
+    }
+
+    const int depth = header.depth;
+    const int channelCount = header.channelCount;
+    const int orientation = header.orientation;
+    const clBool fp32 = header.fp32;
+
+    clImageLogCreate(C, header.width, header.height, depth, header.profile);
+    image = clImageCreate(C, header.width, header.height, depth, header.profile);
+
+    clPixelFormat pixelFormat = headerPixelFormat(&header);
+    clImagePrepareWritePixels(C, image, pixelFormat);
+    pixels = clImagePixelRow(C, image, pixelFormat, 0);
+    rowBytes = image->width * CL_BYTES_PER_PIXEL(pixelFormat);
+
+    if (header.planarConfig == PLANARCONFIG_CONTIG) {
         for (rowIndex = 0; rowIndex < image->height; ++rowIndex) {
             uint8_t * pixelRow;
             if (orientation == ORIENTATION_TOPLEFT) {
@@ -280,102 +436,14 @@ struct clImage * clFormatReadTIFF(struct clContext * C, const char * formatName,
                 image = NULL;
                 goto readCleanup;
             }
-
-            if (channelCount == 1) {
-                // Expand grey in-place into RGBA, then fill A
-                if (fp32) {
-                    for (int x = image->width - 1; x >= 0; --x) {
-                        float * srcPixel = (float *)&pixelRow[x * sizeof(float)];
-                        float * dstPixel = (float *)&pixelRow[x * 4 * sizeof(float)];
-                        dstPixel[3] = 1.0f;
-                        dstPixel[2] = srcPixel[0];
-                        dstPixel[1] = srcPixel[0];
-                        dstPixel[0] = srcPixel[0];
-                    }
-                } else if (depth == 1) {
-                    int shift = 7 - (image->width % 8);
-                    for (int x = image->width - 1; x >= 0; --x) {
-                        uint8_t mask = (uint8_t)(1 << (7 - shift));
-                        uint8_t * srcPixel = &pixelRow[(x / 8) * sizeof(uint8_t)];
-                        uint8_t * dstPixel = &pixelRow[x * 4 * sizeof(uint8_t)];
-                        dstPixel[3] = 255;
-                        dstPixel[2] = (srcPixel[0] & mask) ? monochrome[1] : monochrome[0];
-                        dstPixel[1] = (srcPixel[0] & mask) ? monochrome[1] : monochrome[0];
-                        dstPixel[0] = (srcPixel[0] & mask) ? monochrome[1] : monochrome[0];
-                        --shift;
-                        if (shift < 0) {
-                            shift = 7;
-                        }
-                    }
-                } else if (depth == 8) {
-                    for (int x = image->width - 1; x >= 0; --x) {
-                        uint8_t * srcPixel = &pixelRow[x * sizeof(uint8_t)];
-                        uint8_t * dstPixel = &pixelRow[x * 4 * sizeof(uint8_t)];
-                        dstPixel[3] = 255;
-                        dstPixel[2] = srcPixel[0];
-                        dstPixel[1] = srcPixel[0];
-                        dstPixel[0] = srcPixel[0];
-                    }
-                } else {
-                    for (int x = image->width - 1; x >= 0; --x) {
-                        uint16_t * srcPixel = (uint16_t *)&pixelRow[x * sizeof(uint16_t)];
-                        uint16_t * dstPixel = (uint16_t *)&pixelRow[x * 4 * sizeof(uint16_t)];
-                        dstPixel[3] = 65535;
-                        dstPixel[2] = srcPixel[0];
-                        dstPixel[1] = srcPixel[0];
-                        dstPixel[0] = srcPixel[0];
-                    }
-                }
-            } else if (channelCount == 3) {
-                // Expand RGB in-place into RGBA, then fill A
-                if (fp32) {
-                    for (int x = image->width - 1; x >= 0; --x) {
-                        float * srcPixel = (float *)&pixelRow[x * 3 * sizeof(float)];
-                        float * dstPixel = (float *)&pixelRow[x * 4 * sizeof(float)];
-                        dstPixel[3] = 1.0f;
-                        dstPixel[2] = srcPixel[2];
-                        dstPixel[1] = srcPixel[1];
-                        dstPixel[0] = srcPixel[0];
-                    }
-                } else if (depth == 1) {
-                    int shift = 7 - (image->width % 8);
-                    for (int x = image->width - 1; x >= 0; --x) {
-                        uint8_t mask = (uint8_t)(1 << (7 - shift));
-                        uint8_t * srcPixel = &pixelRow[((x * 3) / 8) * sizeof(uint8_t)];
-                        uint8_t * dstPixel = &pixelRow[x * 4 * sizeof(uint8_t)];
-                        dstPixel[3] = 255;
-                        dstPixel[2] = (srcPixel[2] & mask) ? monochrome[1] : monochrome[0];
-                        dstPixel[1] = (srcPixel[1] & mask) ? monochrome[1] : monochrome[0];
-                        dstPixel[0] = (srcPixel[0] & mask) ? monochrome[1] : monochrome[0];
-                        --shift;
-                        if (shift < 0) {
-                            shift = 7;
-                        }
-                    }
-                } else if (depth == 8) {
-                    for (int x = image->width - 1; x >= 0; --x) {
-                        uint8_t * srcPixel = &pixelRow[x * 3 * sizeof(uint8_t)];
-                        uint8_t * dstPixel = &pixelRow[x * 4 * sizeof(uint8_t)];
-                        dstPixel[3] = 255;
-                        dstPixel[2] = srcPixel[2];
-                        dstPixel[1] = srcPixel[1];
-                        dstPixel[0] = srcPixel[0];
-                    }
-                } else {
-                    for (int x = image->width - 1; x >= 0; --x) {
-                        uint16_t * srcPixel = (uint16_t *)&pixelRow[x * 3 * sizeof(uint16_t)];
-                        uint16_t * dstPixel = (uint16_t *)&pixelRow[x * 4 * sizeof(uint16_t)];
-                        dstPixel[3] = 65535;
-                        dstPixel[2] = srcPixel[2];
-                        dstPixel[1] = srcPixel[1];
-                        dstPixel[0] = srcPixel[0];
-                    }
-                }
-            }
+            expandRow(&header, pixelRow);
         }
-    } else if (planarConfig == PLANARCONFIG_SEPARATE) {
+    } else if (header.planarConfig == PLANARCONFIG_SEPARATE) {
         if (channelCount <= 1) {
-            clContextLogError(C, "unsupported planarConfig(%u) and channelCount(%d) from TIFF", planarConfig, channelCount);
+            clContextLogError(C,
+                              "unsupported planarConfig(%u) and channelCount(%d) from TIFF",
+                              header.planarConfig,
+                              channelCount);
             goto readCleanup;
         }
 
@@ -474,72 +542,110 @@ readCleanup:
     if (tiff) {
         TIFFClose(tiff);
     }
-    if (profile) {
-        clProfileDestroy(C, profile);
+    if (header.profile) {
+        clProfileDestroy(C, header.profile);
     }
     return image;
 }
 
-clBool clFormatWriteTIFF(struct clContext * C, struct clImage * image, const char * formatName, struct clRaw * output, struct clWriteParams * writeParams)
+typedef struct tiffStripReader
 {
-    COLORIST_UNUSED(formatName);
-    COLORIST_UNUSED(writeParams);
-
-    clBool writeResult = clTrue;
-    TIFF * tiff = NULL;
-    int rowIndex, rowBytes;
+    clFormatStripReader base;
+    TIFF * tiff;
     tiffCallbackInfo ci;
-    uint8_t * pixels = NULL;
+    tiffHeader header;
+    int rowIndex;
+} tiffStripReader;
 
-    clRaw rawProfile = CL_RAW_EMPTY;
-    if (!clProfilePack(C, image->profile, &rawProfile)) {
-        clContextLogError(C, "Failed to create ICC profile");
-        goto writeCleanup;
+static clBool stripReaderReadRows(struct clContext * C, clFormatStripReader * base, clImage * strip, int rowCount)
+{
+    tiffStripReader * reader = (tiffStripReader *)base;
+
+    clPixelFormat pixelFormat = headerPixelFormat(&reader->header);
+    clImagePrepareWritePixels(C, strip, pixelFormat);
+    for (int y = 0; y < rowCount; ++y) {
+        uint8_t * pixelRow = clImagePixelRow(C, strip, pixelFormat, y);
+        if (TIFFReadScanline(reader->tiff, pixelRow, reader->rowIndex, 0) < 0) {
+            clContextLogError(C, "Failed to read TIFF scanline row %d", reader->rowIndex);
+            return clFalse;
+        }
+        expandRow(&reader->header, pixelRow);
+        ++reader->rowIndex;
     }
+    return clTrue;
+}
 
-    ci.C = C;
-    ci.raw = output;
-    ci.offset = 0;
+static void stripReaderDestroy(struct clContext * C, clFormatStripReader * base)
+{
+    tiffStripReader * reader = (tiffStripReader *)base;
+    if (reader->tiff) {
+        TIFFClose(reader->tiff);
+    }
+    if (reader->header.profile) {
+        clProfileDestroy(C, reader->header.profile);
+    }
+    if (base->image) {
+        clImageDestroy(C, base->image);
+    }
+    clFree(reader);
+}
 
-    TIFFSetErrorHandler(NULL);
-    TIFFSetErrorHandlerExt(errorHandler);
-    TIFFSetWarningHandler(NULL);
-    TIFFSetWarningHandlerExt(warningHandler);
+clFormatStripReader * clFormatReadStripsTIFF(struct clContext * C,
+                                             const char * formatName,
+                                             struct clProfile * overrideProfile,
+                                             struct clRaw * input)
+{
+    COLORIST_UNUSED(formatName);
 
-    tiff = TIFFClientOpen("tiff",
-                          "wb",
-                          (thandle_t)&ci,
-                          (TIFFReadWriteProc)readCallback,
-                          (TIFFReadWriteProc)writeCallback,
-                          (TIFFSeekProc)seekCallback,
-                          (TIFFCloseProc)closeCalllback,
-                          (TIFFSizeProc)sizeCallback,
-                          (TIFFMapFileProc)mapCallback,
-                          (TIFFUnmapFileProc)unmapCallback);
-    if (!tiff) {
-        clContextLogError(C, "cannot open TIFF for write");
-        writeResult = clFalse;
-        goto writeCleanup;
+    tiffStripReader * reader = clAllocateStruct(tiffStripReader);
+    reader->base.image = NULL;
+    reader->base.readRows = stripReaderReadRows;
+    reader->base.destroy = stripReaderDestroy;
+    reader->ci.C = C;
+    reader->ci.raw = input;
+    reader->ci.offset = 0;
+    reader->header.profile = NULL;
+    reader->rowIndex = 0;
+
+    reader->tiff = openTIFF(&reader->ci, "rb");
+    if (!reader->tiff) {
+        clContextLogError(C, "cannot open TIFF for read");
+        stripReaderDestroy(C, &reader->base);
+        return NULL;
+    }
+    if (!readHeader(C, reader->tiff, overrideProfile, &reader->header) || (reader->header.planarConfig != PLANARCONFIG_CONTIG) ||
+        (reader->header.orientation != ORIENTATION_TOPLEFT)) {
+        // Planar and bottom-up TIFFs can't be decoded top-down a row at a time
+        stripReaderDestroy(C, &reader->base);
+        return NULL;
+    }
+
+    tiffHeader * header = &reader->header;
+    clImageLogCreate(C, header->width, header->height, header->depth, header->profile);
+    reader->base.image = clImageCreate(C, header->width, header->height, header->depth, header->profile);
+    return &reader->base;
+}
+
+// Sets every tag but the pixels; the pixel rows are then written top-down as RGBA in the pixel format matching image->depth
+static clBool writeHeader(struct clContext * C, TIFF * tiff, struct clImage * image, struct clWriteParams * writeParams)
+{
+    clRaw rawProfile = CL_RAW_EMPTY;
+    if (!clProfilePack(C, image->profile, &rawProfile)) {
+        clContextLogError(C, "Failed to create ICC profile");
+        return clFalse;
     }
 
-    clBool fp32 = (image->depth == 32) ? clTrue : clFalse;
-    if (fp32) {
+    int rowBytes;
+    if (image->depth == 32) {
         TIFFSetField(tiff, TIFFTAG_BITSPERSAMPLE, 32);
         TIFFSetField(tiff, TIFFTAG_SAMPLEFORMAT, SAMPLEFORMAT_IEEEFP);
-
-        clImagePrepareReadPixels(C, image, CL_PIXELFORMAT_F32);
-        pixels = (uint8_t *)image->pixelsF32;
         rowBytes = image->width * CL_BYTES_PER_PIXEL(CL_PIXELFORMAT_F32);
     } else {
         TIFFSetField(tiff, TIFFTAG_BITSPERSAMPLE, image->depth);
         TIFFSetField(tiff, TIFFTAG_SAMPLEFORMAT, SAMPLEFORMAT_UINT);
         if (image->depth == 8) {
-            clImagePrepareReadPixels(C, image, CL_PIXELFORMAT_U8);
-            pixels = image->pixelsU8;
             rowBytes = image->width * CL_BYTES_PER_PIXEL(CL_PIXELFORMAT_U8);
         } else {
-            clImagePrepareReadPixels(C, image, CL_PIXELFORMAT_U16);
-            pixels = (uint8_t *)image->pixelsU16;
             rowBytes = image->width * CL_BYTES_PER_PIXEL(CL_PIXELFORMAT_U16);
         }
     }
@@ -555,10 +661,54 @@ clBool clFormatWriteTIFF(struct clContext * C, struct clImage * image, const cha
     if (writeParams->writeProfile) {
         TIFFSetField(tiff, TIFFTAG_ICCPROFILE, rawProfile.size, rawProfile.ptr);
     }
+    clRawFree(C, &rawProfile);
+    return clTrue;
+}
+
+static clPixelFormat depthPixelFormat(int depth)
+{
+    if (depth == 32) {
+        return CL_PIXELFORMAT_F32;
+    }
+    if (depth == 8) {
+        return CL_PIXELFORMAT_U8;
+    }
+    return CL_PIXELFORMAT_U16;
+}
 
+clBool clFormatWriteTIFF(struct clContext * C, struct clImage * image, const char * formatName, struct clRaw * output, struct clWriteParams * writeParams)
+{
+    COLORIST_UNUSED(formatName);
+
+    clBool writeResult = clTrue;
+    TIFF * tiff = NULL;
+    int rowIndex;
+    tiffCallbackInfo ci;
+    uint8_t * rowPixels = NULL;
+
+    ci.C = C;
+    ci.raw = output;
+    ci.offset = 0;
+
+    tiff = openTIFF(&ci, "wb");
+    if (!tiff) {
+        clContextLogError(C, "cannot open TIFF for write");
+        writeResult = clFalse;
+        goto writeCleanup;
+    }
+    if (!writeHeader(C, tiff, image, writeParams)) {
+        goto writeCleanup;
+    }
+
+    clPixelFormat pixelFormat = depthPixelFormat(image->depth);
+    clImagePrepareReadRows(C, image, pixelFormat);
+
+    // libtiff byteswaps the scanlines it is handed in-place, so hand it copies (the pixels may be a caller's buffer)
+    int rowBytes = image->width * CL_BYTES_PER_PIXEL(pixelFormat);
+    rowPixels = clAllocate(rowBytes);
     for (rowIndex = 0; rowIndex < image->height; ++rowIndex) {
-        uint8_t * pixelRow = &pixels[rowIndex * rowBytes];
-        if (TIFFWriteScanline(tiff, pixelRow, rowIndex, 0) < 0) {
+        memcpy(rowPixels, clImagePixelRow(C, image, pixelFormat, rowIndex), rowBytes);
+        if (TIFFWriteScanline(tiff, rowPixels, rowIndex, 0) < 0) {
             clContextLogError(C, "Failed to write TIFF scanline row %d", rowIndex);
             writeResult = clFalse;
             goto writeCleanup;
@@ -566,9 +716,86 @@ clBool clFormatWriteTIFF(struct clContext * C, struct clImage * image, const cha
     }
 
 writeCleanup:
+    if (rowPixels) {
+        clFree(rowPixels);
+    }
     if (tiff) {
         TIFFClose(tiff);
     }
-    clRawFree(C, &rawProfile);
     return writeResult;
 }
+
+typedef struct tiffStripWriter
+{
+    clFormatStripWriter base;
+    TIFF * tiff;
+    tiffCallbackInfo ci;
+    int depth;
+    int rowIndex;
+} tiffStripWriter;
+
+static clBool stripWriterWriteRows(struct clContext * C, clFormatStripWriter * base, clImage * strip, int rowCount)
+{
+    tiffStripWriter * writer = (tiffStripWriter *)base;
+
+    clPixelFormat pixelFormat = depthPixelFormat(writer->depth);
+    clImagePrepareReadPixels(C, strip, pixelFormat);
+    for (int y = 0; y < rowCount; ++y) {
+        if (TIFFWriteScanline(writer->tiff, clImagePixelRow(C, strip, pixelFormat, y), writer->rowIndex, 0) < 0) {
+            clContextLogError(C, "Failed to write TIFF scanline row %d", writer->rowIndex);
+            return clFalse;
+        }
+        ++writer->rowIndex;
+    }
+    return clTrue;
+}
+
+static clBool stripWriterFinish(struct clContext * C, clFormatStripWriter * base)
+{
+    COLORIST_UNUSED(C);
+
+    tiffStripWriter * writer = (tiffStripWriter *)base;
+    TIFFClose(writer->tiff); // flushes the final strip and the directory into the output
+    writer->tiff = NULL;
+    return clTrue;
+}
+
+static void stripWriterDestroy(struct clContext * C, clFormatStripWriter * base)
+{
+    tiffStripWriter * writer = (tiffStripWriter *)base;
+    if (writer->tiff) {
+        TIFFClose(writer->tiff);
+    }
+    clFree(writer);
+}
+
+clFormatStripWriter * clFormatWriteStripsTIFF(struct clContext * C,
+                                              struct clImage * image,
+                                              const char * formatName,
+                                              struct clRaw * output,
+                                              struct clWriteParams * writeParams)
+{
+    COLORIST_UNUSED(formatName);
+
+    tiffStripWriter * writer = clAllocateStruct(tiffStripWriter);
+    writer->base.writeRows = stripWriterWriteRows;
+    writer->base.finish = stripWriterFinish;
+    writer->base.destroy = stripWriterDestroy;
+    writer->ci.C = C;
+    writer->ci.raw = output;
+    writer->ci.offset = 0;
+    writer->depth = image->depth;
+    writer->rowIndex = 0;
+
+    writer->tiff = openTIFF(&writer->ci, "wb");
+    if (!writer->tiff) {
+        clContextLogError(C, "cannot open TIFF for write");
+        stripWriterDestroy(C, &writer->base);
+        return NULL;
+    }
+    if (!writeHeader(C, writer->tiff, image, writeParams)) {
+        stripWriterDestroy(C, &writer->base);
+        return NULL;
+    }
+    return &writer->base;
+}
@@ -131,8 +131,8 @@ clBool clFormatWriteWebP(struct clContext * C, struct clImage * image, const cha
     picture.width = image->width;
     picture.height = image->height;
 
-    clImagePrepareReadPixels(C, image, CL_PIXELFORMAT_U8);
-    WebPPictureImportRGBA(&picture, image->pixelsU8, CL_BYTES_PER_PIXEL(CL_PIXELFORMAT_U8) * image->width);
+    clImagePrepareReadRows(C, image, CL_PIXELFORMAT_U8);
+    WebPPictureImportRGBA(&picture, image->pixelsU8, image->rowBytes[CL_PIXELFORMAT_U8]);
 
     if (!WebPEncode(&config, &picture)) {
         clContextLogError(C, "Failed to encode WebP");
@@ -10,10 +10,21 @@
 #include "colorist/context.h"
 #include "colorist/pixelmath.h"
 #include "colorist/profile.h"
+#include "colorist/task.h"
 #include "colorist/transform.h"
 
+#include <stddef.h>
 #include <string.h>
 
+// Same baseline-only SIMD selection as the CCMM batch kernel in transform.c
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#include <emmintrin.h>
+#define CL_IMAGE_SSE2
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define CL_IMAGE_NEON
+#endif
+
 static uint8_t * clImagePixelPtr(clContext * C, clImage * image, clPixelFormat pixelFormat)
 {
     COLORIST_UNUSED(C);
@@ -31,28 +42,113 @@ static uint8_t * clImagePixelPtr(clContext * C, clImage * image, clPixelFormat p
     return NULL;
 }
 
-static void clImageAllocatePixels(struct clContext * C, clImage * image, clPixelFormat pixelFormat)
+static void clImageSetPixelPtr(clImage * image, clPixelFormat pixelFormat, void * pixels, int rowBytes, clBool borrowed)
 {
     switch (pixelFormat) {
         case CL_PIXELFORMAT_U8:
-            if (!image->pixelsU8) {
-                image->pixelsU8 = clAllocate(image->width * image->height * CL_BYTES_PER_PIXEL(pixelFormat));
-            }
+            image->pixelsU8 = pixels;
             break;
         case CL_PIXELFORMAT_U16:
-            if (!image->pixelsU16) {
-                image->pixelsU16 = clAllocate(image->width * image->height * CL_BYTES_PER_PIXEL(pixelFormat));
-            }
+            image->pixelsU16 = pixels;
             break;
         case CL_PIXELFORMAT_F32:
-            if (!image->pixelsF32) {
-                image->pixelsF32 = clAllocate(image->width * image->height * CL_BYTES_PER_PIXEL(pixelFormat));
-            }
+            image->pixelsF32 = pixels;
             break;
         case CL_PIXELFORMAT_COUNT:
             COLORIST_ASSERT(0);
+            return;
+    }
+    image->rowBytes[pixelFormat] = rowBytes;
+    image->borrowed[pixelFormat] = borrowed;
+}
+
+static void clImageAllocatePixels(struct clContext * C, clImage * image, clPixelFormat pixelFormat)
+{
+    if (!clImagePixelPtr(C, image, pixelFormat)) {
+        int rowBytes = image->width * CL_BYTES_PER_PIXEL(pixelFormat);
+        clImageSetPixelPtr(image, pixelFormat, clAllocate((size_t)rowBytes * image->height), rowBytes, clFalse);
+    }
+}
+
+// A crop view's parent can go as soon as the view has its own copies of everything it borrowed
+static void clImageReleaseViewParent(struct clContext * C, clImage * image)
+{
+    if (!image->viewParent) {
+        return;
+    }
+    for (clPixelFormat pixelFormat = CL_PIXELFORMAT_FIRST; pixelFormat != CL_PIXELFORMAT_COUNT; ++pixelFormat) {
+        if (image->borrowed[pixelFormat]) {
+            return;
+        }
+    }
+    clImageDestroy(C, image->viewParent);
+    image->viewParent = NULL;
+}
+
+// Drops a plane, only freeing it if colorist owns it
+static void clImageFreePixels(struct clContext * C, clImage * image, clPixelFormat pixelFormat)
+{
+    uint8_t * pixels = clImagePixelPtr(C, image, pixelFormat);
+    if (pixels && !image->borrowed[pixelFormat]) {
+        clFree(pixels);
+    }
+    clImageSetPixelPtr(image, pixelFormat, NULL, image->width * CL_BYTES_PER_PIXEL(pixelFormat), clFalse);
+    clImageReleaseViewParent(C, image);
+}
+
+// Replaces a plane with padded rows (or, if ownPixels is set, any borrowed plane) by a tightly packed copy
+static void clImagePackPixels(struct clContext * C, clImage * image, clPixelFormat pixelFormat, clBool ownPixels)
+{
+    uint8_t * pixels = clImagePixelPtr(C, image, pixelFormat);
+    if (!pixels || (clImageIsPacked(C, image, pixelFormat) && !(ownPixels && image->borrowed[pixelFormat]))) {
+        return;
+    }
+
+    int srcRowBytes = image->rowBytes[pixelFormat];
+    int dstRowBytes = image->width * CL_BYTES_PER_PIXEL(pixelFormat);
+    uint8_t * packed = clAllocate((size_t)dstRowBytes * image->height);
+    for (int y = 0; y < image->height; ++y) {
+        memcpy(&packed[(size_t)y * dstRowBytes], &pixels[(size_t)y * srcRowBytes], dstRowBytes);
+    }
+    if (!image->borrowed[pixelFormat]) {
+        clFree(pixels);
+    }
+    clImageSetPixelPtr(image, pixelFormat, packed, dstRowBytes, clFalse);
+    clImageReleaseViewParent(C, image);
+}
+
+// The most precise pixels an image already has, or the format matching its depth if it has none yet
+static clPixelFormat clImageNativePixelFormat(struct clContext * C, clImage * image)
+{
+    COLORIST_UNUSED(C);
+    if (image->pixelsF32) {
+        return CL_PIXELFORMAT_F32;
+    }
+    if (image->pixelsU16) {
+        return CL_PIXELFORMAT_U16;
+    }
+    if (image->pixelsU8) {
+        return CL_PIXELFORMAT_U8;
+    }
+    if (image->depth == 8) {
+        return CL_PIXELFORMAT_U8;
+    }
+    return (image->depth > 16) ? CL_PIXELFORMAT_F32 : CL_PIXELFORMAT_U16;
+}
+
+static clTransformFormat clImagePixelFormatToTransformFormat(struct clContext * C, clPixelFormat pixelFormat)
+{
+    COLORIST_UNUSED(C);
+    switch (pixelFormat) {
+        case CL_PIXELFORMAT_U8:
+            return CL_XF_RGBA8;
+        case CL_PIXELFORMAT_U16:
+            return CL_XF_RGBA16;
+        case CL_PIXELFORMAT_F32:
+        case CL_PIXELFORMAT_COUNT:
             break;
     }
+    return CL_XF_RGBA;
 }
 
 void clImageLogCreate(clContext * C, int width, int height, int depth, clProfile * profile)
@@ -81,46 +177,306 @@ clImage * clImageCreate(clContext * C, int width, int height, int depth, clProfi
     image->pixelsU8 = NULL;
     image->pixelsU16 = NULL;
     image->pixelsF32 = NULL;
+    for (clPixelFormat pixelFormat = CL_PIXELFORMAT_FIRST; pixelFormat != CL_PIXELFORMAT_COUNT; ++pixelFormat) {
+        image->rowBytes[pixelFormat] = width * CL_BYTES_PER_PIXEL(pixelFormat);
+        image->borrowed[pixelFormat] = clFalse;
+    }
+    image->viewParent = NULL;
+    image->reduction = NULL;
     return image;
 }
 
-void clImagePrepareReadPixels(struct clContext * C, clImage * image, clPixelFormat pixelFormat)
+clImage * clImageCreateWrapped(struct clContext * C,
+                               int width,
+                               int height,
+                               int depth,
+                               struct clProfile * profile,
+                               clPixelFormat pixelFormat,
+                               void * pixels,
+                               int rowBytes)
+{
+    int packedRowBytes = width * CL_BYTES_PER_PIXEL(pixelFormat);
+    if (rowBytes == 0) {
+        rowBytes = packedRowBytes;
+    }
+    if (!pixels || (rowBytes < packedRowBytes)) {
+        clContextLogError(C, "Invalid buffer to wrap: %d bytes per row for %d pixels", rowBytes, width);
+        return NULL;
+    }
+
+    clImage * image = clImageCreate(C, width, height, depth, profile);
+    clImageSetPixelPtr(image, pixelFormat, pixels, rowBytes, clTrue);
+    return image;
+}
+
+uint8_t * clImagePixelRow(struct clContext * C, clImage * image, clPixelFormat pixelFormat, int y)
+{
+    uint8_t * pixels = clImagePixelPtr(C, image, pixelFormat);
+    if (!pixels) {
+        return NULL;
+    }
+    return pixels + ((size_t)y * image->rowBytes[pixelFormat]);
+}
+
+clBool clImageIsPacked(struct clContext * C, clImage * image, clPixelFormat pixelFormat)
+{
+    COLORIST_UNUSED(C);
+    return (image->rowBytes[pixelFormat] == (int)(image->width * CL_BYTES_PER_PIXEL(pixelFormat))) ? clTrue : clFalse;
+}
+
+// ----------------------------------------------------------------------------
+// Pixel format conversion kernels
+//
+// Every direction is (integer ->) float math (-> integer) on a flat array of channels, rounding exactly as
+// clPixelMathRoundUNorm() does. SSE2 and (AArch64) NEON handle 8 channels per iteration; the scalar loops
+// handle any leftover channels and are the reference implementation on other architectures.
+
+// Conversions are memory bound, so smaller ranges aren't worth handing to another thread
+#define CL_IMAGE_MIN_PIXELS_PER_CONVERSION_TASK (16 * 1024)
+
+typedef struct clPixelConversionTask
+{
+    clPixelFormat srcFormat;
+    clPixelFormat dstFormat;
+    const void * srcPixels;
+    void * dstPixels;
+    int srcRowBytes;
+    int dstRowBytes;
+    int width;
+    float srcMaxChannel;    // Integer src formats are divided by this
+    uint32_t dstMaxChannel; // Integer dst formats are scaled by this and rounded
+} clPixelConversionTask;
+
+#if defined(CL_IMAGE_SSE2)
+typedef __m128 clPixelVec;
+
+static void loadChannels8(clPixelFormat format, const void * src, clPixelVec * lo, clPixelVec * hi)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i wide;
+    if (format == CL_PIXELFORMAT_F32) {
+        *lo = _mm_loadu_ps((const float *)src);
+        *hi = _mm_loadu_ps((const float *)src + 4);
+        return;
+    }
+    if (format == CL_PIXELFORMAT_U8) {
+        wide = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)src), zero);
+    } else {
+        wide = _mm_loadu_si128((const __m128i *)src);
+    }
+    *lo = _mm_cvtepi32_ps(_mm_unpacklo_epi16(wide, zero));
+    *hi = _mm_cvtepi32_ps(_mm_unpackhi_epi16(wide, zero));
+}
+
+// floor(v * maxChannel + 0.5) clamped to [0, maxChannel]; clamping first makes truncation the same as floor
+static __m128i quantizeChannels4(__m128 v, __m128 maxChannel)
+{
+    __m128 t = _mm_add_ps(_mm_mul_ps(v, maxChannel), _mm_set1_ps(0.5f));
+    t = _mm_min_ps(_mm_max_ps(t, _mm_setzero_ps()), maxChannel); // max() picks 0 for NaN
+    return _mm_cvttps_epi32(t);
+}
+
+static void storeChannels8(clPixelFormat format, void * dst, clPixelVec lo, clPixelVec hi, clPixelVec maxChannel)
+{
+    if (format == CL_PIXELFORMAT_F32) {
+        _mm_storeu_ps((float *)dst, lo);
+        _mm_storeu_ps((float *)dst + 4, hi);
+        return;
+    }
+    __m128i ilo = quantizeChannels4(lo, maxChannel);
+    __m128i ihi = quantizeChannels4(hi, maxChannel);
+    if (format == CL_PIXELFORMAT_U8) {
+        __m128i packed = _mm_packs_epi32(ilo, ihi);
+        _mm_storel_epi64((__m128i *)dst, _mm_packus_epi16(packed, packed));
+    } else {
+        // SSE2 only has a signed 32 -> 16 pack, so bias into signed range and back
+        const __m128i bias32 = _mm_set1_epi32(32768);
+        const __m128i bias16 = _mm_set1_epi16((short)0x8000);
+        __m128i packed = _mm_packs_epi32(_mm_sub_epi32(ilo, bias32), _mm_sub_epi32(ihi, bias32));
+        _mm_storeu_si128((__m128i *)dst, _mm_xor_si128(packed, bias16));
+    }
+}
+#define clPixelVecSet1(F) _mm_set1_ps(F)
+#define clPixelVecDiv(A, B) _mm_div_ps(A, B)
+#elif defined(CL_IMAGE_NEON)
+typedef float32x4_t clPixelVec;
+
+static void loadChannels8(clPixelFormat format, const void * src, clPixelVec * lo, clPixelVec * hi)
+{
+    uint16x8_t wide;
+    if (format == CL_PIXELFORMAT_F32) {
+        *lo = vld1q_f32((const float *)src);
+        *hi = vld1q_f32((const float *)src + 4);
+        return;
+    }
+    if (format == CL_PIXELFORMAT_U8) {
+        wide = vmovl_u8(vld1_u8((const uint8_t *)src));
+    } else {
+        wide = vld1q_u16((const uint16_t *)src);
+    }
+    *lo = vcvtq_f32_u32(vmovl_u16(vget_low_u16(wide)));
+    *hi = vcvtq_f32_u32(vmovl_u16(vget_high_u16(wide)));
+}
+
+static uint32x4_t quantizeChannels4(float32x4_t v, float32x4_t maxChannel)
+{
+    float32x4_t t = vaddq_f32(vmulq_f32(v, maxChannel), vdupq_n_f32(0.5f));
+    t = vminq_f32(vmaxq_f32(t, vdupq_n_f32(0.0f)), maxChannel);
+    return vcvtq_u32_f32(t); // Truncates, and converts NaN to 0
+}
+
+static void storeChannels8(clPixelFormat format, void * dst, clPixelVec lo, clPixelVec hi, clPixelVec maxChannel)
 {
-    static const uint32_t maxChannelU8 = 255;
-    static const float maxChannelU8f = 255.0f;
-    uint32_t depthU16 = CL_CLAMP(image->depth, 8, 16);
-    uint32_t maxChannelU16 = (1 << depthU16) - 1;
-    float maxChannelU16f = (float)maxChannelU16;
+    if (format == CL_PIXELFORMAT_F32) {
+        vst1q_f32((float *)dst, lo);
+        vst1q_f32((float *)dst + 4, hi);
+        return;
+    }
+    uint16x8_t packed = vcombine_u16(vmovn_u32(quantizeChannels4(lo, maxChannel)),
+                                     vmovn_u32(quantizeChannels4(hi, maxChannel)));
+    if (format == CL_PIXELFORMAT_U8) {
+        vst1_u8((uint8_t *)dst, vmovn_u16(packed));
+    } else {
+        vst1q_u16((uint16_t *)dst, packed);
+    }
+}
+#define clPixelVecSet1(F) vdupq_n_f32(F)
+#define clPixelVecDiv(A, B) vdivq_f32(A, B)
+#endif
 
+static float loadChannel(clPixelFormat format, const void * src, int index)
+{
+    switch (format) {
+        case CL_PIXELFORMAT_U8:
+            return (float)((const uint8_t *)src)[index];
+        case CL_PIXELFORMAT_U16:
+            return (float)((const uint16_t *)src)[index];
+        case CL_PIXELFORMAT_F32:
+        case CL_PIXELFORMAT_COUNT:
+            break;
+    }
+    return ((const float *)src)[index];
+}
+
+static void storeChannel(clPixelFormat format, void * dst, int index, float value, uint32_t maxChannel)
+{
+    switch (format) {
+        case CL_PIXELFORMAT_U8:
+            ((uint8_t *)dst)[index] = (uint8_t)clPixelMathRoundUNorm(value, maxChannel);
+            break;
+        case CL_PIXELFORMAT_U16:
+            ((uint16_t *)dst)[index] = (uint16_t)clPixelMathRoundUNorm(value, maxChannel);
+            break;
+        case CL_PIXELFORMAT_F32:
+        case CL_PIXELFORMAT_COUNT:
+            ((float *)dst)[index] = value;
+            break;
+    }
+}
+
+static void convertChannels(clPixelConversionTask * info, const uint8_t * src, uint8_t * dst, int channelCount)
+{
+    const clBool srcIsInteger = (info->srcFormat != CL_PIXELFORMAT_F32);
+    const int srcChannelBytes = CL_BYTES_PER_CHANNEL[info->srcFormat];
+    const int dstChannelBytes = CL_BYTES_PER_CHANNEL[info->dstFormat];
+
+    int i = 0;
+#if defined(CL_IMAGE_SSE2) || defined(CL_IMAGE_NEON)
+    const clPixelVec srcMaxChannel = clPixelVecSet1(info->srcMaxChannel);
+    const clPixelVec dstMaxChannel = clPixelVecSet1((float)info->dstMaxChannel);
+    for (; i + 8 <= channelCount; i += 8) {
+        clPixelVec lo, hi;
+        loadChannels8(info->srcFormat, src + ((size_t)i * srcChannelBytes), &lo, &hi);
+        if (srcIsInteger) {
+            lo = clPixelVecDiv(lo, srcMaxChannel);
+            hi = clPixelVecDiv(hi, srcMaxChannel);
+        }
+        storeChannels8(info->dstFormat, dst + ((size_t)i * dstChannelBytes), lo, hi, dstMaxChannel);
+    }
+#endif
+    for (; i < channelCount; ++i) {
+        float value = loadChannel(info->srcFormat, src, i);
+        if (srcIsInteger) {
+            value /= info->srcMaxChannel;
+        }
+        storeChannel(info->dstFormat, dst, i, value, info->dstMaxChannel);
+    }
+}
+
+// Both planes tightly packed: any range of pixels is one run of channels
+static void pixelConversionTaskFunc(clPixelConversionTask * info, int firstPixel, int pixelCount)
+{
+    size_t firstChannel = (size_t)firstPixel * CL_CHANNELS_PER_PIXEL;
+    convertChannels(info,
+                    (const uint8_t *)info->srcPixels + (firstChannel * CL_BYTES_PER_CHANNEL[info->srcFormat]),
+                    (uint8_t *)info->dstPixels + (firstChannel * CL_BYTES_PER_CHANNEL[info->dstFormat]),
+                    pixelCount * CL_CHANNELS_PER_PIXEL);
+}
+
+static void rowConversionTaskFunc(clPixelConversionTask * info, int firstRow, int rowCount)
+{
+    for (int y = firstRow; y < firstRow + rowCount; ++y) {
+        convertChannels(info,
+                        (const uint8_t *)info->srcPixels + ((size_t)y * info->srcRowBytes),
+                        (uint8_t *)info->dstPixels + ((size_t)y * info->dstRowBytes),
+                        info->width * CL_CHANNELS_PER_PIXEL);
+    }
+}
+
+static uint32_t clImageFormatMaxChannel(clImage * image, clPixelFormat pixelFormat)
+{
+    if (pixelFormat == CL_PIXELFORMAT_U8) {
+        return 255;
+    }
+    if (pixelFormat == CL_PIXELFORMAT_U16) {
+        return (1 << CL_CLAMP(image->depth, 8, 16)) - 1;
+    }
+    return 1;
+}
+
+// Fills image's dstFormat pixels from its existing srcFormat pixels
+static void clImageConvertPixels(struct clContext * C, clImage * image, clPixelFormat srcFormat, clPixelFormat dstFormat)
+{
+    clPixelConversionTask info;
+    info.srcFormat = srcFormat;
+    info.dstFormat = dstFormat;
+    info.srcPixels = clImagePixelPtr(C, image, srcFormat);
+    info.dstPixels = clImagePixelPtr(C, image, dstFormat);
+    info.srcRowBytes = image->rowBytes[srcFormat];
+    info.dstRowBytes = image->rowBytes[dstFormat];
+    info.width = image->width;
+    info.srcMaxChannel = (float)clImageFormatMaxChannel(image, srcFormat);
+    info.dstMaxChannel = clImageFormatMaxChannel(image, dstFormat);
+    if (clImageIsPacked(C, image, srcFormat) && clImageIsPacked(C, image, dstFormat)) {
+        clTaskParallelFor(C,
+                          image->width * image->height,
+                          CL_IMAGE_MIN_PIXELS_PER_CONVERSION_TASK,
+                          (clTaskRangeFunc)pixelConversionTaskFunc,
+                          &info);
+    } else {
+        int minRowsPerTask = CL_MAX(1, CL_IMAGE_MIN_PIXELS_PER_CONVERSION_TASK / CL_MAX(1, image->width));
+        clTaskParallelFor(C, image->height, minRowsPerTask, (clTaskRangeFunc)rowConversionTaskFunc, &info);
+    }
+}
+
+// Every in-place change to an image's pixels goes through here, dropping anything cached about them
+static void clImagePixelsChanged(struct clContext * C, clImage * image)
+{
+    clFree(image->reduction);
+    image->reduction = NULL;
+}
+
+void clImagePrepareReadRows(struct clContext * C, clImage * image, clPixelFormat pixelFormat)
+{
     switch (pixelFormat) {
         case CL_PIXELFORMAT_U8:
             if (!image->pixelsU8) {
                 clImageAllocatePixels(C, image, pixelFormat);
 
                 if (image->pixelsF32) {
-                    // F32 -> U8
-                    for (int j = 0; j < image->height; ++j) {
-                        for (int i = 0; i < image->width; ++i) {
-                            float * srcPixel = &image->pixelsF32[(i + (j * image->width)) * CL_CHANNELS_PER_PIXEL];
-                            uint8_t * dstPixel = &image->pixelsU8[(i + (j * image->width)) * CL_CHANNELS_PER_PIXEL];
-                            dstPixel[0] = (uint8_t)clPixelMathRoundUNorm(srcPixel[0], maxChannelU8);
-                            dstPixel[1] = (uint8_t)clPixelMathRoundUNorm(srcPixel[1], maxChannelU8);
-                            dstPixel[2] = (uint8_t)clPixelMathRoundUNorm(srcPixel[2], maxChannelU8);
-                            dstPixel[3] = (uint8_t)clPixelMathRoundUNorm(srcPixel[3], maxChannelU8);
-                        }
-                    }
+                    clImageConvertPixels(C, image, CL_PIXELFORMAT_F32, pixelFormat);
                 } else if (image->pixelsU16) {
-                    // U16 -> U8
-                    for (int j = 0; j < image->height; ++j) {
-                        for (int i = 0; i < image->width; ++i) {
-                            uint16_t * srcPixel = &image->pixelsU16[(i + (j * image->width)) * CL_CHANNELS_PER_PIXEL];
-                            uint8_t * dstPixel = &image->pixelsU8[(i + (j * image->width)) * CL_CHANNELS_PER_PIXEL];
-                            dstPixel[0] = (uint8_t)clPixelMathRoundUNorm(srcPixel[0] / maxChannelU16f, maxChannelU8);
-                            dstPixel[1] = (uint8_t)clPixelMathRoundUNorm(srcPixel[1] / maxChannelU16f, maxChannelU8);
-                            dstPixel[2] = (uint8_t)clPixelMathRoundUNorm(srcPixel[2] / maxChannelU16f, maxChannelU8);
-                            dstPixel[3] = (uint8_t)clPixelMathRoundUNorm(srcPixel[3] / maxChannelU16f, maxChannelU8);
-                        }
-                    }
+                    clImageConvertPixels(C, image, CL_PIXELFORMAT_U16, pixelFormat);
                 } else {
                     // U8 White
                     memset(image->pixelsU8, 0xff, image->width * image->height * CL_CHANNELS_PER_PIXEL * sizeof(uint8_t));
@@ -133,29 +489,9 @@ void clImagePrepareReadPixels(struct clContext * C, clImage * image, clPixelForm
                 clImageAllocatePixels(C, image, pixelFormat);
 
                 if (image->pixelsF32) {
-                    // F32 -> U16
-                    for (int j = 0; j < image->height; ++j) {
-                        for (int i = 0; i < image->width; ++i) {
-                            float * srcPixel = &image->pixelsF32[(i + (j * image->width)) * CL_CHANNELS_PER_PIXEL];
-                            uint16_t * dstPixel = &image->pixelsU16[(i + (j * image->width)) * CL_CHANNELS_PER_PIXEL];
-                            dstPixel[0] = (uint16_t)clPixelMathRoundUNorm(srcPixel[0], maxChannelU16);
-                            dstPixel[1] = (uint16_t)clPixelMathRoundUNorm(srcPixel[1], maxChannelU16);
-                            dstPixel[2] = (uint16_t)clPixelMathRoundUNorm(srcPixel[2], maxChannelU16);
-                            dstPixel[3] = (uint16_t)clPixelMathRoundUNorm(srcPixel[3], maxChannelU16);
-                        }
-                    }
+                    clImageConvertPixels(C, image, CL_PIXELFORMAT_F32, pixelFormat);
                 } else if (image->pixelsU8) {
-                    // U8 -> U16
-                    for (int j = 0; j < image->height; ++j) {
-                        for (int i = 0; i < image->width; ++i) {
-                            uint8_t * srcPixel = &image->pixelsU8[(i + (j * image->width)) * CL_CHANNELS_PER_PIXEL];
-                            uint16_t * dstPixel = &image->pixelsU16[(i + (j * image->width)) * CL_CHANNELS_PER_PIXEL];
-                            dstPixel[0] = (uint16_t)clPixelMathRoundUNorm(srcPixel[0] / maxChannelU8f, maxChannelU16);
-                            dstPixel[1] = (uint16_t)clPixelMathRoundUNorm(srcPixel[1] / maxChannelU8f, maxChannelU16);
-                            dstPixel[2] = (uint16_t)clPixelMathRoundUNorm(srcPixel[2] / maxChannelU8f, maxChannelU16);
-                            dstPixel[3] = (uint16_t)clPixelMathRoundUNorm(srcPixel[3] / maxChannelU8f, maxChannelU16);
-                        }
-                    }
+                    clImageConvertPixels(C, image, CL_PIXELFORMAT_U8, pixelFormat);
                 } else {
                     // U16 White
                     memset(image->pixelsU16, 0xff, image->width * image->height * CL_CHANNELS_PER_PIXEL * sizeof(uint16_t));
@@ -168,29 +504,9 @@ void clImagePrepareReadPixels(struct clContext * C, clImage * image, clPixelForm
                 clImageAllocatePixels(C, image, pixelFormat);
 
                 if (image->pixelsU16) {
-                    // U16 -> F32
-                    for (int j = 0; j < image->height; ++j) {
-                        for (int i = 0; i < image->width; ++i) {
-                            uint16_t * srcPixel = &image->pixelsU16[(i + (j * image->width)) * CL_CHANNELS_PER_PIXEL];
-                            float * dstPixel = &image->pixelsF32[(i + (j * image->width)) * CL_CHANNELS_PER_PIXEL];
-                            dstPixel[0] = srcPixel[0] / maxChannelU16f;
-                            dstPixel[1] = srcPixel[1] / maxChannelU16f;
-                            dstPixel[2] = srcPixel[2] / maxChannelU16f;
-                            dstPixel[3] = srcPixel[3] / maxChannelU16f;
-                        }
-                    }
+                    clImageConvertPixels(C, image, CL_PIXELFORMAT_U16, pixelFormat);
                 } else if (image->pixelsU8) {
-                    // U8 -> F32
-                    for (int j = 0; j < image->height; ++j) {
-                        for (int i = 0; i < image->width; ++i) {
-                            uint8_t * srcPixel = &image->pixelsU8[(i + (j * image->width)) * CL_CHANNELS_PER_PIXEL];
-                            float * dstPixel = &image->pixelsF32[(i + (j * image->width)) * CL_CHANNELS_PER_PIXEL];
-                            dstPixel[0] = srcPixel[0] / maxChannelU8f;
-                            dstPixel[1] = srcPixel[1] / maxChannelU8f;
-                            dstPixel[2] = srcPixel[2] / maxChannelU8f;
-                            dstPixel[3] = srcPixel[3] / maxChannelU8f;
-                        }
-                    }
+                    clImageConvertPixels(C, image, CL_PIXELFORMAT_U8, pixelFormat);
                 } else {
                     // F32 White
                     uint32_t channelCount = image->width * image->height * CL_CHANNELS_PER_PIXEL;
@@ -207,26 +523,33 @@ void clImagePrepareReadPixels(struct clContext * C, clImage * image, clPixelForm
     }
 }
 
-void clImagePrepareWritePixels(struct clContext * C, clImage * image, clPixelFormat pixelFormat)
+void clImagePrepareReadPixels(struct clContext * C, clImage * image, clPixelFormat pixelFormat)
+{
+    clImagePrepareReadRows(C, image, pixelFormat);
+    clImagePackPixels(C, image, pixelFormat, clFalse);
+}
+
+void clImagePrepareWriteRows(struct clContext * C, clImage * image, clPixelFormat pixelFormat)
 {
-    clImagePrepareReadPixels(C, image, pixelFormat);
+    clImagePixelsChanged(C, image);
+
+    clImagePrepareReadRows(C, image, pixelFormat);
 
     // Throw away anything that isn't about to be written to; it will be stale and can be repopulated
     // lazily by a future call to clImagePrepareReadPixels().
-    if (image->pixelsU8 && (pixelFormat != CL_PIXELFORMAT_U8)) {
-        clFree(image->pixelsU8);
-        image->pixelsU8 = NULL;
-    }
-    if (image->pixelsU16 && (pixelFormat != CL_PIXELFORMAT_U16)) {
-        clFree(image->pixelsU16);
-        image->pixelsU16 = NULL;
-    }
-    if (image->pixelsF32 && (pixelFormat != CL_PIXELFORMAT_F32)) {
-        clFree(image->pixelsF32);
-        image->pixelsF32 = NULL;
+    for (clPixelFormat otherFormat = CL_PIXELFORMAT_FIRST; otherFormat != CL_PIXELFORMAT_COUNT; ++otherFormat) {
+        if (otherFormat != pixelFormat) {
+            clImageFreePixels(C, image, otherFormat);
+        }
     }
 }
 
+void clImagePrepareWritePixels(struct clContext * C, clImage * image, clPixelFormat pixelFormat)
+{
+    clImagePrepareWriteRows(C, image, pixelFormat);
+    clImagePackPixels(C, image, pixelFormat, clTrue);
+}
+
 clImage * clImageCrop(struct clContext * C, clImage * srcImage, int x, int y, int w, int h, clBool keepSrc)
 {
     if (!srcImage) {
@@ -236,47 +559,95 @@ clImage * clImageCrop(struct clContext * C, clImage * srcImage, int x, int y, in
         return NULL;
     }
 
+    // Borrow every plane srcImage has, starting at (x, y) and keeping its row pitch
     clImage * dstImage = clImageCreate(C, w, h, srcImage->depth, srcImage->profile);
     for (clPixelFormat pixelFormat = CL_PIXELFORMAT_FIRST; pixelFormat != CL_PIXELFORMAT_COUNT; ++pixelFormat) {
-        uint8_t * srcPixels = clImagePixelPtr(C, srcImage, pixelFormat);
-        if (!srcPixels) {
-            continue;
-        }
-        clImageAllocatePixels(C, dstImage, pixelFormat);
-        uint8_t * dstPixels = clImagePixelPtr(C, dstImage, pixelFormat);
-        for (int j = 0; j < h; ++j) {
-            for (int i = 0; i < w; ++i) {
-                uint8_t * src = &srcPixels[CL_BYTES_PER_PIXEL(pixelFormat) * ((i + x) + (srcImage->width * (j + y)))];
-                uint8_t * dst = &dstPixels[CL_BYTES_PER_PIXEL(pixelFormat) * (i + (dstImage->width * j))];
-                memcpy(dst, src, CL_BYTES_PER_PIXEL(pixelFormat));
-            }
+        uint8_t * srcRow = clImagePixelRow(C, srcImage, pixelFormat, y);
+        if (srcRow) {
+            clImageSetPixelPtr(dstImage,
+                               pixelFormat,
+                               srcRow + (x * CL_BYTES_PER_PIXEL(pixelFormat)),
+                               srcImage->rowBytes[pixelFormat],
+                               clTrue);
         }
     }
 
     if (!keepSrc) {
-        clImageDestroy(C, srcImage);
+        dstImage->viewParent = srcImage;
+        clImageReleaseViewParent(C, dstImage); // Nothing to borrow
     }
     return dstImage;
 }
 
-clImage * clImageApplyHALD(struct clContext * C, clImage * image, clImage * hald, int haldDims)
+typedef struct clHaldLUTTask
 {
-    clImage * appliedImage = clImageCreate(C, image->width, image->height, image->depth, image->profile);
-
-    clImagePrepareReadPixels(C, image, CL_PIXELFORMAT_F32);
-    clImagePrepareReadPixels(C, hald, CL_PIXELFORMAT_F32);
-    clImagePrepareWritePixels(C, appliedImage, CL_PIXELFORMAT_F32);
-
-    int pixelCount = image->width * image->height;
-    for (int i = 0; i < pixelCount; ++i) {
-        clPixelMathHaldCLUTLookup(C,
-                                  hald->pixelsF32,
-                                  haldDims,
-                                  &image->pixelsF32[i * CL_CHANNELS_PER_PIXEL],
-                                  &appliedImage->pixelsF32[i * CL_CHANNELS_PER_PIXEL]);
+    struct clContext * C;
+    clImage * srcImage;
+    clImage * dstImage;
+    const clHaldLUT * lut;
+    clPixelConversionTask toFloat;   // Integer rows are looked up through a float scratch row...
+    clPixelConversionTask fromFloat; // ...and quantized back exactly like clImagePrepareReadPixels() would
+} clHaldLUTTask;
+
+static void haldLUTTaskFunc(clHaldLUTTask * info, int firstRow, int rowCount)
+{
+    struct clContext * C = info->C;
+    const clPixelFormat srcFormat = info->toFloat.srcFormat;
+    const clPixelFormat dstFormat = info->fromFloat.dstFormat;
+    const int width = info->dstImage->width;
+    const int channelCount = width * CL_CHANNELS_PER_PIXEL;
+    float * scratch = NULL;
+    if ((srcFormat != CL_PIXELFORMAT_F32) || (dstFormat != CL_PIXELFORMAT_F32)) {
+        scratch = clAllocate(sizeof(float) * channelCount);
+    }
+    for (int y = firstRow; y < (firstRow + rowCount); ++y) {
+        uint8_t * srcRow = clImagePixelRow(C, info->srcImage, srcFormat, y);
+        uint8_t * dstRow = clImagePixelRow(C, info->dstImage, dstFormat, y);
+        const float * src = (const float *)srcRow;
+        float * dst = (dstFormat == CL_PIXELFORMAT_F32) ? (float *)dstRow : scratch;
+        if (srcFormat != CL_PIXELFORMAT_F32) {
+            convertChannels(&info->toFloat, srcRow, (uint8_t *)scratch, channelCount);
+            src = scratch;
+        }
+        clPixelMathHaldLUTApply(C, info->lut, src, dst, width);
+        if (dstFormat != CL_PIXELFORMAT_F32) {
+            convertChannels(&info->fromFloat, (const uint8_t *)scratch, dstRow, channelCount);
+        }
     }
+    clFree(scratch);
+}
 
-    return appliedImage;
+void clImageApplyHaldLUT(struct clContext * C, clImage * srcImage, clImage * dstImage, const clHaldLUT * lut)
+{
+    COLORIST_ASSERT((srcImage->width == dstImage->width) && (srcImage->height == dstImage->height));
+
+    // Read and written at whatever pixel formats the images naturally hold, a band of rows per task
+    clPixelFormat srcFormat = clImageNativePixelFormat(C, srcImage);
+    clPixelFormat dstFormat = srcFormat;
+    if (srcImage != dstImage) {
+        dstFormat = clImageNativePixelFormat(C, dstImage);
+        clImagePrepareReadRows(C, srcImage, srcFormat);
+    }
+    clImagePrepareWritePixels(C, dstImage, dstFormat);
+
+    clHaldLUTTask info;
+    info.C = C;
+    info.srcImage = srcImage;
+    info.dstImage = dstImage;
+    info.lut = lut;
+    memset(&info.toFloat, 0, sizeof(info.toFloat));
+    info.toFloat.srcFormat = srcFormat;
+    info.toFloat.dstFormat = CL_PIXELFORMAT_F32;
+    info.toFloat.srcMaxChannel = (float)clImageFormatMaxChannel(srcImage, srcFormat);
+    info.toFloat.dstMaxChannel = 1;
+    memcpy(&info.fromFloat, &info.toFloat, sizeof(info.fromFloat));
+    info.fromFloat.srcFormat = CL_PIXELFORMAT_F32;
+    info.fromFloat.dstFormat = dstFormat;
+    info.fromFloat.srcMaxChannel = 1.0f;
+    info.fromFloat.dstMaxChannel = clImageFormatMaxChannel(dstImage, dstFormat);
+
+    int minRowsPerTask = CL_MAX(1, CL_IMAGE_MIN_PIXELS_PER_TASK / CL_MAX(1, dstImage->width));
+    clTaskParallelFor(C, dstImage->height, minRowsPerTask, (clTaskRangeFunc)haldLUTTaskFunc, &info);
 }
 
 clImage * clImageResize(struct clContext * C, clImage * image, int width, int height, clFilter resizeFilter)
@@ -287,11 +658,6 @@ clImage * clImageResize(struct clContext * C, clImage * image, int width, int he
     clImagePrepareWritePixels(C, resizedImage, CL_PIXELFORMAT_F32);
 
     clPixelMathResize(C, image->width, image->height, image->pixelsF32, resizedImage->width, resizedImage->height, resizedImage->pixelsF32, resizeFilter);
-    int resizedChannelCount = resizedImage->width * resizedImage->height * CL_CHANNELS_PER_PIXEL;
-    for (int i = 0; i < resizedChannelCount; ++i) {
-        // catmullrom and mitchell sometimes give negative values. Protect against that
-        resizedImage->pixelsF32[i] = CL_MAX(resizedImage->pixelsF32[i], 0.0f);
-    }
     return resizedImage;
 }
 
@@ -299,6 +665,7 @@ void clBlendParamsSetDefaults(struct clContext * C, clBlendParams * blendParams)
 {
     COLORIST_UNUSED(C);
 
+    blendParams->mode = CL_BLEND_SOURCEOVER;
     blendParams->gamma = 2.2f;
     blendParams->srcTonemap = CL_TONEMAP_AUTO;
     clTonemapParamsSetDefaults(C, &blendParams->srcParams);
@@ -309,97 +676,223 @@ void clBlendParamsSetDefaults(struct clContext * C, clBlendParams * blendParams)
     blendParams->offsetY = 0;
 }
 
-clImage * clImageBlend(struct clContext * C, clImage * image, clImage * compositeImage, clBlendParams * blendParams)
+// One composite's part in a blend: the rectangle of the base image it covers, and how its pixels get into blend space
+typedef struct clBlendLayer
 {
+    clImage * image;
+    const clBlendParams * params;
+    clPixelFormat pixelFormat;
+    clTransform * blendTransform;
+    int dstX; // Overlap rectangle in the base image...
+    int dstY;
+    int width;
+    int height;
+    int cmpX; // ...and where it starts in the composite
+    int cmpY;
+} clBlendLayer;
+
+typedef struct clBlendTask
+{
+    struct clContext * C;
+    clImage * image;
+    clPixelFormat pixelFormat;
+    clTransform * srcBlendTransform;
+    clTransform * dstTransform;
+    const clBlendLayer * layers; // Only the ones overlapping image, in blend order
+    int layerCount;
+    int firstY;   // First row any layer covers
+    int maxWidth; // Widest layer overlap
+} clBlendTask;
+
+static clBool blendLayerCoversRow(const clBlendLayer * layer, int y)
+{
+    return ((y >= layer->dstY) && (y < (layer->dstY + layer->height))) ? clTrue : clFalse;
+}
+
+static void blendTaskFunc(clBlendTask * info, int firstRow, int rowCount)
+{
+    struct clContext * C = info->C;
+    const size_t pixelBytes = CL_BYTES_PER_PIXEL(info->pixelFormat);
+    float * srcFloats = clAllocate(4 * sizeof(float) * info->image->width);
+    float * cmpFloats = clAllocate(4 * sizeof(float) * info->maxWidth);
+    for (int y = info->firstY + firstRow; y < (info->firstY + firstRow + rowCount); ++y) {
+        uint8_t * dstRow = clImagePixelRow(C, info->image, info->pixelFormat, y);
+
+        // Walk the runs of this row that layers cover (overlapping or touching layers share a run). Each run goes into
+        // blend space and back once with every layer on it blended in order; pixels between runs are never touched.
+        int runEnd = 0;
+        for (;;) {
+            int runStart = info->image->width;
+            for (int i = 0; i < info->layerCount; ++i) {
+                const clBlendLayer * layer = &info->layers[i];
+                if (blendLayerCoversRow(layer, y) && (layer->dstX >= runEnd)) {
+                    runStart = CL_MIN(runStart, layer->dstX);
+                }
+            }
+            if (runStart == info->image->width) {
+                break;
+            }
+            runEnd = runStart;
+            for (clBool grew = clTrue; grew;) {
+                grew = clFalse;
+                for (int i = 0; i < info->layerCount; ++i) {
+                    const clBlendLayer * layer = &info->layers[i];
+                    if (blendLayerCoversRow(layer, y) && (layer->dstX <= runEnd) && ((layer->dstX + layer->width) > runEnd)) {
+                        runEnd = layer->dstX + layer->width;
+                        grew = clTrue;
+                    }
+                }
+            }
+
+            uint8_t * run = dstRow + ((size_t)runStart * pixelBytes);
+            clTransformRun(C, info->srcBlendTransform, run, srcFloats, runEnd - runStart);
+            for (int i = 0; i < info->layerCount; ++i) {
+                const clBlendLayer * layer = &info->layers[i];
+                if (blendLayerCoversRow(layer, y) && (layer->dstX >= runStart) && (layer->dstX < runEnd)) {
+                    uint8_t * cmpRow = clImagePixelRow(C, layer->image, layer->pixelFormat, layer->cmpY + (y - layer->dstY)) +
+                                       ((size_t)layer->cmpX * CL_BYTES_PER_PIXEL(layer->pixelFormat));
+                    clTransformRun(C, layer->blendTransform, cmpRow, cmpFloats, layer->width);
+                    clPixelMathBlend(C,
+                                     layer->params->mode,
+                                     cmpFloats,
+                                     &srcFloats[(layer->dstX - runStart) * 4],
+                                     layer->width,
+                                     layer->params->premultiplied);
+                }
+            }
+            clTransformRun(C, info->dstTransform, srcFloats, run, runEnd - runStart);
+        }
+    }
+    clFree(srcFloats);
+    clFree(cmpFloats);
+}
+
+clBool clImageBlendLayersInPlace(struct clContext * C,
+                                 clImage * image,
+                                 int layerCount,
+                                 clImage ** compositeImages,
+                                 clBlendParams * blendParams)
+{
+    if (layerCount < 1) {
+        return clTrue;
+    }
+
+    // Find the rectangle each composite covers once offset, clipped to image
+    clBlendLayer * layers = clAllocate(sizeof(clBlendLayer) * layerCount);
+    int overlapCount = 0;
+    int firstY = image->height;
+    int lastY = 0;
+    int maxWidth = 0;
+    for (int i = 0; i < layerCount; ++i) {
+        COLORIST_ASSERT(compositeImages[i] != image);
+        clBlendLayer * layer = &layers[overlapCount];
+        layer->image = compositeImages[i];
+        layer->params = &blendParams[i];
+        layer->dstX = CL_MAX(blendParams[i].offsetX, 0);
+        layer->dstY = CL_MAX(blendParams[i].offsetY, 0);
+        layer->width = CL_MIN(image->width, blendParams[i].offsetX + layer->image->width) - layer->dstX;
+        layer->height = CL_MIN(image->height, blendParams[i].offsetY + layer->image->height) - layer->dstY;
+        if ((layer->width < 1) || (layer->height < 1)) {
+            continue; // Nothing overlaps
+        }
+        layer->cmpX = layer->dstX - blendParams[i].offsetX;
+        layer->cmpY = layer->dstY - blendParams[i].offsetY;
+        firstY = CL_MIN(firstY, layer->dstY);
+        lastY = CL_MAX(lastY, layer->dstY + layer->height);
+        maxWidth = CL_MAX(maxWidth, layer->width);
+        ++overlapCount;
+    }
+    if (overlapCount == 0) {
+        clFree(layers);
+        return clTrue;
+    }
+
     // Query profile used for both src and dst image
     clProfilePrimaries primaries;
     clProfileCurve curve;
     int maxLuminance;
     if (!clProfileQuery(C, image->profile, &primaries, &curve, &maxLuminance)) {
         clContextLogError(C, "clImageBlend: failed to query source profile");
-        return NULL;
+        clFree(layers);
+        return clFalse;
     }
     maxLuminance = (int)((float)maxLuminance * curve.implicitScale);
 
     // Build a profile using the same color volume, but a blend-friendly gamma
     curve.type = CL_PCT_GAMMA;
     curve.implicitScale = 1.0f;
-    curve.gamma = blendParams->gamma;
+    curve.gamma = blendParams[0].gamma;
     clProfile * blendProfile = clProfileCreate(C, &primaries, &curve, maxLuminance, NULL);
 
-    // Build transforms that go [src -> blend], [cmp -> blend], [blend -> dst]
-    clTransform * srcBlendTransform = clTransformCreate(C, image->profile, CL_XF_RGBA, blendProfile, CL_XF_RGBA, blendParams->srcTonemap);
-    memcpy(&srcBlendTransform->tonemapParams, &blendParams->srcParams, sizeof(clTonemapParams));
-    clTransform * cmpBlendTransform =
-        clTransformCreate(C, compositeImage->profile, CL_XF_RGBA, blendProfile, CL_XF_RGBA, blendParams->cmpTonemap);
-    memcpy(&cmpBlendTransform->tonemapParams, &blendParams->cmpParams, sizeof(clTonemapParams));
-    clTransform * dstTransform =
-        clTransformCreate(C, blendProfile, CL_XF_RGBA, image->profile, CL_XF_RGBA, CL_TONEMAP_OFF); // maxLuminance should match, no need to tonemap
-
-    // Transform src and comp images into normalized blend space
-    clImagePrepareReadPixels(C, image, CL_PIXELFORMAT_F32);
-    clImagePrepareReadPixels(C, compositeImage, CL_PIXELFORMAT_F32);
-    float * srcFloats = clAllocate(4 * sizeof(float) * image->width * image->height);
-    clTransformRun(C, srcBlendTransform, image->pixelsF32, srcFloats, image->width * image->height);
-    float * cmpFloats = clAllocate(4 * sizeof(float) * compositeImage->width * compositeImage->height);
-    clTransformRun(C, cmpBlendTransform, compositeImage->pixelsF32, cmpFloats, compositeImage->width * compositeImage->height);
-
-    // Find bounds and offset for composition
-    int offsetX = blendParams->offsetX;
-    int offsetY = blendParams->offsetY;
-    int rangeX = CL_MIN(image->width - offsetX, compositeImage->width);
-    int rangeY = CL_MIN(image->height - offsetY, compositeImage->height);
-
-    // Perform SourceOver blend
-    float * dstFloats = clAllocate(4 * sizeof(float) * image->width * image->height);
-    memcpy(dstFloats, srcFloats, 4 * sizeof(float) * image->width * image->height); // start with the original pixels
-    if ((rangeX >= 1) && (rangeY >= 1)) {
-        if (blendParams->premultiplied) {
-            // Premultiplied alpha
-            for (int j = 0; j < rangeY; ++j) {
-                for (int i = 0; i < rangeX; ++i) {
-                    float * srcPixel = &srcFloats[CL_CHANNELS_PER_PIXEL * ((i + offsetX) + ((j + offsetY) * image->width))];
-                    float * cmpPixel = &cmpFloats[CL_CHANNELS_PER_PIXEL * (i + (j * compositeImage->width))];
-                    float * dstPixel = &dstFloats[CL_CHANNELS_PER_PIXEL * ((i + offsetX) + ((j + offsetY) * image->width))];
-
-                    // cmpPixel is the "Source" in a SourceOver Porter/Duff blend
-                    dstPixel[0] = cmpPixel[0] + (srcPixel[0] * (1 - cmpPixel[3]));
-                    dstPixel[1] = cmpPixel[1] + (srcPixel[1] * (1 - cmpPixel[3]));
-                    dstPixel[2] = cmpPixel[2] + (srcPixel[2] * (1 - cmpPixel[3]));
-                    dstPixel[3] = cmpPixel[3] + (srcPixel[3] * (1 - cmpPixel[3]));
-                }
-            }
-        } else {
-            // Not Premultiplied alpha, perform the multiply during the blend
-            for (int j = 0; j < rangeY; ++j) {
-                for (int i = 0; i < rangeX; ++i) {
-                    float * srcPixel = &srcFloats[CL_CHANNELS_PER_PIXEL * ((i + offsetX) + ((j + offsetY) * image->width))];
-                    float * cmpPixel = &cmpFloats[CL_CHANNELS_PER_PIXEL * (i + (j * compositeImage->width))];
-                    float * dstPixel = &dstFloats[CL_CHANNELS_PER_PIXEL * ((i + offsetX) + ((j + offsetY) * image->width))];
-
-                    // cmpPixel is the "Source" in a SourceOver Porter/Duff blend
-                    dstPixel[0] = (cmpPixel[0] * cmpPixel[3]) + (srcPixel[0] * srcPixel[3] * (1 - cmpPixel[3]));
-                    dstPixel[1] = (cmpPixel[1] * cmpPixel[3]) + (srcPixel[1] * srcPixel[3] * (1 - cmpPixel[3]));
-                    dstPixel[2] = (cmpPixel[2] * cmpPixel[3]) + (srcPixel[2] * srcPixel[3] * (1 - cmpPixel[3]));
-                    dstPixel[3] = cmpPixel[3] + (srcPixel[3] * (1 - cmpPixel[3]));
-                }
-            }
-        }
+    // Every image is read (and image is written) at whatever pixel format it naturally holds
+    clPixelFormat pixelFormat = clImageNativePixelFormat(C, image);
+    clImagePrepareWritePixels(C, image, pixelFormat);
+    clTransformFormat format = clImagePixelFormatToTransformFormat(C, pixelFormat);
+
+    // Build transforms that go [src -> blend], [each cmp -> blend], [blend -> dst]
+    for (int i = 0; i < overlapCount; ++i) {
+        clBlendLayer * layer = &layers[i];
+        layer->pixelFormat = clImageNativePixelFormat(C, layer->image);
+        clImagePrepareReadRows(C, layer->image, layer->pixelFormat);
+        layer->blendTransform = clTransformAcquire(C,
+                                                   layer->image->profile,
+                                                   clImagePixelFormatToTransformFormat(C, layer->pixelFormat),
+                                                   blendProfile,
+                                                   CL_XF_RGBA,
+                                                   layer->params->cmpTonemap,
+                                                   &layer->params->cmpParams,
+                                                   layer->image->depth,
+                                                   0);
     }
-
-    // Transform blended pixels into new destination image
-    clImage * dstImage = clImageCreate(C, image->width, image->height, image->depth, image->profile);
-    clImagePrepareWritePixels(C, dstImage, CL_PIXELFORMAT_F32);
-    clTransformRun(C, dstTransform, dstFloats, dstImage->pixelsF32, image->width * image->height);
+    clBlendTask info;
+    info.C = C;
+    info.image = image;
+    info.pixelFormat = pixelFormat;
+    info.srcBlendTransform = clTransformAcquire(C,
+                                                image->profile,
+                                                format,
+                                                blendProfile,
+                                                CL_XF_RGBA,
+                                                blendParams[0].srcTonemap,
+                                                &blendParams[0].srcParams,
+                                                image->depth,
+                                                0);
+    // maxLuminance should match, no need to tonemap
+    info.dstTransform = clTransformAcquire(C, blendProfile, CL_XF_RGBA, image->profile, format, CL_TONEMAP_OFF, NULL, 0, image->depth);
+    info.layers = layers;
+    info.layerCount = overlapCount;
+    info.firstY = firstY;
+    info.maxWidth = maxWidth;
+
+    // Blend every layer in one pass over the rows they cover, a band of rows per task
+    int minRowsPerTask = CL_MAX(1, CL_IMAGE_MIN_PIXELS_PER_TASK / maxWidth);
+    clTaskParallelFor(C, lastY - firstY, minRowsPerTask, (clTaskRangeFunc)blendTaskFunc, &info);
 
     // Cleanup
-    clTransformDestroy(C, srcBlendTransform);
-    clTransformDestroy(C, cmpBlendTransform);
-    clTransformDestroy(C, dstTransform);
+    for (int i = 0; i < overlapCount; ++i) {
+        clTransformRelease(C, layers[i].blendTransform);
+    }
+    clTransformRelease(C, info.srcBlendTransform);
+    clTransformRelease(C, info.dstTransform);
     clProfileDestroy(C, blendProfile);
-    clFree(srcFloats);
-    clFree(cmpFloats);
-    clFree(dstFloats);
+    clFree(layers);
+    return clTrue;
+}
+
+clBool clImageBlendInPlace(struct clContext * C, clImage * image, clImage * compositeImage, clBlendParams * blendParams)
+{
+    return clImageBlendLayersInPlace(C, image, 1, &compositeImage, blendParams);
+}
+
+clImage * clImageBlend(struct clContext * C, clImage * image, clImage * compositeImage, clBlendParams * blendParams)
+{
+    // Copies only the plane image's blend would write, instead of every plane image has
+    clImage * dstImage = clImageCrop(C, image, 0, 0, image->width, image->height, clTrue);
+    clImagePrepareWritePixels(C, dstImage, clImageNativePixelFormat(C, dstImage));
+    if (!clImageBlendInPlace(C, dstImage, compositeImage, blendParams)) {
+        clImageDestroy(C, dstImage);
+        return NULL;
+    }
     return dstImage;
 }
 
@@ -424,170 +917,277 @@ clBool clImageAdjustRect(struct clContext * C, clImage * image, int * x, int * y
     return clTrue;
 }
 
-clImage * clImageRotate(struct clContext * C, clImage * image, int cwTurns)
+// Rotations and mirrors walk the destination in square tiles so that the transposing ones touch a handful of source
+// rows at a time instead of striding across the whole image for every destination row
+#define CL_IMAGE_ORIENT_TILE_SIZE 32
+
+// dst(x, y) = src(originX + x * xStepX + y * yStepX, originY + x * xStepY + y * yStepY), all in src pixels
+typedef struct clImageOrientation
 {
-    clImage * rotated = NULL;
+    int originX;
+    int originY;
+    int xStepX;
+    int xStepY;
+    int yStepX;
+    int yStepY;
+} clImageOrientation;
+
+typedef struct clOrientTask
+{
+    const uint8_t * srcOrigin;
+    ptrdiff_t srcStepX; // Bytes between the src pixels of horizontally adjacent dst pixels
+    ptrdiff_t srcStepY; // Bytes between the src pixels of vertically adjacent dst pixels
+    uint8_t * dstPixels;
+    int dstRowBytes;
+    int dstWidth;
+    int dstHeight;
+    int pixelBytes;
+} clOrientTask;
+
+// Copies count pixels into a dst span, stepping through src by srcStep bytes. The constant memcpy() sizes compile down to
+// single loads and stores per pixel format.
+static void orientSpan(uint8_t * dst, const uint8_t * src, ptrdiff_t srcStep, int count, int pixelBytes)
+{
+    if (srcStep == pixelBytes) {
+        memcpy(dst, src, (size_t)count * pixelBytes);
+        return;
+    }
 
-    switch (cwTurns) {
-        case 0: // Not rotated
-            rotated = clImageCreate(C, image->width, image->height, image->depth, image->profile);
-            break;
-        case 1: // 90 degrees clockwise
-            rotated = clImageCreate(C, image->height, image->width, image->depth, image->profile);
+    switch (pixelBytes) {
+        case 4:
+            for (int i = 0; i < count; ++i, dst += 4, src += srcStep) {
+                memcpy(dst, src, 4);
+            }
             break;
-        case 2: // 180 degrees clockwise
-            rotated = clImageCreate(C, image->width, image->height, image->depth, image->profile);
+        case 8:
+            for (int i = 0; i < count; ++i, dst += 8, src += srcStep) {
+                memcpy(dst, src, 8);
+            }
             break;
-        case 3: // 270 degrees clockwise
-            rotated = clImageCreate(C, image->height, image->width, image->depth, image->profile);
+        case 16:
+            for (int i = 0; i < count; ++i, dst += 16, src += srcStep) {
+                memcpy(dst, src, 16);
+            }
             break;
     }
+}
 
-    if (rotated) {
-        for (clPixelFormat pixelFormat = CL_PIXELFORMAT_FIRST; pixelFormat != CL_PIXELFORMAT_COUNT; ++pixelFormat) {
-            uint8_t * srcPixels = clImagePixelPtr(C, image, pixelFormat);
-            if (!srcPixels) {
-                continue;
-            }
-            clImageAllocatePixels(C, rotated, pixelFormat);
-            uint8_t * dstPixels = clImagePixelPtr(C, rotated, pixelFormat);
-
-            switch (cwTurns) {
-                case 0: // Not rotated
-                    memcpy(dstPixels, srcPixels, rotated->width * rotated->height * CL_BYTES_PER_PIXEL(pixelFormat));
-                    break;
-                case 1: // 90 degrees clockwise
-                    for (int j = 0; j < image->height; ++j) {
-                        for (int i = 0; i < image->width; ++i) {
-                            uint8_t * srcPixel = &srcPixels[CL_BYTES_PER_PIXEL(pixelFormat) * (i + (j * image->width))];
-                            uint8_t * dstPixel =
-                                &dstPixels[CL_BYTES_PER_PIXEL(pixelFormat) * ((rotated->width - 1 - j) + (i * rotated->width))];
-                            memcpy(dstPixel, srcPixel, CL_BYTES_PER_PIXEL(pixelFormat));
-                        }
-                    }
-                    break;
-                case 2: // 180 degrees clockwise
-                    for (int j = 0; j < image->height; ++j) {
-                        for (int i = 0; i < image->width; ++i) {
-                            uint8_t * srcPixel = &srcPixels[CL_BYTES_PER_PIXEL(pixelFormat) * (i + (j * image->width))];
-                            uint8_t * dstPixel = &dstPixels[CL_BYTES_PER_PIXEL(pixelFormat) *
-                                                            ((rotated->width - 1 - i) + ((rotated->height - 1 - j) * rotated->width))];
-                            memcpy(dstPixel, srcPixel, CL_BYTES_PER_PIXEL(pixelFormat));
-                        }
-                    }
-                    break;
-                case 3: // 270 degrees clockwise
-                    for (int j = 0; j < image->height; ++j) {
-                        for (int i = 0; i < image->width; ++i) {
-                            uint8_t * srcPixel = &srcPixels[CL_BYTES_PER_PIXEL(pixelFormat) * (i + (j * image->width))];
-                            uint8_t * dstPixel =
-                                &dstPixels[CL_BYTES_PER_PIXEL(pixelFormat) * (j + ((rotated->height - 1 - i) * rotated->width))];
-                            memcpy(dstPixel, srcPixel, CL_BYTES_PER_PIXEL(pixelFormat));
-                        }
-                    }
-                    break;
+static void orientTaskFunc(clOrientTask * info, int firstTileRow, int tileRowCount)
+{
+    const int tileSize = CL_IMAGE_ORIENT_TILE_SIZE;
+    int endY = CL_MIN((firstTileRow + tileRowCount) * tileSize, info->dstHeight);
+    for (int tileY = firstTileRow * tileSize; tileY < endY; tileY += tileSize) {
+        int tileEndY = CL_MIN(tileY + tileSize, endY);
+        for (int tileX = 0; tileX < info->dstWidth; tileX += tileSize) {
+            int tileWidth = CL_MIN(tileSize, info->dstWidth - tileX);
+            for (int y = tileY; y < tileEndY; ++y) {
+                orientSpan(&info->dstPixels[((size_t)y * info->dstRowBytes) + ((size_t)tileX * info->pixelBytes)],
+                           info->srcOrigin + (tileX * info->srcStepX) + (y * info->srcStepY),
+                           info->srcStepX,
+                           tileWidth,
+                           info->pixelBytes);
             }
         }
     }
-    return rotated;
 }
 
-clImage * clImageMirror(struct clContext * C, clImage * image, int horizontal)
+// Builds a dstWidth x dstHeight copy of every plane image has, laid out by orientation
+static clImage * clImageOrient(struct clContext * C,
+                               clImage * image,
+                               int dstWidth,
+                               int dstHeight,
+                               const clImageOrientation * orientation)
 {
-    clImage * mirrored = clImageCreate(C, image->width, image->height, image->depth, image->profile);
+    clImage * dstImage = clImageCreate(C, dstWidth, dstHeight, image->depth, image->profile);
+    int minTileRowsPerTask = CL_MAX(1, CL_IMAGE_MIN_PIXELS_PER_TASK / (CL_IMAGE_ORIENT_TILE_SIZE * CL_MAX(1, dstWidth)));
     for (clPixelFormat pixelFormat = CL_PIXELFORMAT_FIRST; pixelFormat != CL_PIXELFORMAT_COUNT; ++pixelFormat) {
-        uint8_t * srcPixels = clImagePixelPtr(C, image, pixelFormat);
-        if (!srcPixels) {
+        const uint8_t * srcRow = clImagePixelRow(C, image, pixelFormat, orientation->originY);
+        if (!srcRow) {
             continue;
         }
-        clImageAllocatePixels(C, mirrored, pixelFormat);
-        uint8_t * dstPixels = clImagePixelPtr(C, mirrored, pixelFormat);
+        clImageAllocatePixels(C, dstImage, pixelFormat);
 
-        if (horizontal) {
-            // Horizontal
+        const ptrdiff_t pixelBytes = CL_BYTES_PER_PIXEL(pixelFormat);
+        const ptrdiff_t srcRowBytes = image->rowBytes[pixelFormat];
+        clOrientTask info;
+        info.srcOrigin = srcRow + (orientation->originX * pixelBytes);
+        info.srcStepX = (orientation->xStepX * pixelBytes) + (orientation->xStepY * srcRowBytes);
+        info.srcStepY = (orientation->yStepX * pixelBytes) + (orientation->yStepY * srcRowBytes);
+        info.dstPixels = clImagePixelPtr(C, dstImage, pixelFormat);
+        info.dstRowBytes = dstImage->rowBytes[pixelFormat];
+        info.dstWidth = dstWidth;
+        info.dstHeight = dstHeight;
+        info.pixelBytes = (int)pixelBytes;
+        int tileRowCount = (dstHeight + CL_IMAGE_ORIENT_TILE_SIZE - 1) / CL_IMAGE_ORIENT_TILE_SIZE;
+        clTaskParallelFor(C, tileRowCount, minTileRowsPerTask, (clTaskRangeFunc)orientTaskFunc, &info);
+    }
+    return dstImage;
+}
 
-            for (int j = 0; j < image->height; ++j) {
-                for (int i = 0; i < image->width; ++i) {
-                    uint8_t * srcPixel = &srcPixels[CL_BYTES_PER_PIXEL(pixelFormat) * (i + (j * image->width))];
-                    uint8_t * dstPixel = &dstPixels[CL_BYTES_PER_PIXEL(pixelFormat) * ((image->width - 1 - i) + (j * image->width))];
-                    memcpy(dstPixel, srcPixel, CL_BYTES_PER_PIXEL(pixelFormat));
-                }
-            }
-        } else {
-            // Vertical
-
-            for (int j = 0; j < image->height; ++j) {
-                for (int i = 0; i < image->width; ++i) {
-                    uint8_t * srcPixel = &srcPixels[CL_BYTES_PER_PIXEL(pixelFormat) * (i + (j * image->width))];
-                    uint8_t * dstPixel = &dstPixels[CL_BYTES_PER_PIXEL(pixelFormat) * (i + ((image->height - 1 - j) * image->width))];
-                    memcpy(dstPixel, srcPixel, CL_BYTES_PER_PIXEL(pixelFormat));
-                }
-            }
+clImage * clImageRotate(struct clContext * C, clImage * image, int cwTurns)
+{
+    const int w = image->width;
+    const int h = image->height;
+    switch (cwTurns) {
+        case 0: // Not rotated
+        {
+            const clImageOrientation orientation = { 0, 0, 1, 0, 0, 1 };
+            return clImageOrient(C, image, w, h, &orientation);
+        }
+        case 1: // 90 degrees clockwise
+        {
+            const clImageOrientation orientation = { 0, h - 1, 0, -1, 1, 0 };
+            return clImageOrient(C, image, h, w, &orientation);
+        }
+        case 2: // 180 degrees clockwise
+        {
+            const clImageOrientation orientation = { w - 1, h - 1, -1, 0, 0, -1 };
+            return clImageOrient(C, image, w, h, &orientation);
+        }
+        case 3: // 270 degrees clockwise
+        {
+            const clImageOrientation orientation = { w - 1, 0, 0, 1, -1, 0 };
+            return clImageOrient(C, image, h, w, &orientation);
         }
     }
-    return mirrored;
+    return NULL;
 }
 
-clImage * clImageConvert(struct clContext * C, clImage * srcImage, int depth, struct clProfile * dstProfile, clTonemap tonemap, clTonemapParams * tonemapParams)
+clImage * clImageMirror(struct clContext * C, clImage * image, int horizontal)
 {
-    Timer t;
-
-    // Create destination image
-    clImage * dstImage = clImageCreate(C, srcImage->width, srcImage->height, depth, dstProfile);
-
-    // Show image details
-    clContextLog(C, "details", 0, "Source:");
-    clImageDebugDump(C, srcImage, 0, 0, 0, 0, 1);
-    clContextLog(C, "details", 0, "Destination:");
-    clImageDebugDump(C, dstImage, 0, 0, 0, 0, 1);
+    const int w = image->width;
+    const int h = image->height;
+    if (horizontal) {
+        const clImageOrientation orientation = { w - 1, 0, -1, 0, 0, 1 };
+        return clImageOrient(C, image, w, h, &orientation);
+    }
+    const clImageOrientation orientation = { 0, h - 1, 1, 0, 0, -1 };
+    return clImageOrient(C, image, w, h, &orientation);
+}
 
-    if (tonemap == CL_TONEMAP_AUTO) {
-        if (depth == 32) {
-            // Allow overranging, never tonemap
-            clContextLog(C, "tonemap", 0, "Tonemap: converting to FP32 (overranging), auto-tonemap disabled");
-            tonemap = CL_TONEMAP_OFF;
-        } else {
-            int srcPeakLuminance = (int)clImagePeakLuminance(C, srcImage);
-            int dstLuminance = CL_LUMINANCE_UNSPECIFIED;
-            clProfileQuery(C, dstProfile, NULL, NULL, &dstLuminance);
-            if (dstLuminance == CL_LUMINANCE_UNSPECIFIED) {
-                dstLuminance = C->defaultLuminance;
+// Swaps row pairs (or reverses single rows) in place; with flipY, item j pairs row j with row (height - 1 - j)
+typedef struct clFlipTask
+{
+    uint8_t * pixels;
+    int rowBytes;
+    int width;
+    int height;
+    int pixelBytes;
+    clBool flipX;
+    clBool flipY;
+} clFlipTask;
+
+// Swaps count pixels of a with those of b, stepping through b by bStep bytes
+static void flipSpan(uint8_t * a, uint8_t * b, ptrdiff_t bStep, int count, int pixelBytes)
+{
+    uint8_t t[16];
+    switch (pixelBytes) {
+        case 4:
+            for (int i = 0; i < count; ++i, a += 4, b += bStep) {
+                memcpy(t, a, 4);
+                memcpy(a, b, 4);
+                memcpy(b, t, 4);
             }
-
-            if (srcPeakLuminance > dstLuminance) {
-                tonemap = CL_TONEMAP_ON;
-            } else {
-                tonemap = CL_TONEMAP_OFF;
+            break;
+        case 8:
+            for (int i = 0; i < count; ++i, a += 8, b += bStep) {
+                memcpy(t, a, 8);
+                memcpy(a, b, 8);
+                memcpy(b, t, 8);
+            }
+            break;
+        case 16:
+            for (int i = 0; i < count; ++i, a += 16, b += bStep) {
+                memcpy(t, a, 16);
+                memcpy(a, b, 16);
+                memcpy(b, t, 16);
             }
+            break;
+    }
+}
 
-            clContextLog(C,
-                         "tonemap",
-                         0,
-                         "Tonemap: %d nits (measured potential peak) -> %d nits normalized (%dbpc), auto-tonemap %s",
-                         srcPeakLuminance,
-                         dstLuminance,
-                         depth,
-                         (tonemap == CL_TONEMAP_ON) ? "enabled" : "disabled");
+static void flipTaskFunc(clFlipTask * info, int firstItem, int itemCount)
+{
+    const ptrdiff_t pixelBytes = info->pixelBytes;
+    for (int j = firstItem; j < (firstItem + itemCount); ++j) {
+        int otherRow = info->flipY ? (info->height - 1 - j) : j;
+        uint8_t * rowA = &info->pixels[(size_t)j * info->rowBytes];
+        uint8_t * rowB = &info->pixels[(size_t)otherRow * info->rowBytes];
+        if (info->flipX) {
+            // A row being reversed onto itself only swaps its first half with its second
+            int count = (rowA == rowB) ? (info->width / 2) : info->width;
+            flipSpan(rowA, rowB + ((info->width - 1) * pixelBytes), -pixelBytes, count, info->pixelBytes);
+        } else if (rowA != rowB) {
+            flipSpan(rowA, rowB, pixelBytes, info->width, info->pixelBytes);
         }
     }
+}
 
-    // Create the transform
-    clTransform * transform = clTransformCreate(C, srcImage->profile, CL_XF_RGBA, dstImage->profile, CL_XF_RGBA, tonemap);
-    if (tonemapParams) {
-        memcpy(&transform->tonemapParams, tonemapParams, sizeof(clTonemapParams));
+static void clImageFlipInPlace(struct clContext * C, clImage * image, clBool flipX, clBool flipY)
+{
+    clImagePixelsChanged(C, image);
+
+    int itemCount = flipY ? ((image->height + 1) / 2) : image->height;
+    int minRowsPerTask = CL_MAX(1, CL_IMAGE_MIN_PIXELS_PER_TASK / CL_MAX(1, image->width));
+    for (clPixelFormat pixelFormat = CL_PIXELFORMAT_FIRST; pixelFormat != CL_PIXELFORMAT_COUNT; ++pixelFormat) {
+        if (!clImagePixelPtr(C, image, pixelFormat)) {
+            continue;
+        }
+        clImagePackPixels(C, image, pixelFormat, clTrue); // Never flip a caller's buffer or a crop view's source
+
+        clFlipTask info;
+        info.pixels = clImagePixelPtr(C, image, pixelFormat);
+        info.rowBytes = image->rowBytes[pixelFormat];
+        info.width = image->width;
+        info.height = image->height;
+        info.pixelBytes = CL_BYTES_PER_PIXEL(pixelFormat);
+        info.flipX = flipX;
+        info.flipY = flipY;
+        clTaskParallelFor(C, itemCount, minRowsPerTask, (clTaskRangeFunc)flipTaskFunc, &info);
     }
-    clTransformPrepare(C, transform);
-    float luminanceScale = clTransformGetLuminanceScale(C, transform);
+}
+
+clBool clImageRotateInPlace(struct clContext * C, clImage * image, int cwTurns)
+{
+    switch (cwTurns) {
+        case 0:
+            return clTrue;
+        case 2:
+            clImageFlipInPlace(C, image, clTrue, clTrue);
+            return clTrue;
+    }
+    return clFalse;
+}
+
+void clImageMirrorInPlace(struct clContext * C, clImage * image, int horizontal)
+{
+    clImageFlipInPlace(C, image, horizontal ? clTrue : clFalse, horizontal ? clFalse : clTrue);
+}
 
-    clImagePrepareReadPixels(C, srcImage, CL_PIXELFORMAT_F32);
-    clImagePrepareWritePixels(C, dstImage, CL_PIXELFORMAT_F32);
+clTransform * clImageConvertTransformAcquire(struct clContext * C,
+                                             clImage * srcImage,
+                                             clPixelFormat srcPixelFormat,
+                                             clImage * dstImage,
+                                             clPixelFormat dstPixelFormat,
+                                             clTonemap tonemap,
+                                             clTonemapParams * tonemapParams)
+{
+    clTransform * transform = clTransformAcquire(C,
+                                                 srcImage->profile,
+                                                 clImagePixelFormatToTransformFormat(C, srcPixelFormat),
+                                                 dstImage->profile,
+                                                 clImagePixelFormatToTransformFormat(C, dstPixelFormat),
+                                                 tonemap,
+                                                 tonemapParams,
+                                                 srcImage->depth,
+                                                 dstImage->depth);
+    float luminanceScale = clTransformGetLuminanceScale(C, transform);
 
     const char * tonemapDescription = transform->tonemapEnabled ? "tonemap" : "clip";
-    if ((tonemap == CL_TONEMAP_OFF) && (depth == 32)) {
+    if ((tonemap == CL_TONEMAP_OFF) && (dstImage->depth == 32)) {
         tonemapDescription = "overrange";
     }
 
-    // Perform conversion
     clContextLog(C, "convert", 0, "Converting (%s, lum scale %gx, %s)...", clTransformCMMName(C, transform), luminanceScale, tonemapDescription);
     if (transform->tonemapEnabled) {
         clContextLog(C,
@@ -599,15 +1199,113 @@ clImage * clImageConvert(struct clContext * C, clImage * srcImage, int depth, st
                      transform->tonemapParams.speed,
                      transform->tonemapParams.power);
     }
+    return transform;
+}
+
+clImage * clImageConvert(struct clContext * C,
+                         clImage * srcImage,
+                         int depth,
+                         struct clProfile * dstProfile,
+                         clTonemap tonemap,
+                         clTonemapParams * tonemapParams,
+                         clBool dither)
+{
+    Timer t;
+
+    // Create destination image
+    clImage * dstImage = clImageCreate(C, srcImage->width, srcImage->height, depth, dstProfile);
+
+    // Show image details
+    clContextLog(C, "details", 0, "Source:");
+    clImageDebugDump(C, srcImage, 0, 0, 0, 0, 1);
+    clContextLog(C, "details", 0, "Destination:");
+    clImageDebugDump(C, dstImage, 0, 0, 0, 0, 1);
+
+    if (tonemap == CL_TONEMAP_AUTO) {
+        float srcPeakLuminance = (depth == 32) ? 0.0f : clImagePeakLuminance(C, srcImage);
+        tonemap = clImageAutoTonemap(C, srcPeakLuminance, depth, dstProfile, clTrue);
+    }
+
+    // Read and write whatever pixels the images naturally hold, so that integer images don't need F32 copies
+    clPixelFormat srcPixelFormat = clImageNativePixelFormat(C, srcImage);
+    clPixelFormat dstPixelFormat = clImageNativePixelFormat(C, dstImage);
+    clImagePrepareReadRows(C, srcImage, srcPixelFormat);
+    clImagePrepareWritePixels(C, dstImage, dstPixelFormat);
+
+    // Create the transform
+    clTransform * transform =
+        clImageConvertTransformAcquire(C, srcImage, srcPixelFormat, dstImage, dstPixelFormat, tonemap, tonemapParams);
+
+    // Perform conversion
     timerStart(&t);
-    clTransformRun(C, transform, srcImage->pixelsF32, dstImage->pixelsF32, srcImage->width * srcImage->height);
+    if (!clImageIsPacked(C, srcImage, srcPixelFormat)) {
+        // Borrowed source rows with padding between them
+        for (int y = 0; y < srcImage->height; ++y) {
+            uint8_t * srcRow = clImagePixelRow(C, srcImage, srcPixelFormat, y);
+            uint8_t * dstRow = clImagePixelRow(C, dstImage, dstPixelFormat, y);
+            if (dither) {
+                clTransformRunDithered(C, transform, srcRow, dstRow, srcImage->width, y, 1);
+            } else {
+                clTransformRun(C, transform, srcRow, dstRow, srcImage->width);
+            }
+        }
+    } else if (dither) {
+        clTransformRunDithered(C,
+                               transform,
+                               clImagePixelPtr(C, srcImage, srcPixelFormat),
+                               clImagePixelPtr(C, dstImage, dstPixelFormat),
+                               srcImage->width,
+                               0,
+                               srcImage->height);
+    } else {
+        clTransformRun(C,
+                       transform,
+                       clImagePixelPtr(C, srcImage, srcPixelFormat),
+                       clImagePixelPtr(C, dstImage, dstPixelFormat),
+                       srcImage->width * srcImage->height);
+    }
     clContextLog(C, "timing", -1, TIMING_FORMAT, timerElapsedSeconds(&t));
 
     // Cleanup
-    clTransformDestroy(C, transform);
+    clTransformRelease(C, transform);
     return dstImage;
 }
 
+clTonemap clImageAutoTonemap(struct clContext * C,
+                             float srcPeakLuminance,
+                             int dstDepth,
+                             struct clProfile * dstProfile,
+                             clBool verbose)
+{
+    if (dstDepth == 32) {
+        // Allow overranging, never tonemap
+        if (verbose) {
+            clContextLog(C, "tonemap", 0, "Tonemap: converting to FP32 (overranging), auto-tonemap disabled");
+        }
+        return CL_TONEMAP_OFF;
+    }
+
+    int srcPeak = (int)srcPeakLuminance;
+    int dstLuminance = CL_LUMINANCE_UNSPECIFIED;
+    clProfileQuery(C, dstProfile, NULL, NULL, &dstLuminance);
+    if (dstLuminance == CL_LUMINANCE_UNSPECIFIED) {
+        dstLuminance = C->defaultLuminance;
+    }
+
+    clTonemap tonemap = (srcPeak > dstLuminance) ? CL_TONEMAP_ON : CL_TONEMAP_OFF;
+    if (verbose) {
+        clContextLog(C,
+                     "tonemap",
+                     0,
+                     "Tonemap: %d nits (measured potential peak) -> %d nits normalized (%dbpc), auto-tonemap %s",
+                     srcPeak,
+                     dstLuminance,
+                     dstDepth,
+                     (tonemap == CL_TONEMAP_ON) ? "enabled" : "disabled");
+    }
+    return tonemap;
+}
+
 void clImageColorGrade(struct clContext * C, clImage * image, int dstColorDepth, int * outLuminance, float * outGamma, clBool verbose)
 {
     int srcLuminance = 0;
@@ -616,46 +1314,77 @@ void clImageColorGrade(struct clContext * C, clImage * image, int dstColorDepth,
 
     int pixelCount = image->width * image->height;
     clImagePrepareReadPixels(C, image, CL_PIXELFORMAT_F32);
-    clPixelMathColorGrade(C, image->profile, image->pixelsF32, pixelCount, image->width, srcLuminance, dstColorDepth, outLuminance, outGamma, verbose);
+    const clPixelReduction * reduction = (*outLuminance == 0) ? clImageReduce(C, image) : NULL;
+    clPixelMathColorGradeWithReduction(C,
+                                       image->profile,
+                                       image->pixelsF32,
+                                       pixelCount,
+                                       image->width,
+                                       reduction,
+                                       srcLuminance,
+                                       dstColorDepth,
+                                       outLuminance,
+                                       outGamma,
+                                       verbose);
 }
 
-float clImageLargestChannel(struct clContext * C, clImage * image)
+const clPixelReduction * clImageReduce(struct clContext * C, clImage * image)
 {
-    clImagePrepareReadPixels(C, image, CL_PIXELFORMAT_F32);
-
-    float largestChannel = 0.0f;
-    int pixelCount = image->width * image->height;
-    for (int i = 0; i < pixelCount; ++i) {
-        float * pixel = &image->pixelsF32[i * CL_CHANNELS_PER_PIXEL];
-        if (largestChannel < pixel[0]) {
-            largestChannel = pixel[0];
-        }
-        if (largestChannel < pixel[1]) {
-            largestChannel = pixel[1];
-        }
-        if (largestChannel < pixel[2]) {
-            largestChannel = pixel[2];
-        }
+    // Luma is derived from the (cached) sums every time, as the profile can change without the pixels changing
+    clProfilePrimaries primaries;
+    clProfileQuery(C, image->profile, &primaries, NULL, NULL);
+    gbMat3 toXYZ;
+    clTransformDeriveXYZMatrix(C, &primaries, &toXYZ);
+    float lumaWeights[3] = { toXYZ.e[3], toXYZ.e[4], toXYZ.e[5] }; // the Y row
+
+    clPixelFormat pixelFormat = clImageNativePixelFormat(C, image);
+    if (image->reduction && image->borrowed[pixelFormat]) {
+        clFree(image->reduction);
+        image->reduction = NULL;
+    }
+    if (!image->reduction) {
+        clImagePrepareReadRows(C, image, pixelFormat);
+        image->reduction = clAllocateStruct(clPixelReduction);
+        clPixelMathReduce(C,
+                          pixelFormat,
+                          clImagePixelRow(C, image, pixelFormat, 0),
+                          image->rowBytes[pixelFormat],
+                          image->width,
+                          image->height,
+                          clImageFormatMaxChannel(image, pixelFormat),
+                          lumaWeights,
+                          image->reduction);
     }
-    return largestChannel;
+    clPixelReduction * reduction = image->reduction;
+    reduction->lumaSum = (lumaWeights[0] * reduction->channelSum[0]) + (lumaWeights[1] * reduction->channelSum[1]) +
+                         (lumaWeights[2] * reduction->channelSum[2]);
+    return reduction;
 }
 
-float clImagePeakLuminance(struct clContext * C, clImage * image)
+float clImageLargestChannel(struct clContext * C, clImage * image)
 {
-    float largestChannel = clImageLargestChannel(C, image);
-
-    float peakPixel[4];
-    peakPixel[0] = largestChannel;
-    peakPixel[1] = largestChannel;
-    peakPixel[2] = largestChannel;
-    peakPixel[3] = 1.0f;
+    return clImageReduce(C, image)->maxChannel;
+}
 
-    float peakXYZ[3];
-    clTransform * toXYZ = clTransformCreate(C, image->profile, CL_XF_RGBA, NULL, CL_XF_XYZ, CL_TONEMAP_OFF);
-    clTransformRun(C, toXYZ, peakPixel, peakXYZ, 1);
-    clTransformDestroy(C, toXYZ);
+float clImageChannelLuminance(struct clContext * C, struct clProfile * profile, float channelValue)
+{
+    float pixel[4];
+    pixel[0] = channelValue;
+    pixel[1] = channelValue;
+    pixel[2] = channelValue;
+    pixel[3] = 1.0f;
+
+    float pixelXYZ[3];
+    clTransform * toXYZ = clTransformAcquire(C, profile, CL_XF_RGBA, NULL, CL_XF_XYZ, CL_TONEMAP_OFF, NULL, 0, 0);
+    clTransformRun(C, toXYZ, pixel, pixelXYZ, 1);
+    clTransformRelease(C, toXYZ);
+
+    return pixelXYZ[1];
+}
 
-    return peakXYZ[1];
+float clImagePeakLuminance(struct clContext * C, clImage * image)
+{
+    return clImageChannelLuminance(C, image->profile, clImageLargestChannel(C, image));
 }
 
 void clImageClear(struct clContext * C, clImage * image, float color[4])
@@ -672,14 +1401,12 @@ void clImageClear(struct clContext * C, clImage * image, float color[4])
 void clImageDestroy(clContext * C, clImage * image)
 {
     clProfileDestroy(C, image->profile);
-    if (image->pixelsU8) {
-        clFree(image->pixelsU8);
-    }
-    if (image->pixelsU16) {
-        clFree(image->pixelsU16);
+    for (clPixelFormat pixelFormat = CL_PIXELFORMAT_FIRST; pixelFormat != CL_PIXELFORMAT_COUNT; ++pixelFormat) {
+        clImageFreePixels(C, image, pixelFormat);
     }
-    if (image->pixelsF32) {
-        clFree(image->pixelsF32);
+    if (image->viewParent) {
+        clImageDestroy(C, image->viewParent);
     }
+    clFree(image->reduction);
     clFree(image);
 }
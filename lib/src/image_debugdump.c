@@ -27,7 +27,7 @@ static void dumpPixel(struct clContext * C,
 
 void clImageDebugDump(struct clContext * C, clImage * image, int x, int y, int w, int h, int extraIndent)
 {
-    clTransform * toXYZ = clTransformCreate(C, image->profile, CL_XF_RGBA, NULL, CL_XF_XYZ, CL_TONEMAP_OFF);
+    clTransform * toXYZ = clTransformAcquire(C, image->profile, CL_XF_RGBA, NULL, CL_XF_XYZ, CL_TONEMAP_OFF, NULL, 0, 0);
 
     clContextLog(C, "image", 0 + extraIndent, "Image: %dx%d %d-bit", image->width, image->height, image->depth);
     clProfileDebugDump(C, image->profile, C->verbose, 1 + extraIndent);
@@ -50,14 +50,14 @@ void clImageDebugDump(struct clContext * C, clImage * image, int x, int y, int w
         }
     }
 
-    clTransformDestroy(C, toXYZ);
+    clTransformRelease(C, toXYZ);
 }
 
 void clImageDebugDumpJSON(struct clContext * C, struct cJSON * jsonOutput, clImage * image, int x, int y, int w, int h)
 {
     cJSON * jsonProfile = cJSON_AddObjectToObject(jsonOutput, "profile");
 
-    clTransform * toXYZ = clTransformCreate(C, image->profile, CL_XF_RGBA, NULL, CL_XF_XYZ, CL_TONEMAP_OFF);
+    clTransform * toXYZ = clTransformAcquire(C, image->profile, CL_XF_RGBA, NULL, CL_XF_XYZ, CL_TONEMAP_OFF, NULL, 0, 0);
 
     cJSON_AddNumberToObject(jsonOutput, "width", image->width);
     cJSON_AddNumberToObject(jsonOutput, "height", image->height);
@@ -87,7 +87,7 @@ void clImageDebugDumpJSON(struct clContext * C, struct cJSON * jsonOutput, clIma
         }
     }
 
-    clTransformDestroy(C, toXYZ);
+    clTransformRelease(C, toXYZ);
 }
 
 void clImageDebugDumpPixel(struct clContext * C, clImage * image, int x, int y, clImagePixelInfo * pixelInfo)
@@ -97,7 +97,7 @@ void clImageDebugDumpPixel(struct clContext * C, clImage * image, int x, int y,
         return;
     }
 
-    clTransform * toXYZ = clTransformCreate(C, image->profile, CL_XF_RGBA, NULL, CL_XF_XYZ, CL_TONEMAP_OFF);
+    clTransform * toXYZ = clTransformAcquire(C, image->profile, CL_XF_RGBA, NULL, CL_XF_XYZ, CL_TONEMAP_OFF, NULL, 0, 0);
 
     int maxLuminance;
     clProfileQuery(C, image->profile, NULL, NULL, &maxLuminance);
@@ -108,7 +108,7 @@ void clImageDebugDumpPixel(struct clContext * C, clImage * image, int x, int y,
 
     dumpPixel(C, image, toXYZ, maxLuminanceFloat, x, y, 0, NULL, pixelInfo);
 
-    clTransformDestroy(C, toXYZ);
+    clTransformRelease(C, toXYZ);
 }
 
 static void dumpPixel(struct clContext * C,
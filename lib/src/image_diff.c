@@ -10,11 +10,56 @@
 #include "colorist/context.h"
 #include "colorist/pixelmath.h"
 #include "colorist/profile.h"
+#include "colorist/task.h"
 #include "colorist/transform.h"
 
 #include <stdlib.h>
 #include <string.h>
 
+typedef struct clImageDiffTask
+{
+    clImageDiff * diff;
+    clImage * image1;
+    clImage * image2;
+} clImageDiffTask;
+
+static void diffTaskFunc(clImageDiffTask * info, int firstPixel, int pixelCount)
+{
+    clImageDiff * diff = info->diff;
+    float kr = 0.2126f;
+    float kb = 0.0722f;
+    float kg = 1.0f - kr - kb;
+    int endPixel = firstPixel + pixelCount;
+    for (int i = firstPixel; i < endPixel; ++i) {
+        uint16_t * p1 = &info->image1->pixelsU16[i * CL_CHANNELS_PER_PIXEL];
+        uint16_t * p2 = &info->image2->pixelsU16[i * CL_CHANNELS_PER_PIXEL];
+        uint16_t * diffPixel = &diff->image->pixelsU16[i * CL_CHANNELS_PER_PIXEL];
+
+        float * intensityPixel = &info->image1->pixelsF32[i * CL_CHANNELS_PER_PIXEL];
+        float intensity = (intensityPixel[0] * kr) + (intensityPixel[1] * kg) + (intensityPixel[2] * kb);
+        intensity = CL_CLAMP(intensity + diff->minIntensity, 0.0f, 1.0f);
+        diff->intensities[i] = (uint16_t)clPixelMathRoundf(255.0f * powf(intensity, 1.0f / 2.2f));
+
+        int channelDiff;
+        int largestDiff = abs((int)p1[0] - (int)p2[0]);
+        channelDiff = abs((int)p1[1] - (int)p2[1]);
+        if (largestDiff < channelDiff) {
+            largestDiff = channelDiff;
+        }
+        channelDiff = abs((int)p1[2] - (int)p2[2]);
+        if (largestDiff < channelDiff) {
+            largestDiff = channelDiff;
+        }
+        channelDiff = abs((int)p1[3] - (int)p2[3]);
+        if (largestDiff < channelDiff) {
+            largestDiff = channelDiff;
+        }
+
+        diff->diffs[i] = (uint16_t)largestDiff;
+        diffPixel[3] = 255;
+    }
+}
+
 clImageDiff * clImageDiffCreate(struct clContext * C, clImage * image1, clImage * image2, float minIntensity, int threshold)
 {
     if (!clProfileComponentsMatch(C, image1->profile, image2->profile) || (image1->width != image2->width) ||
@@ -54,41 +99,16 @@ clImageDiff * clImageDiffCreate(struct clContext * C, clImage * image1, clImage
     clImagePrepareReadPixels(C, image1, CL_PIXELFORMAT_F32); // for intensity calculation
     clImagePrepareReadPixels(C, image2, CL_PIXELFORMAT_U16);
 
-    float kr = 0.2126f;
-    float kb = 0.0722f;
-    float kg = 1.0f - kr - kb;
-    for (int i = 0; i < diff->pixelCount; ++i) {
-        uint16_t * p1 = &image1->pixelsU16[i * CL_CHANNELS_PER_PIXEL];
-        uint16_t * p2 = &image2->pixelsU16[i * CL_CHANNELS_PER_PIXEL];
-        uint16_t * diffPixel = &diff->image->pixelsU16[i * CL_CHANNELS_PER_PIXEL];
-
-        float * intensityPixel = &image1->pixelsF32[i * CL_CHANNELS_PER_PIXEL];
-        float intensity = (intensityPixel[0] * kr) + (intensityPixel[1] * kg) + (intensityPixel[2] * kb);
-        intensity = CL_CLAMP(intensity + diff->minIntensity, 0.0f, 1.0f);
-        diff->intensities[i] = (uint16_t)clPixelMathRoundf(255.0f * powf(intensity, 1.0f / 2.2f));
-
-        int channelDiff;
-        int largestDiff = abs((int)p1[0] - (int)p2[0]);
-        channelDiff = abs((int)p1[1] - (int)p2[1]);
-        if (largestDiff < channelDiff) {
-            largestDiff = channelDiff;
-        }
-        channelDiff = abs((int)p1[2] - (int)p2[2]);
-        if (largestDiff < channelDiff) {
-            largestDiff = channelDiff;
-        }
-        channelDiff = abs((int)p1[3] - (int)p2[3]);
-        if (largestDiff < channelDiff) {
-            largestDiff = channelDiff;
-        }
-
-        diff->diffs[i] = (uint16_t)largestDiff;
+    clImageDiffTask info;
+    info.diff = diff;
+    info.image1 = image1;
+    info.image2 = image2;
+    clTaskParallelFor(C, diff->pixelCount, CL_IMAGE_MIN_PIXELS_PER_TASK, (clTaskRangeFunc)diffTaskFunc, &info);
 
-        if (diff->largestChannelDiff < largestDiff) {
-            diff->largestChannelDiff = largestDiff;
+    for (int i = 0; i < diff->pixelCount; ++i) {
+        if (diff->largestChannelDiff < diff->diffs[i]) {
+            diff->largestChannelDiff = diff->diffs[i];
         }
-
-        diffPixel[3] = 255;
     }
 
     clImageDiffUpdate(C, diff, threshold);
@@ -264,7 +264,7 @@ void clImageDrawCIE(struct clContext * C, clImage * image, float borderColor[4],
         luminance = C->defaultLuminance;
     }
 
-    clTransform * fromXYZ = clTransformCreate(C, NULL, CL_XF_XYZ, image->profile, CL_XF_RGBA, CL_TONEMAP_OFF);
+    clTransform * fromXYZ = clTransformAcquire(C, NULL, CL_XF_XYZ, image->profile, CL_XF_RGBA, CL_TONEMAP_OFF, NULL, 0, 0);
 
     // Find the biggest square in the upper left to fill
     int dim = CL_MIN(image->width, image->height);
@@ -372,7 +372,7 @@ void clImageDrawCIE(struct clContext * C, clImage * image, float borderColor[4],
     }
 
     clFree(scanlines);
-    clTransformDestroy(C, fromXYZ);
+    clTransformRelease(C, fromXYZ);
 }
 
 // Assumes clImagePrepareWritePixels(C, image, CL_PIXELFORMAT_F32) was called
@@ -10,35 +10,25 @@
 #include "colorist/context.h"
 #include "colorist/pixelmath.h"
 #include "colorist/profile.h"
+#include "colorist/task.h"
 #include "colorist/transform.h"
 
-#include <stdlib.h>
+#include <float.h>
 #include <string.h>
 
-static int compareFloats(const void * p, const void * q)
+// Even at 10,000 nits, this is only 1 nit difference. If its less than this, we're not over.
+static const float REASONABLY_OVERBRIGHT = 0.0001f;
+
+static clBool isOverbright(float Y, float maxY)
 {
-    const float x = *(const float *)p;
-    const float y = *(const float *)q;
-    if (x < y) {
-        return -1;
-    } else if (x > y) {
-        return 1;
-    }
-    return 0;
+    return (Y / maxY) > (1.0f + REASONABLY_OVERBRIGHT);
 }
 
+// How far (0-1) an overbright pixel is towards the brightest the image gets
 static float calcOverbright(float Y, float overbrightScale, float maxY)
 {
-    // Even at 10,000 nits, this is only 1 nit difference. If its less than this, we're not over.
-    static const float REASONABLY_OVERBRIGHT = 0.0001f;
-
-    float p = Y / maxY;
-    if (p > (1.0f + REASONABLY_OVERBRIGHT)) {
-        p = (p - 1.0f) / (overbrightScale - 1.0f);
-        p = CL_CLAMP(p, 0.0f, 1.0f);
-        return p;
-    }
-    return 0.0f;
+    float p = ((Y / maxY) - 1.0f) / (overbrightScale - 1.0f);
+    return CL_CLAMP(p, 0.0f, 1.0f);
 }
 
 static void calcGamutDistances(float x, float y, const clProfilePrimaries * primaries, float outDistances[3])
@@ -178,24 +168,329 @@ void clImageHDRPixelInfoDestroy(struct clContext * C, clImageHDRPixelInfo * pixe
     clFree(pixelInfo);
 }
 
-void clImageMeasureHDR(clContext * C,
-                       clImage * srcImage,
-                       int srgbLuminance,
-                       float satLuminance,
-                       clImage ** outImage,
-                       clImageHDRStats * outStats,
-                       clImageHDRPixelInfo * outPixelInfo,
-                       clImageHDRQuantization * outQuantization)
+// Which highlight (if any) a pixel gets
+typedef enum clHDRPixelCategory
+{
+    CL_HDR_PIXEL_SDR = 0,
+    CL_HDR_PIXEL_OVERBRIGHT,
+    CL_HDR_PIXEL_OUT_OF_GAMUT,
+    CL_HDR_PIXEL_BOTH
+} clHDRPixelCategory;
+
+// Percentiles are read from histograms this fine instead of sorting every pixel. Nits are bucketed on the PQ curve and
+// saturation linearly across [0-2], so a reported percentile is within half a bucket (1/32768th of either range) of the
+// exact one; the 0th and 100th are exact.
+#define CL_HDR_PERCENTILE_BUCKET_COUNT 16384
+
+// Pixels converted to XYZ at a time, per thread
+#define CL_HDR_MEASURE_BLOCK_PIXELS 256
+
+// One thread's share of an accumulator's totals, merged when the accumulator finishes
+typedef struct clHDRMeasurePart
+{
+    clImageHDRStats stats;                 // pixel counts, brightest pixel, and maxCLL
+    double frameLightSum;                  // this part's share of the current frame's light (for maxFALL)
+    clImageHDRQuantization * quantization; // percentiles unused; NULL unless quantizing
+    int64_t * nitsHistogram;               // CL_HDR_PERCENTILE_BUCKET_COUNT buckets each
+    int64_t * saturationHistogram;
+    int64_t saturationCount; // pixels bright enough to count towards saturation
+    float minNits;
+    float maxNits;
+    float minSaturation;
+    float maxSaturation;
+} clHDRMeasurePart;
+
+typedef struct clImageHDRAccumulator
+{
+    int srgbLuminance;
+    float satLuminance;
+    int partCount;
+    clHDRMeasurePart * parts;
+    int frameCount;          // frames ended so far, which is also the index of the frame being added to
+    int64_t framePixelCount; // pixels added to the current frame so far
+    float maxFALL;
+} clImageHDRAccumulator;
+
+typedef struct clHDRMeasureTask
+{
+    clContext * C;
+    clImageHDRAccumulator * accumulator;
+    clTransform * toXYZ;
+    float * pixels; // F32, starting at the image's pixel firstPixel
+    int firstPixel;
+    int pixelCount;
+    int width;
+    int partCount; // accumulator parts this call spreads its pixels across
+    clProfilePrimaries * srcPrimaries;
+    gbMat3 linearFromXYZ;
+    float srcLuminance; // srcLuminance * implicitScale
+    float overbrightScale;
+    clImage * highlight;
+    clImageHDRPixelInfo * pixelInfo;
+} clHDRMeasureTask;
+
+// Whether b's brightest pixel replaces a's: it is brighter, or as bright and earlier in the sequence
+static clBool brightestPixelWins(const clImageHDRStats * a, const clImageHDRStats * b)
+{
+    if (a->brightestPixelNits != b->brightestPixelNits) {
+        return a->brightestPixelNits < b->brightestPixelNits;
+    }
+    if (a->brightestPixelFrame != b->brightestPixelFrame) {
+        return b->brightestPixelFrame < a->brightestPixelFrame;
+    }
+    if (a->brightestPixelY != b->brightestPixelY) {
+        return b->brightestPixelY < a->brightestPixelY;
+    }
+    return b->brightestPixelX < a->brightestPixelX;
+}
+
+static void measureHDRPixels(clHDRMeasureTask * info, clHDRMeasurePart * part, int firstPixel, int pixelCount)
 {
     const float minHighlight = 0.4f;
+    const float * m = info->linearFromXYZ.e;
+    const float satLuminance = info->accumulator->satLuminance;
+    const int srgbLuminance = info->accumulator->srgbLuminance;
+    const int frame = info->accumulator->frameCount;
+
+    clImageHDRStats * stats = &part->stats;
+    clImageHDRQuantization * quantization = part->quantization;
+    stats->pixelCount += pixelCount;
+
+    float xyzPixels[3 * CL_HDR_MEASURE_BLOCK_PIXELS];
+    for (int blockStart = 0; blockStart < pixelCount; blockStart += CL_HDR_MEASURE_BLOCK_PIXELS) {
+        int blockCount = CL_MIN(CL_HDR_MEASURE_BLOCK_PIXELS, pixelCount - blockStart);
+        clTransformRun(info->C,
+                       info->toXYZ,
+                       &info->pixels[(size_t)(firstPixel + blockStart) * CL_CHANNELS_PER_PIXEL],
+                       xyzPixels,
+                       blockCount);
+
+        for (int blockIndex = 0; blockIndex < blockCount; ++blockIndex) {
+            int i = info->firstPixel + firstPixel + blockStart + blockIndex; // index into the whole image
+            float * srcXYZ = &xyzPixels[blockIndex * 3];
+
+            cmsCIEXYZ XYZ;
+            XYZ.X = srcXYZ[0];
+            XYZ.Y = srcXYZ[1];
+            XYZ.Z = srcXYZ[2];
+
+            cmsCIExyY xyY;
+            if (XYZ.Y > 0) {
+                cmsXYZ2xyY(&xyY, &XYZ);
+            } else {
+                xyY.x = info->srcPrimaries->white[0];
+                xyY.y = info->srcPrimaries->white[1];
+                xyY.Y = 0.0f;
+            }
+
+            float pixelNits = (float)xyY.Y;
+            float maxY = clTransformCalcMaxY(info->C, &info->linearFromXYZ, (float)xyY.x, (float)xyY.y) * (float)srgbLuminance;
+            float saturation = calcSaturation((float)xyY.x, (float)xyY.y, info->srcPrimaries);
+            float outOfSRGB = CL_CLAMP(saturation - 1.0f, 0.0f, 1.0f);
+
+            if (stats->brightestPixelNits < pixelNits) {
+                stats->brightestPixelNits = pixelNits;
+                stats->brightestPixelFrame = frame;
+                stats->brightestPixelX = i % info->width;
+                stats->brightestPixelY = i / info->width;
+            }
+
+            // The pixel's light level is its largest linear channel, in nits (same math as gb_mat3_mul_vec3())
+            float lightLevel = (m[0] * srcXYZ[0]) + (m[1] * srcXYZ[1]) + (m[2] * srcXYZ[2]);
+            lightLevel = CL_MAX(lightLevel, (m[3] * srcXYZ[0]) + (m[4] * srcXYZ[1]) + (m[5] * srcXYZ[2]));
+            lightLevel = CL_MAX(lightLevel, (m[6] * srcXYZ[0]) + (m[7] * srcXYZ[1]) + (m[8] * srcXYZ[2]));
+            lightLevel = CL_MAX(lightLevel, 0.0f);
+            stats->maxCLL = CL_MAX(stats->maxCLL, lightLevel);
+            part->frameLightSum += lightLevel;
+
+            clBool overbright = isOverbright(pixelNits, maxY);
+            clHDRPixelCategory category;
+            if (overbright && (outOfSRGB > 0.0f)) {
+                category = CL_HDR_PIXEL_BOTH;
+                ++stats->bothPixelCount;
+            } else if (overbright) {
+                category = CL_HDR_PIXEL_OVERBRIGHT;
+                ++stats->overbrightPixelCount;
+            } else if (outOfSRGB > 0.0f) {
+                category = CL_HDR_PIXEL_OUT_OF_GAMUT;
+                ++stats->outOfGamutPixelCount;
+            } else {
+                category = CL_HDR_PIXEL_SDR;
+            }
+
+            if (info->pixelInfo) {
+                clImageHDRPixel * pixelHighlightInfo = &info->pixelInfo->pixels[i];
+                pixelHighlightInfo->x = (float)xyY.x;
+                pixelHighlightInfo->y = (float)xyY.y;
+                pixelHighlightInfo->Y = pixelNits / info->srcLuminance;
+                pixelHighlightInfo->nits = pixelNits;
+                pixelHighlightInfo->maxNits = maxY;
+                pixelHighlightInfo->saturation = saturation;
+            }
 
-    clTransform * toXYZ = clTransformCreate(C, srcImage->profile, CL_XF_RGBA, NULL, CL_XF_XYZ, CL_TONEMAP_OFF);
-    clTransform * fromXYZ = clTransformCreate(C, NULL, CL_XF_XYZ, srcImage->profile, CL_XF_RGB, CL_TONEMAP_OFF);
+            if (quantization) {
+                float clampedNits = CL_CLAMP(pixelNits, 0.0f, 10000.0f);
+                float pq = clTransformOETF_PQ(clampedNits / 10000.0f);
+                int pqBucket = (int)clPixelMathRoundf(pq * (float)(CL_QUANTIZATION_BUCKET_COUNT - 1));
+                ++quantization->pixelCountsNitsPQ[CL_CLAMP(pqBucket, 0, CL_QUANTIZATION_BUCKET_COUNT - 1)];
+                int nitsBucket = (int)(pq * (float)CL_HDR_PERCENTILE_BUCKET_COUNT);
+                ++part->nitsHistogram[CL_CLAMP(nitsBucket, 0, CL_HDR_PERCENTILE_BUCKET_COUNT - 1)];
+                part->minNits = CL_MIN(part->minNits, pixelNits);
+                part->maxNits = CL_MAX(part->maxNits, pixelNits);
+
+                if (clampedNits >= satLuminance) {
+                    int saturationBucket = (int)clPixelMathRoundf(saturation * 0.5f * (float)(CL_QUANTIZATION_BUCKET_COUNT - 1));
+                    ++quantization->pixelCountsSaturation[CL_CLAMP(saturationBucket, 0, CL_QUANTIZATION_BUCKET_COUNT - 1)];
+                    int fineSaturationBucket = (int)(saturation * 0.5f * (float)CL_HDR_PERCENTILE_BUCKET_COUNT);
+                    ++part->saturationHistogram[CL_CLAMP(fineSaturationBucket, 0, CL_HDR_PERCENTILE_BUCKET_COUNT - 1)];
+                    ++part->saturationCount;
+                    part->minSaturation = CL_MIN(part->minSaturation, saturation);
+                    part->maxSaturation = CL_MAX(part->maxSaturation, saturation);
+                }
+            }
+
+            if (info->highlight) {
+                uint16_t * dstPixel = &info->highlight->pixelsU16[i * CL_CHANNELS_PER_PIXEL];
+                float baseIntensity = pixelNits / (float)srgbLuminance;
+                baseIntensity = CL_CLAMP(baseIntensity, 0.0f, 1.0f);
+                uint8_t intensity8 = intensityToU8(baseIntensity);
+
+                switch (category) {
+                    case CL_HDR_PIXEL_BOTH: {
+                        float overbrightAmount = calcOverbright(pixelNits, info->overbrightScale, maxY);
+                        float biggerHighlight = (overbrightAmount > outOfSRGB) ? overbrightAmount : outOfSRGB;
+                        float highlightIntensity = minHighlight + (biggerHighlight * (1.0f - minHighlight));
+                        // Yellow
+                        dstPixel[0] = intensity8;
+                        dstPixel[1] = intensity8;
+                        dstPixel[2] = intensityToU8(baseIntensity * (1.0f - highlightIntensity));
+                        break;
+                    }
+                    case CL_HDR_PIXEL_OVERBRIGHT: {
+                        float overbrightAmount = calcOverbright(pixelNits, info->overbrightScale, maxY);
+                        float highlightIntensity = minHighlight + (overbrightAmount * (1.0f - minHighlight));
+                        // Magenta
+                        dstPixel[0] = intensity8;
+                        dstPixel[1] = intensityToU8(baseIntensity * (1.0f - highlightIntensity));
+                        dstPixel[2] = intensity8;
+                        break;
+                    }
+                    case CL_HDR_PIXEL_OUT_OF_GAMUT: {
+                        float highlightIntensity = minHighlight + (outOfSRGB * (1.0f - minHighlight));
+                        // Cyan
+                        dstPixel[0] = intensityToU8(baseIntensity * (1.0f - highlightIntensity));
+                        dstPixel[1] = intensity8;
+                        dstPixel[2] = intensity8;
+                        break;
+                    }
+                    default:
+                        // Gray
+                        dstPixel[0] = intensity8;
+                        dstPixel[1] = intensity8;
+                        dstPixel[2] = intensity8;
+                        break;
+                }
+                dstPixel[3] = 255;
+            }
+        }
+    }
+}
+
+static void measureHDRTaskFunc(clHDRMeasureTask * info, int firstPart, int partCount)
+{
+    for (int i = firstPart; i < firstPart + partCount; ++i) {
+        int firstPixel = (int)(((int64_t)info->pixelCount * i) / info->partCount);
+        int endPixel = (int)(((int64_t)info->pixelCount * (i + 1)) / info->partCount);
+        measureHDRPixels(info, &info->accumulator->parts[i], firstPixel, endPixel - firstPixel);
+    }
+}
+
+static float nitsBucketValue(int bucket)
+{
+    return 10000.0f * clTransformEOTF_PQ(((float)bucket + 0.5f) / (float)CL_HDR_PERCENTILE_BUCKET_COUNT);
+}
+
+static float saturationBucketValue(int bucket)
+{
+    return 2.0f * ((float)bucket + 0.5f) / (float)CL_HDR_PERCENTILE_BUCKET_COUNT;
+}
+
+// Fills outValues[i] with the value at sorted index (i * total / 100) of the histogrammed values, in one walk
+static void histogramPercentiles(const int64_t * histogram,
+                                 int64_t total,
+                                 float minValue,
+                                 float maxValue,
+                                 float (*bucketValue)(int bucket),
+                                 float outValues[101])
+{
+    if (total <= 0) {
+        memset(outValues, 0, sizeof(float) * 101);
+        return;
+    }
+
+    int bucket = 0;
+    int64_t countThroughBucket = histogram[0];
+    for (int i = 0; i < 100; ++i) {
+        int64_t percentileIndex = (int64_t)((double)i * (double)total / 100.0);
+        while ((countThroughBucket <= percentileIndex) && (bucket < (CL_HDR_PERCENTILE_BUCKET_COUNT - 1))) {
+            ++bucket;
+            countThroughBucket += histogram[bucket];
+        }
+        float value = bucketValue(bucket);
+        outValues[i] = CL_CLAMP(value, minValue, maxValue);
+    }
+    outValues[0] = minValue;
+    outValues[100] = maxValue;
+}
+
+static clImageHDRAccumulator * accumulatorCreate(clContext * C, int srgbLuminance, float satLuminance, clBool quantize)
+{
+    clImageHDRAccumulator * accumulator = clAllocateStruct(clImageHDRAccumulator);
+    memset(accumulator, 0, sizeof(clImageHDRAccumulator));
+    accumulator->srgbLuminance = srgbLuminance;
+    accumulator->satLuminance = satLuminance;
+
+    // One part per thread, so the histograms cost O(buckets * jobs) rather than anything per pixel
+    accumulator->partCount = CL_MAX(C->jobs, 1);
+    accumulator->parts = clAllocate(sizeof(clHDRMeasurePart) * accumulator->partCount);
+    memset(accumulator->parts, 0, sizeof(clHDRMeasurePart) * accumulator->partCount);
+    for (int i = 0; i < accumulator->partCount; ++i) {
+        clHDRMeasurePart * part = &accumulator->parts[i];
+        if (quantize) {
+            part->quantization = clAllocateStruct(clImageHDRQuantization);
+            memset(part->quantization, 0, sizeof(clImageHDRQuantization));
+            part->nitsHistogram = clAllocate(sizeof(int64_t) * CL_HDR_PERCENTILE_BUCKET_COUNT);
+            memset(part->nitsHistogram, 0, sizeof(int64_t) * CL_HDR_PERCENTILE_BUCKET_COUNT);
+            part->saturationHistogram = clAllocate(sizeof(int64_t) * CL_HDR_PERCENTILE_BUCKET_COUNT);
+            memset(part->saturationHistogram, 0, sizeof(int64_t) * CL_HDR_PERCENTILE_BUCKET_COUNT);
+            part->minNits = FLT_MAX;
+            part->maxNits = -FLT_MAX;
+            part->minSaturation = FLT_MAX;
+            part->maxSaturation = -FLT_MAX;
+        }
+    }
+    return accumulator;
+}
+
+// highlight and pixelInfo (either may be NULL) cover the whole image, and are only written for the rows measured
+static void accumulateRows(clContext * C,
+                           clImageHDRAccumulator * accumulator,
+                           clImage * image,
+                           int firstRow,
+                           int rowCount,
+                           float overbrightScale,
+                           clImage * highlight,
+                           clImageHDRPixelInfo * pixelInfo)
+{
+    rowCount = CL_MIN(rowCount, image->height - firstRow);
+    if ((firstRow < 0) || (rowCount <= 0)) {
+        return;
+    }
 
     clProfilePrimaries srcPrimaries;
     clProfileCurve srcCurve;
     int srcLuminance = 0;
-    clProfileQuery(C, srcImage->profile, &srcPrimaries, &srcCurve, &srcLuminance);
+    clProfileQuery(C, image->profile, &srcPrimaries, &srcCurve, &srcLuminance);
     if (srcLuminance == CL_LUMINANCE_UNSPECIFIED) {
         if (srcCurve.type == CL_PCT_HLG) {
             srcLuminance = clTransformCalcHLGLuminance(C->defaultLuminance);
@@ -204,160 +499,194 @@ void clImageMeasureHDR(clContext * C,
         }
     }
 
-    // clTransformCalcMaxY assumes the RGB profile is linear with a 1 nit luminance
-    clProfileCurve gamma1;
-    gamma1.type = CL_PCT_GAMMA;
-    gamma1.gamma = 1.0f;
-    clProfile * linearProfile = clProfileCreate(C, &srcPrimaries, &gamma1, 1, NULL);
-    clTransform * linearToXYZ = clTransformCreate(C, linearProfile, CL_XF_RGBA, NULL, CL_XF_XYZ, CL_TONEMAP_OFF);
-    clTransform * linearFromXYZ = clTransformCreate(C, NULL, CL_XF_XYZ, linearProfile, CL_XF_RGB, CL_TONEMAP_OFF);
-
-    memset(outStats, 0, sizeof(clImageHDRStats));
-    int pixelCount = outStats->pixelCount = srcImage->width * srcImage->height;
-
-    clImagePrepareReadPixels(C, srcImage, CL_PIXELFORMAT_F32);
-
-    float measuredPeakLuminance = clImagePeakLuminance(C, srcImage);
-    float overbrightScale = measuredPeakLuminance * srcCurve.implicitScale / (float)srgbLuminance;
+    clImagePrepareReadPixels(C, image, CL_PIXELFORMAT_F32);
+
+    clHDRMeasureTask info;
+    info.C = C;
+    info.accumulator = accumulator;
+    info.toXYZ = clTransformAcquire(C, image->profile, CL_XF_RGBA, NULL, CL_XF_XYZ, CL_TONEMAP_OFF, NULL, 0, 0);
+    clTransformPrepare(C, info.toXYZ); // before the workers all run it a block at a time
+    info.firstPixel = firstRow * image->width;
+    info.pixels = &image->pixelsF32[(size_t)info.firstPixel * CL_CHANNELS_PER_PIXEL];
+    info.pixelCount = rowCount * image->width;
+    info.width = image->width;
+    info.partCount = CL_MIN(accumulator->partCount,
+                            (info.pixelCount + CL_IMAGE_MIN_PIXELS_PER_TASK - 1) / CL_IMAGE_MIN_PIXELS_PER_TASK);
+    info.srcPrimaries = &srcPrimaries;
+    clTransformDeriveFromXYZMatrix(C, &srcPrimaries, &info.linearFromXYZ);
+    info.srcLuminance = (float)srcLuminance * srcCurve.implicitScale;
+    info.overbrightScale = overbrightScale;
+    info.highlight = highlight;
+    info.pixelInfo = pixelInfo;
+    clTaskParallelFor(C, info.partCount, 1, (clTaskRangeFunc)measureHDRTaskFunc, &info);
+    clTransformRelease(C, info.toXYZ);
+
+    accumulator->framePixelCount += info.pixelCount;
+}
 
-    float * xyzPixels = clAllocate(3 * sizeof(float) * pixelCount);
-    clTransformRun(C, toXYZ, srcImage->pixelsF32, xyzPixels, pixelCount);
+struct clImageHDRAccumulator * clImageHDRAccumulatorCreate(struct clContext * C, int srgbLuminance, float satLuminance)
+{
+    return accumulatorCreate(C, srgbLuminance, satLuminance, clTrue);
+}
 
-    clImage * highlight = NULL;
-    if (outImage) {
-        clContextLog(C, "highlight", 1, "Creating sRGB highlight (%d nits, %s)...", srgbLuminance, clTransformCMMName(C, toXYZ));
+void clImageHDRAccumulatorAddRows(struct clContext * C,
+                                  struct clImageHDRAccumulator * accumulator,
+                                  clImage * image,
+                                  int firstRow,
+                                  int rowCount)
+{
+    accumulateRows(C, accumulator, image, firstRow, rowCount, 0.0f, NULL, NULL);
+}
 
-        highlight = clImageCreate(C, srcImage->width, srcImage->height, 8, NULL);
-        *outImage = highlight;
+void clImageHDRAccumulatorEndFrame(struct clContext * C, struct clImageHDRAccumulator * accumulator)
+{
+    COLORIST_UNUSED(C);
 
-        clImagePrepareWritePixels(C, highlight, CL_PIXELFORMAT_U16);
+    if (accumulator->framePixelCount == 0) {
+        return;
     }
 
-    float * saturationForPercentiles = NULL;
-    float * nitsForPercentiles = NULL;
-    if (outQuantization) {
-        memset(outQuantization, 0, sizeof(clImageHDRQuantization));
-        saturationForPercentiles = clAllocate(sizeof(float) * pixelCount);
-        nitsForPercentiles = clAllocate(sizeof(float) * pixelCount);
+    double frameLightSum = 0.0;
+    for (int i = 0; i < accumulator->partCount; ++i) {
+        frameLightSum += accumulator->parts[i].frameLightSum;
+        accumulator->parts[i].frameLightSum = 0.0;
     }
+    float frameAverageLightLevel = (float)(frameLightSum / (double)accumulator->framePixelCount);
+    accumulator->maxFALL = CL_MAX(accumulator->maxFALL, frameAverageLightLevel);
+    accumulator->framePixelCount = 0;
+    ++accumulator->frameCount;
+}
 
-    for (int i = 0; i < pixelCount; ++i) {
-        float * srcXYZ = &xyzPixels[i * 3];
-        uint16_t * dstPixel = highlight ? &highlight->pixelsU16[i * CL_CHANNELS_PER_PIXEL] : NULL;
-
-        cmsCIEXYZ XYZ;
-        XYZ.X = srcXYZ[0];
-        XYZ.Y = srcXYZ[1];
-        XYZ.Z = srcXYZ[2];
-
-        cmsCIExyY xyY;
-        if (XYZ.Y > 0) {
-            cmsXYZ2xyY(&xyY, &XYZ);
-        } else {
-            xyY.x = srcPrimaries.white[0];
-            xyY.y = srcPrimaries.white[1];
-            xyY.Y = 0.0f;
-        }
+void clImageHDRAccumulatorAddImage(struct clContext * C, struct clImageHDRAccumulator * accumulator, clImage * image)
+{
+    clImageHDRAccumulatorAddRows(C, accumulator, image, 0, image->height);
+    clImageHDRAccumulatorEndFrame(C, accumulator);
+}
 
-        float pixelNits = (float)xyY.Y;
-        if (outStats->brightestPixelNits < pixelNits) {
-            outStats->brightestPixelNits = pixelNits;
-            outStats->brightestPixelX = i % srcImage->width;
-            outStats->brightestPixelY = i / srcImage->width;
+void clImageHDRAccumulatorFinish(struct clContext * C,
+                                 struct clImageHDRAccumulator * accumulator,
+                                 clImageHDRStats * outStats,
+                                 clImageHDRQuantization * outQuantization)
+{
+    clImageHDRStats stats;
+    memset(&stats, 0, sizeof(stats));
+    for (int i = 0; i < accumulator->partCount; ++i) {
+        clImageHDRStats * partStats = &accumulator->parts[i].stats;
+        if (brightestPixelWins(&stats, partStats)) {
+            stats.brightestPixelNits = partStats->brightestPixelNits;
+            stats.brightestPixelFrame = partStats->brightestPixelFrame;
+            stats.brightestPixelX = partStats->brightestPixelX;
+            stats.brightestPixelY = partStats->brightestPixelY;
         }
+        stats.overbrightPixelCount += partStats->overbrightPixelCount;
+        stats.outOfGamutPixelCount += partStats->outOfGamutPixelCount;
+        stats.bothPixelCount += partStats->bothPixelCount;
+        stats.pixelCount += partStats->pixelCount;
+        stats.maxCLL = CL_MAX(stats.maxCLL, partStats->maxCLL);
+    }
+    stats.hdrPixelCount = stats.bothPixelCount + stats.overbrightPixelCount + stats.outOfGamutPixelCount;
+    stats.frameCount = accumulator->frameCount;
+    stats.maxFALL = accumulator->maxFALL;
+    if (outStats) {
+        memcpy(outStats, &stats, sizeof(stats));
+    }
 
-        float maxY = clTransformCalcMaxY(C, linearFromXYZ, linearToXYZ, (float)xyY.x, (float)xyY.y) * (float)srgbLuminance;
-        float overbright = calcOverbright((float)xyY.Y, overbrightScale, maxY);
-        float saturation = calcSaturation((float)xyY.x, (float)xyY.y, &srcPrimaries);
-
-        if (outPixelInfo) {
-            clImageHDRPixel * pixelHighlightInfo = &outPixelInfo->pixels[i];
-            pixelHighlightInfo->x = (float)xyY.x;
-            pixelHighlightInfo->y = (float)xyY.y;
-            pixelHighlightInfo->Y = (float)xyY.Y / ((float)srcLuminance * srcCurve.implicitScale);
-            pixelHighlightInfo->nits = pixelNits;
-            pixelHighlightInfo->maxNits = maxY;
-            pixelHighlightInfo->saturation = saturation;
+    if (outQuantization) {
+        memset(outQuantization, 0, sizeof(clImageHDRQuantization));
+        if (!accumulator->parts[0].quantization) {
+            return;
         }
 
-        if (outQuantization) {
-            float clampedNits = CL_CLAMP(pixelNits, 0.0f, 10000.0f);
-            int pqBucket =
-                (int)clPixelMathRoundf(clTransformOETF_PQ(clampedNits / 10000.0f) * (float)(CL_QUANTIZATION_BUCKET_COUNT - 1));
-            pqBucket = CL_CLAMP(pqBucket, 0, CL_QUANTIZATION_BUCKET_COUNT - 1);
-            ++outQuantization->pixelCountsNitsPQ[pqBucket];
-            nitsForPercentiles[i] = pixelNits;
-
-            if (clampedNits >= satLuminance) {
-                int saturationBucket = (int)clPixelMathRoundf(saturation * 0.5f * (float)(CL_QUANTIZATION_BUCKET_COUNT - 1));
-                saturationBucket = CL_CLAMP(saturationBucket, 0, CL_QUANTIZATION_BUCKET_COUNT - 1);
-                ++outQuantization->pixelCountsSaturation[saturationBucket];
-                saturationForPercentiles[i] = saturation;
+        int64_t * nitsHistogram = clAllocate(sizeof(int64_t) * CL_HDR_PERCENTILE_BUCKET_COUNT);
+        memset(nitsHistogram, 0, sizeof(int64_t) * CL_HDR_PERCENTILE_BUCKET_COUNT);
+        int64_t * saturationHistogram = clAllocate(sizeof(int64_t) * CL_HDR_PERCENTILE_BUCKET_COUNT);
+        memset(saturationHistogram, 0, sizeof(int64_t) * CL_HDR_PERCENTILE_BUCKET_COUNT);
+        int64_t saturationCount = 0;
+        float minNits = FLT_MAX;
+        float maxNits = -FLT_MAX;
+        float minSaturation = FLT_MAX;
+        float maxSaturation = -FLT_MAX;
+        for (int i = 0; i < accumulator->partCount; ++i) {
+            clHDRMeasurePart * part = &accumulator->parts[i];
+            for (int j = 0; j < CL_QUANTIZATION_BUCKET_COUNT; ++j) {
+                outQuantization->pixelCountsNitsPQ[j] += part->quantization->pixelCountsNitsPQ[j];
+                outQuantization->pixelCountsSaturation[j] += part->quantization->pixelCountsSaturation[j];
+            }
+            for (int j = 0; j < CL_HDR_PERCENTILE_BUCKET_COUNT; ++j) {
+                nitsHistogram[j] += part->nitsHistogram[j];
+                saturationHistogram[j] += part->saturationHistogram[j];
             }
+            saturationCount += part->saturationCount;
+            minNits = CL_MIN(minNits, part->minNits);
+            maxNits = CL_MAX(maxNits, part->maxNits);
+            minSaturation = CL_MIN(minSaturation, part->minSaturation);
+            maxSaturation = CL_MAX(maxSaturation, part->maxSaturation);
         }
 
-        if (dstPixel) {
-            float outOfSRGB = CL_CLAMP(saturation - 1.0f, 0.0f, 1.0f);
-            float baseIntensity = pixelNits / (float)srgbLuminance;
-            baseIntensity = CL_CLAMP(baseIntensity, 0.0f, 1.0f);
-            uint8_t intensity8 = intensityToU8(baseIntensity);
-
-            if ((overbright > 0.0f) && (outOfSRGB > 0.0f)) {
-                float biggerHighlight = (overbright > outOfSRGB) ? overbright : outOfSRGB;
-                float highlightIntensity = minHighlight + (biggerHighlight * (1.0f - minHighlight));
-                // Yellow
-                dstPixel[0] = intensity8;
-                dstPixel[1] = intensity8;
-                dstPixel[2] = intensityToU8(baseIntensity * (1.0f - highlightIntensity));
-                ++outStats->bothPixelCount;
-            } else if (overbright > 0.0f) {
-                float highlightIntensity = minHighlight + (overbright * (1.0f - minHighlight));
-                // Magenta
-                dstPixel[0] = intensity8;
-                dstPixel[1] = intensityToU8(baseIntensity * (1.0f - highlightIntensity));
-                dstPixel[2] = intensity8;
-                ++outStats->overbrightPixelCount;
-            } else if (outOfSRGB > 0.0f) {
-                float highlightIntensity = minHighlight + (outOfSRGB * (1.0f - minHighlight));
-                // Cyan
-                dstPixel[0] = intensityToU8(baseIntensity * (1.0f - highlightIntensity));
-                dstPixel[1] = intensity8;
-                dstPixel[2] = intensity8;
-                ++outStats->outOfGamutPixelCount;
-            } else {
-                // Gray
-                dstPixel[0] = intensity8;
-                dstPixel[1] = intensity8;
-                dstPixel[2] = intensity8;
-            }
-            dstPixel[3] = 255;
+        float nitsPercentiles[101];
+        float saturationPercentiles[101];
+        histogramPercentiles(nitsHistogram, stats.pixelCount, minNits, maxNits, nitsBucketValue, nitsPercentiles);
+        histogramPercentiles(saturationHistogram,
+                             saturationCount,
+                             minSaturation,
+                             maxSaturation,
+                             saturationBucketValue,
+                             saturationPercentiles);
+        for (int i = 0; i <= 100; ++i) {
+            outQuantization->percentiles[i].nits = nitsPercentiles[i];
+            outQuantization->percentiles[i].saturation = saturationPercentiles[i];
         }
+        clFree(nitsHistogram);
+        clFree(saturationHistogram);
     }
-    outStats->hdrPixelCount = outStats->bothPixelCount + outStats->overbrightPixelCount + outStats->outOfGamutPixelCount;
+}
 
-    if (outQuantization) {
-        qsort(saturationForPercentiles, pixelCount, sizeof(float), compareFloats);
-        qsort(nitsForPercentiles, pixelCount, sizeof(float), compareFloats);
-
-        for (int i = 0; i < 100; ++i) {
-            clImageHDRPercentile * percentile = &outQuantization->percentiles[i];
-            int percentileIndex = (int)((float)i * (float)pixelCount / 100.0f);
-            percentile->saturation = saturationForPercentiles[percentileIndex];
-            percentile->nits = nitsForPercentiles[percentileIndex];
+void clImageHDRAccumulatorDestroy(struct clContext * C, struct clImageHDRAccumulator * accumulator)
+{
+    for (int i = 0; i < accumulator->partCount; ++i) {
+        clHDRMeasurePart * part = &accumulator->parts[i];
+        if (part->quantization) {
+            clFree(part->quantization);
+            clFree(part->nitsHistogram);
+            clFree(part->saturationHistogram);
         }
-        clImageHDRPercentile * topPercentile = &outQuantization->percentiles[100];
-        topPercentile->saturation = saturationForPercentiles[pixelCount - 1];
-        topPercentile->nits = nitsForPercentiles[pixelCount - 1];
-
-        clFree(saturationForPercentiles);
-        clFree(nitsForPercentiles);
     }
+    clFree(accumulator->parts);
+    clFree(accumulator);
+}
+
+void clImageMeasureHDR(clContext * C,
+                       clImage * srcImage,
+                       int srgbLuminance,
+                       float satLuminance,
+                       clImage ** outImage,
+                       clImageHDRStats * outStats,
+                       clImageHDRPixelInfo * outPixelInfo,
+                       clImageHDRQuantization * outQuantization)
+{
+    clProfileCurve srcCurve;
+    clProfileQuery(C, srcImage->profile, NULL, &srcCurve, NULL);
+
+    clImagePrepareReadPixels(C, srcImage, CL_PIXELFORMAT_F32);
+
+    float measuredPeakLuminance = clImagePeakLuminance(C, srcImage);
+    float overbrightScale = measuredPeakLuminance * srcCurve.implicitScale / (float)srgbLuminance;
+
+    clImage * highlight = NULL;
+    if (outImage) {
+        clTransform * toXYZ = clTransformAcquire(C, srcImage->profile, CL_XF_RGBA, NULL, CL_XF_XYZ, CL_TONEMAP_OFF, NULL, 0, 0);
+        clContextLog(C, "highlight", 1, "Creating sRGB highlight (%d nits, %s)...", srgbLuminance, clTransformCMMName(C, toXYZ));
+        clTransformRelease(C, toXYZ);
+
+        highlight = clImageCreate(C, srcImage->width, srcImage->height, 8, NULL);
+        *outImage = highlight;
 
-    clTransformDestroy(C, linearToXYZ);
-    clTransformDestroy(C, linearFromXYZ);
-    clProfileDestroy(C, linearProfile);
+        clImagePrepareWritePixels(C, highlight, CL_PIXELFORMAT_U16);
+    }
 
-    clTransformDestroy(C, fromXYZ);
-    clTransformDestroy(C, toXYZ);
-    clFree(xyzPixels);
+    clImageHDRAccumulator * accumulator = accumulatorCreate(C, srgbLuminance, satLuminance, outQuantization != NULL);
+    accumulateRows(C, accumulator, srcImage, 0, srcImage->height, overbrightScale, highlight, outPixelInfo);
+    clImageHDRAccumulatorEndFrame(C, accumulator);
+    clImageHDRAccumulatorFinish(C, accumulator, outStats, outQuantization);
+    clImageHDRAccumulatorDestroy(C, accumulator);
 }
@@ -34,16 +34,16 @@ clBool clImageCalcSignals(struct clContext * C, clImage * srcImage, clImage * ds
     float maxLuminanceF = (float)maxLuminance;
 
     clImagePrepareReadPixels(C, srcImage, CL_PIXELFORMAT_F32);
-    clTransform * srcToXYZ = clTransformCreate(C, srcImage->profile, CL_XF_RGBA, NULL, CL_XF_XYZ, CL_TONEMAP_OFF);
+    clTransform * srcToXYZ = clTransformAcquire(C, srcImage->profile, CL_XF_RGBA, NULL, CL_XF_XYZ, CL_TONEMAP_OFF, NULL, 0, 0);
     float * srcXYZ = clAllocate(3 * sizeof(float) * pixelCount);
     clTransformRun(C, srcToXYZ, srcImage->pixelsF32, srcXYZ, pixelCount);
-    clTransformDestroy(C, srcToXYZ);
+    clTransformRelease(C, srcToXYZ);
 
     clImagePrepareReadPixels(C, dstImage, CL_PIXELFORMAT_F32);
-    clTransform * dstToXYZ = clTransformCreate(C, dstImage->profile, CL_XF_RGBA, NULL, CL_XF_XYZ, CL_TONEMAP_OFF);
+    clTransform * dstToXYZ = clTransformAcquire(C, dstImage->profile, CL_XF_RGBA, NULL, CL_XF_XYZ, CL_TONEMAP_OFF, NULL, 0, 0);
     float * dstXYZ = clAllocate(3 * sizeof(float) * pixelCount);
     clTransformRun(C, dstToXYZ, dstImage->pixelsF32, dstXYZ, pixelCount);
-    clTransformDestroy(C, dstToXYZ);
+    clTransformRelease(C, dstToXYZ);
 
     float errorSquaredSumLinear = 0.0f;
     float errorSquaredSumG22 = 0.0f;
@@ -749,7 +749,7 @@ clImage * clImageParseString(struct clContext * C, const char * str, int depth,
     char * buffer = clContextStrdup(C, str);
     const char * stripeDelims = "|/";
     char * stripeString;
-    clTransform * fromXYZ = clTransformCreate(C, NULL, CL_XF_XYZ, profile, CL_XF_RGB, CL_TONEMAP_OFF);
+    clTransform * fromXYZ = clTransformAcquire(C, NULL, CL_XF_XYZ, profile, CL_XF_RGB, CL_TONEMAP_OFF, NULL, 0, 0);
     int luminance = 0;
 
     clContextLog(C, "parse", 0, "Parsing image string (%s)...", clTransformCMMName(C, fromXYZ));
@@ -826,7 +826,7 @@ parseCleanup:
         clFree(deleteme);
     }
     clFree(buffer);
-    clTransformDestroy(C, fromXYZ);
+    clTransformRelease(C, fromXYZ);
     return image;
 }
 
@@ -1028,11 +1028,12 @@ static clImage * interpretTokens(struct clContext * C, clToken * tokens, int dep
     }
 
     if (rotate != 0) {
-        clImage * rotated;
         clContextLog(C, "parse", 1, "Rotating image %d turn%s clockwise", rotate, (rotate > 1) ? "s" : "");
-        rotated = clImageRotate(C, image, rotate);
-        clImageDestroy(C, image);
-        image = rotated;
+        if (!clImageRotateInPlace(C, image, rotate)) {
+            clImage * rotated = clImageRotate(C, image, rotate);
+            clImageDestroy(C, image);
+            image = rotated;
+        }
         clContextLog(C, "parse", 1, "Final resolution after rotation: %dx%d", image->width, image->height);
     }
     return image;
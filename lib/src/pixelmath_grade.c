@@ -6,6 +6,7 @@
 #include "colorist/transform.h"
 
 #include <math.h>
+#include <string.h>
 
 // (1.0 - 4.0) by 0.05
 #define GAMMA_RANGE_START 20
@@ -22,11 +23,19 @@ float clPixelMathRoundf(float val)
 
 uint32_t clPixelMathRoundUNorm(float val, uint32_t maxValue)
 {
-    uint32_t ret = (uint32_t)floorf((val * (float)maxValue) + 0.5f);
-    if (ret > maxValue) {
-        ret = maxValue;
+    return clPixelMathDitherUNorm(val, maxValue, 0.5f);
+}
+
+uint32_t clPixelMathDitherUNorm(float val, uint32_t maxValue, float threshold)
+{
+    float scaled = floorf((val * (float)maxValue) + threshold);
+    if (!(scaled > 0.0f)) { // negative or NaN
+        return 0;
     }
-    return ret;
+    if (scaled >= (float)maxValue) {
+        return maxValue;
+    }
+    return (uint32_t)scaled;
 }
 
 float clPixelMathFloorf(float val)
@@ -49,53 +58,81 @@ float clPixelMathRoundNormalized(float normalizedValue, float factor)
     return clPixelMathRoundf(normalizedValue * factor);
 }
 
-static float gammaErrorTerm(float gamma, float * pixels, int pixelCount, float maxChannel, float luminanceScale)
+// Channel values are quantized this finely (after luminance scaling) before any gamma is scored, so scoring costs the same
+// for any pixel count. Buckets also sum their values, so sources of 16 bits or less per channel score almost exactly.
+#define GAMMA_HISTOGRAM_BUCKET_COUNT (1 << 16)
+#define GAMMA_HISTOGRAM_MIN_PIXELS_PER_PART (1 << 16)
+
+typedef struct clGammaHistogramPart
+{
+    double counts[GAMMA_HISTOGRAM_BUCKET_COUNT];
+    double sums[GAMMA_HISTOGRAM_BUCKET_COUNT];
+} clGammaHistogramPart;
+
+typedef struct clGammaHistogramTask
+{
+    const float * pixels;
+    int pixelCount;
+    int partCount;
+    float luminanceScale;
+    clGammaHistogramPart * parts;
+} clGammaHistogramTask;
+
+static void gammaHistogramTaskFunc(clGammaHistogramTask * info, int firstPart, int partCount)
+{
+    for (int partIndex = firstPart; partIndex < firstPart + partCount; ++partIndex) {
+        clGammaHistogramPart * part = &info->parts[partIndex];
+        int firstPixel = (int)(((int64_t)info->pixelCount * partIndex) / info->partCount);
+        int endPixel = (int)(((int64_t)info->pixelCount * (partIndex + 1)) / info->partCount);
+        const float * pixel = &info->pixels[(size_t)firstPixel * 4];
+        for (int i = firstPixel; i < endPixel; ++i) {
+            for (int channel = 0; channel < 3; ++channel) {
+                // 0 and 1 (and everything clamped to them) round trip exactly at any gamma, so they're never an error
+                float scaledChannel = pixel[channel] * info->luminanceScale;
+                if (!(scaledChannel > 0.0f) || (scaledChannel >= 1.0f)) {
+                    continue;
+                }
+                int bucket = (int)(scaledChannel * (float)GAMMA_HISTOGRAM_BUCKET_COUNT);
+                bucket = CL_MIN(bucket, GAMMA_HISTOGRAM_BUCKET_COUNT - 1);
+                part->counts[bucket] += 1.0;
+                part->sums[bucket] += scaledChannel;
+            }
+            pixel += 4;
+        }
+    }
+}
+
+// How far every (weighted) value drifts after a round trip through a dstColorDepth encoding with this gamma
+static float gammaErrorTerm(float gamma, const float * values, const double * weights, int valueCount, float maxChannel)
 {
     float invGamma = 1.0f / gamma;
-    float errorTerm = 0.0f;
-    float * pixel = pixels;
-
-    for (int i = 0; i < pixelCount; ++i) {
-        float channelErrorTerm;
-        float scaledChannel;
-
-        scaledChannel = pixel[0] * luminanceScale;
-        scaledChannel = CL_CLAMP(scaledChannel, 0.0f, 1.0f);
-        channelErrorTerm =
-            fabsf(scaledChannel - powf(clPixelMathRoundf(powf(scaledChannel, invGamma) * maxChannel) / maxChannel, gamma));
-        errorTerm += channelErrorTerm; // * channelErrorTerm;
-
-        scaledChannel = pixel[1] * luminanceScale;
-        scaledChannel = CL_CLAMP(scaledChannel, 0.0f, 1.0f);
-        channelErrorTerm =
-            fabsf(scaledChannel - powf(clPixelMathRoundf(powf(scaledChannel, invGamma) * maxChannel) / maxChannel, gamma));
-        errorTerm += channelErrorTerm; // * channelErrorTerm;
-
-        scaledChannel = pixel[2] * luminanceScale;
-        scaledChannel = CL_CLAMP(scaledChannel, 0.0f, 1.0f);
-        channelErrorTerm =
-            fabsf(scaledChannel - powf(clPixelMathRoundf(powf(scaledChannel, invGamma) * maxChannel) / maxChannel, gamma));
-        errorTerm += channelErrorTerm; // * channelErrorTerm;
-
-        pixel += 4;
+    double errorTerm = 0.0;
+
+    for (int i = 0; i < valueCount; ++i) {
+        float value = values[i];
+        float channelErrorTerm = fabsf(value - powf(clPixelMathRoundf(powf(value, invGamma) * maxChannel) / maxChannel, gamma));
+        errorTerm += channelErrorTerm * weights[i];
     }
-    return errorTerm;
+    return (float)errorTerm;
 }
 
 typedef struct clGammaErrorTermTask
 {
     int gammaInt;
     float gamma;
-    float * pixels;
-    int pixelCount;
+    const float * values;
+    const double * weights;
+    int valueCount;
     float maxChannel;
-    float luminanceScale;
     float outErrorTerm;
 } clGammaErrorTermTask;
 
-static void gammaErrorTermTaskFunc(clGammaErrorTermTask * info)
+static void gammaErrorTermTaskFunc(clGammaErrorTermTask * infos, int firstAttempt, int attemptCount)
 {
-    info->outErrorTerm = gammaErrorTerm(info->gamma, info->pixels, info->pixelCount, info->maxChannel, info->luminanceScale);
+    for (int i = firstAttempt; i < firstAttempt + attemptCount; ++i) {
+        clGammaErrorTermTask * info = &infos[i];
+        info->outErrorTerm = gammaErrorTerm(info->gamma, info->values, info->weights, info->valueCount, info->maxChannel);
+    }
 }
 
 void clPixelMathColorGrade(struct clContext * C,
@@ -108,38 +145,62 @@ void clPixelMathColorGrade(struct clContext * C,
                            int * outLuminance,
                            float * outGamma,
                            clBool verbose)
+{
+    clPixelMathColorGradeWithReduction(C,
+                                       pixelProfile,
+                                       pixels,
+                                       pixelCount,
+                                       imageWidth,
+                                       NULL,
+                                       srcLuminance,
+                                       dstColorDepth,
+                                       outLuminance,
+                                       outGamma,
+                                       verbose);
+}
+
+// A NULL reduction has the pixels reduced here, if the max luminance is needed
+void clPixelMathColorGradeWithReduction(struct clContext * C,
+                                        struct clProfile * pixelProfile,
+                                        float * pixels,
+                                        int pixelCount,
+                                        int imageWidth,
+                                        const clPixelReduction * reduction,
+                                        int srcLuminance,
+                                        int dstColorDepth,
+                                        int * outLuminance,
+                                        float * outGamma,
+                                        clBool verbose)
 {
     int maxLuminance = 0;
     float bestGamma = 0.0f;
 
     // Find max luminance
     if (*outLuminance == 0) {
-        float * pixel;
-        int indexWithMaxChannel = 0;
-        float maxChannel = 0.0f;
+        float maxChannel;
         float maxPixel[4];
         float xyz[3];
         int pixelX, pixelY;
         float pixelLuminance, maxLuminanceFloat;
 
-        clTransform * toXYZ = clTransformCreate(C, pixelProfile, CL_XF_RGBA, NULL, CL_XF_XYZ, CL_TONEMAP_OFF);
-
-        pixel = pixels;
-        for (int i = 0; i < pixelCount; ++i) {
-            if (maxChannel < pixel[0]) {
-                indexWithMaxChannel = i;
-                maxChannel = pixel[0];
-            }
-            if (maxChannel < pixel[1]) {
-                indexWithMaxChannel = i;
-                maxChannel = pixel[1];
-            }
-            if (maxChannel < pixel[2]) {
-                indexWithMaxChannel = i;
-                maxChannel = pixel[2];
-            }
-            pixel += 4;
+        clPixelReduction pixelsReduction;
+        if (!reduction) {
+            static const float unusedLumaWeights[3] = { 0.0f, 0.0f, 0.0f };
+            clPixelMathReduce(C,
+                              CL_PIXELFORMAT_F32,
+                              (const uint8_t *)pixels,
+                              imageWidth * 4 * (int)sizeof(float),
+                              imageWidth,
+                              pixelCount / imageWidth,
+                              1,
+                              unusedLumaWeights,
+                              &pixelsReduction);
+            reduction = &pixelsReduction;
         }
+        maxChannel = reduction->maxChannel;
+        int indexWithMaxChannel = (reduction->maxChannelY * imageWidth) + reduction->maxChannelX;
+
+        clTransform * toXYZ = clTransformAcquire(C, pixelProfile, CL_XF_RGBA, NULL, CL_XF_XYZ, CL_TONEMAP_OFF, NULL, 0, 0);
 
         clTransformRun(C, toXYZ, &pixels[indexWithMaxChannel * 4], xyz, 1);
         pixelX = indexWithMaxChannel % imageWidth;
@@ -154,7 +215,7 @@ void clPixelMathColorGrade(struct clContext * C,
         maxLuminanceFloat = xyz[1];
         maxLuminance = (int)clPixelMathRoundf(maxLuminanceFloat);
 
-        clTransformDestroy(C, toXYZ);
+        clTransformRelease(C, toXYZ);
 
         clContextLog(C,
                      "grading",
@@ -172,60 +233,81 @@ void clPixelMathColorGrade(struct clContext * C,
     // Find best gamma
     if (*outGamma <= 0.0f) {
         float luminanceScale = (float)srcLuminance / maxLuminance;
-        int gammaInt;
         int minGammaInt = 0;
         float minErrorTerm = -1.0f;
         float maxChannel = (float)((1 << dstColorDepth) - 1);
-        clTask ** tasks;
         clGammaErrorTermTask * infos;
-        int tasksInFlight = 0;
-        int taskCount = C->jobs;
+        int attemptCount = GAMMA_RANGE_END - GAMMA_RANGE_START + 1;
+        int taskCount = CL_MIN(C->jobs, attemptCount);
+
+        // Quantize every channel once; each gamma attempt then only visits the distinct values
+        clGammaHistogramTask histogramInfo;
+        histogramInfo.pixels = pixels;
+        histogramInfo.pixelCount = pixelCount;
+        histogramInfo.partCount = CL_CLAMP(pixelCount / GAMMA_HISTOGRAM_MIN_PIXELS_PER_PART, 1, C->jobs);
+        histogramInfo.luminanceScale = luminanceScale;
+        histogramInfo.parts = clAllocate(sizeof(clGammaHistogramPart) * histogramInfo.partCount);
+        memset(histogramInfo.parts, 0, sizeof(clGammaHistogramPart) * histogramInfo.partCount);
+        clTaskParallelFor(C, histogramInfo.partCount, 1, (clTaskRangeFunc)gammaHistogramTaskFunc, &histogramInfo);
+
+        float * values = clAllocate(sizeof(float) * GAMMA_HISTOGRAM_BUCKET_COUNT);
+        double * weights = clAllocate(sizeof(double) * GAMMA_HISTOGRAM_BUCKET_COUNT);
+        int valueCount = 0;
+        for (int bucket = 0; bucket < GAMMA_HISTOGRAM_BUCKET_COUNT; ++bucket) {
+            double count = 0.0;
+            double sum = 0.0;
+            for (int i = 0; i < histogramInfo.partCount; ++i) {
+                count += histogramInfo.parts[i].counts[bucket];
+                sum += histogramInfo.parts[i].sums[bucket];
+            }
+            if (count > 0.0) {
+                values[valueCount] = (float)(sum / count); // the bucket's mean stands in for all of its values
+                weights[valueCount] = count;
+                ++valueCount;
+            }
+        }
+        clFree(histogramInfo.parts);
 
         clContextLog(C, "grading", 1, "Using %d thread%s to find best gamma.", taskCount, (taskCount == 1) ? "" : "s");
+        clContextLog(C, "grading", 1, "Scoring %d distinct channel values per gamma attempt.", valueCount);
 
-        tasks = clAllocate(taskCount * sizeof(clTask *));
-        infos = clAllocate(taskCount * sizeof(clGammaErrorTermTask));
-        for (gammaInt = GAMMA_RANGE_START; gammaInt <= GAMMA_RANGE_END; ++gammaInt) {
-            float gammaAttempt = (float)gammaInt / GAMMA_INT_DIVISOR;
-
-            infos[tasksInFlight].gammaInt = gammaInt;
-            infos[tasksInFlight].gamma = gammaAttempt;
-            infos[tasksInFlight].pixels = pixels;
-            infos[tasksInFlight].pixelCount = pixelCount;
-            infos[tasksInFlight].maxChannel = maxChannel;
-            infos[tasksInFlight].luminanceScale = luminanceScale;
-            infos[tasksInFlight].outErrorTerm = 0;
-            tasks[tasksInFlight] = clTaskCreate(C, (clTaskFunc)gammaErrorTermTaskFunc, &infos[tasksInFlight]);
-            ++tasksInFlight;
-
-            if ((tasksInFlight == taskCount) || (gammaInt == GAMMA_RANGE_END)) {
-                for (int i = 0; i < tasksInFlight; ++i) {
-                    clTaskJoin(C, tasks[i]);
-                    if (minErrorTerm < 0.0f) {
-                        minErrorTerm = infos[i].outErrorTerm;
-                        minGammaInt = infos[i].gammaInt;
-                    } else if (minErrorTerm > infos[i].outErrorTerm) {
-                        minErrorTerm = infos[i].outErrorTerm;
-                        minGammaInt = infos[i].gammaInt;
-                    }
-                    if (verbose)
-                        clContextLog(C,
-                                     "grading",
-                                     2,
-                                     "attempt: gamma %.3g, err: %g     best -> gamma: %g, err: %g",
-                                     infos[i].gamma,
-                                     infos[i].outErrorTerm,
-                                     (float)minGammaInt / GAMMA_INT_DIVISOR,
-                                     minErrorTerm);
-                    clTaskDestroy(C, tasks[i]);
-                }
-                tasksInFlight = 0;
+        infos = clAllocate(attemptCount * sizeof(clGammaErrorTermTask));
+        for (int i = 0; i < attemptCount; ++i) {
+            int gammaInt = GAMMA_RANGE_START + i;
+            infos[i].gammaInt = gammaInt;
+            infos[i].gamma = (float)gammaInt / GAMMA_INT_DIVISOR;
+            infos[i].values = values;
+            infos[i].weights = weights;
+            infos[i].valueCount = valueCount;
+            infos[i].maxChannel = maxChannel;
+            infos[i].outErrorTerm = 0;
+        }
+
+        clTaskParallelFor(C, attemptCount, 1, (clTaskRangeFunc)gammaErrorTermTaskFunc, infos);
+
+        for (int i = 0; i < attemptCount; ++i) {
+            if (minErrorTerm < 0.0f) {
+                minErrorTerm = infos[i].outErrorTerm;
+                minGammaInt = infos[i].gammaInt;
+            } else if (minErrorTerm > infos[i].outErrorTerm) {
+                minErrorTerm = infos[i].outErrorTerm;
+                minGammaInt = infos[i].gammaInt;
             }
+            if (verbose)
+                clContextLog(C,
+                             "grading",
+                             2,
+                             "attempt: gamma %.3g, err: %g     best -> gamma: %g, err: %g",
+                             infos[i].gamma,
+                             infos[i].outErrorTerm,
+                             (float)minGammaInt / GAMMA_INT_DIVISOR,
+                             minErrorTerm);
         }
         bestGamma = (float)minGammaInt / GAMMA_INT_DIVISOR;
         clContextLog(C, "grading", 1, "Found best gamma: %g", bestGamma);
-        clFree(tasks);
         clFree(infos);
+        clFree(weights);
+        clFree(values);
     } else {
         bestGamma = *outGamma;
         clContextLog(C, "grading", 1, "Using requested gamma: %g", bestGamma);
@@ -0,0 +1,258 @@
+#include "colorist/pixelmath.h"
+
+#include "colorist/context.h"
+#include "colorist/image.h"
+#include "colorist/task.h"
+
+#include <float.h>
+#include <string.h>
+
+// Same baseline-only SIMD selection as the CCMM batch kernel in transform.c
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#include <emmintrin.h>
+#define CL_REDUCE_SSE2
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define CL_REDUCE_NEON
+#endif
+
+// Reductions are memory bound, so smaller ranges aren't worth handing to another thread
+#define CL_PIXELMATH_MIN_PIXELS_PER_REDUCE_TASK (16 * 1024)
+
+typedef struct clReducePart
+{
+    float channelMin[3];
+    float channelMax[3];
+    double channelSum[3];
+    float maxChannel;
+    int maxChannelY; // first row reaching maxChannel, -1 if no channel is above 0
+} clReducePart;
+
+typedef struct clReduceTask
+{
+    clPixelFormat pixelFormat;
+    const uint8_t * pixels;
+    int rowBytes;
+    int width;
+    int height;
+    float maxValue;
+    int partCount;
+    clReducePart * parts;
+} clReduceTask;
+
+static float loadNormalizedChannel(clPixelFormat pixelFormat, const uint8_t * row, int index, float maxValue)
+{
+    switch (pixelFormat) {
+        case CL_PIXELFORMAT_U8:
+            return (float)row[index] / maxValue;
+        case CL_PIXELFORMAT_U16:
+            return (float)((const uint16_t *)row)[index] / maxValue;
+        case CL_PIXELFORMAT_F32:
+        case CL_PIXELFORMAT_COUNT:
+            break;
+    }
+    return ((const float *)row)[index];
+}
+
+// One row of F32 pixels; NaNs are skipped by the min and max (like the comparisons in the scalar loop) but not the sum
+static void reduceRowF32(const float * row, int width, float rowMin[3], float rowMax[3], float rowSum[3])
+{
+#if defined(CL_REDUCE_SSE2)
+    __m128 vMin = _mm_set1_ps(FLT_MAX);
+    __m128 vMax = _mm_set1_ps(-FLT_MAX);
+    __m128 vSum = _mm_setzero_ps();
+    for (int x = 0; x < width; ++x) {
+        __m128 pixel = _mm_loadu_ps(&row[x * CL_CHANNELS_PER_PIXEL]);
+        vMin = _mm_min_ps(pixel, vMin); // a NaN in the first operand returns the second
+        vMax = _mm_max_ps(pixel, vMax);
+        vSum = _mm_add_ps(vSum, pixel);
+    }
+    float mins[4], maxs[4], sums[4];
+    _mm_storeu_ps(mins, vMin);
+    _mm_storeu_ps(maxs, vMax);
+    _mm_storeu_ps(sums, vSum);
+#elif defined(CL_REDUCE_NEON)
+    float32x4_t vMin = vdupq_n_f32(FLT_MAX);
+    float32x4_t vMax = vdupq_n_f32(-FLT_MAX);
+    float32x4_t vSum = vdupq_n_f32(0.0f);
+    for (int x = 0; x < width; ++x) {
+        float32x4_t pixel = vld1q_f32(&row[x * CL_CHANNELS_PER_PIXEL]);
+        vMin = vminnmq_f32(vMin, pixel); // the number wins over a NaN
+        vMax = vmaxnmq_f32(vMax, pixel);
+        vSum = vaddq_f32(vSum, pixel);
+    }
+    float mins[4], maxs[4], sums[4];
+    vst1q_f32(mins, vMin);
+    vst1q_f32(maxs, vMax);
+    vst1q_f32(sums, vSum);
+#else
+    float mins[4] = { FLT_MAX, FLT_MAX, FLT_MAX, FLT_MAX };
+    float maxs[4] = { -FLT_MAX, -FLT_MAX, -FLT_MAX, -FLT_MAX };
+    float sums[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    for (int x = 0; x < width; ++x) {
+        const float * pixel = &row[x * CL_CHANNELS_PER_PIXEL];
+        for (int c = 0; c < 3; ++c) {
+            if (mins[c] > pixel[c]) {
+                mins[c] = pixel[c];
+            }
+            if (maxs[c] < pixel[c]) {
+                maxs[c] = pixel[c];
+            }
+            sums[c] += pixel[c];
+        }
+    }
+#endif
+    for (int c = 0; c < 3; ++c) {
+        rowMin[c] = mins[c];
+        rowMax[c] = maxs[c];
+        rowSum[c] = sums[c];
+    }
+}
+
+// Integer rows reduce exactly (simple enough loops for the compiler to vectorize); a row's sum fits easily in 64 bits
+static void reduceRowInteger(const clReduceTask * info, const uint8_t * row, float rowMin[3], float rowMax[3], double rowSum[3])
+{
+    uint32_t mins[3] = { UINT32_MAX, UINT32_MAX, UINT32_MAX };
+    uint32_t maxs[3] = { 0, 0, 0 };
+    uint64_t sums[3] = { 0, 0, 0 };
+    if (info->pixelFormat == CL_PIXELFORMAT_U8) {
+        for (int x = 0; x < info->width; ++x) {
+            const uint8_t * pixel = &row[x * CL_CHANNELS_PER_PIXEL];
+            for (int c = 0; c < 3; ++c) {
+                mins[c] = CL_MIN(mins[c], pixel[c]);
+                maxs[c] = CL_MAX(maxs[c], pixel[c]);
+                sums[c] += pixel[c];
+            }
+        }
+    } else {
+        const uint16_t * row16 = (const uint16_t *)row;
+        for (int x = 0; x < info->width; ++x) {
+            const uint16_t * pixel = &row16[x * CL_CHANNELS_PER_PIXEL];
+            for (int c = 0; c < 3; ++c) {
+                mins[c] = CL_MIN(mins[c], pixel[c]);
+                maxs[c] = CL_MAX(maxs[c], pixel[c]);
+                sums[c] += pixel[c];
+            }
+        }
+    }
+    for (int c = 0; c < 3; ++c) {
+        rowMin[c] = (float)mins[c] / info->maxValue;
+        rowMax[c] = (float)maxs[c] / info->maxValue;
+        rowSum[c] = (double)sums[c] / info->maxValue;
+    }
+}
+
+static void reduceTaskFunc(clReduceTask * info, int firstPart, int partCount)
+{
+    for (int partIndex = firstPart; partIndex < firstPart + partCount; ++partIndex) {
+        clReducePart * part = &info->parts[partIndex];
+        int firstRow = (int)(((int64_t)info->height * partIndex) / info->partCount);
+        int endRow = (int)(((int64_t)info->height * (partIndex + 1)) / info->partCount);
+        for (int y = firstRow; y < endRow; ++y) {
+            const uint8_t * row = &info->pixels[(size_t)y * info->rowBytes];
+            float rowMin[3];
+            float rowMax[3];
+            double rowSum[3];
+            if (info->pixelFormat == CL_PIXELFORMAT_F32) {
+                // Rows are summed in float and parts in double, which keeps the sum's error proportional to the width
+                float rowSumF32[3];
+                reduceRowF32((const float *)row, info->width, rowMin, rowMax, rowSumF32);
+                rowSum[0] = rowSumF32[0];
+                rowSum[1] = rowSumF32[1];
+                rowSum[2] = rowSumF32[2];
+            } else {
+                reduceRowInteger(info, row, rowMin, rowMax, rowSum);
+            }
+
+            for (int c = 0; c < 3; ++c) {
+                part->channelMin[c] = CL_MIN(part->channelMin[c], rowMin[c]);
+                part->channelMax[c] = CL_MAX(part->channelMax[c], rowMax[c]);
+                part->channelSum[c] += rowSum[c];
+                if (part->maxChannel < rowMax[c]) {
+                    part->maxChannel = rowMax[c];
+                    part->maxChannelY = y;
+                }
+            }
+        }
+    }
+}
+
+void clPixelMathReduce(struct clContext * C,
+                       clPixelFormat pixelFormat,
+                       const uint8_t * pixels,
+                       int rowBytes,
+                       int width,
+                       int height,
+                       uint32_t maxValue,
+                       const float lumaWeights[3],
+                       clPixelReduction * outReduction)
+{
+    memset(outReduction, 0, sizeof(clPixelReduction));
+    if ((width <= 0) || (height <= 0)) {
+        return;
+    }
+
+    clReduceTask info;
+    info.pixelFormat = pixelFormat;
+    info.pixels = pixels;
+    info.rowBytes = rowBytes;
+    info.width = width;
+    info.height = height;
+    info.maxValue = (float)maxValue;
+    int minRowsPerTask = CL_MAX(1, CL_PIXELMATH_MIN_PIXELS_PER_REDUCE_TASK / width);
+    info.partCount = CL_CLAMP(height / minRowsPerTask, 1, C->jobs);
+    info.parts = clAllocate(sizeof(clReducePart) * info.partCount);
+    for (int i = 0; i < info.partCount; ++i) {
+        clReducePart * part = &info.parts[i];
+        for (int c = 0; c < 3; ++c) {
+            part->channelMin[c] = FLT_MAX;
+            part->channelMax[c] = -FLT_MAX;
+            part->channelSum[c] = 0.0;
+        }
+        part->maxChannel = 0.0f;
+        part->maxChannelY = -1;
+    }
+    clTaskParallelFor(C, info.partCount, 1, (clTaskRangeFunc)reduceTaskFunc, &info);
+
+    // Parts are merged in row order, so ties for the largest channel go to the first row reaching it
+    int maxChannelY = -1;
+    for (int c = 0; c < 3; ++c) {
+        outReduction->channelMin[c] = FLT_MAX;
+        outReduction->channelMax[c] = -FLT_MAX;
+    }
+    for (int i = 0; i < info.partCount; ++i) {
+        clReducePart * part = &info.parts[i];
+        for (int c = 0; c < 3; ++c) {
+            outReduction->channelMin[c] = CL_MIN(outReduction->channelMin[c], part->channelMin[c]);
+            outReduction->channelMax[c] = CL_MAX(outReduction->channelMax[c], part->channelMax[c]);
+            outReduction->channelSum[c] += part->channelSum[c];
+        }
+        if (outReduction->maxChannel < part->maxChannel) {
+            outReduction->maxChannel = part->maxChannel;
+            maxChannelY = part->maxChannelY;
+        }
+    }
+    clFree(info.parts);
+
+    outReduction->lumaSum = (lumaWeights[0] * outReduction->channelSum[0]) + (lumaWeights[1] * outReduction->channelSum[1]) +
+                            (lumaWeights[2] * outReduction->channelSum[2]);
+
+    // Only the winning row is searched for the largest channel's pixel
+    if (maxChannelY >= 0) {
+        const uint8_t * row = &pixels[(size_t)maxChannelY * rowBytes];
+        for (int x = 0; x < width; ++x) {
+            clBool found = clFalse;
+            for (int c = 0; c < 3; ++c) {
+                if (loadNormalizedChannel(pixelFormat, row, (x * CL_CHANNELS_PER_PIXEL) + c, info.maxValue) ==
+                    outReduction->maxChannel) {
+                    found = clTrue;
+                }
+            }
+            if (found) {
+                outReduction->maxChannelX = x;
+                outReduction->maxChannelY = maxChannelY;
+                break;
+            }
+        }
+    }
+}
@@ -1,48 +1,379 @@
 #include "colorist/pixelmath.h"
 
 #include "colorist/context.h"
+#include "colorist/task.h"
 
-#include "stb_image_resize.h"
-
+#include <math.h>
 #include <string.h>
 
-void clPixelMathResize(struct clContext * C, int srcW, int srcH, float * srcPixels, int dstW, int dstH, float * dstPixels, clFilter filter)
+// Same baseline-only SIMD selection as the CCMM batch kernel in transform.c
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#include <emmintrin.h>
+#define CL_RESIZE_SSE2
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define CL_RESIZE_NEON
+#endif
+
+// Rows (times their width) handed to each worker at once
+#define CL_RESIZE_MIN_PIXELS_PER_TASK (16 * 1024)
+
+// ---------------------------------------------------------------------------
+// Filters
+//
+// The kernels, supports and sample ranges are the same as stb_image_resize's (which this replaced), so the
+// output only differs from it by float summation order.
+
+static float resizeFilterTrapezoid(float x, float scale)
+{
+    float halfscale = scale / 2;
+    float t = 0.5f + halfscale;
+
+    x = fabsf(x);
+    if (x >= t) {
+        return 0.0f;
+    }
+    float r = 0.5f - halfscale;
+    if (x <= r) {
+        return 1.0f;
+    }
+    return (t - x) / scale;
+}
+
+static float resizeFilterKernel(clFilter filter, float x, float scale)
 {
-    COLORIST_UNUSED(C);
+    x = fabsf(x);
+    switch (filter) {
+        case CL_FILTER_BOX:
+            return resizeFilterTrapezoid(x, scale);
+        case CL_FILTER_TRIANGLE:
+            return (x <= 1.0f) ? (1 - x) : 0.0f;
+        case CL_FILTER_CUBICBSPLINE:
+            if (x < 1.0f) {
+                return (4 + x * x * (3 * x - 6)) / 6;
+            } else if (x < 2.0f) {
+                return (8 + x * (-12 + x * (6 - x))) / 6;
+            }
+            return 0.0f;
+        case CL_FILTER_CATMULLROM:
+            if (x < 1.0f) {
+                return 1 - x * x * (2.5f - 1.5f * x);
+            } else if (x < 2.0f) {
+                return 2 - x * (4 + x * (0.5f * x - 2.5f));
+            }
+            return 0.0f;
+        case CL_FILTER_MITCHELL:
+            if (x < 1.0f) {
+                return (16 + x * x * (21 * x - 36)) / 18;
+            } else if (x < 2.0f) {
+                return (32 + x * (-60 + x * (36 - 7 * x))) / 18;
+            }
+            return 0.0f;
+        default:
+            break;
+    }
+    return 0.0f;
+}
+
+static float resizeFilterSupport(clFilter filter, float scale)
+{
+    switch (filter) {
+        case CL_FILTER_BOX:
+            return 0.5f + scale / 2;
+        case CL_FILTER_TRIANGLE:
+            return 1.0f;
+        default:
+            break;
+    }
+    return 2.0f;
+}
+
+// ---------------------------------------------------------------------------
+// Per-axis kernels
+
+// For every output pixel along one axis: the first input pixel it reads, how many it reads, and their weights
+// (normalized, with taps past either edge folded into the edge pixel)
+typedef struct clResizeAxis
+{
+    int * first;
+    int * count;
+    float * weights; // tapStride weights per output pixel
+    int tapStride;
+} clResizeAxis;
+
+static void resizeAxisCreate(struct clContext * C, clResizeAxis * axis, int inSize, int outSize, clFilter filter)
+{
+    float scale = (float)outSize / (float)inSize;
+    clBool upsampling = (scale > 1.0f) ? clTrue : clFalse;
+    if (filter == CL_FILTER_AUTO) {
+        filter = upsampling ? CL_FILTER_CATMULLROM : CL_FILTER_MITCHELL;
+    }
+
+    // Upsampling evaluates the filter in input pixels; downsampling widens it to cover 1/scale input pixels per output
+    float filterScale = upsampling ? (1.0f / scale) : scale;
+    float inRadius = upsampling ? resizeFilterSupport(filter, filterScale) : (resizeFilterSupport(filter, filterScale) / scale);
+    int rawTapCount = (int)ceilf(inRadius * 2.0f) + 3;
+    int margin = upsampling ? 0 : ((int)ceilf(resizeFilterSupport(filter, filterScale) * 2.0f / scale) / 2);
+
+    axis->tapStride = CL_MIN(rawTapCount, inSize);
+    axis->first = clAllocate(sizeof(int) * outSize);
+    axis->count = clAllocate(sizeof(int) * outSize);
+    axis->weights = clAllocate(sizeof(float) * outSize * axis->tapStride);
+    float * rawWeights = clAllocate(sizeof(float) * rawTapCount);
+
+    for (int o = 0; o < outSize; ++o) {
+        float outCenter = (float)o + 0.5f;
+        float inCenter = outCenter / scale;
+        int rawFirst = (int)floorf(inCenter - inRadius + 0.5f);
+        int rawLast = (int)floorf(inCenter + inRadius - 0.5f);
+        if (!upsampling) {
+            // Input pixels outside the image only count as far as stb_image_resize's decode margin reached
+            rawFirst = CL_MAX(rawFirst - 1, -margin);
+            rawLast = CL_MIN(rawLast + 1, inSize + margin - 1);
+        }
+        rawLast = CL_MIN(rawLast, rawFirst + rawTapCount - 1);
+
+        float total = 0.0f;
+        for (int n = rawFirst; n <= rawLast; ++n) {
+            float w;
+            if (upsampling) {
+                w = resizeFilterKernel(filter, inCenter - ((float)n + 0.5f), filterScale);
+            } else {
+                w = resizeFilterKernel(filter, outCenter - (((float)n + 0.5f) * scale), filterScale) * scale;
+            }
+            rawWeights[n - rawFirst] = w;
+            total += w;
+        }
+        float normalize = (total != 0.0f) ? (1.0f / total) : 0.0f;
+
+        // Clamp to the edges (STBIR_EDGE_CLAMP), then trim zero taps off both ends
+        int first = CL_CLAMP(rawFirst, 0, inSize - 1);
+        int last = CL_CLAMP(rawLast, 0, inSize - 1);
+        float * weights = &axis->weights[(size_t)o * axis->tapStride];
+        memset(weights, 0, sizeof(float) * axis->tapStride);
+        for (int n = rawFirst; n <= rawLast; ++n) {
+            int clamped = CL_CLAMP(n, first, last);
+            weights[clamped - first] += rawWeights[n - rawFirst] * normalize;
+        }
+        int count = last - first + 1;
+        while ((count > 1) && (weights[0] == 0.0f)) {
+            memmove(weights, weights + 1, sizeof(float) * (count - 1));
+            weights[count - 1] = 0.0f;
+            ++first;
+            --count;
+        }
+        while ((count > 1) && (weights[count - 1] == 0.0f)) {
+            --count;
+        }
+        axis->first[o] = first;
+        axis->count[o] = count;
+    }
+    clFree(rawWeights);
+}
+
+static void resizeAxisDestroy(struct clContext * C, clResizeAxis * axis)
+{
+    clFree(axis->first);
+    clFree(axis->count);
+    clFree(axis->weights);
+}
+
+// ---------------------------------------------------------------------------
+// Passes
 
+typedef struct clResizeTask
+{
+    struct clContext * C;
+    const clResizeAxis * axis;
+    const float * srcPixels;
+    float * dstPixels;
+    int srcW;
+    int dstW;
+} clResizeTask;
+
+// Resamples rows of srcW premultiplied pixels down/up to dstW
+static void resizeHorizontalTaskFunc(clResizeTask * info, int firstRow, int rowCount)
+{
+    struct clContext * C = info->C;
+    const clResizeAxis * axis = info->axis;
+    float * premultiplied = clAllocate(sizeof(float) * 4 * info->srcW);
+    for (int y = firstRow; y < (firstRow + rowCount); ++y) {
+        const float * srcRow = &info->srcPixels[(size_t)y * info->srcW * 4];
+        float * dstRow = &info->dstPixels[(size_t)y * info->dstW * 4];
+
+        // Color is filtered weighted by alpha, then divided back out at the end of the vertical pass
+        for (int x = 0; x < info->srcW; ++x) {
+            const float * src = &srcRow[x * 4];
+            float * dst = &premultiplied[x * 4];
+            dst[0] = src[0] * src[3];
+            dst[1] = src[1] * src[3];
+            dst[2] = src[2] * src[3];
+            dst[3] = src[3];
+        }
+
+        for (int x = 0; x < info->dstW; ++x) {
+            const float * src = &premultiplied[axis->first[x] * 4];
+            const float * weights = &axis->weights[(size_t)x * axis->tapStride];
+            int count = axis->count[x];
+#if defined(CL_RESIZE_SSE2)
+            __m128 sum = _mm_setzero_ps();
+            for (int k = 0; k < count; ++k) {
+                sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(&src[k * 4]), _mm_set1_ps(weights[k])));
+            }
+            _mm_storeu_ps(&dstRow[x * 4], sum);
+#elif defined(CL_RESIZE_NEON)
+            float32x4_t sum = vdupq_n_f32(0.0f);
+            for (int k = 0; k < count; ++k) {
+                sum = vmlaq_n_f32(sum, vld1q_f32(&src[k * 4]), weights[k]);
+            }
+            vst1q_f32(&dstRow[x * 4], sum);
+#else
+            float sum[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+            for (int k = 0; k < count; ++k) {
+                for (int c = 0; c < 4; ++c) {
+                    sum[c] += src[(k * 4) + c] * weights[k];
+                }
+            }
+            memcpy(&dstRow[x * 4], sum, sizeof(sum));
+#endif
+        }
+    }
+    clFree(premultiplied);
+}
+
+// Blends the rows of the horizontally resized image each output row covers, then unpremultiplies and clamps
+static void resizeVerticalTaskFunc(clResizeTask * info, int firstRow, int rowCount)
+{
+    const clResizeAxis * axis = info->axis;
+    const size_t channelCount = (size_t)info->dstW * 4;
+    for (int y = firstRow; y < (firstRow + rowCount); ++y) {
+        const float * srcRows = &info->srcPixels[(size_t)axis->first[y] * channelCount];
+        const float * weights = &axis->weights[(size_t)y * axis->tapStride];
+        const int count = axis->count[y];
+        float * dstPixel = &info->dstPixels[(size_t)y * channelCount];
+        for (int x = 0; x < info->dstW; ++x, dstPixel += 4) {
+            const float * src = &srcRows[x * 4];
+            float sum[4];
+#if defined(CL_RESIZE_SSE2)
+            __m128 sum4 = _mm_setzero_ps();
+            for (int k = 0; k < count; ++k, src += channelCount) {
+                sum4 = _mm_add_ps(sum4, _mm_mul_ps(_mm_loadu_ps(src), _mm_set1_ps(weights[k])));
+            }
+            _mm_storeu_ps(sum, sum4);
+#elif defined(CL_RESIZE_NEON)
+            float32x4_t sum4 = vdupq_n_f32(0.0f);
+            for (int k = 0; k < count; ++k, src += channelCount) {
+                sum4 = vmlaq_n_f32(sum4, vld1q_f32(src), weights[k]);
+            }
+            vst1q_f32(sum, sum4);
+#else
+            sum[0] = sum[1] = sum[2] = sum[3] = 0.0f;
+            for (int k = 0; k < count; ++k, src += channelCount) {
+                for (int c = 0; c < 4; ++c) {
+                    sum[c] += src[c] * weights[k];
+                }
+            }
+#endif
+
+            // catmullrom and mitchell sometimes give negative values. Protect against that
+            float alpha = sum[3];
+            float reciprocalAlpha = alpha ? (1.0f / alpha) : 0.0f;
+            dstPixel[0] = CL_MAX(sum[0] * reciprocalAlpha, 0.0f);
+            dstPixel[1] = CL_MAX(sum[1] * reciprocalAlpha, 0.0f);
+            dstPixel[2] = CL_MAX(sum[2] * reciprocalAlpha, 0.0f);
+            dstPixel[3] = CL_MAX(alpha, 0.0f);
+        }
+    }
+}
+
+typedef struct clResizeNearestTask
+{
+    const int * srcX;
+    const int * srcY;
+    const float * srcPixels;
+    float * dstPixels;
+    int srcW;
+    int dstW;
+} clResizeNearestTask;
+
+static void resizeNearestTaskFunc(clResizeNearestTask * info, int firstRow, int rowCount)
+{
+    for (int j = firstRow; j < (firstRow + rowCount); ++j) {
+        const float * srcRow = &info->srcPixels[(size_t)info->srcY[j] * info->srcW * 4];
+        float * dstPixel = &info->dstPixels[(size_t)j * info->dstW * 4];
+        for (int i = 0; i < info->dstW; ++i, dstPixel += 4) {
+            memcpy(dstPixel, &srcRow[info->srcX[i] * 4], 4 * sizeof(float));
+        }
+    }
+}
+
+// colorist's very own super-obvious nearest neighbor implementation, with the source coordinates looked up once per axis
+static void resizeNearest(struct clContext * C,
+                          int srcW,
+                          int srcH,
+                          const float * srcPixels,
+                          int dstW,
+                          int dstH,
+                          float * dstPixels)
+{
+    float scaleW = (float)srcW / (float)dstW;
+    float scaleH = (float)srcH / (float)dstH;
+    int * srcX = clAllocate(sizeof(int) * dstW);
+    int * srcY = clAllocate(sizeof(int) * dstH);
+    for (int i = 0; i < dstW; ++i) {
+        srcX[i] = CL_CLAMP((int)(((float)i + 0.5f) * scaleW), 0, srcW - 1);
+    }
+    for (int j = 0; j < dstH; ++j) {
+        srcY[j] = CL_CLAMP((int)(((float)j + 0.5f) * scaleH), 0, srcH - 1);
+    }
+
+    clResizeNearestTask info;
+    info.srcX = srcX;
+    info.srcY = srcY;
+    info.srcPixels = srcPixels;
+    info.dstPixels = dstPixels;
+    info.srcW = srcW;
+    info.dstW = dstW;
+    int minRowsPerTask = CL_MAX(1, CL_RESIZE_MIN_PIXELS_PER_TASK / dstW);
+    clTaskParallelFor(C, dstH, minRowsPerTask, (clTaskRangeFunc)resizeNearestTaskFunc, &info);
+
+    clFree(srcX);
+    clFree(srcY);
+}
+
+void clPixelMathResize(struct clContext * C, int srcW, int srcH, float * srcPixels, int dstW, int dstH, float * dstPixels, clFilter filter)
+{
     if (filter == CL_FILTER_NEAREST) {
-        // colorist's very own super-obvious nearest neighbor implementation
-        float scaleW = (float)srcW / (float)dstW;
-        float scaleH = (float)srcH / (float)dstH;
-        for (int j = 0; j < dstH; ++j) {
-            for (int i = 0; i < dstW; ++i) {
-                float * srcPixel;
-                float * dstPixel;
-                int srcX = (int)(((float)i + 0.5f) * scaleW);
-                int srcY = (int)(((float)j + 0.5f) * scaleH);
-                srcX = CL_CLAMP(srcX, 0, srcW - 1);
-                srcY = CL_CLAMP(srcY, 0, srcH - 1);
-                srcPixel = &srcPixels[4 * (srcX + (srcY * srcW))];
-                dstPixel = &dstPixels[4 * (i + (j * dstW))];
-                memcpy(dstPixel, srcPixel, 4 * sizeof(float));
-            }
-        }
-    } else {
-        // use STB!
-        stbir_resize_float_generic(srcPixels,
-                                   srcW,
-                                   srcH,
-                                   srcW * 4 * sizeof(float),
-                                   dstPixels,
-                                   dstW,
-                                   dstH,
-                                   dstW * 4 * sizeof(float),
-                                   4,
-                                   3,
-                                   0,
-                                   STBIR_EDGE_CLAMP,
-                                   (stbir_filter)filter,
-                                   STBIR_COLORSPACE_LINEAR,
-                                   NULL);
+        resizeNearest(C, srcW, srcH, srcPixels, dstW, dstH, dstPixels);
+        return;
     }
+
+    // Separable: every source row is resized horizontally into a dstW x srcH scratch image, then every output row
+    // blends the scratch rows its vertical kernel covers. Both passes are split into bands of rows across the task pool.
+    clResizeAxis horizontal;
+    clResizeAxis vertical;
+    resizeAxisCreate(C, &horizontal, srcW, dstW, filter);
+    resizeAxisCreate(C, &vertical, srcH, dstH, filter);
+    float * scratch = clAllocate(sizeof(float) * 4 * dstW * srcH);
+
+    clResizeTask info;
+    info.C = C;
+    info.axis = &horizontal;
+    info.srcPixels = srcPixels;
+    info.dstPixels = scratch;
+    info.srcW = srcW;
+    info.dstW = dstW;
+    int minRowsPerTask = CL_MAX(1, CL_RESIZE_MIN_PIXELS_PER_TASK / CL_MAX(srcW, dstW));
+    clTaskParallelFor(C, srcH, minRowsPerTask, (clTaskRangeFunc)resizeHorizontalTaskFunc, &info);
+
+    info.axis = &vertical;
+    info.srcPixels = scratch;
+    info.dstPixels = dstPixels;
+    info.srcW = dstW;
+    minRowsPerTask = CL_MAX(1, CL_RESIZE_MIN_PIXELS_PER_TASK / dstW);
+    clTaskParallelFor(C, dstH, minRowsPerTask, (clTaskRangeFunc)resizeVerticalTaskFunc, &info);
+
+    clFree(scratch);
+    resizeAxisDestroy(C, &horizontal);
+    resizeAxisDestroy(C, &vertical);
 }
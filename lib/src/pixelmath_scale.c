@@ -2,83 +2,193 @@
 
 #include "colorist/context.h"
 
-// If you're closer than this to a color, just use that color exclusively
-#define MIN_DISTANCE (0.000001f)
+#include <string.h>
 
-// Converts ([0-1], [0-1], [0-1]) to a hald data or weight index in [0-7]
-#define I(X, Y, Z) ((X) + ((Y)*2) + ((Z)*4))
+// Same baseline-only SIMD selection as the CCMM batch kernel in transform.c
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#include <emmintrin.h>
+#define CL_LUT_SSE2
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define CL_LUT_NEON
+#endif
 
-void clPixelMathHaldCLUTLookup(struct clContext * C, float * haldData, int haldDims, const float src[4], float dst[4])
+clHaldLUT * clHaldLUTCreate(struct clContext * C, const float * haldPixels, int haldDims, clHaldInterpolation interpolation)
 {
-    COLORIST_UNUSED(C);
+    if (haldDims < 2) {
+        clContextLogError(C, "Hald CLUT needs at least 2 lattice points per axis, got %d", haldDims);
+        return NULL;
+    }
+
+    clHaldLUT * lut = clAllocateStruct(clHaldLUT);
+    lut->dims = haldDims;
+    lut->interpolation = interpolation;
+
+    // A Hald image is already the cube in the right order (red fastest, then green, then blue); keep its RGB only, so
+    // the lookups never touch the (unused) alpha and don't depend on how the image's rows were laid out
+    size_t latticeCount = (size_t)haldDims * haldDims * haldDims;
+    lut->cube = clAllocate(sizeof(float) * 4 * latticeCount);
+    for (size_t i = 0; i < latticeCount; ++i) {
+        lut->cube[(i * 4) + 0] = haldPixels[(i * 4) + 0];
+        lut->cube[(i * 4) + 1] = haldPixels[(i * 4) + 1];
+        lut->cube[(i * 4) + 2] = haldPixels[(i * 4) + 2];
+        lut->cube[(i * 4) + 3] = 0.0f;
+    }
+    return lut;
+}
+
+void clHaldLUTDestroy(struct clContext * C, clHaldLUT * lut)
+{
+    if (lut) {
+        clFree(lut->cube);
+        clFree(lut);
+    }
+}
+
+// Where one pixel lands in the cube: the index (in floats) of its lattice cell's first corner, and how far along each
+// axis it is inside that cell
+typedef struct clLUTCell
+{
+    size_t base;
+    float f[3];
+} clLUTCell;
 
-    float idealR = src[0] * (haldDims - 1);
-    float idealG = src[1] * (haldDims - 1);
-    float idealB = src[2] * (haldDims - 1);
-
-    float firstCornerX = clPixelMathFloorf(idealR);
-    float firstCornerY = clPixelMathFloorf(idealG);
-    float firstCornerZ = clPixelMathFloorf(idealB);
-    firstCornerX = CL_CLAMP(firstCornerX, 0, haldDims - 2);
-    firstCornerY = CL_CLAMP(firstCornerY, 0, haldDims - 2);
-    firstCornerZ = CL_CLAMP(firstCornerZ, 0, haldDims - 2);
-
-    float distSquared[8];
-    int dist0Index = -1; // Index containing a distance of 0, if any
-    for (int z = 0; z < 2; ++z) {
-        for (int y = 0; y < 2; ++y) {
-            for (int x = 0; x < 2; ++x) {
-                float dx = (firstCornerX + x) - idealR;
-                float dy = (firstCornerY + y) - idealG;
-                float dz = (firstCornerZ + z) - idealB;
-                float dsq = (dx * dx) + (dy * dy) + (dz * dz);
-
-                distSquared[I(x, y, z)] = dsq;
-                if (dsq < MIN_DISTANCE) {
-                    dist0Index = I(x, y, z);
-                }
-            }
+static void lutLocate(const clHaldLUT * lut, const float src[4], clLUTCell * cell)
+{
+    const int maxCorner = lut->dims - 2;
+    const float scale = (float)(lut->dims - 1);
+    int corner[3];
+    for (int c = 0; c < 3; ++c) {
+        float ideal = CL_CLAMP(src[c], 0.0f, 1.0f) * scale;
+        if (!(ideal >= 0.0f)) {
+            ideal = 0.0f; // NaN
         }
+        corner[c] = CL_MIN((int)ideal, maxCorner);
+        cell->f[c] = ideal - (float)corner[c];
     }
+    cell->base = ((size_t)corner[0] + ((size_t)corner[1] * lut->dims) + ((size_t)corner[2] * lut->dims * lut->dims)) * 4;
+}
+
+#if defined(CL_LUT_SSE2)
+typedef __m128 clLUTVec;
+#define clLUTVecLoad(P) _mm_loadu_ps(P)
+#define clLUTVecStore(P, V) _mm_storeu_ps(P, V)
+#define clLUTVecMulAdd(SUM, V, W) _mm_add_ps(SUM, _mm_mul_ps(V, _mm_set1_ps(W)))
+#define clLUTVecScale(V, W) _mm_mul_ps(V, _mm_set1_ps(W))
+#define clLUTVecLerp(A, B, T) _mm_add_ps(A, _mm_mul_ps(_mm_sub_ps(B, A), _mm_set1_ps(T)))
+#elif defined(CL_LUT_NEON)
+typedef float32x4_t clLUTVec;
+#define clLUTVecLoad(P) vld1q_f32(P)
+#define clLUTVecStore(P, V) vst1q_f32(P, V)
+#define clLUTVecMulAdd(SUM, V, W) vmlaq_n_f32(SUM, V, W)
+#define clLUTVecScale(V, W) vmulq_n_f32(V, W)
+#define clLUTVecLerp(A, B, T) vmlaq_n_f32(A, vsubq_f32(B, A), T)
+#else
+typedef struct clLUTVec
+{
+    float v[4];
+} clLUTVec;
 
-    float weights[8];
-    float idwDivisor;
-    if (dist0Index == -1) {
-        // No color with a distance of 0 found, use IDW
-        idwDivisor = 0.0f;
-        for (int i = 0; i < 8; ++i) {
-            weights[i] = 1.0f / distSquared[i];
-            idwDivisor += weights[i];
+static clLUTVec clLUTVecLoad(const float * p)
+{
+    clLUTVec r;
+    memcpy(r.v, p, sizeof(r.v));
+    return r;
+}
+static clLUTVec clLUTVecMulAdd(clLUTVec sum, clLUTVec v, float w)
+{
+    for (int c = 0; c < 4; ++c) {
+        sum.v[c] += v.v[c] * w;
+    }
+    return sum;
+}
+static clLUTVec clLUTVecScale(clLUTVec v, float w)
+{
+    for (int c = 0; c < 4; ++c) {
+        v.v[c] *= w;
+    }
+    return v;
+}
+static clLUTVec clLUTVecLerp(clLUTVec a, clLUTVec b, float t)
+{
+    for (int c = 0; c < 4; ++c) {
+        a.v[c] += (b.v[c] - a.v[c]) * t;
+    }
+    return a;
+}
+static void clLUTVecStore(float * p, clLUTVec v)
+{
+    memcpy(p, v.v, sizeof(v.v));
+}
+#endif
+
+// Splits the cell into six tetrahedra along its black-white diagonal and blends the four corners of the one holding
+// the pixel: 4 lattice reads instead of trilinear's 8, and neutral inputs only ever read the neutral axis
+static void lutTetrahedral(const clHaldLUT * lut, const float * src, float * dst, int pixelCount)
+{
+    const size_t strides[3] = { 4, (size_t)lut->dims * 4, (size_t)lut->dims * lut->dims * 4 };
+    for (int i = 0; i < pixelCount; ++i, src += 4, dst += 4) {
+        clLUTCell cell;
+        lutLocate(lut, src, &cell);
+
+        // Order the axes by how far along them the pixel is; the tetrahedron walks them in that order
+        int a = 0, b = 1, c = 2, t;
+        if (cell.f[a] < cell.f[b]) {
+            t = a, a = b, b = t;
         }
-    } else {
-        // Give all of the weight to one color, skip IDW
-        for (int i = 0; i < 8; ++i) {
-            weights[i] = 0.0f;
+        if (cell.f[b] < cell.f[c]) {
+            t = b, b = c, c = t;
+        }
+        if (cell.f[a] < cell.f[b]) {
+            t = a, a = b, b = t;
         }
-        weights[dist0Index] = 1.0f;
-        idwDivisor = 1.0f; // Unused
+
+        const float * p0 = &lut->cube[cell.base];
+        const float * p1 = p0 + strides[a];
+        const float * p2 = p1 + strides[b];
+        const float * p3 = p2 + strides[c];
+        const float alpha = src[3];
+        clLUTVec sum = clLUTVecScale(clLUTVecLoad(p0), 1.0f - cell.f[a]);
+        sum = clLUTVecMulAdd(sum, clLUTVecLoad(p1), cell.f[a] - cell.f[b]);
+        sum = clLUTVecMulAdd(sum, clLUTVecLoad(p2), cell.f[b] - cell.f[c]);
+        sum = clLUTVecMulAdd(sum, clLUTVecLoad(p3), cell.f[c]);
+        clLUTVecStore(dst, sum);
+        dst[3] = alpha;
     }
+}
 
-    dst[0] = 0.0f;
-    dst[1] = 0.0f;
-    dst[2] = 0.0f;
-    for (int z = 0; z < 2; ++z) {
-        for (int y = 0; y < 2; ++y) {
-            for (int x = 0; x < 2; ++x) {
-                int index = ((int)firstCornerX + x) + (((int)firstCornerY + y) * haldDims) +
-                            (((int)firstCornerZ + z) * haldDims * haldDims);
-                float * lookup = &haldData[index * 4];
-                float weight = weights[I(x, y, z)];
-                dst[0] += lookup[0] * weight;
-                dst[1] += lookup[1] * weight;
-                dst[2] += lookup[2] * weight;
-            }
-        }
+static void lutTrilinear(const clHaldLUT * lut, const float * src, float * dst, int pixelCount)
+{
+    const size_t strideG = (size_t)lut->dims * 4;
+    const size_t strideB = strideG * lut->dims;
+    for (int i = 0; i < pixelCount; ++i, src += 4, dst += 4) {
+        clLUTCell cell;
+        lutLocate(lut, src, &cell);
+
+        const float * p = &lut->cube[cell.base];
+        const float alpha = src[3];
+        clLUTVec c00 = clLUTVecLerp(clLUTVecLoad(p), clLUTVecLoad(p + 4), cell.f[0]);
+        clLUTVec c10 = clLUTVecLerp(clLUTVecLoad(p + strideG), clLUTVecLoad(p + strideG + 4), cell.f[0]);
+        clLUTVec c01 = clLUTVecLerp(clLUTVecLoad(p + strideB), clLUTVecLoad(p + strideB + 4), cell.f[0]);
+        clLUTVec c11 = clLUTVecLerp(clLUTVecLoad(p + strideB + strideG), clLUTVecLoad(p + strideB + strideG + 4), cell.f[0]);
+        clLUTVec c0 = clLUTVecLerp(c00, c10, cell.f[1]);
+        clLUTVec c1 = clLUTVecLerp(c01, c11, cell.f[1]);
+        clLUTVecStore(dst, clLUTVecLerp(c0, c1, cell.f[2]));
+        dst[3] = alpha;
     }
-    dst[0] /= idwDivisor;
-    dst[1] /= idwDivisor;
-    dst[2] /= idwDivisor;
+}
 
-    // Copy alpha directly
-    dst[3] = src[3];
+void clPixelMathHaldLUTApply(struct clContext * C,
+                             const clHaldLUT * lut,
+                             const float * srcPixels,
+                             float * dstPixels,
+                             int pixelCount)
+{
+    COLORIST_UNUSED(C);
+
+    if (lut->interpolation == CL_HALD_TRILINEAR) {
+        lutTrilinear(lut, srcPixels, dstPixels, pixelCount);
+    } else {
+        lutTetrahedral(lut, srcPixels, dstPixels, pixelCount);
+    }
 }
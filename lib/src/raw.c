@@ -13,8 +13,16 @@
 
 #include <stdarg.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
 void clRawRealloc(struct clContext * C, clRaw * raw, size_t newSize)
 {
     if (raw->size != newSize) {
@@ -238,3 +246,91 @@ int clFileSize(const char * filename)
     fclose(f);
     return (int)bytes;
 }
+
+static int compareFilenames(const void * p, const void * q)
+{
+    return strcmp(*(char * const *)p, *(char * const *)q);
+}
+
+static void fileListAppend(struct clContext * C, clFileList * fileList, int * capacity, const char * dirName, const char * name)
+{
+    if (fileList->count == *capacity) {
+        int newCapacity = (*capacity) ? (*capacity * 2) : 16;
+        char ** filenames = clAllocate(sizeof(char *) * newCapacity);
+        if (fileList->count) {
+            memcpy(filenames, fileList->filenames, sizeof(char *) * fileList->count);
+        }
+        clFree(fileList->filenames);
+        fileList->filenames = filenames;
+        *capacity = newCapacity;
+    }
+
+    size_t dirLen = strlen(dirName);
+    size_t nameLen = strlen(name);
+    char * filename = clAllocate(dirLen + nameLen + 2);
+    memcpy(filename, dirName, dirLen);
+    filename[dirLen] = '/';
+    memcpy(filename + dirLen + 1, name, nameLen + 1);
+    fileList->filenames[fileList->count++] = filename;
+}
+
+clFileList * clFileListCreate(struct clContext * C, const char * dirName)
+{
+    clFileList * fileList = NULL;
+    int capacity = 0;
+
+#ifdef _WIN32
+    size_t dirLen = strlen(dirName);
+    char * pattern = clAllocate(dirLen + 3);
+    memcpy(pattern, dirName, dirLen);
+    memcpy(pattern + dirLen, "/*", 3);
+    WIN32_FIND_DATAA findData;
+    HANDLE find = FindFirstFileA(pattern, &findData);
+    clFree(pattern);
+    if (find == INVALID_HANDLE_VALUE) {
+        return NULL;
+    }
+    fileList = clAllocateStruct(clFileList);
+    memset(fileList, 0, sizeof(clFileList));
+    do {
+        if (!(findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) {
+            fileListAppend(C, fileList, &capacity, dirName, findData.cFileName);
+        }
+    } while (FindNextFileA(find, &findData));
+    FindClose(find);
+#else
+    DIR * dir = opendir(dirName);
+    if (!dir) {
+        return NULL;
+    }
+    fileList = clAllocateStruct(clFileList);
+    memset(fileList, 0, sizeof(clFileList));
+    struct dirent * entry;
+    while ((entry = readdir(dir)) != NULL) {
+        fileListAppend(C, fileList, &capacity, dirName, entry->d_name);
+
+        // Only keep regular files
+        struct stat st;
+        char * filename = fileList->filenames[fileList->count - 1];
+        if ((stat(filename, &st) != 0) || !S_ISREG(st.st_mode)) {
+            clFree(filename);
+            --fileList->count;
+        }
+    }
+    closedir(dir);
+#endif
+
+    if (fileList->count > 1) {
+        qsort(fileList->filenames, fileList->count, sizeof(char *), compareFilenames);
+    }
+    return fileList;
+}
+
+void clFileListDestroy(struct clContext * C, clFileList * fileList)
+{
+    for (int i = 0; i < fileList->count; ++i) {
+        clFree(fileList->filenames[i]);
+    }
+    clFree(fileList->filenames);
+    clFree(fileList);
+}
@@ -9,8 +9,58 @@
 
 #include "colorist/context.h"
 
+#include <stdio.h>
+#include <string.h>
+
+// Each participant in a job aims for this many blocks, so that anybody who finishes early has something to steal
+#define CL_TASK_BLOCKS_PER_PARTICIPANT 8
+
+// A participant's run of blocks, [front, back). The owner takes from the front, thieves take from the back.
+typedef struct clTaskDeque
+{
+    int front;
+    int back;
+} clTaskDeque;
+
+typedef struct clTaskWorker
+{
+    struct clTaskPool * pool;
+    int participant;
+} clTaskWorker;
+
+typedef struct clTaskPool
+{
+    int workerCount; // Threads owned by the pool; the thread calling clTaskParallelFor() also works
+    clTask ** workers;
+    clTaskWorker * workerInfos;
+    void * nativeData;
+
+    // Current job, all protected by the pool's lock. Participant 0 is the calling thread, workers are 1..workerCount.
+    clTaskRangeFunc func;
+    void * userData;
+    int itemCount;
+    int blockSize;
+    int blocksRemaining;
+    clTaskDeque * deques;
+    uint32_t generation; // Bumped every time a new job is posted
+    clBool busy;
+    clBool shutdown;
+
+    // Accumulated across jobs until clTaskLogBusyTime(), also protected by the lock
+    double * busySeconds; // Per participant, time spent inside func
+    int stealCount;
+} clTaskPool;
+
 static void nativeTaskStart(clContext * C, clTask * task);
 static void nativeTaskJoin(clContext * C, clTask * task);
+static void nativePoolCreate(clContext * C, clTaskPool * pool);
+static void nativePoolDestroy(clContext * C, clTaskPool * pool);
+static void nativePoolLock(clTaskPool * pool);
+static void nativePoolUnlock(clTaskPool * pool);
+static void nativePoolWaitForWork(clTaskPool * pool);
+static void nativePoolSignalWork(clTaskPool * pool);
+static void nativePoolWaitForDone(clTaskPool * pool);
+static void nativePoolSignalDone(clTaskPool * pool);
 
 clTask * clTaskCreate(struct clContext * C, clTaskFunc func, void * userData)
 {
@@ -39,6 +89,215 @@ void clTaskDestroy(struct clContext * C, clTask * task)
     clFree(task);
 }
 
+// ----------------------------------------------------------------------------
+// Persistent worker pool
+
+// Returns the next block for participant to run, or -1 if every deque is empty. Must be called with the pool locked.
+static int poolNextBlock(clTaskPool * pool, int participant)
+{
+    clTaskDeque * own = &pool->deques[participant];
+    if (own->front < own->back) {
+        return own->front++;
+    }
+
+    // Steal from the back of whoever has the most left, which is the work its owner would get to last
+    clTaskDeque * victim = NULL;
+    for (int i = 0; i <= pool->workerCount; ++i) {
+        clTaskDeque * deque = &pool->deques[i];
+        if ((deque->front < deque->back) && (!victim || ((deque->back - deque->front) > (victim->back - victim->front)))) {
+            victim = deque;
+        }
+    }
+    if (!victim) {
+        return -1;
+    }
+    ++pool->stealCount;
+    return --victim->back;
+}
+
+// Must be called with the pool locked; returns with the pool locked.
+static void poolRunBlocks(clTaskPool * pool, int participant)
+{
+    int block;
+    while ((block = poolNextBlock(pool, participant)) >= 0) {
+        int firstItem = block * pool->blockSize;
+        int itemCount = CL_MIN(pool->blockSize, pool->itemCount - firstItem);
+        clTaskRangeFunc func = pool->func;
+        void * userData = pool->userData;
+
+        nativePoolUnlock(pool);
+        Timer t;
+        timerStart(&t);
+        func(userData, firstItem, itemCount);
+        double elapsed = timerElapsedSeconds(&t);
+        nativePoolLock(pool);
+
+        pool->busySeconds[participant] += elapsed;
+        if (--pool->blocksRemaining == 0) {
+            nativePoolSignalDone(pool);
+        }
+    }
+}
+
+static void poolWorkerFunc(clTaskWorker * worker)
+{
+    clTaskPool * pool = worker->pool;
+    uint32_t seenGeneration = 0;
+
+    nativePoolLock(pool);
+    for (;;) {
+        while (!pool->shutdown && (pool->generation == seenGeneration)) {
+            nativePoolWaitForWork(pool);
+        }
+        if (pool->shutdown) {
+            break;
+        }
+        seenGeneration = pool->generation;
+        poolRunBlocks(pool, worker->participant);
+    }
+    nativePoolUnlock(pool);
+}
+
+static clTaskPool * clTaskPoolCreate(struct clContext * C, int workerCount)
+{
+    clTaskPool * pool = clAllocateStruct(clTaskPool);
+    memset(pool, 0, sizeof(clTaskPool));
+    pool->workerCount = workerCount;
+    nativePoolCreate(C, pool);
+
+    pool->deques = clAllocate(sizeof(clTaskDeque) * (workerCount + 1));
+    memset(pool->deques, 0, sizeof(clTaskDeque) * (workerCount + 1));
+    pool->busySeconds = clAllocate(sizeof(double) * (workerCount + 1));
+    memset(pool->busySeconds, 0, sizeof(double) * (workerCount + 1));
+
+    pool->workers = clAllocate(sizeof(clTask *) * workerCount);
+    pool->workerInfos = clAllocate(sizeof(clTaskWorker) * workerCount);
+    for (int i = 0; i < workerCount; ++i) {
+        pool->workerInfos[i].pool = pool;
+        pool->workerInfos[i].participant = i + 1;
+        pool->workers[i] = clTaskCreate(C, (clTaskFunc)poolWorkerFunc, &pool->workerInfos[i]);
+    }
+    return pool;
+}
+
+void clTaskPoolDestroy(struct clContext * C, struct clTaskPool * pool)
+{
+    if (!pool) {
+        return;
+    }
+
+    nativePoolLock(pool);
+    pool->shutdown = clTrue;
+    nativePoolSignalWork(pool);
+    nativePoolUnlock(pool);
+
+    for (int i = 0; i < pool->workerCount; ++i) {
+        clTaskDestroy(C, pool->workers[i]);
+    }
+    clFree(pool->workers);
+    clFree(pool->workerInfos);
+    clFree(pool->deques);
+    clFree(pool->busySeconds);
+    nativePoolDestroy(C, pool);
+    clFree(pool);
+}
+
+void clTaskParallelFor(struct clContext * C, int itemCount, int minItemsPerRange, clTaskRangeFunc func, void * userData)
+{
+    if (itemCount <= 0) {
+        return;
+    }
+    if (minItemsPerRange < 1) {
+        minItemsPerRange = 1;
+    }
+
+    int rangeCount = CL_MIN(C->jobs, (itemCount + minItemsPerRange - 1) / minItemsPerRange);
+    if (rangeCount <= 1) {
+        // Not worth waking anybody up
+        func(userData, 0, itemCount);
+        return;
+    }
+
+    clTaskPool * pool = C->taskPool;
+    if (pool) {
+        nativePoolLock(pool);
+        clBool busy = pool->busy;
+        nativePoolUnlock(pool);
+        if (busy) {
+            // Nested parallel-for from inside a worker; just do the work here
+            func(userData, 0, itemCount);
+            return;
+        }
+        if (pool->workerCount != (C->jobs - 1)) {
+            // C->jobs changed since the pool was created (clContextParseArgs(), etc)
+            clTaskPoolDestroy(C, pool);
+            pool = NULL;
+            C->taskPool = NULL;
+        }
+    }
+    if (!pool) {
+        pool = clTaskPoolCreate(C, C->jobs - 1);
+        C->taskPool = pool;
+    }
+
+    // Fixed-size blocks, dealt out to the participants in contiguous runs so that neighboring blocks usually stay on
+    // one thread
+    int participantCount = pool->workerCount + 1;
+    int targetBlockCount = participantCount * CL_TASK_BLOCKS_PER_PARTICIPANT;
+    int blockSize = CL_MAX(minItemsPerRange, (itemCount + targetBlockCount - 1) / targetBlockCount);
+    int blockCount = (itemCount + blockSize - 1) / blockSize;
+
+    nativePoolLock(pool);
+    pool->func = func;
+    pool->userData = userData;
+    pool->itemCount = itemCount;
+    pool->blockSize = blockSize;
+    pool->blocksRemaining = blockCount;
+    for (int i = 0; i < participantCount; ++i) {
+        pool->deques[i].front = (int)(((int64_t)blockCount * i) / participantCount);
+        pool->deques[i].back = (int)(((int64_t)blockCount * (i + 1)) / participantCount);
+    }
+    pool->busy = clTrue;
+    ++pool->generation;
+    nativePoolSignalWork(pool);
+
+    poolRunBlocks(pool, 0);
+    while (pool->blocksRemaining > 0) {
+        nativePoolWaitForDone(pool);
+    }
+
+    pool->func = NULL;
+    pool->userData = NULL;
+    pool->busy = clFalse;
+    nativePoolUnlock(pool);
+}
+
+void clTaskLogBusyTime(struct clContext * C)
+{
+    clTaskPool * pool = C->taskPool;
+    if (!pool) {
+        return;
+    }
+
+    // Every participant (the caller and each worker) gets its own " %.3f", which is far shorter than this
+    static const int maxEntryLen = 32;
+    int participantCount = pool->workerCount + 1;
+    char * text = clAllocate((size_t)participantCount * maxEntryLen + 1);
+    int textLen = 0;
+    text[0] = 0;
+    nativePoolLock(pool);
+    for (int i = 0; i < participantCount; ++i) {
+        textLen += snprintf(&text[textLen], maxEntryLen, " %.3f", pool->busySeconds[i]);
+        pool->busySeconds[i] = 0.0;
+    }
+    int stealCount = pool->stealCount;
+    pool->stealCount = 0;
+    nativePoolUnlock(pool);
+
+    clContextLog(C, "timing", 0, "Thread busy time (sec):%s (%d blocks stolen)", text, stealCount);
+    clFree(text);
+}
+
 #ifdef _WIN32
 
 #pragma warning(disable : 5031)
@@ -83,6 +342,60 @@ static void nativeTaskJoin(clContext * C, clTask * task)
     task->nativeData = NULL;
 }
 
+typedef struct clNativeTaskPool
+{
+    SRWLOCK lock;
+    CONDITION_VARIABLE workCond;
+    CONDITION_VARIABLE doneCond;
+} clNativeTaskPool;
+
+static void nativePoolCreate(clContext * C, clTaskPool * pool)
+{
+    clNativeTaskPool * nativePool = clAllocateStruct(clNativeTaskPool);
+    InitializeSRWLock(&nativePool->lock);
+    InitializeConditionVariable(&nativePool->workCond);
+    InitializeConditionVariable(&nativePool->doneCond);
+    pool->nativeData = nativePool;
+}
+
+static void nativePoolDestroy(clContext * C, clTaskPool * pool)
+{
+    clFree(pool->nativeData);
+    pool->nativeData = NULL;
+}
+
+static void nativePoolLock(clTaskPool * pool)
+{
+    AcquireSRWLockExclusive(&((clNativeTaskPool *)pool->nativeData)->lock);
+}
+
+static void nativePoolUnlock(clTaskPool * pool)
+{
+    ReleaseSRWLockExclusive(&((clNativeTaskPool *)pool->nativeData)->lock);
+}
+
+static void nativePoolWaitForWork(clTaskPool * pool)
+{
+    clNativeTaskPool * nativePool = (clNativeTaskPool *)pool->nativeData;
+    SleepConditionVariableSRW(&nativePool->workCond, &nativePool->lock, INFINITE, 0);
+}
+
+static void nativePoolSignalWork(clTaskPool * pool)
+{
+    WakeAllConditionVariable(&((clNativeTaskPool *)pool->nativeData)->workCond);
+}
+
+static void nativePoolWaitForDone(clTaskPool * pool)
+{
+    clNativeTaskPool * nativePool = (clNativeTaskPool *)pool->nativeData;
+    SleepConditionVariableSRW(&nativePool->doneCond, &nativePool->lock, INFINITE, 0);
+}
+
+static void nativePoolSignalDone(clTaskPool * pool)
+{
+    WakeAllConditionVariable(&((clNativeTaskPool *)pool->nativeData)->doneCond);
+}
+
 #else /* ifdef _WIN32 */
 
 #ifdef __APPLE__
@@ -154,4 +467,62 @@ static void nativeTaskJoin(clContext * C, clTask * task)
     task->nativeData = NULL;
 }
 
+typedef struct clNativeTaskPool
+{
+    pthread_mutex_t mutex;
+    pthread_cond_t workCond;
+    pthread_cond_t doneCond;
+} clNativeTaskPool;
+
+static void nativePoolCreate(clContext * C, clTaskPool * pool)
+{
+    clNativeTaskPool * nativePool = clAllocateStruct(clNativeTaskPool);
+    pthread_mutex_init(&nativePool->mutex, NULL);
+    pthread_cond_init(&nativePool->workCond, NULL);
+    pthread_cond_init(&nativePool->doneCond, NULL);
+    pool->nativeData = nativePool;
+}
+
+static void nativePoolDestroy(clContext * C, clTaskPool * pool)
+{
+    clNativeTaskPool * nativePool = (clNativeTaskPool *)pool->nativeData;
+    pthread_cond_destroy(&nativePool->doneCond);
+    pthread_cond_destroy(&nativePool->workCond);
+    pthread_mutex_destroy(&nativePool->mutex);
+    clFree(pool->nativeData);
+    pool->nativeData = NULL;
+}
+
+static void nativePoolLock(clTaskPool * pool)
+{
+    pthread_mutex_lock(&((clNativeTaskPool *)pool->nativeData)->mutex);
+}
+
+static void nativePoolUnlock(clTaskPool * pool)
+{
+    pthread_mutex_unlock(&((clNativeTaskPool *)pool->nativeData)->mutex);
+}
+
+static void nativePoolWaitForWork(clTaskPool * pool)
+{
+    clNativeTaskPool * nativePool = (clNativeTaskPool *)pool->nativeData;
+    pthread_cond_wait(&nativePool->workCond, &nativePool->mutex);
+}
+
+static void nativePoolSignalWork(clTaskPool * pool)
+{
+    pthread_cond_broadcast(&((clNativeTaskPool *)pool->nativeData)->workCond);
+}
+
+static void nativePoolWaitForDone(clTaskPool * pool)
+{
+    clNativeTaskPool * nativePool = (clNativeTaskPool *)pool->nativeData;
+    pthread_cond_wait(&nativePool->doneCond, &nativePool->mutex);
+}
+
+static void nativePoolSignalDone(clTaskPool * pool)
+{
+    pthread_cond_broadcast(&((clNativeTaskPool *)pool->nativeData)->doneCond);
+}
+
 #endif /* ifdef _WIN32 */
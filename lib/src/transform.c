@@ -10,6 +10,16 @@
 #include <math.h>
 #include <string.h>
 
+// SSE2 and (AArch64) NEON are part of their architectures' baselines, so the CCMM batch kernel can
+// use them unconditionally without any runtime CPU detection. Everything else uses the scalar loops.
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#include <emmintrin.h>
+#define CL_CCMM_SSE2
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define CL_CCMM_NEON
+#endif
+
 // The small amount after the 1.0 here buys us  a little imprecision wiggle
 // room on an automatic tonemap. (It's ok to clip if our luminance scale is
 // this close.)
@@ -20,6 +30,14 @@
 
 static cmsUInt32Number clTransformFormatToLCMSFormat(struct clContext * C, clTransformFormat format);
 static int clTransformFormatToChannelCount(struct clContext * C, clTransformFormat format);
+static int clTransformFormatToPixelBytes(struct clContext * C, clTransformFormat format);
+static clBool clTransformFormatIsInteger(struct clContext * C, clTransformFormat format);
+static uint32_t clTransformFormatMaxChannel(struct clContext * C, clTransformFormat format, int depth);
+
+typedef float (*ccmmCurveFunc)(struct clTransform * transform, float v);
+static float ccmmEOTF(struct clTransform * transform, float v);
+static float ccmmOETF(struct clTransform * transform, float v);
+static float * ccmmCreateCurveTable(struct clContext * C, struct clTransform * transform, ccmmCurveFunc func);
 
 // ----------------------------------------------------------------------------
 // Debug Helpers
@@ -81,7 +99,14 @@ static const float HLG_B = 0.28466892f;    // 1.0f - (4.0f * HLG_A);
 static const float HLG_C = 0.55991072953f; // 0.5f - HLG_A * logf(4.0f * HLG_A);
 static const float HLG_ONE_TWELFTH = 1.0f / 12.0f;
 
-static float HLG_EOTF(float N, float maxLuminance)
+// The HLG OOTF exponent (system gamma) for a given peak luminance
+static float HLG_OOTFExponent(float maxLuminance)
+{
+    return 1.2f + (0.42f * log10f(maxLuminance / 1000.0f));
+}
+
+// ootfExponent is HLG_OOTFExponent(maxLuminance), which is calculated once in clTransformPrepare()
+static float HLG_EOTF(float N, float ootfExponent)
 {
     float L;
     if (N < 0.5f) {
@@ -91,15 +116,13 @@ static float HLG_EOTF(float N, float maxLuminance)
     }
 
     // This includes the HLG OOTF here
-    float exponent = 1.2f + (0.42f * log10f(maxLuminance / 1000.0f));
-    return powf(L, exponent);
+    return powf(L, ootfExponent);
 }
 
-static float HLG_OETF(float L, float maxLuminance)
+static float HLG_OETF(float L, float ootfExponent)
 {
     // This includes the HLG OOTF here
-    float exponent = 1.2f + (0.42f * log10f(maxLuminance / 1000.0f));
-    float N = powf(L, 1.0f / exponent);
+    float N = powf(L, 1.0f / ootfExponent);
 
     if (N <= HLG_ONE_TWELFTH) {
         return sqrtf(3.0f * N);
@@ -110,7 +133,7 @@ static float HLG_OETF(float L, float maxLuminance)
 static float hlgDiffuseWhite(float peakWhite)
 {
     float base = (expf((0.75f - HLG_C) / HLG_A) + HLG_B) / 12.0f;
-    float exponent = 1.2f + (0.42f * log10f(peakWhite / 1000.0f));
+    float exponent = HLG_OOTFExponent(peakWhite);
     return peakWhite * powf(base, exponent);
 }
 
@@ -179,6 +202,14 @@ void clTransformDeriveXYZMatrix(struct clContext * C, clProfilePrimaries * prima
     DEBUG_PRINT_MATRIX("Cxr", toXYZ);
 }
 
+void clTransformDeriveFromXYZMatrix(struct clContext * C, clProfilePrimaries * primaries, gbMat3 * fromXYZ)
+{
+    gbMat3 toXYZ;
+    clTransformDeriveXYZMatrix(C, primaries, &toXYZ);
+    gb_mat3_inverse(fromXYZ, &toXYZ);
+    gb_mat3_transpose(fromXYZ);
+}
+
 static clBool derivePrimariesAndXTF(struct clContext * C,
                                     struct clProfile * profile,
                                     clProfilePrimaries * outPrimaries,
@@ -239,6 +270,9 @@ void clTransformPrepare(struct clContext * C, struct clTransform * transform)
                     srcUsesHLGScaling = clTrue;
                 }
             }
+            if (srcCurve.type == CL_PCT_HLG) {
+                transform->ccmmHLGLuminance = (float)srcLuminance;
+            }
             transform->srcLuminanceScale = (float)srcLuminance;
             transform->srcCurveScale = srcCurve.implicitScale;
             transform->whitePointX = srcPrimaries.white[0];
@@ -261,6 +295,9 @@ void clTransformPrepare(struct clContext * C, struct clTransform * transform)
                     dstUsesHLGScaling = clTrue;
                 }
             }
+            if (dstCurve.type == CL_PCT_HLG) {
+                transform->ccmmHLGLuminance = (float)dstLuminance;
+            }
             transform->dstLuminanceScale = (float)dstLuminance;
             transform->dstCurveScale = dstCurve.implicitScale;
             transform->whitePointX = dstPrimaries.white[0];
@@ -321,12 +358,27 @@ void clTransformPrepare(struct clContext * C, struct clTransform * transform)
             derivePrimariesAndXTF(C, transform->srcProfile, &srcPrimaries, &transform->ccmmSrcEOTF, &transform->ccmmSrcGamma);
             derivePrimariesAndXTF(C, transform->dstProfile, &dstPrimaries, &transform->ccmmDstOETF, &transform->ccmmDstInvGamma);
 
-            if (clProfilePrimariesMatch(C, &srcPrimaries, &dstPrimaries)) {
+            clBool primariesMatch = clProfilePrimariesMatch(C, &srcPrimaries, &dstPrimaries);
+            if (primariesMatch) {
                 // if the src/dst primaries are close enough, make them match exactly to help roundtripping
                 // by making the SrcToXYZ and XYZtoDst matrices as close to true inverses of one another as possible.
                 memcpy(&srcPrimaries, &dstPrimaries, sizeof(srcPrimaries));
             }
 
+            // Without luminance scaling, nothing happens in XYZ, so the two matrices can be combined (or skipped entirely
+            // if the primaries match), and if the curves match as well then this is just a re-tag
+            transform->ccmmKernel = CL_XK_FULL;
+            if (!transform->luminanceScaleEnabled) {
+                if (!primariesMatch) {
+                    transform->ccmmKernel = CL_XK_MATRIX;
+                } else if ((transform->ccmmSrcEOTF == transform->ccmmDstOETF) &&
+                           (transform->ccmmSrcGamma == transform->ccmmDstInvGamma)) {
+                    transform->ccmmKernel = CL_XK_IDENTITY;
+                } else {
+                    transform->ccmmKernel = CL_XK_CURVE;
+                }
+            }
+
             if (transform->srcProfile) {
                 clTransformDeriveXYZMatrix(C, &srcPrimaries, &transform->ccmmSrcToXYZ);
             } else {
@@ -349,6 +401,25 @@ void clTransformPrepare(struct clContext * C, struct clTransform * transform)
             gb_mat3_mul(&transform->ccmmCombined, &transform->ccmmSrcToXYZ, &transform->ccmmXYZToDst);
             DEBUG_PRINT_MATRIX("MA*MB", &transform->ccmmCombined);
 
+            transform->ccmmHLGExponent = HLG_OOTFExponent(transform->ccmmHLGLuminance);
+            if (C->ccmmFastCurves) {
+                if (transform->ccmmSrcEOTF != CL_XTF_NONE) {
+                    transform->ccmmSrcEOTFTable = ccmmCreateCurveTable(C, transform, ccmmEOTF);
+                }
+                if (transform->ccmmDstOETF != CL_XTF_NONE) {
+                    transform->ccmmDstOETFTable = ccmmCreateCurveTable(C, transform, ccmmOETF);
+                }
+            }
+            if (clTransformFormatIsInteger(C, transform->srcFormat)) {
+                // Every possible src value, decoded exactly
+                uint32_t maxChannel = clTransformFormatMaxChannel(C, transform->srcFormat, transform->srcDepth);
+                float maxChannelf = (float)maxChannel;
+                transform->ccmmSrcIntegerTable = clAllocate(sizeof(float) * (maxChannel + 1));
+                for (uint32_t i = 0; i <= maxChannel; ++i) {
+                    transform->ccmmSrcIntegerTable[i] = ccmmEOTF(transform, i / maxChannelf);
+                }
+            }
+
             transform->ccmmReady = clTrue;
         }
     } else {
@@ -375,186 +446,719 @@ void clTransformPrepare(struct clContext * C, struct clTransform * transform)
                 dstProfileHandle = transform->lcmsXYZProfile;
             }
 
-            transform->lcmsSrcToXYZ = cmsCreateTransformTHR(C->lcms,
-                                                            srcProfileHandle,
-                                                            srcFormat,
-                                                            transform->lcmsXYZProfile,
-                                                            TYPE_XYZ_FLT,
-                                                            INTENT_ABSOLUTE_COLORIMETRIC,
-                                                            cmsFLAGS_COPY_ALPHA | cmsFLAGS_NOOPTIMIZE);
+            // When the luminance scale between the two halves would be a no-op, go straight from src to dst
+            if (!transform->tonemapEnabled && (fabsf(transform->srcLuminanceScale - transform->dstLuminanceScale) < 0.00001f)) {
+                transform->lcmsCombined = cmsCreateTransformTHR(C->lcms,
+                                                                srcProfileHandle,
+                                                                srcFormat,
+                                                                dstProfileHandle,
+                                                                dstFormat,
+                                                                INTENT_ABSOLUTE_COLORIMETRIC,
+                                                                cmsFLAGS_COPY_ALPHA | cmsFLAGS_NOOPTIMIZE);
+            }
 
-            transform->lcmsXYZToDst = cmsCreateTransformTHR(C->lcms,
-                                                            transform->lcmsXYZProfile,
-                                                            TYPE_XYZ_FLT,
-                                                            dstProfileHandle,
-                                                            dstFormat,
-                                                            INTENT_ABSOLUTE_COLORIMETRIC,
-                                                            cmsFLAGS_COPY_ALPHA | cmsFLAGS_NOOPTIMIZE);
+            if (!transform->lcmsCombined) {
+                transform->lcmsSrcToXYZ = cmsCreateTransformTHR(C->lcms,
+                                                                srcProfileHandle,
+                                                                srcFormat,
+                                                                transform->lcmsXYZProfile,
+                                                                TYPE_XYZ_FLT,
+                                                                INTENT_ABSOLUTE_COLORIMETRIC,
+                                                                cmsFLAGS_COPY_ALPHA | cmsFLAGS_NOOPTIMIZE);
+
+                transform->lcmsXYZToDst = cmsCreateTransformTHR(C->lcms,
+                                                                transform->lcmsXYZProfile,
+                                                                TYPE_XYZ_FLT,
+                                                                dstProfileHandle,
+                                                                dstFormat,
+                                                                INTENT_ABSOLUTE_COLORIMETRIC,
+                                                                cmsFLAGS_COPY_ALPHA | cmsFLAGS_NOOPTIMIZE);
+            }
 
             transform->lcmsReady = clTrue;
         }
     }
 }
 
-// The real color conversion function
-static void colorConvert(struct clContext * C,
-                         struct clTransform * transform,
-                         clBool useCCMM,
-                         float * srcPixels,
-                         int srcChannelCount,
-                         float * dstPixels,
-                         int dstChannelCount,
-                         int pixelCount)
+// ----------------------------------------------------------------------------
+// Ordered dithering
+
+// Where a run of pixels sits in its image, so integer output can be dithered by position
+typedef struct clTransformDither
+{
+    int width;
+    int firstRow;
+} clTransformDither;
+
+static const uint8_t bayer8x8[8][8] = {
+    { 0, 32, 8, 40, 2, 34, 10, 42 },  { 48, 16, 56, 24, 50, 18, 58, 26 }, { 12, 44, 4, 36, 14, 46, 6, 38 },
+    { 60, 28, 52, 20, 62, 30, 54, 22 }, { 3, 35, 11, 43, 1, 33, 9, 41 },  { 51, 19, 59, 27, 49, 17, 57, 25 },
+    { 15, 47, 7, 39, 13, 45, 5, 37 },  { 63, 31, 55, 23, 61, 29, 53, 21 }
+};
+
+// Fills one rounding threshold in (0,1) per pixel, starting at pixel index firstPixel of the run
+static void ditherThresholds(const clTransformDither * dither, int firstPixel, float * thresholds, int pixelCount)
 {
+    int x = firstPixel % dither->width;
+    int y = dither->firstRow + (firstPixel / dither->width);
     for (int i = 0; i < pixelCount; ++i) {
-        float * srcPixel = &srcPixels[i * srcChannelCount];
-        float * dstPixel = &dstPixels[i * dstChannelCount];
-        gbVec3 src;
-        float XYZ[3];
+        thresholds[i] = ((float)bayer8x8[y & 7][x & 7] + 0.5f) / 64.0f;
+        if (++x == dither->width) {
+            x = 0;
+            ++y;
+        }
+    }
+}
+
+// ----------------------------------------------------------------------------
+// CCMM batch kernel
+//
+// Pixels are converted CL_CCMM_BATCH_SIZE at a time in planar form (one array per channel), so that each
+// stage can be a tight loop with a single switch per batch instead of per pixel. The matrix, clamp and
+// luminance scale stages process 4 pixels per instruction with SSE2/NEON; the scalar loops handle any
+// leftover pixels and are the reference implementation on other architectures. The transfer functions
+// themselves are still evaluated with libm per channel.
+
+#define CL_CCMM_BATCH_SIZE 64
+
+#if defined(CL_CCMM_SSE2)
+#define CL_CCMM_VECTOR_WIDTH 4
+typedef __m128 clVec4;
+typedef __m128 clVec4Mask;
+#define clVec4Load(P) _mm_loadu_ps(P)
+#define clVec4Store(P, V) _mm_storeu_ps(P, V)
+#define clVec4Set1(F) _mm_set1_ps(F)
+#define clVec4Add(A, B) _mm_add_ps(A, B)
+#define clVec4Sub(A, B) _mm_sub_ps(A, B)
+#define clVec4Mul(A, B) _mm_mul_ps(A, B)
+#define clVec4Div(A, B) _mm_div_ps(A, B)
+#define clVec4Max(A, B) _mm_max_ps(A, B)
+#define clVec4Min(A, B) _mm_min_ps(A, B)
+#define clVec4LessEqual(A, B) _mm_cmple_ps(A, B)
+#define clVec4Select(M, A, B) _mm_or_ps(_mm_and_ps(M, A), _mm_andnot_ps(M, B)) // M ? A : B
+#elif defined(CL_CCMM_NEON)
+#define CL_CCMM_VECTOR_WIDTH 4
+typedef float32x4_t clVec4;
+typedef uint32x4_t clVec4Mask;
+#define clVec4Load(P) vld1q_f32(P)
+#define clVec4Store(P, V) vst1q_f32(P, V)
+#define clVec4Set1(F) vdupq_n_f32(F)
+#define clVec4Add(A, B) vaddq_f32(A, B)
+#define clVec4Sub(A, B) vsubq_f32(A, B)
+#define clVec4Mul(A, B) vmulq_f32(A, B)
+#define clVec4Div(A, B) vdivq_f32(A, B)
+#define clVec4Max(A, B) vmaxq_f32(A, B)
+#define clVec4Min(A, B) vminq_f32(A, B)
+#define clVec4LessEqual(A, B) vcleq_f32(A, B)
+#define clVec4Select(M, A, B) vbslq_f32(M, A, B) // M ? A : B
+#else
+#define CL_CCMM_VECTOR_WIDTH 0
+#endif
+
+typedef struct clCCMMBatch
+{
+    float c0[CL_CCMM_BATCH_SIZE]; // R or X, x after ccmmXYZToXYY()
+    float c1[CL_CCMM_BATCH_SIZE]; // G or Y, y after ccmmXYZToXYY()
+    float c2[CL_CCMM_BATCH_SIZE]; // B or Z, Y after ccmmXYZToXYY()
+    float alpha[CL_CCMM_BATCH_SIZE];
+} clCCMMBatch;
+
+// Returns the number of leading pixels in a batch of pixelCount that the vector loops can handle
+static int ccmmVectorPixelCount(int pixelCount)
+{
+#if CL_CCMM_VECTOR_WIDTH
+    return pixelCount - (pixelCount % CL_CCMM_VECTOR_WIDTH);
+#else
+    COLORIST_UNUSED(pixelCount);
+    return 0;
+#endif
+}
+
+static float sRGB_EOTF(float N)
+{
+    return (N <= 0.04045f) ? (N / 12.92f) : (powf((N + 0.055f) / 1.055f, 2.4f));
+}
+
+static float sRGB_OETF(float L)
+{
+    return (L <= 0.0031308) ? (L * 12.92f) : ((powf(L, 1.0f / 2.4f) * 1.055f) - 0.055f);
+}
+
+// Exact, single value versions of the curves applied by ccmmApplyEOTF() / ccmmApplyOETF()
+static float ccmmEOTF(struct clTransform * transform, float v)
+{
+    switch (transform->ccmmSrcEOTF) {
+        case CL_XTF_GAMMA:
+            return powf((v >= 0.0f) ? v : 0.0f, transform->ccmmSrcGamma);
+        case CL_XTF_SRGB:
+            return sRGB_EOTF(v);
+        case CL_XTF_HLG:
+            return HLG_EOTF((v >= 0.0f) ? v : 0.0f, transform->ccmmHLGExponent);
+        case CL_XTF_PQ:
+            return clTransformEOTF_PQ((v >= 0.0f) ? v : 0.0f);
+        case CL_XTF_NONE:
+        default:
+            break;
+    }
+    return v;
+}
+
+static float ccmmOETF(struct clTransform * transform, float v)
+{
+    switch (transform->ccmmDstOETF) {
+        case CL_XTF_SRGB:
+            return sRGB_OETF(v);
+        case CL_XTF_GAMMA:
+            return powf((v >= 0.0f) ? v : 0.0f, transform->ccmmDstInvGamma);
+        case CL_XTF_HLG:
+            return HLG_OETF((v >= 0.0f) ? v : 0.0f, transform->ccmmHLGExponent);
+        case CL_XTF_PQ:
+            return clTransformOETF_PQ((v >= 0.0f) ? v : 0.0f);
+        case CL_XTF_NONE:
+        default:
+            break;
+    }
+    return v;
+}
+
+// Curve lookup tables (--ccmm-accuracy fast)
+//
+// A table is indexed directly by the bits of a positive float: the top CL_CURVE_TABLE_MANTISSA_BITS of the
+// mantissa pick one of 256 evenly spaced entries within each power of two, and the remaining mantissa bits
+// interpolate linearly to the next entry. Every octave in [2^-24, 1] gets the same relative precision, which
+// suits the power-law shape of all of the supported curves (including their steep ends near zero). Inputs
+// outside of that range (negative, tiny, overranged, NaN) use the exact functions.
+#define CL_CURVE_TABLE_MANTISSA_BITS 8
+#define CL_CURVE_TABLE_SHIFT (23 - CL_CURVE_TABLE_MANTISSA_BITS)
+#define CL_CURVE_TABLE_MIN_BITS ((uint32_t)(127 - 24) << 23) // 2^-24
+#define CL_CURVE_TABLE_MAX_BITS ((uint32_t)127 << 23)        // 1.0
+#define CL_CURVE_TABLE_SIZE ((int)((CL_CURVE_TABLE_MAX_BITS - CL_CURVE_TABLE_MIN_BITS) >> CL_CURVE_TABLE_SHIFT) + 2)
+
+static float * ccmmCreateCurveTable(struct clContext * C, struct clTransform * transform, ccmmCurveFunc func)
+{
+    float * table = clAllocate(sizeof(float) * CL_CURVE_TABLE_SIZE);
+    for (int i = 0; i < CL_CURVE_TABLE_SIZE - 1; ++i) {
+        uint32_t bits = CL_CURVE_TABLE_MIN_BITS + ((uint32_t)i << CL_CURVE_TABLE_SHIFT);
+        float v;
+        memcpy(&v, &bits, sizeof(v));
+        table[i] = func(transform, v);
+    }
+    // Lets an input of exactly 1.0 interpolate without reading past the end
+    table[CL_CURVE_TABLE_SIZE - 1] = table[CL_CURVE_TABLE_SIZE - 2];
+    return table;
+}
+
+static void ccmmApplyCurveTable(struct clTransform * transform, const float * table, ccmmCurveFunc func, clCCMMBatch * batch, int pixelCount)
+{
+    static const float fractionScale = 1.0f / (float)(1 << CL_CURVE_TABLE_SHIFT);
+    float * channels[3] = { batch->c0, batch->c1, batch->c2 };
+    for (int c = 0; c < 3; ++c) {
+        float * v = channels[c];
+        for (int i = 0; i < pixelCount; ++i) {
+            uint32_t bits;
+            memcpy(&bits, &v[i], sizeof(bits));
+            if ((bits >= CL_CURVE_TABLE_MIN_BITS) && (bits <= CL_CURVE_TABLE_MAX_BITS)) {
+                uint32_t offset = bits - CL_CURVE_TABLE_MIN_BITS;
+                uint32_t index = offset >> CL_CURVE_TABLE_SHIFT;
+                float t = (float)(offset & ((1 << CL_CURVE_TABLE_SHIFT) - 1)) * fractionScale;
+                v[i] = table[index] + ((table[index + 1] - table[index]) * t);
+            } else {
+                v[i] = func(transform, v[i]);
+            }
+        }
+    }
+}
+
+static void ccmmApplyEOTF(struct clTransform * transform, clCCMMBatch * batch, int pixelCount)
+{
+    if (transform->ccmmSrcEOTFTable) {
+        ccmmApplyCurveTable(transform, transform->ccmmSrcEOTFTable, ccmmEOTF, batch, pixelCount);
+        return;
+    }
 
-        if (useCCMM) {
-            switch (transform->ccmmSrcEOTF) {
-                default:
-                case CL_XTF_NONE:
-                    memcpy(&src, srcPixel, sizeof(src));
-                    break;
-                case CL_XTF_GAMMA:
-                    src.x = powf((srcPixel[0] >= 0.0f) ? srcPixel[0] : 0.0f, transform->ccmmSrcGamma);
-                    src.y = powf((srcPixel[1] >= 0.0f) ? srcPixel[1] : 0.0f, transform->ccmmSrcGamma);
-                    src.z = powf((srcPixel[2] >= 0.0f) ? srcPixel[2] : 0.0f, transform->ccmmSrcGamma);
-                    break;
-                case CL_XTF_SRGB:
-                    src.x = (srcPixel[0] <= 0.04045f) ? (srcPixel[0] / 12.92f) : (powf((srcPixel[0] + 0.055f) / 1.055f, 2.4f));
-                    src.y = (srcPixel[1] <= 0.04045f) ? (srcPixel[1] / 12.92f) : (powf((srcPixel[1] + 0.055f) / 1.055f, 2.4f));
-                    src.z = (srcPixel[2] <= 0.04045f) ? (srcPixel[2] / 12.92f) : (powf((srcPixel[2] + 0.055f) / 1.055f, 2.4f));
-                    break;
-                case CL_XTF_HLG:
-                    src.x = HLG_EOTF((srcPixel[0] >= 0.0f) ? srcPixel[0] : 0.0f, transform->ccmmHLGLuminance);
-                    src.y = HLG_EOTF((srcPixel[1] >= 0.0f) ? srcPixel[1] : 0.0f, transform->ccmmHLGLuminance);
-                    src.z = HLG_EOTF((srcPixel[2] >= 0.0f) ? srcPixel[2] : 0.0f, transform->ccmmHLGLuminance);
-                    break;
-                case CL_XTF_PQ:
-                    src.x = clTransformEOTF_PQ((srcPixel[0] >= 0.0f) ? srcPixel[0] : 0.0f);
-                    src.y = clTransformEOTF_PQ((srcPixel[1] >= 0.0f) ? srcPixel[1] : 0.0f);
-                    src.z = clTransformEOTF_PQ((srcPixel[2] >= 0.0f) ? srcPixel[2] : 0.0f);
-                    break;
-            }
-
-            gb_mat3_mul_vec3((gbVec3 *)XYZ, &transform->ccmmSrcToXYZ, src);
+    float * channels[3] = { batch->c0, batch->c1, batch->c2 };
+    for (int c = 0; c < 3; ++c) {
+        float * v = channels[c];
+        switch (transform->ccmmSrcEOTF) {
+            default:
+            case CL_XTF_NONE:
+                break;
+            case CL_XTF_GAMMA:
+                for (int i = 0; i < pixelCount; ++i) {
+                    v[i] = powf((v[i] >= 0.0f) ? v[i] : 0.0f, transform->ccmmSrcGamma);
+                }
+                break;
+            case CL_XTF_SRGB:
+                for (int i = 0; i < pixelCount; ++i) {
+                    v[i] = sRGB_EOTF(v[i]);
+                }
+                break;
+            case CL_XTF_HLG:
+                for (int i = 0; i < pixelCount; ++i) {
+                    v[i] = HLG_EOTF((v[i] >= 0.0f) ? v[i] : 0.0f, transform->ccmmHLGExponent);
+                }
+                break;
+            case CL_XTF_PQ:
+                for (int i = 0; i < pixelCount; ++i) {
+                    v[i] = clTransformEOTF_PQ((v[i] >= 0.0f) ? v[i] : 0.0f);
+                }
+                break;
+        }
+    }
+}
+
+static void ccmmApplyOETF(struct clTransform * transform, clCCMMBatch * batch, int pixelCount)
+{
+    if (transform->ccmmDstOETFTable) {
+        ccmmApplyCurveTable(transform, transform->ccmmDstOETFTable, ccmmOETF, batch, pixelCount);
+        return;
+    }
+
+    float * channels[3] = { batch->c0, batch->c1, batch->c2 };
+    for (int c = 0; c < 3; ++c) {
+        float * v = channels[c];
+        switch (transform->ccmmDstOETF) {
+            default:
+            case CL_XTF_NONE:
+                break;
+            case CL_XTF_SRGB:
+                for (int i = 0; i < pixelCount; ++i) {
+                    v[i] = sRGB_OETF(v[i]);
+                }
+                break;
+            case CL_XTF_GAMMA:
+                for (int i = 0; i < pixelCount; ++i) {
+                    v[i] = powf((v[i] >= 0.0f) ? v[i] : 0.0f, transform->ccmmDstInvGamma);
+                }
+                break;
+            case CL_XTF_HLG:
+                for (int i = 0; i < pixelCount; ++i) {
+                    v[i] = HLG_OETF((v[i] >= 0.0f) ? v[i] : 0.0f, transform->ccmmHLGExponent);
+                }
+                break;
+            case CL_XTF_PQ:
+                for (int i = 0; i < pixelCount; ++i) {
+                    v[i] = clTransformOETF_PQ((v[i] >= 0.0f) ? v[i] : 0.0f);
+                }
+                break;
+        }
+    }
+}
+
+// Same math (and operation order) as gb_mat3_mul_vec3()
+static void ccmmMultiplyMatrix(gbMat3 * m, clCCMMBatch * batch, int pixelCount)
+{
+    const float * e = m->e;
+    int i = 0;
+
+#if CL_CCMM_VECTOR_WIDTH
+    clVec4 m0 = clVec4Set1(e[0]), m1 = clVec4Set1(e[1]), m2 = clVec4Set1(e[2]);
+    clVec4 m3 = clVec4Set1(e[3]), m4 = clVec4Set1(e[4]), m5 = clVec4Set1(e[5]);
+    clVec4 m6 = clVec4Set1(e[6]), m7 = clVec4Set1(e[7]), m8 = clVec4Set1(e[8]);
+    int vectorCount = ccmmVectorPixelCount(pixelCount);
+    for (; i < vectorCount; i += CL_CCMM_VECTOR_WIDTH) {
+        clVec4 x = clVec4Load(&batch->c0[i]);
+        clVec4 y = clVec4Load(&batch->c1[i]);
+        clVec4 z = clVec4Load(&batch->c2[i]);
+        clVec4Store(&batch->c0[i], clVec4Add(clVec4Add(clVec4Mul(m0, x), clVec4Mul(m1, y)), clVec4Mul(m2, z)));
+        clVec4Store(&batch->c1[i], clVec4Add(clVec4Add(clVec4Mul(m3, x), clVec4Mul(m4, y)), clVec4Mul(m5, z)));
+        clVec4Store(&batch->c2[i], clVec4Add(clVec4Add(clVec4Mul(m6, x), clVec4Mul(m7, y)), clVec4Mul(m8, z)));
+    }
+#endif
+
+    for (; i < pixelCount; ++i) {
+        float x = batch->c0[i];
+        float y = batch->c1[i];
+        float z = batch->c2[i];
+        batch->c0[i] = e[0] * x + e[1] * y + e[2] * z;
+        batch->c1[i] = e[3] * x + e[4] * y + e[5] * z;
+        batch->c2[i] = e[6] * x + e[7] * y + e[8] * z;
+    }
+}
+
+// Clamps to [low, high]; a negative high means "no upper limit" (allow overranging)
+static void ccmmClamp(clCCMMBatch * batch, int pixelCount, float low, float high)
+{
+    float * channels[3] = { batch->c0, batch->c1, batch->c2 };
+    for (int c = 0; c < 3; ++c) {
+        float * v = channels[c];
+        int i = 0;
+#if CL_CCMM_VECTOR_WIDTH
+        clVec4 vlow = clVec4Set1(low);
+        clVec4 vhigh = clVec4Set1(high);
+        int vectorCount = ccmmVectorPixelCount(pixelCount);
+        for (; i < vectorCount; i += CL_CCMM_VECTOR_WIDTH) {
+            // Operand order matters here: on SSE2, NaNs must come through like they do with CL_CLAMP/CL_MAX
+            clVec4 x = clVec4Max(vlow, clVec4Load(&v[i]));
+            if (high >= 0.0f) {
+                x = clVec4Min(vhigh, x);
+            }
+            clVec4Store(&v[i], x);
+        }
+#endif
+        if (high >= 0.0f) {
+            for (; i < pixelCount; ++i) {
+                v[i] = CL_CLAMP(v[i], low, high);
+            }
         } else {
-            // Use LCMS
-            if (transform->lcmsSrcToXYZ) {
-                cmsDoTransform(transform->lcmsSrcToXYZ, srcPixel, XYZ, 1);
+            for (; i < pixelCount; ++i) {
+                v[i] = CL_MAX(v[i], low);
             }
         }
+    }
+}
+
+// XYZ -> xyY, then applies the src/dst luminance scales to Y (see clTransformXYZToXYY())
+static void ccmmXYZToXYY(struct clContext * C, struct clTransform * transform, clCCMMBatch * batch, int pixelCount)
+{
+    // Apply srcCurveScale as CCMM (LCMS implicitly does this), then luminance scale, then
+    // inverse dstCurveScale prior to tonemapping to ensure tonemap gets [0-1] range
+    const float srcCurveScale = transform->srcCurveScale;
+    const float srcLuminanceScale = transform->srcLuminanceScale;
+    const float dstLuminanceScale = transform->dstLuminanceScale;
+    const float dstCurveScale = transform->dstCurveScale;
+    int i = 0;
+
+#if CL_CCMM_VECTOR_WIDTH
+    clVec4 zero = clVec4Set1(0.0f);
+    clVec4 whitePointX = clVec4Set1(transform->whitePointX);
+    clVec4 whitePointY = clVec4Set1(transform->whitePointY);
+    clVec4 vSrcCurveScale = clVec4Set1(srcCurveScale);
+    clVec4 vSrcLuminanceScale = clVec4Set1(srcLuminanceScale);
+    clVec4 vDstLuminanceScale = clVec4Set1(dstLuminanceScale);
+    clVec4 vDstCurveScale = clVec4Set1(dstCurveScale);
+    int vectorCount = ccmmVectorPixelCount(pixelCount);
+    for (; i < vectorCount; i += CL_CCMM_VECTOR_WIDTH) {
+        clVec4 X = clVec4Load(&batch->c0[i]);
+        clVec4 Y = clVec4Load(&batch->c1[i]);
+        clVec4 Z = clVec4Load(&batch->c2[i]);
+        clVec4 sum = clVec4Add(clVec4Add(X, Y), Z);
+        clVec4Mask black = clVec4LessEqual(sum, zero);
+        clVec4 x = clVec4Select(black, whitePointX, clVec4Div(X, sum));
+        clVec4 y = clVec4Select(black, whitePointY, clVec4Div(Y, sum));
+        Y = clVec4Select(black, zero, Y);
+        Y = clVec4Mul(Y, vSrcCurveScale);
+        Y = clVec4Mul(Y, vSrcLuminanceScale);
+        Y = clVec4Div(Y, vDstLuminanceScale);
+        Y = clVec4Div(Y, vDstCurveScale);
+        clVec4Store(&batch->c0[i], x);
+        clVec4Store(&batch->c1[i], y);
+        clVec4Store(&batch->c2[i], Y);
+    }
+#endif
 
-        // if tonemapping is necessary, luminance scale MUST be enabled
-        COLORIST_ASSERT(!transform->tonemapEnabled || transform->luminanceScaleEnabled);
+    for (; i < pixelCount; ++i) {
+        float XYZ[3];
+        float xyY[3];
+        XYZ[0] = batch->c0[i];
+        XYZ[1] = batch->c1[i];
+        XYZ[2] = batch->c2[i];
+        clTransformXYZToXYY(C, xyY, XYZ, transform->whitePointX, transform->whitePointY);
+        xyY[2] *= srcCurveScale;
+        xyY[2] *= srcLuminanceScale;
+        xyY[2] /= dstLuminanceScale;
+        xyY[2] /= dstCurveScale;
+        batch->c0[i] = xyY[0];
+        batch->c1[i] = xyY[1];
+        batch->c2[i] = xyY[2];
+    }
+}
 
-        if (transform->luminanceScaleEnabled) {
-            float xyY[3];
+// Same math as clTransformXYYToXYZ()
+static void ccmmXYYToXYZ(struct clContext * C, clCCMMBatch * batch, int pixelCount)
+{
+    int i = 0;
+
+#if CL_CCMM_VECTOR_WIDTH
+    clVec4 zero = clVec4Set1(0.0f);
+    clVec4 one = clVec4Set1(1.0f);
+    int vectorCount = ccmmVectorPixelCount(pixelCount);
+    for (; i < vectorCount; i += CL_CCMM_VECTOR_WIDTH) {
+        clVec4 x = clVec4Load(&batch->c0[i]);
+        clVec4 y = clVec4Load(&batch->c1[i]);
+        clVec4 Y = clVec4Load(&batch->c2[i]);
+        clVec4Mask black = clVec4LessEqual(Y, zero);
+        clVec4 X = clVec4Div(clVec4Mul(x, Y), y);
+        clVec4 Z = clVec4Div(clVec4Mul(clVec4Sub(clVec4Sub(one, x), y), Y), y);
+        clVec4Store(&batch->c0[i], clVec4Select(black, zero, X));
+        clVec4Store(&batch->c1[i], clVec4Select(black, zero, Y));
+        clVec4Store(&batch->c2[i], clVec4Select(black, zero, Z));
+    }
+#endif
 
-            // Convert to xyY
-            clTransformXYZToXYY(C, xyY, XYZ, transform->whitePointX, transform->whitePointY);
+    for (; i < pixelCount; ++i) {
+        float xyY[3];
+        float XYZ[3];
+        xyY[0] = batch->c0[i];
+        xyY[1] = batch->c1[i];
+        xyY[2] = batch->c2[i];
+        clTransformXYYToXYZ(C, XYZ, xyY);
+        batch->c0[i] = XYZ[0];
+        batch->c1[i] = XYZ[1];
+        batch->c2[i] = XYZ[2];
+    }
+}
 
-            // Apply srcCurveScale as CCMM, if any (LCMS implicitly does this)
-            if (useCCMM) {
-                xyY[2] *= transform->srcCurveScale;
+// Integer formats decode straight to linear through ccmmSrcIntegerTable, so this returns clTrue when the src
+// EOTF has already been applied. Alpha is normalized the same way clImagePrepareReadPixels() does it.
+static clBool ccmmLoad(struct clContext * C,
+                       struct clTransform * transform,
+                       void * srcPixels,
+                       clCCMMBatch * batch,
+                       int pixelCount)
+{
+    const float * table = transform->ccmmSrcIntegerTable;
+
+    if (transform->srcFormat == CL_XF_RGBA8) {
+        const float maxChannelf = 255.0f;
+        uint8_t * srcPixel = srcPixels;
+        for (int i = 0; i < pixelCount; ++i) {
+            batch->c0[i] = table[srcPixel[0]];
+            batch->c1[i] = table[srcPixel[1]];
+            batch->c2[i] = table[srcPixel[2]];
+            batch->alpha[i] = srcPixel[3] / maxChannelf;
+            srcPixel += 4;
+        }
+        return clTrue;
+    }
+
+    if (transform->srcFormat == CL_XF_RGBA16) {
+        const uint16_t maxChannel = (uint16_t)clTransformFormatMaxChannel(C, transform->srcFormat, transform->srcDepth);
+        const float maxChannelf = (float)maxChannel;
+        uint16_t * srcPixel = srcPixels;
+        for (int i = 0; i < pixelCount; ++i) {
+            batch->c0[i] = table[CL_MIN(srcPixel[0], maxChannel)];
+            batch->c1[i] = table[CL_MIN(srcPixel[1], maxChannel)];
+            batch->c2[i] = table[CL_MIN(srcPixel[2], maxChannel)];
+            batch->alpha[i] = srcPixel[3] / maxChannelf;
+            srcPixel += 4;
+        }
+        return clTrue;
+    }
+
+    int srcChannelCount = clTransformFormatToChannelCount(C, transform->srcFormat);
+    float * srcPixel = srcPixels;
+    for (int i = 0; i < pixelCount; ++i) {
+        batch->c0[i] = srcPixel[0];
+        batch->c1[i] = srcPixel[1];
+        batch->c2[i] = srcPixel[2];
+        batch->alpha[i] = SRC_FLOAT_HAS_ALPHA() ? srcPixel[3] : 1.0f;
+        srcPixel += srcChannelCount;
+    }
+    return clFalse;
+}
+
+// Integer formats are rounded the same way clImagePrepareReadPixels() rounds F32 pixels, unless thresholds are provided
+// for dithering the color channels (alpha is always rounded)
+static void ccmmStore(struct clContext * C,
+                      struct clTransform * transform,
+                      clCCMMBatch * batch,
+                      const float * thresholds,
+                      void * dstPixels,
+                      int pixelCount)
+{
+    if (thresholds && clTransformFormatIsInteger(C, transform->dstFormat)) {
+        const uint32_t maxChannel = clTransformFormatMaxChannel(C, transform->dstFormat, transform->dstDepth);
+        if (transform->dstFormat == CL_XF_RGBA8) {
+            uint8_t * dstPixel = dstPixels;
+            for (int i = 0; i < pixelCount; ++i) {
+                dstPixel[0] = (uint8_t)clPixelMathDitherUNorm(batch->c0[i], maxChannel, thresholds[i]);
+                dstPixel[1] = (uint8_t)clPixelMathDitherUNorm(batch->c1[i], maxChannel, thresholds[i]);
+                dstPixel[2] = (uint8_t)clPixelMathDitherUNorm(batch->c2[i], maxChannel, thresholds[i]);
+                dstPixel[3] = (uint8_t)clPixelMathRoundUNorm(batch->alpha[i], maxChannel);
+                dstPixel += 4;
             }
+        } else {
+            uint16_t * dstPixel = dstPixels;
+            for (int i = 0; i < pixelCount; ++i) {
+                dstPixel[0] = (uint16_t)clPixelMathDitherUNorm(batch->c0[i], maxChannel, thresholds[i]);
+                dstPixel[1] = (uint16_t)clPixelMathDitherUNorm(batch->c1[i], maxChannel, thresholds[i]);
+                dstPixel[2] = (uint16_t)clPixelMathDitherUNorm(batch->c2[i], maxChannel, thresholds[i]);
+                dstPixel[3] = (uint16_t)clPixelMathRoundUNorm(batch->alpha[i], maxChannel);
+                dstPixel += 4;
+            }
+        }
+        return;
+    }
+
+    if (transform->dstFormat == CL_XF_RGBA8) {
+        const uint32_t maxChannel = 255;
+        uint8_t * dstPixel = dstPixels;
+        for (int i = 0; i < pixelCount; ++i) {
+            dstPixel[0] = (uint8_t)clPixelMathRoundUNorm(batch->c0[i], maxChannel);
+            dstPixel[1] = (uint8_t)clPixelMathRoundUNorm(batch->c1[i], maxChannel);
+            dstPixel[2] = (uint8_t)clPixelMathRoundUNorm(batch->c2[i], maxChannel);
+            dstPixel[3] = (uint8_t)clPixelMathRoundUNorm(batch->alpha[i], maxChannel);
+            dstPixel += 4;
+        }
+        return;
+    }
+
+    if (transform->dstFormat == CL_XF_RGBA16) {
+        const uint32_t maxChannel = clTransformFormatMaxChannel(C, transform->dstFormat, transform->dstDepth);
+        uint16_t * dstPixel = dstPixels;
+        for (int i = 0; i < pixelCount; ++i) {
+            dstPixel[0] = (uint16_t)clPixelMathRoundUNorm(batch->c0[i], maxChannel);
+            dstPixel[1] = (uint16_t)clPixelMathRoundUNorm(batch->c1[i], maxChannel);
+            dstPixel[2] = (uint16_t)clPixelMathRoundUNorm(batch->c2[i], maxChannel);
+            dstPixel[3] = (uint16_t)clPixelMathRoundUNorm(batch->alpha[i], maxChannel);
+            dstPixel += 4;
+        }
+        return;
+    }
+
+    int dstChannelCount = clTransformFormatToChannelCount(C, transform->dstFormat);
+    float * dstPixel = dstPixels;
+    for (int i = 0; i < pixelCount; ++i) {
+        dstPixel[0] = batch->c0[i];
+        dstPixel[1] = batch->c1[i];
+        dstPixel[2] = batch->c2[i];
+        if (DST_FLOAT_HAS_ALPHA()) {
+            dstPixel[3] = batch->alpha[i];
+        }
+        dstPixel += dstChannelCount;
+    }
+}
+
+static void ccmmConvert(struct clContext * C,
+                        struct clTransform * transform,
+                        void * srcPixels,
+                        void * dstPixels,
+                        int pixelCount,
+                        int firstPixel,
+                        const clTransformDither * dither)
+{
+    // if tonemapping is necessary, luminance scale MUST be enabled
+    COLORIST_ASSERT(!transform->tonemapEnabled || transform->luminanceScaleEnabled);
 
-            // Luminance scale
-            xyY[2] *= transform->srcLuminanceScale;
-            xyY[2] /= transform->dstLuminanceScale;
+    int srcPixelBytes = clTransformFormatToPixelBytes(C, transform->srcFormat);
+    int dstPixelBytes = clTransformFormatToPixelBytes(C, transform->dstFormat);
 
-            // Apply inverse dstCurveScale prior to tonemapping to ensure tonemap gets [0-1] range
-            xyY[2] /= transform->dstCurveScale;
+    clCCMMBatch batch;
+    float thresholds[CL_CCMM_BATCH_SIZE];
+    for (int batchStart = 0; batchStart < pixelCount; batchStart += CL_CCMM_BATCH_SIZE) {
+        int batchCount = CL_MIN(CL_CCMM_BATCH_SIZE, pixelCount - batchStart);
 
-            // Tonemap
-            if (transform->tonemapEnabled) {
-                // reinhard tonemap, with additional tuning (see context.h for attribution)
-                float z = powf(xyY[2] > 0.0f ? xyY[2] : 0.0f, transform->tonemapParams.contrast);
-                xyY[2] = z / ((powf(z, transform->tonemapParams.power) * transform->tonemapParams.clipPoint) +
-                              transform->tonemapParams.speed);
+        if (!ccmmLoad(C, transform, (uint8_t *)srcPixels + (batchStart * srcPixelBytes), &batch, batchCount)) {
+            ccmmApplyEOTF(transform, &batch, batchCount);
+        }
+
+        if (transform->ccmmKernel == CL_XK_MATRIX) {
+            ccmmMultiplyMatrix(&transform->ccmmCombined, &batch, batchCount);
+        } else if (transform->ccmmKernel == CL_XK_FULL) {
+            ccmmMultiplyMatrix(&transform->ccmmSrcToXYZ, &batch, batchCount);
+
+            if (transform->luminanceScaleEnabled) {
+                ccmmXYZToXYY(C, transform, &batch, batchCount);
+
+                if (transform->tonemapEnabled) {
+                    // reinhard tonemap, with additional tuning (see context.h for attribution)
+                    for (int i = 0; i < batchCount; ++i) {
+                        float Y = batch.c2[i];
+                        float z = powf(Y > 0.0f ? Y : 0.0f, transform->tonemapParams.contrast);
+                        batch.c2[i] = z / ((powf(z, transform->tonemapParams.power) * transform->tonemapParams.clipPoint) +
+                                           transform->tonemapParams.speed);
+                    }
+                }
+
+                ccmmXYYToXYZ(C, &batch, batchCount);
             }
 
-            if (!useCCMM) {
-                // Re-apply dst scale for LCMS as it expects the XYZ->Dst input to be overranged
-                xyY[2] *= transform->dstCurveScale;
+            ccmmMultiplyMatrix(&transform->ccmmXYZToDst, &batch, batchCount);
+        }
+        if (transform->dstProfile) { // don't clamp XYZ
+            if ((transform->ccmmDstOETF == CL_XTF_HLG) || (transform->ccmmDstOETF == CL_XTF_PQ)) {
+                ccmmClamp(&batch, batchCount, 0.0f, 1.0f);
+            } else {
+                ccmmClamp(&batch, batchCount, 0.0f, -1.0f); // clamp (allow overranging)
             }
+        }
+        ccmmApplyOETF(transform, &batch, batchCount);
 
-            // Convert to XYZ
-            clTransformXYYToXYZ(C, XYZ, xyY);
+        if (dither) {
+            ditherThresholds(dither, firstPixel + batchStart, thresholds, batchCount);
         }
+        ccmmStore(C, transform, &batch, dither ? thresholds : NULL, (uint8_t *)dstPixels + (batchStart * dstPixelBytes), batchCount);
+    }
+}
 
-        if (useCCMM) {
-            float tmp[3];
-            memcpy(&src, XYZ, sizeof(src));
+// ----------------------------------------------------------------------------
+// LittleCMS conversion
 
-            switch (transform->ccmmDstOETF) {
-                case CL_XTF_NONE:
-                    gb_mat3_mul_vec3((gbVec3 *)dstPixel, &transform->ccmmXYZToDst, src);
-                    if (transform->dstProfile) {                 // don't clamp XYZ
-                        dstPixel[0] = CL_MAX(dstPixel[0], 0.0f); // clamp (allow overranging)
-                        dstPixel[1] = CL_MAX(dstPixel[1], 0.0f); // clamp (allow overranging)
-                        dstPixel[2] = CL_MAX(dstPixel[2], 0.0f); // clamp (allow overranging)
-                    }
-                    break;
-                case CL_XTF_SRGB:
-                    gb_mat3_mul_vec3((gbVec3 *)tmp, &transform->ccmmXYZToDst, src);
-                    if (transform->dstProfile) {       // don't clamp XYZ
-                        tmp[0] = CL_MAX(tmp[0], 0.0f); // clamp (allow overranging)
-                        tmp[1] = CL_MAX(tmp[1], 0.0f); // clamp (allow overranging)
-                        tmp[2] = CL_MAX(tmp[2], 0.0f); // clamp (allow overranging)
-                    }
-                    dstPixel[0] = (tmp[0] <= 0.0031308) ? (tmp[0] * 12.92f) : ((powf(tmp[0], 1.0f / 2.4f) * 1.055f) - 0.055f);
-                    dstPixel[1] = (tmp[1] <= 0.0031308) ? (tmp[1] * 12.92f) : ((powf(tmp[1], 1.0f / 2.4f) * 1.055f) - 0.055f);
-                    dstPixel[2] = (tmp[2] <= 0.0031308) ? (tmp[2] * 12.92f) : ((powf(tmp[2], 1.0f / 2.4f) * 1.055f) - 0.055f);
-                    break;
-                case CL_XTF_GAMMA:
-                    gb_mat3_mul_vec3((gbVec3 *)tmp, &transform->ccmmXYZToDst, src);
-                    if (transform->dstProfile) {       // don't clamp XYZ
-                        tmp[0] = CL_MAX(tmp[0], 0.0f); // clamp (allow overranging)
-                        tmp[1] = CL_MAX(tmp[1], 0.0f); // clamp (allow overranging)
-                        tmp[2] = CL_MAX(tmp[2], 0.0f); // clamp (allow overranging)
-                    }
-                    dstPixel[0] = powf((tmp[0] >= 0.0f) ? tmp[0] : 0.0f, transform->ccmmDstInvGamma);
-                    dstPixel[1] = powf((tmp[1] >= 0.0f) ? tmp[1] : 0.0f, transform->ccmmDstInvGamma);
-                    dstPixel[2] = powf((tmp[2] >= 0.0f) ? tmp[2] : 0.0f, transform->ccmmDstInvGamma);
-                    break;
-                case CL_XTF_HLG:
-                    gb_mat3_mul_vec3((gbVec3 *)tmp, &transform->ccmmXYZToDst, src);
-                    if (transform->dstProfile) {               // don't clamp XYZ
-                        tmp[0] = CL_CLAMP(tmp[0], 0.0f, 1.0f); // clamp
-                        tmp[1] = CL_CLAMP(tmp[1], 0.0f, 1.0f); // clamp
-                        tmp[2] = CL_CLAMP(tmp[2], 0.0f, 1.0f); // clamp
-                    }
-                    dstPixel[0] = HLG_OETF((tmp[0] >= 0.0f) ? tmp[0] : 0.0f, transform->ccmmHLGLuminance);
-                    dstPixel[1] = HLG_OETF((tmp[1] >= 0.0f) ? tmp[1] : 0.0f, transform->ccmmHLGLuminance);
-                    dstPixel[2] = HLG_OETF((tmp[2] >= 0.0f) ? tmp[2] : 0.0f, transform->ccmmHLGLuminance);
-                    break;
-                case CL_XTF_PQ:
-                    gb_mat3_mul_vec3((gbVec3 *)tmp, &transform->ccmmXYZToDst, src);
-                    if (transform->dstProfile) {               // don't clamp XYZ
-                        tmp[0] = CL_CLAMP(tmp[0], 0.0f, 1.0f); // clamp
-                        tmp[1] = CL_CLAMP(tmp[1], 0.0f, 1.0f); // clamp
-                        tmp[2] = CL_CLAMP(tmp[2], 0.0f, 1.0f); // clamp
-                    }
-                    dstPixel[0] = clTransformOETF_PQ((tmp[0] >= 0.0f) ? tmp[0] : 0.0f);
-                    dstPixel[1] = clTransformOETF_PQ((tmp[1] >= 0.0f) ? tmp[1] : 0.0f);
-                    dstPixel[2] = clTransformOETF_PQ((tmp[2] >= 0.0f) ? tmp[2] : 0.0f);
-                    break;
+// Pixels go through LittleCMS this many at a time, so its per-call overhead is paid per block instead of per pixel
+#define CL_LCMS_BATCH_SIZE 256
+
+static void lcmsScaleLuminance(struct clContext * C, struct clTransform * transform, float * XYZ, int pixelCount)
+{
+    // if tonemapping is necessary, luminance scale MUST be enabled
+    COLORIST_ASSERT(!transform->tonemapEnabled || transform->luminanceScaleEnabled);
+
+    for (int i = 0; i < pixelCount; ++i) {
+        float * pixelXYZ = &XYZ[i * 3];
+        float xyY[3];
+
+        // Convert to xyY
+        clTransformXYZToXYY(C, xyY, pixelXYZ, transform->whitePointX, transform->whitePointY);
+
+        // Luminance scale
+        xyY[2] *= transform->srcLuminanceScale;
+        xyY[2] /= transform->dstLuminanceScale;
+
+        // Apply inverse dstCurveScale prior to tonemapping to ensure tonemap gets [0-1] range
+        xyY[2] /= transform->dstCurveScale;
+
+        // Tonemap
+        if (transform->tonemapEnabled) {
+            // reinhard tonemap, with additional tuning (see context.h for attribution)
+            float z = powf(xyY[2] > 0.0f ? xyY[2] : 0.0f, transform->tonemapParams.contrast);
+            xyY[2] = z / ((powf(z, transform->tonemapParams.power) * transform->tonemapParams.clipPoint) +
+                          transform->tonemapParams.speed);
+        }
+
+        // Re-apply dst scale for LCMS as it expects the XYZ->Dst input to be overranged
+        xyY[2] *= transform->dstCurveScale;
+
+        // Convert to XYZ
+        clTransformXYYToXYZ(C, pixelXYZ, xyY);
+    }
+}
+
+static void colorConvert(struct clContext * C,
+                         struct clTransform * transform,
+                         float * srcPixels,
+                         int srcChannelCount,
+                         float * dstPixels,
+                         int dstChannelCount,
+                         int pixelCount)
+{
+    if (transform->lcmsCombined) {
+        cmsDoTransform(transform->lcmsCombined, srcPixels, dstPixels, pixelCount);
+    } else {
+        float XYZ[CL_LCMS_BATCH_SIZE * 3];
+        for (int batchStart = 0; batchStart < pixelCount; batchStart += CL_LCMS_BATCH_SIZE) {
+            int batchCount = CL_MIN(CL_LCMS_BATCH_SIZE, pixelCount - batchStart);
+
+            if (transform->lcmsSrcToXYZ) {
+                cmsDoTransform(transform->lcmsSrcToXYZ, &srcPixels[batchStart * srcChannelCount], XYZ, batchCount);
             }
-        } else {
-            // LittleCMS
-            if (transform->lcmsXYZToDst) {
-                cmsDoTransform(transform->lcmsXYZToDst, XYZ, dstPixel, 1);
+            if (transform->luminanceScaleEnabled) {
+                lcmsScaleLuminance(C, transform, XYZ, batchCount);
             }
-            if (transform->dstProfile) {                 // don't clamp XYZ
-                dstPixel[0] = CL_MAX(dstPixel[0], 0.0f); // clamp (allow overranging)
-                dstPixel[1] = CL_MAX(dstPixel[1], 0.0f); // clamp (allow overranging)
-                dstPixel[2] = CL_MAX(dstPixel[2], 0.0f); // clamp (allow overranging)
+            if (transform->lcmsXYZToDst) {
+                cmsDoTransform(transform->lcmsXYZToDst, XYZ, &dstPixels[batchStart * dstChannelCount], batchCount);
             }
         }
+    }
+
+    for (int i = 0; i < pixelCount; ++i) {
+        float * srcPixel = &srcPixels[i * srcChannelCount];
+        float * dstPixel = &dstPixels[i * dstChannelCount];
+
+        if (transform->dstProfile) {                 // don't clamp XYZ
+            dstPixel[0] = CL_MAX(dstPixel[0], 0.0f); // clamp (allow overranging)
+            dstPixel[1] = CL_MAX(dstPixel[1], 0.0f); // clamp (allow overranging)
+            dstPixel[2] = CL_MAX(dstPixel[2], 0.0f); // clamp (allow overranging)
+        }
 
         if (DST_FLOAT_HAS_ALPHA()) {
             if (SRC_FLOAT_HAS_ALPHA()) {
@@ -571,34 +1175,159 @@ static void colorConvert(struct clContext * C,
 // ----------------------------------------------------------------------------
 // Transform entry point
 
-static void clCCMMTransform(struct clContext * C, struct clTransform * transform, clBool useCCMM, float * srcPixels, float * dstPixels, int pixelCount)
+// No color conversion necessary, just repack honoring src/dst alpha
+static void repackConvert(float * srcPixels, int srcChannelCount, float * dstPixels, int dstChannelCount, int pixelCount)
+{
+    for (int i = 0; i < pixelCount; ++i) {
+        float * srcPixel = &srcPixels[i * srcChannelCount];
+        float * dstPixel = &dstPixels[i * dstChannelCount];
+        memcpy(dstPixel, srcPixel, sizeof(float) * 3); // all float formats are at least 3 floats
+        if (DST_FLOAT_HAS_ALPHA()) {
+            if (SRC_FLOAT_HAS_ALPHA()) {
+                dstPixel[3] = srcPixel[3];
+            } else {
+                // RGB -> RGBA, set full opacity
+                dstPixel[3] = 1.0f;
+            }
+        }
+    }
+}
+
+// Integer pixels <-> RGBA floats for the paths that only work on floats, using the same math as
+// clImagePrepareReadPixels()
+static void unpackIntegerPixels(struct clContext * C,
+                                clTransformFormat format,
+                                int depth,
+                                void * srcPixels,
+                                float * dstPixels,
+                                int pixelCount)
+{
+    const float maxChannelf = (float)clTransformFormatMaxChannel(C, format, depth);
+    int channelCount = pixelCount * 4;
+    if (format == CL_XF_RGBA8) {
+        uint8_t * src = srcPixels;
+        for (int i = 0; i < channelCount; ++i) {
+            dstPixels[i] = src[i] / maxChannelf;
+        }
+    } else {
+        uint16_t * src = srcPixels;
+        for (int i = 0; i < channelCount; ++i) {
+            dstPixels[i] = src[i] / maxChannelf;
+        }
+    }
+}
+
+static void packIntegerPixels(struct clContext * C,
+                              clTransformFormat format,
+                              int depth,
+                              float * srcPixels,
+                              const float * thresholds,
+                              void * dstPixels,
+                              int pixelCount)
+{
+    const uint32_t maxChannel = clTransformFormatMaxChannel(C, format, depth);
+    int channelCount = pixelCount * 4;
+    if (thresholds) {
+        // Dither the color channels, round alpha
+        for (int i = 0; i < pixelCount; ++i) {
+            uint32_t r = clPixelMathDitherUNorm(srcPixels[0], maxChannel, thresholds[i]);
+            uint32_t g = clPixelMathDitherUNorm(srcPixels[1], maxChannel, thresholds[i]);
+            uint32_t b = clPixelMathDitherUNorm(srcPixels[2], maxChannel, thresholds[i]);
+            uint32_t a = clPixelMathRoundUNorm(srcPixels[3], maxChannel);
+            if (format == CL_XF_RGBA8) {
+                uint8_t * dst = (uint8_t *)dstPixels + (i * 4);
+                dst[0] = (uint8_t)r;
+                dst[1] = (uint8_t)g;
+                dst[2] = (uint8_t)b;
+                dst[3] = (uint8_t)a;
+            } else {
+                uint16_t * dst = (uint16_t *)dstPixels + (i * 4);
+                dst[0] = (uint16_t)r;
+                dst[1] = (uint16_t)g;
+                dst[2] = (uint16_t)b;
+                dst[3] = (uint16_t)a;
+            }
+            srcPixels += 4;
+        }
+    } else if (format == CL_XF_RGBA8) {
+        uint8_t * dst = dstPixels;
+        for (int i = 0; i < channelCount; ++i) {
+            dst[i] = (uint8_t)clPixelMathRoundUNorm(srcPixels[i], maxChannel);
+        }
+    } else {
+        uint16_t * dst = dstPixels;
+        for (int i = 0; i < channelCount; ++i) {
+            dst[i] = (uint16_t)clPixelMathRoundUNorm(srcPixels[i], maxChannel);
+        }
+    }
+}
+
+// Integer pixels are staged through RGBA floats this many at a time when CCMM isn't converting them directly
+#define CL_TRANSFORM_STAGING_PIXEL_COUNT 64
+
+// firstPixel is where srcPixels/dstPixels begin within the run described by dither (if any)
+static void clCCMMTransform(struct clContext * C,
+                            struct clTransform * transform,
+                            clBool useCCMM,
+                            void * srcPixels,
+                            void * dstPixels,
+                            int pixelCount,
+                            int firstPixel,
+                            const clTransformDither * dither)
 {
     int srcChannelCount = clTransformFormatToChannelCount(C, transform->srcFormat);
     int dstChannelCount = clTransformFormatToChannelCount(C, transform->dstFormat);
+    clBool srcIsInteger = clTransformFormatIsInteger(C, transform->srcFormat);
+    clBool dstIsInteger = clTransformFormatIsInteger(C, transform->dstFormat);
 
     // COLORIST_ASSERT(!transform->srcProfile || transform->srcProfile->ccmm);
     // COLORIST_ASSERT(!transform->dstProfile || transform->dstProfile->ccmm);
 
-    if (clProfileMatches(C, transform->srcProfile, transform->dstProfile)) {
-        // No color conversion necessary, just repack honoring src/dst alpha
+    clBool profilesMatch = clProfileMatches(C, transform->srcProfile, transform->dstProfile) ||
+                           (useCCMM && (transform->ccmmKernel == CL_XK_IDENTITY));
+    if (!profilesMatch && useCCMM) {
+        // CCMM reads and writes every format directly
+        ccmmConvert(C, transform, srcPixels, dstPixels, pixelCount, firstPixel, dither);
+        return;
+    }
 
-        for (int i = 0; i < pixelCount; ++i) {
-            float * srcPixel = &srcPixels[i * srcChannelCount];
-            float * dstPixel = &dstPixels[i * dstChannelCount];
-            memcpy(dstPixel, srcPixel, sizeof(float) * 3); // all float formats are at least 3 floats
-            if (DST_FLOAT_HAS_ALPHA()) {
-                if (SRC_FLOAT_HAS_ALPHA()) {
-                    dstPixel[3] = srcPixel[3];
-                } else {
-                    // RGB -> RGBA, set full opacity
-                    dstPixel[3] = 1.0f;
-                }
-            }
+    if (profilesMatch && srcIsInteger && (transform->srcFormat == transform->dstFormat) &&
+        ((transform->srcFormat == CL_XF_RGBA8) || (transform->srcDepth == transform->dstDepth))) {
+        memcpy(dstPixels, srcPixels, (size_t)pixelCount * clTransformFormatToPixelBytes(C, transform->srcFormat));
+        return;
+    }
+
+    float srcStaging[CL_TRANSFORM_STAGING_PIXEL_COUNT * 4];
+    float dstStaging[CL_TRANSFORM_STAGING_PIXEL_COUNT * 4];
+    float thresholds[CL_TRANSFORM_STAGING_PIXEL_COUNT];
+    int srcPixelBytes = clTransformFormatToPixelBytes(C, transform->srcFormat);
+    int dstPixelBytes = clTransformFormatToPixelBytes(C, transform->dstFormat);
+    int stagingPixelCount = (srcIsInteger || dstIsInteger) ? CL_TRANSFORM_STAGING_PIXEL_COUNT : pixelCount;
+    for (int stagingStart = 0; stagingStart < pixelCount; stagingStart += stagingPixelCount) {
+        int stagingCount = CL_MIN(stagingPixelCount, pixelCount - stagingStart);
+        void * srcPixel = (uint8_t *)srcPixels + ((size_t)stagingStart * srcPixelBytes);
+        void * dstPixel = (uint8_t *)dstPixels + ((size_t)stagingStart * dstPixelBytes);
+        float * srcFloats = srcPixel;
+        float * dstFloats = dstIsInteger ? dstStaging : dstPixel;
+
+        if (srcIsInteger) {
+            unpackIntegerPixels(C, transform->srcFormat, transform->srcDepth, srcPixel, srcStaging, stagingCount);
+            srcFloats = srcStaging;
         }
-    } else {
-        // Color conversion is required
 
-        colorConvert(C, transform, useCCMM, srcPixels, srcChannelCount, dstPixels, dstChannelCount, pixelCount);
+        // Color conversion is required unless the profiles match
+        if (profilesMatch) {
+            repackConvert(srcFloats, srcChannelCount, dstFloats, dstChannelCount, stagingCount);
+        } else {
+            colorConvert(C, transform, srcFloats, srcChannelCount, dstFloats, dstChannelCount, stagingCount);
+        }
+
+        if (dstIsInteger) {
+            if (dither) {
+                ditherThresholds(dither, firstPixel + stagingStart, thresholds, stagingCount);
+            }
+            packIntegerPixels(C, transform->dstFormat, transform->dstDepth, dstStaging, dither ? thresholds : NULL, dstPixel, stagingCount);
+        }
     }
 }
 
@@ -636,31 +1365,25 @@ void clTransformXYYToXYZ(struct clContext * C, float * dstXYZ, const float * src
     dstXYZ[2] = ((1 - srcXYY[0] - srcXYY[1]) * srcXYY[2]) / srcXYY[1];
 }
 
-float clTransformCalcMaxY(clContext * C, clTransform * linearFromXYZ, clTransform * linearToXYZ, float x, float y)
-{
-    float floatXYZ[3];
-    float floatRGB[3];
-    float maxChannel;
-    cmsCIEXYZ XYZ;
-    cmsCIExyY xyY;
-    xyY.x = x;
-    xyY.y = y;
-    xyY.Y = 1.0f; // start with max luminance
-    cmsxyY2XYZ(&XYZ, &xyY);
-    floatXYZ[0] = (float)XYZ.X;
-    floatXYZ[1] = (float)XYZ.Y;
-    floatXYZ[2] = (float)XYZ.Z;
-    clTransformRun(C, linearFromXYZ, floatXYZ, floatRGB, 1);
-    maxChannel = floatRGB[0];
-    if (maxChannel < floatRGB[1])
-        maxChannel = floatRGB[1];
-    if (maxChannel < floatRGB[2])
-        maxChannel = floatRGB[2];
-    floatRGB[0] /= maxChannel;
-    floatRGB[1] /= maxChannel;
-    floatRGB[2] /= maxChannel;
-    clTransformRun(C, linearToXYZ, floatRGB, floatXYZ, 1);
-    return floatXYZ[1];
+float clTransformCalcMaxY(clContext * C, const gbMat3 * fromXYZ, float x, float y)
+{
+    COLORIST_UNUSED(C);
+
+    // The linear RGB of chromaticity x,y at Y = 1 (same math as gb_mat3_mul_vec3())...
+    const float * e = fromXYZ->e;
+    float X = x / y;
+    float Z = (1.0f - x - y) / y;
+    float r = (e[0] * X) + e[1] + (e[2] * Z);
+    float g = (e[3] * X) + e[4] + (e[5] * Z);
+    float b = (e[6] * X) + e[7] + (e[8] * Z);
+
+    // ...and Y scales with it until its largest channel reaches 1
+    float maxChannel = r;
+    if (maxChannel < g)
+        maxChannel = g;
+    if (maxChannel < b)
+        maxChannel = b;
+    return 1.0f / maxChannel;
 }
 
 clTransform * clTransformCreate(struct clContext * C,
@@ -675,14 +1398,22 @@ clTransform * clTransformCreate(struct clContext * C,
     transform->dstProfile = dstProfile;
     transform->srcFormat = srcFormat;
     transform->dstFormat = dstFormat;
+    transform->srcDepth = 16;
+    transform->dstDepth = 16;
     transform->requestedTonemap = tonemap;
     clTonemapParamsSetDefaults(C, &transform->tonemapParams);
 
+    transform->ccmmKernel = CL_XK_FULL;
+    transform->ccmmHLGLuminance = 1000.0f;
+    transform->ccmmSrcEOTFTable = NULL;
+    transform->ccmmDstOETFTable = NULL;
+    transform->ccmmSrcIntegerTable = NULL;
     transform->ccmmReady = clFalse;
 
     transform->lcmsXYZProfile = NULL;
     transform->lcmsSrcToXYZ = NULL;
     transform->lcmsXYZToDst = NULL;
+    transform->lcmsCombined = NULL;
     transform->lcmsReady = clFalse;
     return transform;
 }
@@ -695,9 +1426,21 @@ void clTransformDestroy(struct clContext * C, clTransform * transform)
     if (transform->lcmsXYZToDst) {
         cmsDeleteTransform(transform->lcmsXYZToDst);
     }
+    if (transform->lcmsCombined) {
+        cmsDeleteTransform(transform->lcmsCombined);
+    }
     if (transform->lcmsXYZProfile) {
         cmsCloseProfile(transform->lcmsXYZProfile);
     }
+    if (transform->ccmmSrcEOTFTable) {
+        clFree(transform->ccmmSrcEOTFTable);
+    }
+    if (transform->ccmmDstOETFTable) {
+        clFree(transform->ccmmDstOETFTable);
+    }
+    if (transform->ccmmSrcIntegerTable) {
+        clFree(transform->ccmmSrcIntegerTable);
+    }
     clFree(transform);
 }
 
@@ -711,7 +1454,9 @@ static cmsUInt32Number clTransformFormatToLCMSFormat(struct clContext * C, clTra
         case CL_XF_RGB:
             return TYPE_RGB_FLT;
         case CL_XF_RGBA:
-            return TYPE_RGB_FLT; // CCMM deals with the alpha
+        case CL_XF_RGBA8:  // staged through RGBA floats
+        case CL_XF_RGBA16: // staged through RGBA floats
+            return TYPE_RGBA_FLT; // colorConvert() still deals with the alpha, this just gets the stride right
     }
 
     COLORIST_FAILURE("clTransformFormatToLCMSFormat: Unknown transform format");
@@ -728,6 +1473,8 @@ static int clTransformFormatToChannelCount(struct clContext * C, clTransformForm
             return 3;
 
         case CL_XF_RGBA:
+        case CL_XF_RGBA8:
+        case CL_XF_RGBA16:
             return 4;
     }
 
@@ -735,6 +1482,38 @@ static int clTransformFormatToChannelCount(struct clContext * C, clTransformForm
     return 4;
 }
 
+static int clTransformFormatToPixelBytes(struct clContext * C, clTransformFormat format)
+{
+    switch (format) {
+        case CL_XF_RGBA8:
+            return 4 * sizeof(uint8_t);
+        case CL_XF_RGBA16:
+            return 4 * sizeof(uint16_t);
+        case CL_XF_XYZ:
+        case CL_XF_RGB:
+        case CL_XF_RGBA:
+            break;
+    }
+    return clTransformFormatToChannelCount(C, format) * sizeof(float);
+}
+
+static clBool clTransformFormatIsInteger(struct clContext * C, clTransformFormat format)
+{
+    COLORIST_UNUSED(C);
+
+    return (format == CL_XF_RGBA8) || (format == CL_XF_RGBA16);
+}
+
+static uint32_t clTransformFormatMaxChannel(struct clContext * C, clTransformFormat format, int depth)
+{
+    COLORIST_UNUSED(C);
+
+    if (format == CL_XF_RGBA8) {
+        return 255;
+    }
+    return (1 << CL_CLAMP(depth, 8, 16)) - 1;
+}
+
 clBool clTransformUsesCCMM(struct clContext * C, clTransform * transform)
 {
     clBool useCCMM = C->ccmmAllowed;
@@ -758,69 +1537,75 @@ float clTransformGetLuminanceScale(struct clContext * C, clTransform * transform
     return transform->srcLuminanceScale / transform->dstLuminanceScale * transform->srcCurveScale / transform->dstCurveScale;
 }
 
+// Ranges smaller than this aren't worth handing to another thread
+#define CL_TRANSFORM_MIN_PIXELS_PER_TASK 256
+
 typedef struct clTransformTask
 {
     clContext * C;
     clTransform * transform;
-    float * inPixels;
-    float * outPixels;
-    int pixelCount;
+    uint8_t * srcPixels;
+    uint8_t * dstPixels;
+    int srcPixelBytes;
+    int dstPixelBytes;
     clBool useCCMM;
+    const clTransformDither * dither;
 } clTransformTask;
 
-static void transformTaskFunc(clTransformTask * info)
+static void transformTaskFunc(clTransformTask * info, int firstPixel, int pixelCount)
 {
-    clCCMMTransform(info->C, info->transform, info->useCCMM, info->inPixels, info->outPixels, info->pixelCount);
+    clCCMMTransform(info->C,
+                    info->transform,
+                    info->useCCMM,
+                    &info->srcPixels[(size_t)firstPixel * info->srcPixelBytes],
+                    &info->dstPixels[(size_t)firstPixel * info->dstPixelBytes],
+                    pixelCount,
+                    firstPixel,
+                    info->dither);
 }
 
-void clTransformRun(struct clContext * C, clTransform * transform, float * srcPixels, float * dstPixels, int pixelCount)
+static void transformRun(struct clContext * C,
+                         clTransform * transform,
+                         void * srcPixels,
+                         void * dstPixels,
+                         int pixelCount,
+                         const clTransformDither * dither)
 {
-    int srcChannelCount = clTransformFormatToChannelCount(C, transform->srcFormat);
-    int dstChannelCount = clTransformFormatToChannelCount(C, transform->dstFormat);
-    clBool useCCMM = clTransformUsesCCMM(C, transform);
-    int taskCount = C->jobs;
+    clTransformTask info;
+    info.C = C;
+    info.transform = transform;
+    info.srcPixels = srcPixels;
+    info.dstPixels = dstPixels;
+    info.srcPixelBytes = clTransformFormatToPixelBytes(C, transform->srcFormat);
+    info.dstPixelBytes = clTransformFormatToPixelBytes(C, transform->dstFormat);
+    info.useCCMM = clTransformUsesCCMM(C, transform);
+    info.dither = dither;
 
     clTransformPrepare(C, transform);
 
-    if (taskCount > pixelCount) {
-        // This is a dumb corner case I'm not too worried about.
-        taskCount = pixelCount;
-    }
-
-    if (taskCount == 1) {
-        // Don't bother making any new threads
-        clTransformTask info;
-        info.C = C;
-        info.transform = transform;
-        info.inPixels = srcPixels;
-        info.outPixels = dstPixels;
-        info.pixelCount = pixelCount;
-        info.useCCMM = useCCMM;
-        transformTaskFunc(&info);
-    } else {
-        int pixelsPerTask = pixelCount / taskCount;
-        int lastTaskPixelCount = pixelCount - (pixelsPerTask * (taskCount - 1));
-        clTask ** tasks;
-        clTransformTask * infos;
-        int i;
-
-        tasks = clAllocate(taskCount * sizeof(clTask *));
-        infos = clAllocate(taskCount * sizeof(clTransformTask));
-        for (i = 0; i < taskCount; ++i) {
-            infos[i].C = C;
-            infos[i].transform = transform;
-            infos[i].inPixels = &srcPixels[i * pixelsPerTask * srcChannelCount];
-            infos[i].outPixels = &dstPixels[i * pixelsPerTask * dstChannelCount];
-            infos[i].pixelCount = (i == (taskCount - 1)) ? lastTaskPixelCount : pixelsPerTask;
-            infos[i].useCCMM = useCCMM;
-            tasks[i] = clTaskCreate(C, (clTaskFunc)transformTaskFunc, &infos[i]);
-        }
+    clTaskParallelFor(C, pixelCount, CL_TRANSFORM_MIN_PIXELS_PER_TASK, (clTaskRangeFunc)transformTaskFunc, &info);
+}
 
-        for (i = 0; i < taskCount; ++i) {
-            clTaskDestroy(C, tasks[i]);
-        }
+void clTransformRun(struct clContext * C, clTransform * transform, void * srcPixels, void * dstPixels, int pixelCount)
+{
+    transformRun(C, transform, srcPixels, dstPixels, pixelCount, NULL);
+}
 
-        clFree(tasks);
-        clFree(infos);
-    }
+void clTransformRunDithered(struct clContext * C,
+                            clTransform * transform,
+                            void * srcPixels,
+                            void * dstPixels,
+                            int width,
+                            int firstRow,
+                            int rowCount)
+{
+    clTransformDither dither;
+    dither.width = width;
+    dither.firstRow = firstRow;
+    transformRun(C,
+                 transform,
+                 srcPixels,
+                 dstPixels,
+                 width * rowCount,
+                 clTransformFormatIsInteger(C, transform->dstFormat) ? &dither : NULL);
 }
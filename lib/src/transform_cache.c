@@ -0,0 +1,236 @@
+// ---------------------------------------------------------------------------
+//                         Copyright Joe Drago 2018.
+//         Distributed under the Boost Software License, Version 1.0.
+//            (See accompanying file LICENSE_1_0.txt or copy at
+//                  http://www.boost.org/LICENSE_1_0.txt)
+// ---------------------------------------------------------------------------
+
+#include "colorist/transform.h"
+
+#include "colorist/context.h"
+#include "colorist/profile.h"
+
+#include "md5.h"
+
+#include <string.h>
+
+// Everything clTransformPrepare() depends on. Profiles are identified by an MD5 of their ICC payload (all zeros for
+// XYZ), and the struct is always memset before being filled so that it can be compared with memcmp().
+typedef struct clTransformCacheKey
+{
+    uint8_t srcSignature[16];
+    uint8_t dstSignature[16];
+    clTransformFormat srcFormat;
+    clTransformFormat dstFormat;
+    int srcDepth; // 0 unless srcFormat is CL_XF_RGBA16
+    int dstDepth; // 0 unless dstFormat is CL_XF_RGBA16
+    clTonemap tonemap;
+    clTonemapParams tonemapParams;
+    int defaultLuminance;
+    clBool ccmmAllowed;
+    clBool ccmmFastCurves;
+} clTransformCacheKey;
+
+typedef struct clTransformCacheEntry
+{
+    clTransformCacheKey key;
+    clTransform * transform; // Owns clones of its src/dst profiles, so callers' profiles can come and go
+    int refCount;
+    uint32_t lastUsed;
+} clTransformCacheEntry;
+
+typedef struct clTransformCache
+{
+    clTransformCacheEntry entries[CL_TRANSFORM_CACHE_CAPACITY];
+    int entryCount;
+    uint32_t clock; // Bumped on every acquire, for LRU
+} clTransformCache;
+
+// The MD5 of the ICC payload with the header's creation date and profile ID zeroed, so that identical profiles
+// built moments apart (clProfileCreate() stamps the current time) share transforms
+void clTransformProfileSignature(struct clProfile * profile, uint8_t signature[16])
+{
+    if (profile->raw.size < 128) {
+        memcpy(signature, profile->signature, 16);
+        return;
+    }
+
+    uint8_t header[128];
+    memcpy(header, profile->raw.ptr, sizeof(header));
+    memset(&header[24], 0, 12); // dateTimeNumber
+    memset(&header[84], 0, 16); // Profile ID
+
+    MD5_CTX ctx;
+    MD5_Init(&ctx);
+    MD5_Update(&ctx, header, sizeof(header));
+    MD5_Update(&ctx, profile->raw.ptr + sizeof(header), (unsigned long)(profile->raw.size - sizeof(header)));
+    MD5_Final(signature, &ctx);
+}
+
+clBool clTransformProfileIsIdentifiable(struct clProfile * profile)
+{
+    if (profile) {
+        for (int i = 0; i < 16; ++i) {
+            if (profile->signature[i] != 0) {
+                return clTrue;
+            }
+        }
+        return clFalse;
+    }
+    return clTrue; // XYZ
+}
+
+static void destroyEntryTransform(struct clContext * C, clTransform * transform)
+{
+    if (transform->srcProfile) {
+        clProfileDestroy(C, transform->srcProfile);
+    }
+    if (transform->dstProfile) {
+        clProfileDestroy(C, transform->dstProfile);
+    }
+    clTransformDestroy(C, transform);
+}
+
+static clTransform * createTransform(struct clContext * C,
+                                     struct clProfile * srcProfile,
+                                     clTransformFormat srcFormat,
+                                     struct clProfile * dstProfile,
+                                     clTransformFormat dstFormat,
+                                     clTonemap tonemap,
+                                     const clTonemapParams * tonemapParams,
+                                     int srcDepth,
+                                     int dstDepth)
+{
+    clTransform * transform = clTransformCreate(C, srcProfile, srcFormat, dstProfile, dstFormat, tonemap);
+    if (srcDepth > 0) {
+        transform->srcDepth = srcDepth;
+    }
+    if (dstDepth > 0) {
+        transform->dstDepth = dstDepth;
+    }
+    if (tonemapParams) {
+        memcpy(&transform->tonemapParams, tonemapParams, sizeof(clTonemapParams));
+    }
+    clTransformPrepare(C, transform);
+    return transform;
+}
+
+clTransform * clTransformAcquire(struct clContext * C,
+                                 struct clProfile * srcProfile,
+                                 clTransformFormat srcFormat,
+                                 struct clProfile * dstProfile,
+                                 clTransformFormat dstFormat,
+                                 clTonemap tonemap,
+                                 const clTonemapParams * tonemapParams,
+                                 int srcDepth,
+                                 int dstDepth)
+{
+    if (!clTransformProfileIsIdentifiable(srcProfile) || !clTransformProfileIsIdentifiable(dstProfile)) {
+        // Can't be identified; hand out a private transform that clTransformRelease() will simply destroy
+        ++C->transformCacheMisses;
+        return createTransform(C, srcProfile, srcFormat, dstProfile, dstFormat, tonemap, tonemapParams, srcDepth, dstDepth);
+    }
+
+    clTransformCacheKey key;
+    memset(&key, 0, sizeof(key));
+    if (srcProfile) {
+        clTransformProfileSignature(srcProfile, key.srcSignature);
+    }
+    if (dstProfile) {
+        clTransformProfileSignature(dstProfile, key.dstSignature);
+    }
+    key.srcFormat = srcFormat;
+    key.dstFormat = dstFormat;
+    key.srcDepth = (srcFormat == CL_XF_RGBA16) ? ((srcDepth > 0) ? srcDepth : 16) : 0;
+    key.dstDepth = (dstFormat == CL_XF_RGBA16) ? ((dstDepth > 0) ? dstDepth : 16) : 0;
+    key.tonemap = tonemap;
+    if (tonemapParams) {
+        memcpy(&key.tonemapParams, tonemapParams, sizeof(clTonemapParams));
+    } else {
+        clTonemapParamsSetDefaults(C, &key.tonemapParams);
+    }
+    key.defaultLuminance = C->defaultLuminance;
+    key.ccmmAllowed = C->ccmmAllowed;
+    key.ccmmFastCurves = C->ccmmFastCurves;
+
+    if (!C->transformCache) {
+        C->transformCache = clAllocateStruct(clTransformCache);
+        memset(C->transformCache, 0, sizeof(clTransformCache));
+    }
+    clTransformCache * cache = C->transformCache;
+    ++cache->clock;
+
+    for (int i = 0; i < cache->entryCount; ++i) {
+        clTransformCacheEntry * entry = &cache->entries[i];
+        if (!memcmp(&entry->key, &key, sizeof(key))) {
+            ++C->transformCacheHits;
+            ++entry->refCount;
+            entry->lastUsed = cache->clock;
+            return entry->transform;
+        }
+    }
+    ++C->transformCacheMisses;
+
+    // Find a slot: a free one, or else the least recently used entry nobody is holding
+    clTransformCacheEntry * slot = NULL;
+    if (cache->entryCount < CL_TRANSFORM_CACHE_CAPACITY) {
+        slot = &cache->entries[cache->entryCount++];
+    } else {
+        for (int i = 0; i < cache->entryCount; ++i) {
+            clTransformCacheEntry * entry = &cache->entries[i];
+            if ((entry->refCount == 0) && (!slot || (entry->lastUsed < slot->lastUsed))) {
+                slot = entry;
+            }
+        }
+        if (!slot) {
+            // Every entry is in use; don't cache this one
+            return createTransform(C, srcProfile, srcFormat, dstProfile, dstFormat, tonemap, tonemapParams, srcDepth, dstDepth);
+        }
+        destroyEntryTransform(C, slot->transform);
+        ++C->transformCacheEvictions;
+    }
+
+    memcpy(&slot->key, &key, sizeof(key));
+    slot->transform = createTransform(C,
+                                      srcProfile ? clProfileClone(C, srcProfile) : NULL,
+                                      srcFormat,
+                                      dstProfile ? clProfileClone(C, dstProfile) : NULL,
+                                      dstFormat,
+                                      tonemap,
+                                      tonemapParams,
+                                      srcDepth,
+                                      dstDepth);
+    slot->refCount = 1;
+    slot->lastUsed = cache->clock;
+    return slot->transform;
+}
+
+void clTransformRelease(struct clContext * C, clTransform * transform)
+{
+    clTransformCache * cache = C->transformCache;
+    if (cache) {
+        for (int i = 0; i < cache->entryCount; ++i) {
+            clTransformCacheEntry * entry = &cache->entries[i];
+            if (entry->transform == transform) {
+                COLORIST_ASSERT(entry->refCount > 0);
+                --entry->refCount;
+                return;
+            }
+        }
+    }
+
+    // Not cached (see clTransformAcquire()), and it doesn't own its profiles
+    clTransformDestroy(C, transform);
+}
+
+void clTransformCacheDestroy(struct clContext * C, struct clTransformCache * cache)
+{
+    if (!cache) {
+        return;
+    }
+    for (int i = 0; i < cache->entryCount; ++i) {
+        COLORIST_ASSERT(cache->entries[i].refCount == 0);
+        destroyEntryTransform(C, cache->entries[i].transform);
+    }
+    clFree(cache);
+}
@@ -0,0 +1,215 @@
+// ---------------------------------------------------------------------------
+//                         Copyright Joe Drago 2018.
+//         Distributed under the Boost Software License, Version 1.0.
+//            (See accompanying file LICENSE_1_0.txt or copy at
+//                  http://www.boost.org/LICENSE_1_0.txt)
+// ---------------------------------------------------------------------------
+
+#include "colorist/transform.h"
+
+#include "colorist/context.h"
+#include "colorist/pixelmath.h"
+#include "colorist/profile.h"
+#include "colorist/raw.h"
+
+#include "md5.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+// Cached bakes are this magic, the key's MD5, then the cube's dims^3 * 4 floats (native endianness; caches are local)
+static const char bakedLUTMagic[8] = { 'c', 'l', 'L', 'U', 'T', '0', '0', '2' };
+
+// Everything a bake depends on, memset before being filled so its bytes can be hashed
+typedef struct clBakedLUTKey
+{
+    uint8_t srcSignature[16];
+    uint8_t dstSignature[16];
+    uint8_t haldSignature[16]; // MD5 of the hald's cube, all zeros without one
+    int haldInterpolation;     // 0 without one
+    int dims;
+    clTonemap tonemap;
+    clTonemapParams tonemapParams;
+    int defaultLuminance;
+    clBool ccmmAllowed;
+    clBool ccmmFastCurves;
+} clBakedLUTKey;
+
+// Fills in the cache filename for this bake, or returns NULL if a profile can't be identified
+static char * bakedLUTFilename(struct clContext * C,
+                               clTransform * transform,
+                               const clHaldLUT * hald,
+                               int dims,
+                               const char * cacheDir,
+                               uint8_t digest[16])
+{
+    if (!clTransformProfileIsIdentifiable(transform->srcProfile) || !clTransformProfileIsIdentifiable(transform->dstProfile)) {
+        return NULL;
+    }
+
+    clBakedLUTKey key;
+    memset(&key, 0, sizeof(key));
+    if (transform->srcProfile) {
+        clTransformProfileSignature(transform->srcProfile, key.srcSignature);
+    }
+    if (transform->dstProfile) {
+        clTransformProfileSignature(transform->dstProfile, key.dstSignature);
+    }
+    if (hald) {
+        MD5_CTX haldCtx;
+        MD5_Init(&haldCtx);
+        MD5_Update(&haldCtx, hald->cube, (unsigned long)(sizeof(float) * 4 * hald->dims * hald->dims * hald->dims));
+        MD5_Final(key.haldSignature, &haldCtx);
+        key.haldInterpolation = (int)hald->interpolation;
+    }
+    key.dims = dims;
+    key.tonemap = transform->requestedTonemap;
+    memcpy(&key.tonemapParams, &transform->tonemapParams, sizeof(clTonemapParams));
+    key.defaultLuminance = C->defaultLuminance;
+    key.ccmmAllowed = C->ccmmAllowed;
+    key.ccmmFastCurves = C->ccmmFastCurves;
+
+    MD5_CTX ctx;
+    MD5_Init(&ctx);
+    MD5_Update(&ctx, &key, (unsigned long)sizeof(key));
+    MD5_Final(digest, &ctx);
+
+    size_t filenameSize = strlen(cacheDir) + 64;
+    char * filename = clAllocate(filenameSize);
+    int len = snprintf(filename, filenameSize, "%s/colorist-", cacheDir);
+    for (int i = 0; i < 16; ++i) {
+        len += snprintf(filename + len, filenameSize - len, "%02x", digest[i]);
+    }
+    snprintf(filename + len, filenameSize - len, ".lut");
+    return filename;
+}
+
+static clHaldLUT * bakedLUTRead(struct clContext * C, const char * filename, const uint8_t digest[16], int dims)
+{
+    size_t cubeBytes = sizeof(float) * 4 * dims * dims * dims;
+    size_t expectedSize = sizeof(bakedLUTMagic) + 16 + cubeBytes;
+    if (clFileSize(filename) != (int)expectedSize) {
+        return NULL;
+    }
+
+    clHaldLUT * lut = NULL;
+    clRaw raw = CL_RAW_EMPTY;
+    if (clRawReadFile(C, &raw, filename) && (raw.size == expectedSize) &&
+        !memcmp(raw.ptr, bakedLUTMagic, sizeof(bakedLUTMagic)) && !memcmp(raw.ptr + sizeof(bakedLUTMagic), digest, 16)) {
+        lut = clHaldLUTCreate(C, (const float *)(raw.ptr + sizeof(bakedLUTMagic) + 16), dims, CL_HALD_TETRAHEDRAL);
+    }
+    clRawFree(C, &raw);
+    return lut;
+}
+
+static void bakedLUTWrite(struct clContext * C, const clHaldLUT * lut, const char * filename, const uint8_t digest[16])
+{
+    size_t cubeBytes = sizeof(float) * 4 * lut->dims * lut->dims * lut->dims;
+    clRaw raw = CL_RAW_EMPTY;
+    clRawRealloc(C, &raw, sizeof(bakedLUTMagic) + 16 + cubeBytes);
+    memcpy(raw.ptr, bakedLUTMagic, sizeof(bakedLUTMagic));
+    memcpy(raw.ptr + sizeof(bakedLUTMagic), digest, 16);
+    memcpy(raw.ptr + sizeof(bakedLUTMagic) + 16, lut->cube, cubeBytes);
+    if (clRawWriteFile(C, &raw, filename)) {
+        clContextLog(C, "lut", 1, "Saved baked LUT: %s", filename);
+    }
+    clRawFree(C, &raw);
+}
+
+// Runs pixelCount RGBA float pixels through the exact pipeline
+static void exactPipeline(struct clContext * C,
+                          clTransform * transform,
+                          const clHaldLUT * hald,
+                          float * srcPixels,
+                          float * dstPixels,
+                          int pixelCount)
+{
+    clTransformRun(C, transform, srcPixels, dstPixels, pixelCount);
+    if (hald) {
+        clPixelMathHaldLUTApply(C, hald, dstPixels, dstPixels, pixelCount);
+    }
+}
+
+clHaldLUT * clTransformBakeLUT(struct clContext * C,
+                               clTransform * transform,
+                               const clHaldLUT * hald,
+                               int dims,
+                               const char * cacheDir)
+{
+    COLORIST_ASSERT((transform->srcFormat == CL_XF_RGBA) && (transform->dstFormat == CL_XF_RGBA));
+
+    uint8_t digest[16];
+    char * filename = NULL;
+    if (cacheDir) {
+        filename = bakedLUTFilename(C, transform, hald, dims, cacheDir, digest);
+        if (filename) {
+            clHaldLUT * cached = bakedLUTRead(C, filename, digest, dims);
+            if (cached) {
+                clContextLog(C, "lut", 0, "Loaded baked %dx%dx%d LUT: %s", dims, dims, dims, filename);
+                clFree(filename);
+                return cached;
+            }
+        }
+    }
+
+    clContextLog(C, "lut", 0, "Baking %dx%dx%d LUT (%s)...", dims, dims, dims, clTransformCMMName(C, transform));
+    int latticeCount = dims * dims * dims;
+    float * lattice = clAllocate(sizeof(float) * 4 * latticeCount);
+    for (int i = 0; i < latticeCount; ++i) {
+        float * pixel = &lattice[i * 4];
+        pixel[0] = (float)(i % dims) / (float)(dims - 1);
+        pixel[1] = (float)((i / dims) % dims) / (float)(dims - 1);
+        pixel[2] = (float)(i / (dims * dims)) / (float)(dims - 1);
+        pixel[3] = 1.0f;
+    }
+    float * baked = clAllocate(sizeof(float) * 4 * latticeCount);
+    exactPipeline(C, transform, hald, lattice, baked, latticeCount);
+    clHaldLUT * lut = clHaldLUTCreate(C, baked, dims, CL_HALD_TETRAHEDRAL);
+    clFree(lattice);
+    clFree(baked);
+
+    if (lut && filename) {
+        bakedLUTWrite(C, lut, filename, digest);
+    }
+    clFree(filename);
+    return lut;
+}
+
+void clTransformMeasureBakedLUT(struct clContext * C,
+                                clTransform * transform,
+                                const clHaldLUT * hald,
+                                const clHaldLUT * lut,
+                                float * outMaxError,
+                                float * outMeanError)
+{
+    const int cells = lut->dims - 1;
+    const int sampleCount = cells * cells * cells;
+    float * samples = clAllocate(sizeof(float) * 4 * sampleCount);
+    float * exact = clAllocate(sizeof(float) * 4 * sampleCount);
+    float * looked = clAllocate(sizeof(float) * 4 * sampleCount);
+    for (int i = 0; i < sampleCount; ++i) {
+        float * pixel = &samples[i * 4];
+        pixel[0] = ((float)(i % cells) + 0.5f) / (float)cells;
+        pixel[1] = ((float)((i / cells) % cells) + 0.5f) / (float)cells;
+        pixel[2] = ((float)(i / (cells * cells)) + 0.5f) / (float)cells;
+        pixel[3] = 1.0f;
+    }
+    exactPipeline(C, transform, hald, samples, exact, sampleCount);
+    clPixelMathHaldLUTApply(C, lut, samples, looked, sampleCount);
+
+    float maxError = 0.0f;
+    double totalError = 0.0;
+    for (int i = 0; i < sampleCount; ++i) {
+        for (int c = 0; c < 3; ++c) {
+            float error = fabsf(CL_CLAMP(exact[(i * 4) + c], 0.0f, 1.0f) - CL_CLAMP(looked[(i * 4) + c], 0.0f, 1.0f));
+            maxError = CL_MAX(maxError, error);
+            totalError += error;
+        }
+    }
+    clFree(samples);
+    clFree(exact);
+    clFree(looked);
+    *outMaxError = maxError;
+    *outMeanError = (float)(totalError / (sampleCount * 3));
+}